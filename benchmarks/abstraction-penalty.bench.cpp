@@ -0,0 +1,283 @@
+// Measures the cost of each level of the abstraction ladder in examples/abstraction-examples.h, which tokenizes a number
+//     that can be either an integer or a decimal.
+//
+// The levels are included from the header, so the code measured is the code the ladder documents. Every level converts
+// its lexeme with the same routine, so differences between levels come from scanning alone. The program exits with a
+// failure status when a level costs more than a configurable factor of the pointer level. Timings are too noisy to fail
+// on, so when comparing by time, a level over the limit is only reported.
+//
+// Usage: abstraction-penalty.bench.out [--max-overhead=1.25] [--metric=instructions|time] [--repeat=N]
+
+#include <algorithm>       // std::min
+#include <chrono>
+#include <cstdint>
+#include <cstdio>          // std::printf
+#include <cstring>         // std::strncmp
+#include <random>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "../examples/abstraction-examples.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace Pattern;
+
+
+// =====================================================================================================================
+// Levels
+// =====================================================================================================================
+// The levels are the functions of the ladder itself. Each assumes the current character has been identified as a digit
+// by the outer loop.
+
+// Using declarative and grammar-like features: not yet provided by the library (Tokenize::incremental, GrammarExp).
+
+
+struct level
+{
+     const char* name;
+     number_token (*tokenize) (scan_view&);
+};
+
+const level levels[] = {
+     {"number1 (pointers)",      &number1},
+     {"number2 (algorithms)",    &number2},
+     {"number3 (higher-order)",  &number3},
+};
+
+
+// =====================================================================================================================
+// Corpora
+// =====================================================================================================================
+struct corpus
+{
+     const char* name;
+     std::string text;
+     std::size_t tokens;
+};
+
+
+corpus make_corpus (const char* name, std::size_t tokens, int min_digits, int max_digits, int decimal_percent)
+{
+     std::mt19937 gen {42};
+     std::uniform_int_distribution<int> digits {min_digits, max_digits};
+     std::uniform_int_distribution<int> digit {0, 9};
+     std::uniform_int_distribution<int> percent {0, 99};
+
+     corpus c {name, {}, tokens};
+
+     auto append_digits = [&] (int n)
+     {
+          c.text += static_cast<char>('1' + digit(gen) % 9);
+          while (--n > 0)     c.text += static_cast<char>('0' + digit(gen));
+     };
+
+     for (std::size_t i = 0; i < tokens; ++i)
+     {
+          append_digits(digits(gen));
+
+          if (percent(gen) < decimal_percent)
+          {
+               c.text += '.';
+               append_digits(digits(gen));
+          }
+
+          c.text += ' ';
+     }
+
+     return c;
+}
+
+
+// =====================================================================================================================
+// Measurement
+// =====================================================================================================================
+// Counts retired instructions of the calling thread in user space, where the kernel allows it
+class instruction_counter
+{
+public:
+     instruction_counter ()
+     {
+#ifdef __linux__
+          perf_event_attr attr {};
+          attr.type           = PERF_TYPE_HARDWARE;
+          attr.size           = sizeof(attr);
+          attr.config         = PERF_COUNT_HW_INSTRUCTIONS;
+          attr.disabled       = 1;
+          attr.exclude_kernel = 1;
+          attr.exclude_hv     = 1;
+
+          fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+     }
+
+     ~instruction_counter ()
+     {
+#ifdef __linux__
+          if (fd >= 0)     close(fd);
+#endif
+     }
+
+     bool available () const     { return fd >= 0; }
+
+     void start ()
+     {
+#ifdef __linux__
+          if (fd < 0)     return;
+          ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+          ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+     }
+
+     std::uint64_t stop ()
+     {
+          std::uint64_t count = 0;
+#ifdef __linux__
+          if (fd < 0)     return 0;
+          ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+          if (read(fd, &count, sizeof(count)) != sizeof(count))     count = 0;
+#endif
+          return count;
+     }
+
+private:
+     int fd = -1;
+};
+
+
+struct result
+{
+     double ns_per_token;
+     double instructions_per_token;     // 0 when unavailable
+};
+
+
+// Tokenizes the whole corpus; returns a checksum so the work cannot be discarded
+std::uint64_t tokenize_all (const level& l, const corpus& c)
+{
+     std::uint64_t checksum = 0;
+     scan_view s {c.text};
+
+     while (s.has_more())
+     {
+          if (!is_digit(*s))
+          {
+               ++s;
+               continue;
+          }
+
+          number_token t = l.tokenize(s);
+          checksum += static_cast<std::uint64_t>(t.type) + std::visit([] (auto v) { return static_cast<std::uint64_t>(v); }, t.value);
+     }
+
+     return checksum;
+}
+
+
+result measure (const level& l, const corpus& c, int repeat, instruction_counter& counter)
+{
+     using clock = std::chrono::steady_clock;
+
+     double best_ns           = 1e300;
+     std::uint64_t best_insns = UINT64_MAX;
+     volatile std::uint64_t sink = 0;
+
+     for (int i = 0; i < repeat; ++i)
+     {
+          counter.start();
+          auto t0 = clock::now();
+
+          sink = sink + tokenize_all(l, c);
+
+          auto t1 = clock::now();
+          std::uint64_t insns = counter.stop();
+
+          best_ns    = std::min(best_ns, std::chrono::duration<double, std::nano>(t1 - t0).count());
+          best_insns = std::min(best_insns, insns);
+     }
+
+     return {best_ns / c.tokens, counter.available() ? double(best_insns) / c.tokens : 0};
+}
+
+
+// =====================================================================================================================
+// Driver
+// =====================================================================================================================
+int main (int argc, char* argv[])
+{
+     double max_overhead = 1.25;
+     bool   by_time      = false;
+     int    repeat       = 15;
+
+     for (int i = 1; i < argc; ++i)
+     {
+          std::string_view arg = argv[i];
+
+          if      (arg.starts_with("--max-overhead="))     max_overhead = std::stod(std::string {arg.substr(15)});
+          else if (arg == "--metric=time")                 by_time = true;
+          else if (arg == "--metric=instructions")         by_time = false;
+          else if (arg.starts_with("--repeat="))           repeat = std::stoi(std::string {arg.substr(9)});
+          else
+          {
+               std::printf("Usage: %s [--max-overhead=1.25] [--metric=instructions|time] [--repeat=N]\n", argv[0]);
+               return 2;
+          }
+     }
+
+     const corpus corpora[] = {
+          make_corpus("short integers",   200000, 1,  3,  0),
+          make_corpus("long integers",    100000, 8, 16,  0),
+          make_corpus("decimals",         100000, 1,  6, 100),
+          make_corpus("mixed",            150000, 1,  9, 50),
+     };
+
+     instruction_counter counter;
+     if (!by_time && !counter.available())
+     {
+          std::printf("note: instruction counters unavailable, comparing by time, which only warns\n");
+          by_time = true;
+     }
+
+     // All levels must agree before their costs are compared
+     for (const corpus& c : corpora)
+          for (const level& l : levels)
+               if (tokenize_all(l, c) != tokenize_all(levels[0], c))
+               {
+                    std::printf("FAIL: %s disagrees with %s on %s\n", l.name, levels[0].name, c.name);
+                    return 1;
+               }
+
+     bool failed = false;
+
+     for (const corpus& c : corpora)
+     {
+          std::printf("\n%s (%zu tokens, %zu bytes)\n", c.name, c.tokens, c.text.size());
+          std::printf("     %-26s %10s %12s %10s\n", "level", "ns/token", "insns/token", "overhead");
+
+          result baseline = measure(levels[0], c, repeat, counter);
+
+          for (const level& l : levels)
+          {
+               result r = &l == &levels[0] ? baseline : measure(l, c, repeat, counter);
+
+               double overhead = by_time ? r.ns_per_token / baseline.ns_per_token
+                                         : r.instructions_per_token / baseline.instructions_per_token;
+
+               bool too_slow = overhead > max_overhead;
+               failed = failed || (too_slow && !by_time);
+
+               std::printf("     %-26s %10.2f %12.1f %9.2fx%s\n", l.name, r.ns_per_token, r.instructions_per_token,
+                           overhead, !too_slow ? "" : by_time ? "  WARN" : "  FAIL");
+          }
+     }
+
+     std::printf("\nmaximum overhead allowed: %.2fx (%s)\n", max_overhead, by_time ? "time" : "instructions");
+     return failed ? 1 : 0;
+}
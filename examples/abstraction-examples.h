@@ -1,12 +1,15 @@
 // The pattern library supports an evolution of scanning abstractions, from low-level procedural code to high-level
 //     declarative code.
 
-#include <string>
+#pragma once
+
+#include <charconv>        // std::from_chars
+#include <cstdint>
 #include <string_view>
 #include <variant>
-#include "scan_view.h"
-#include "scanning-algorithms.h"
-#include "syntax.h"
+#include "pattern/fn-combinators.h"
+#include "pattern/scan_view.h"
+#include "pattern/scanning-algorithms.h"
 
 
 // --------------------------------------------------
@@ -16,123 +19,128 @@
 // the current character has been identified as a digit in your outer loop.
 
 enum class TokenType { INTEGER, DECIMAL };
-using number_token = token<TokenType, std::variant<int, double>>;
+
+struct number_token
+{
+     TokenType                           type;
+     std::variant<std::int64_t, double>  value;
+};
 
 constexpr bool is_digit (char c)     { return '0' <= c && c <= '9'; }
 
-std::string to_string (std::string_view s)     { return std::string {s.data(), s.length()}; }
+
+// Every level converts its lexeme the same way, so that they differ only in how they scan
+inline number_token make_integer (std::string_view lexeme)
+{
+     std::int64_t value = 0;
+     std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), value);
+     return {TokenType::INTEGER, value};
+}
+
+inline number_token make_decimal (std::string_view lexeme)
+{
+     double value = 0;
+     std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), value);
+     return {TokenType::DECIMAL, value};
+}
 
 
 // --------------------------------------------------
 // Using pointers
 // --------------------------------------------------
-number_token number1 (scan_view& s)
+inline number_token number1 (Pattern::scan_view& s)
 {
-     // Integer
-     std::string match = "" + *s++;
+     const char* start = s.data();
+     const char* p     = start + 1;
+     const char* end   = s.end();
 
-     while (is_digit(*s))    match += *s++;
+     // Integer
+     while (p != end && is_digit(*p))    ++p;
 
-     if (s[0] != '.' || !is_digit(s[1]))     return {TokenType::INTEGER, std::stoi(match)};
+     if (end - p < 2 || p[0] != '.' || !is_digit(p[1]))
+     {
+          s += p - start;
+          return make_integer({start, static_cast<std::size_t>(p - start)});
+     }
 
      // Decimal
-     match += *s++ + *s++;
-
-     while (is_digit(*s))    match += *s++;
+     p += 2;
+     while (p != end && is_digit(*p))    ++p;
 
-     return {TokenType::DECIMAL, std::stod(match)};
+     s += p - start;
+     return make_decimal({start, static_cast<std::size_t>(p - start)});
 }
 
 
 // --------------------------------------------------
 // Using algorithms
 // --------------------------------------------------
-number_token number2 (scan_view& s)
+inline number_token number2 (Pattern::scan_view& s)
 {
+     using namespace Pattern;
+
      s.save();
 
      // Integer
      ++s;
-     advance_while(s, is_digit);
+     while (scan_if(s, is_digit));
 
-     if (*s != '.' || !is_digit(s[1]))     return {TokenType::INTEGER, std::stoi(s.copy_skipped())};
+     if (s.size() < 2 || s[0] != '.' || !is_digit(s[1]))     return make_integer(s.skipped());
 
      // Decimal
      s += 2;
-     advance_while(s, is_digit);
+     while (scan_if(s, is_digit));
 
-     return {TokenType::DECIMAL, std::stod(s.copy_skipped())};
+     return make_decimal(s.skipped());
 }
 
 
 // --------------------------------------------------
 // Using higher-order functions
 // --------------------------------------------------
-number_token number3 (scan_view& s)
+inline number_token number3 (Pattern::scan_view& s)
 {
-     static constexpr auto integer    = Scan::some(is_digit);
-     static constexpr auto fractional = Scan::join('.', integer);
+     using namespace Pattern;
+
+     auto integer    = fo::some(fn::bind_back(scan_if, is_digit));
+     auto fractional = fo::all(fn::bind_back(scan, '.'), integer);
 
      s.save();
 
      integer(s);
 
-     if (!fractional(s))     return {TokenType::INTEGER, std::stoi(s.copy_skipped())};
-     return {TokenType::DECIMAL, std::stod(s.copy_skipped())};
+     scan_view before_fraction = s;
+     if (!fractional(s))
+     {
+          s = before_fraction;
+          return make_integer(s.skipped());
+     }
+
+     return make_decimal(s.skipped());
 }
 
 
 // --------------------------------------------------
 // Using declarative features
 // --------------------------------------------------
-namespace Declarative {
-
-auto integer    = Scan::some(is_digit);
-auto fractional = Scan::join('.', integer);
-
-number_token tokenize_int (std::string_view match)
-{
-    return {TokenType::INTEGER, std::stoi(to_string(match))};
-};
-
-number_token tokenize_dec (std::string_view match)
-{
-    return {TokenType::DECIMAL, std::stod(to_string(match))};
-};
-
-
-// Tokenize::incremental takes a list of pairs of scanners and functions
-auto number4 = Tokenize::incremental({integer,    tokenize_int},
-                                     {fractional, tokenize_dec});
-
-} // namespace Declarative
+// Not yet provided by the library. Tokenize::incremental would take a list of pairs of scanners and functions:
+//
+//      auto integer    = fo::some(fn::bind_back(scan_if, is_digit));
+//      auto fractional = fo::all(fn::bind_back(scan, '.'), integer);
+//
+//      auto number4 = Tokenize::incremental({integer,    make_integer},
+//                                           {fractional, make_decimal});
 
 
 // --------------------------------------------------
 // Using grammar-like features
 // --------------------------------------------------
-namespace Grammar
-{
-
-auto digit   = GrammarExp >> '0' | '1' | '2' | '3' | '4' | '5' | '6' | '7' | '8' | '9';
-auto integer = +digit;
-auto decimal = integer + '.' + integer;
-
-number_token tokenize_int (std::string_view match)
-{
-    return {TokenType::INTEGER, std::stoi(match)};
-};
-
-number_token tokenize_dec (std::string_view match)
-{
-    return {TokenType::DECIMAL, std::stod(match)};
-};
-
-Language myLang;
-
-// Incremental parsing is handled automatically when rules are added
-myLang.add_rule(integer, tokenize_int);
-myLang.add_rule(decimal, tokenize_dec);
-
-} // namespace Grammar
-
+// Not yet provided by the library. Incremental parsing would be handled automatically when rules are added:
+//
+//      auto digit   = GrammarExp >> '0' | '1' | '2' | '3' | '4' | '5' | '6' | '7' | '8' | '9';
+//      auto integer = +digit;
+//      auto decimal = integer + '.' + integer;
+//
+//      Language myLang;
+//      myLang.add_rule(integer, make_integer);
+//      myLang.add_rule(decimal, make_decimal);
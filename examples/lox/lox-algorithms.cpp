@@ -66,17 +66,75 @@ public:
                default  :
                     if      (is_digit(c))      return number();
                     else if (is_letter(c))     return identifier();
-                    else                       return make_token(ERROR, "Unexpected character: "sv);
+                    else                       return make_token(ERROR);
           }
      }
 
 
+     // Lexes only to check the source. The scanners are those of next, but no token is built, no number converted,
+     // and no keyword looked up.
+     lox_validation validate ()
+     {
+          const char* first = s.data();
+          lox_validation v {.lines = count_lines({first, s.size()})};
+
+          while (s.has_more())
+          {
+               s.save();
+               char c = *s++;
+
+               switch (c)
+               {
+                    case ' '  :
+                    case '\r' :
+                    case '\t' :
+                    case '\n' :     continue;
+
+                    case '('  :
+                    case ')'  :
+                    case '{'  :
+                    case '}'  :
+                    case ','  :
+                    case '.'  :
+                    case '-'  :
+                    case '+'  :
+                    case ';'  :
+                    case '*'  :     break;
+
+                    case '!'  :
+                    case '='  :
+                    case '<'  :
+                    case '>'  :     match('=');  break;
+
+                    case '/'  :
+                         if (*s != '/')     break;
+
+                         advance_while_not(s, '\n');
+                         continue;
+
+                    case '"' :
+                         if (!scan_string())     v.error(s.skipped().data() - first);
+                         break;
+
+                    default  :
+                         if      (is_digit(c))      scan_number();
+                         else if (is_letter(c))     advance_while(s, is_alphanumeric);
+                         else                       v.error(s.skipped().data() - first);
+               }
+
+               ++v.tokens;
+          }
+
+          return v;
+     }
+
+
 private:
      scan_view s;
 
-     lox_token make_token (TokenType type, lox_token_value value = empty)
+     lox_token make_token (TokenType type)
      {
-          return {type, value, s.skipped()};
+          return {type, s.skipped()};
      }
 
      bool match (char expected)
@@ -95,10 +153,24 @@ private:
           auto keyword = keywords.find(match);
 
           if (keyword != keywords.end())     return make_token(keyword->second);
-          else                               return make_token(TokenType::IDENTIFIER, match);
+          else                               return make_token(TokenType::IDENTIFIER);
      }
 
      lox_token number ()
+     {
+          scan_number();
+          return make_token(TokenType::NUMBER);
+     }
+
+     lox_token string ()
+     {
+          if (!scan_string())     return make_token(TokenType::ERROR);
+          return make_token(TokenType::STRING);
+     }
+
+
+     // Shared by next and validate
+     void scan_number ()
      {
           advance_while(s, is_digit);
 
@@ -107,18 +179,17 @@ private:
                s += 2;
                advance_while(s, is_digit);
           }
-
-          return make_token(TokenType::NUMBER, std::stod(s.copy_skipped()));
      }
 
-     lox_token string ()
+     // Past the closing quote. Returns false if there is none.
+     bool scan_string ()
      {
           advance_while_not(s, '"');
 
-          if (s.eof())     return make_token(TokenType::ERROR, "Unterminated string."sv);
+          if (s.eof())     return false;
 
           ++s;
-          return make_token(TokenType::STRING, s.skipped(0, 2));
+          return true;
      }
 
 }; // class LoxLexer
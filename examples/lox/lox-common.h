@@ -1,11 +1,17 @@
 #pragma once
 
+#include <algorithm>    // std::count
+#include <charconv>     // std::from_chars
 #include <iostream>
 #include <map>          // keywords
+#include <memory>       // std::unique_ptr
+#include <optional>     // metrics_exporter
 #include <string>
 #include <string_view>
 #include <variant>      // token values
 #include "../../pattern.h"
+#include "pattern/lex-daemon.h"
+#include "pattern/metrics.h"
 
 using namespace Pattern;
 
@@ -104,10 +110,65 @@ using lox_token_value = variant<std::monostate,    // valueless tokens
                                 string_view,       // identifier, string, error
                                 double>;           // number
 
-using lox_token = token_lex<TokenType, lox_token_value>;
 auto empty = std::monostate {};
 
 
+// Decodes the value of a token from its lexeme, so that the lexers neither convert numbers nor trim strings unless the
+// value is read. An error token's lexeme tells which error it is.
+struct lox_decoder
+{
+     lox_token_value operator() (TokenType type, std::string_view lexeme) const
+     {
+          switch (type)
+          {
+               case TokenType::IDENTIFIER :     return lexeme;
+               case TokenType::STRING     :     return lexeme.substr(1, lexeme.size() - 2);
+
+               case TokenType::NUMBER     :
+               {
+                    double d = 0;
+                    std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), d);
+                    return d;
+               }
+
+               case TokenType::ERROR      :
+                    return lexeme.starts_with('"') ? "Unterminated string."sv : "Unexpected character: "sv;
+
+               default                    :     return empty;
+          }
+     }
+};
+
+
+// A tag and lexeme. Its value is decoded on each read, which is rare, so the token is no larger than the two.
+using lox_token = token_lazy<TokenType, lox_decoder>;
+
+
+// What LoxLexer::validate finds, for checks which need no tokens. Error tokens are counted as tokens, as next would
+// return them.
+struct lox_validation
+{
+     bool        valid        = true;
+     std::size_t error_offset = 0;     // of the first error
+     std::size_t tokens       = 0;
+     std::size_t lines        = 0;
+
+     void error (std::size_t offset) noexcept
+     {
+          if (valid)     error_offset = offset;
+          valid = false;
+     }
+};
+
+
+// A final line without a newline is counted
+std::size_t count_lines (std::string_view source)
+{
+     std::size_t lines = std::count(source.begin(), source.end(), '\n');
+     return lines + (!source.empty() && source.back() != '\n');
+}
+
+
 std::string to_string (TokenType type)
 {
      static const std::string strings[] =
@@ -150,7 +211,7 @@ std::string to_string (const lox_token& t, const CharT* data)
      {
           case (TokenType::IDENTIFIER) :
           case (TokenType::STRING)     :
-          case (TokenType::NUMBER)     : val = to_string(t.value); break;
+          case (TokenType::NUMBER)     : val = to_string(t.value()); break;
           default                      : val = to_string(t.tag);
      }
 
@@ -166,12 +227,15 @@ std::string to_string (const lox_token& t, const CharT* data)
 class System
 {
 public:
-     bool had_error = false;
+     // Counted rather than flagged, so it may be exported as a metric (see pattern/metrics.h)
+     std::size_t error_count = 0;
+
+     bool had_error () const noexcept     { return error_count != 0; }
 
      void report (source_location s, string_view lexeme, std::string message)
      {
           std::cout << "[at " << s.line << ":" << s.column << "] Error " << lexeme << ": " << message;
-          had_error = true;
+          ++error_count;
      }
 
 
@@ -220,7 +284,20 @@ void run_file (std::string_view path)
      const std::string code = file_to_string(path);
      run(code);
 
-     if (lox_system.had_error)    exit(EXIT_FAILURE);
+     if (lox_system.had_error())    exit(EXIT_FAILURE);
+}
+
+
+// Reports whether a file is lexically valid, without building tokens
+void check_file (std::string_view path)
+{
+     const std::string code = file_to_string(path);
+     lox_validation v = LoxLexer {code}.validate();
+
+     if (v.valid)     std::cout << path << ": " << v.tokens << " tokens, " << v.lines << " lines\n";
+     else             std::cout << path << ":" << v.error_offset << ": lexical error\n";
+
+     if (!v.valid)    exit(EXIT_FAILURE);
 }
 
 
@@ -233,16 +310,93 @@ void run_prompt ()
           getline(std::cin, buf);
           run(buf);
 
-          if (lox_system.had_error)    exit(EXIT_FAILURE);
+          if (lox_system.had_error())    exit(EXIT_FAILURE);
      }
 }
 
 
+// Lexes the requests of the daemon. The server copies it into each worker, and each copy makes its own shard on first
+// use, so every worker records its metrics without sharing a shard with another thread.
+class lox_daemon_lexer
+{
+public:
+     explicit lox_daemon_lexer (metrics_registry& registry)
+          : registry {&registry},
+            latency  {registry.histogram("lox_lex_seconds", "Time to lex a file or buffer")},
+            bytes    {registry.counter("lox_lex_bytes_total", "Bytes lexed")},
+            lexed    {registry.counter("lox_lex_tokens_total", "Tokens lexed")},
+            errors   {registry.counter("lox_lex_errors_total", "Lexical errors reported")}
+     {}
+
+     // A copy is for another thread, so it does not share the shard
+     lox_daemon_lexer (const lox_daemon_lexer& other)
+          : registry {other.registry}, latency {other.latency}, bytes {other.bytes}, lexed {other.lexed},
+            errors {other.errors}
+     {}
+
+     lox_daemon_lexer& operator= (const lox_daemon_lexer&) = delete;
+
+
+     void operator() (std::string_view source, token_stream<std::uint8_t>& tokens)
+     {
+          if (!shard)     shard = std::make_unique<scoped_shard>(*registry);
+
+          scoped_timer timer {**shard, latency};
+
+          LoxLexer      lox {source};
+          std::uint64_t count = 0, error_count = 0;
+
+          while (lox.has_more())
+          {
+               auto t = lox.next();
+               tokens.push_back(static_cast<std::uint8_t>(t.tag), t.position(source.data()), t.span());
+
+               ++count;
+               if (t.tag == TokenType::ERROR)     ++error_count;
+          }
+
+          (*shard)->add(bytes, source.size());
+          (*shard)->add(lexed, count);
+          (*shard)->add(errors, error_count);
+     }
+
+
+private:
+     metrics_registry*             registry;
+     histogram_id                  latency;
+     counter_id                    bytes;
+     counter_id                    lexed;
+     counter_id                    errors;
+     std::unique_ptr<scoped_shard> shard;
+};
+
+
+// Serves lexing requests on a small pool of workers until killed, keeping the lexers and their tables warm between
+// them. Given a metrics path, the time of each request and the counts of bytes, tokens, and lexical errors are exported
+// there every few seconds, in the Prometheus text format. Errors are counted from the ERROR tokens of the stream, which
+// is all the lexers report them by.
+void run_daemon (const std::string& socket_path, const std::string& metrics_path = {})
+{
+     metrics_registry registry;
+     lox_daemon_lexer lexer {registry};
+
+     std::optional<metrics_exporter> exporter;
+     if (!metrics_path.empty())     exporter.emplace(registry, metrics_path, std::chrono::seconds {5});
+
+     lex_server<std::uint8_t, lox_daemon_lexer> server {socket_path, lexer};
+     server.wait();
+}
+
+
 int lox_main (int argc, char* argv[])
 {
      try
      {
-          if      (argc >  2)     std::cout << "Usage: lox [script]";
+          if ((argc == 3 || argc == 4) && std::string_view {argv[1]} == "--daemon")
+               run_daemon(argv[2], argc == 4 ? argv[3] : "");
+          else if (argc == 3 && std::string_view {argv[1]} == "--check")
+               check_file(argv[2]);
+          else if (argc >  2)     std::cout << "Usage: lox [script | --check script | --daemon socket [metrics-file]]";
           else if (argc == 2)     run_file(argv[1]);
           else                    run_prompt();
      }
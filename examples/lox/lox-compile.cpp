@@ -0,0 +1,1799 @@
+// An ahead-of-time compiler of Lox to C++
+// http://www.craftinginterpreters.com
+//
+// The Translator stage described in pattern.h, for Lox. The scanner of lox-test.cpp feeds a parser of the grammar at
+// the end of that file, a resolver binds each variable to its declaration and finds the variables that closures
+// capture, and an emitter writes a C++ program against lox-runtime.h, which the system compiler can then build.
+//
+//     lox-compile script.lox [-o script.cpp] [--build executable [--benchmark]] [--runtime directory] [--interpret]
+//
+// Locals become C++ locals, or cells when a closure captures them. Each function becomes a struct holding the cells it
+// captures, and its body a member function. Globals are late bound as in jlox, so reading one checks it was defined.
+//
+// The generated program includes lox-runtime.h from the directory given by --runtime, or else by LOX_RUNTIME_DIR, which
+// the Makefile defines when it builds the compiler. It is built with $CXX, or c++.
+//
+// --interpret runs the script with a tree-walking interpreter over the same runtime instead of translating it.
+// --benchmark runs the script with the interpreter and then the built executable, and reports how much faster the
+// translation ran.
+
+#define LOX_NO_MAIN
+#include "lox-test.cpp"
+
+#include "lox-runtime.h"
+
+#include <algorithm>      // std::find
+#include <chrono>         // --benchmark
+#include <cstdlib>        // std::getenv, std::strtod, std::system
+#include <filesystem>     // std::filesystem::path
+#include <map>            // globals, in order
+#include <unordered_map>
+#include <utility>        // std::exchange
+
+
+namespace {
+
+struct function_info;
+
+
+// =====================================================================================================================
+// Syntax Tree
+// =====================================================================================================================
+struct variable
+{
+     std::string    name;
+     int            id;
+     function_info* owner;                 // nullptr for a global
+     bool           captured = false;
+     bool           assigned = false;     // after its declaration
+};
+
+
+enum class expr_kind { literal, grouping, variable, assign, unary, binary, logical, call, get, set, self, super };
+
+struct expr
+{
+     expr_kind                          kind;
+     const TokenBase*                   token;              // the literal, name, or operator, and its line
+     std::vector<std::unique_ptr<expr>> operands = {};      // a call has the callee first
+     variable*                          target   = nullptr;     // of a variable, assignment, this or super
+     variable*                          self     = nullptr;     // of super
+     const TokenBase*                   keyword  = nullptr;     // of super, which names the method as its token
+};
+
+
+enum class stmt_kind { expression, print, var, block, if_else, loop, function, return_value, class_decl };
+
+struct stmt
+{
+     stmt_kind                          kind;
+     const TokenBase*                   token;              // the name declared, or the keyword
+     std::unique_ptr<expr>              value   = nullptr;  // the expression, condition, initializer or superclass
+     std::vector<std::unique_ptr<stmt>> body    = {};       // of a block, the branches of if, or the body of while
+     std::vector<function_info*>        methods = {};
+     function_info*                     function  = nullptr;
+     variable*                          target    = nullptr;     // declared by var, fun or class
+     variable*                          super_var = nullptr;
+};
+
+
+enum class function_kind { script, function, method, initializer };
+
+struct function_info
+{
+     function_kind                      kind;
+     int                                id;
+     const TokenBase*                   name       = nullptr;
+     std::vector<const TokenBase*>      parameters = {};
+     std::vector<std::unique_ptr<stmt>> body       = {};
+
+     // Set by the resolver
+     function_info*                     enclosing  = nullptr;
+     std::vector<variable*>             arguments  = {};
+     variable*                          self       = nullptr;     // this, in a method
+     std::vector<variable*>             free       = {};          // captured from enclosing functions
+};
+
+
+struct program
+{
+     std::vector<std::unique_ptr<function_info>> functions;     // the script first
+     std::vector<std::unique_ptr<variable>>      variables;
+     std::map<std::string, variable*>            globals;
+
+     function_info* new_function (function_kind kind)
+     {
+          int id = static_cast<int>(functions.size());
+          return functions.emplace_back(new function_info {kind, id}).get();
+     }
+
+     variable* new_variable (const std::string& name, function_info* owner)
+     {
+          int id = static_cast<int>(variables.size());
+          return variables.emplace_back(new variable {name, id, owner}).get();
+     }
+
+     variable* global (const std::string& name)
+     {
+          auto& v = globals[name];
+          if (!v)     v = new_variable(name, nullptr);
+
+          return v;
+     }
+};
+
+
+void compile_error (const TokenBase& token, const std::string& message)
+{
+     std::string where = token.type == TokenType::END ? " at end" : " at '" + token.lexeme + "'";
+     std::cerr << "[line " << token.line << "] Error" << where << ": " << message << "\n";
+     had_error = true;
+}
+
+
+// =====================================================================================================================
+// Parser
+// =====================================================================================================================
+class Parser {
+public:
+     Parser (const std::vector<std::unique_ptr<TokenBase>>& tokens, program& p) : tokens {tokens}, p {p} {}
+
+     void parse ();
+
+
+private:
+     struct parse_error {};
+
+     const std::vector<std::unique_ptr<TokenBase>>& tokens;
+     program& p;
+     std::size_t current = 0;
+
+     // Statements
+     std::unique_ptr<stmt> declaration ();
+     std::unique_ptr<stmt> class_declaration ();
+     function_info*        function (function_kind kind);
+     std::unique_ptr<stmt> var_declaration ();
+     std::unique_ptr<stmt> statement ();
+     std::unique_ptr<stmt> for_statement ();
+     std::unique_ptr<stmt> if_statement ();
+     std::unique_ptr<stmt> return_statement ();
+     std::unique_ptr<stmt> while_statement ();
+     std::unique_ptr<stmt> expression_statement ();
+     std::vector<std::unique_ptr<stmt>> block ();
+
+     // Expressions
+     std::unique_ptr<expr> expression ();
+     std::unique_ptr<expr> assignment ();
+     std::unique_ptr<expr> logic_or ();
+     std::unique_ptr<expr> logic_and ();
+     std::unique_ptr<expr> equality ();
+     std::unique_ptr<expr> comparison ();
+     std::unique_ptr<expr> addition ();
+     std::unique_ptr<expr> multiplication ();
+     std::unique_ptr<expr> unary ();
+     std::unique_ptr<expr> call ();
+     std::unique_ptr<expr> finish_call (std::unique_ptr<expr> callee);
+     std::unique_ptr<expr> primary ();
+
+     template <typename Next>
+     std::unique_ptr<expr> binary (expr_kind kind, Next next, std::initializer_list<TokenType> types);
+
+     // Traversal
+     const TokenBase& peek ()     { return *tokens[current]; }
+     const TokenBase& previous () { return *tokens[current - 1]; }
+     bool is_at_end ()            { return peek().type == TokenType::END; }
+     bool check (TokenType type)  { return peek().type == type; }
+
+     const TokenBase& advance ();
+     bool match (std::initializer_list<TokenType> types);
+     const TokenBase& consume (TokenType type, const std::string& message);
+     parse_error error (const TokenBase& token, const std::string& message);
+     void synchronize ();
+};
+
+
+void Parser::parse ()
+{
+     function_info* script = p.new_function(function_kind::script);
+
+     while (!is_at_end())
+          if (auto s = declaration())     script->body.push_back(std::move(s));
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Statements
+// ---------------------------------------------------------------------------------------------------------------------
+std::unique_ptr<stmt> Parser::declaration ()
+{
+     try
+     {
+          if (match({TokenType::CLASS}))     return class_declaration();
+          if (match({TokenType::VAR}))       return var_declaration();
+
+          if (match({TokenType::FUN}))
+          {
+               function_info* f = function(function_kind::function);
+               auto s = std::make_unique<stmt>(stmt_kind::function, f->name);
+               s->function = f;
+               return s;
+          }
+
+          return statement();
+     }
+     catch (const parse_error&)
+     {
+          synchronize();
+          return nullptr;
+     }
+}
+
+
+std::unique_ptr<stmt> Parser::class_declaration ()
+{
+     auto s = std::make_unique<stmt>(stmt_kind::class_decl, &consume(TokenType::IDENTIFIER, "Expect class name."));
+
+     if (match({TokenType::LESS}))
+          s->value = std::make_unique<expr>(expr_kind::variable,
+                                            &consume(TokenType::IDENTIFIER, "Expect superclass name."));
+
+     consume(TokenType::LEFT_BRACE, "Expect '{' before class body.");
+
+     while (!check(TokenType::RIGHT_BRACE) && !is_at_end())
+          s->methods.push_back(function(function_kind::method));
+
+     consume(TokenType::RIGHT_BRACE, "Expect '}' after class body.");
+     return s;
+}
+
+
+function_info* Parser::function (function_kind kind)
+{
+     std::string what = kind == function_kind::method ? "method" : "function";
+
+     function_info* f = p.new_function(kind);
+     f->name = &consume(TokenType::IDENTIFIER, "Expect " + what + " name.");
+     if (kind == function_kind::method && f->name->lexeme == "init")     f->kind = function_kind::initializer;
+
+     consume(TokenType::LEFT_PAREN, "Expect '(' after " + what + " name.");
+
+     if (!check(TokenType::RIGHT_PAREN))
+     {
+          do {
+               if (f->parameters.size() >= 255)     error(peek(), "Can't have more than 255 parameters.");
+               f->parameters.push_back(&consume(TokenType::IDENTIFIER, "Expect parameter name."));
+          } while (match({TokenType::COMMA}));
+     }
+
+     consume(TokenType::RIGHT_PAREN, "Expect ')' after parameters.");
+     consume(TokenType::LEFT_BRACE, "Expect '{' before " + what + " body.");
+     f->body = block();
+
+     return f;
+}
+
+
+std::unique_ptr<stmt> Parser::var_declaration ()
+{
+     auto s = std::make_unique<stmt>(stmt_kind::var, &consume(TokenType::IDENTIFIER, "Expect variable name."));
+     if (match({TokenType::EQUAL}))     s->value = expression();
+
+     consume(TokenType::SEMICOLON, "Expect ';' after variable declaration.");
+     return s;
+}
+
+
+std::unique_ptr<stmt> Parser::statement ()
+{
+     if (match({TokenType::FOR}))        return for_statement();
+     if (match({TokenType::IF}))         return if_statement();
+     if (match({TokenType::RETURN}))     return return_statement();
+     if (match({TokenType::WHILE}))      return while_statement();
+
+     if (match({TokenType::PRINT}))
+     {
+          auto s = std::make_unique<stmt>(stmt_kind::print, &previous(), expression());
+          consume(TokenType::SEMICOLON, "Expect ';' after value.");
+          return s;
+     }
+
+     if (match({TokenType::LEFT_BRACE}))
+     {
+          auto s = std::make_unique<stmt>(stmt_kind::block, &previous());
+          s->body = block();
+          return s;
+     }
+
+     return expression_statement();
+}
+
+
+// A for loop becomes a while loop in a block with its initializer
+std::unique_ptr<stmt> Parser::for_statement ()
+{
+     const TokenBase* keyword = &previous();
+     consume(TokenType::LEFT_PAREN, "Expect '(' after 'for'.");
+
+     std::unique_ptr<stmt> initializer;
+          if (match({TokenType::SEMICOLON}))     ;
+     else if (match({TokenType::VAR}))           initializer = var_declaration();
+     else                                        initializer = expression_statement();
+
+     std::unique_ptr<expr> condition;
+     if (!check(TokenType::SEMICOLON))     condition = expression();
+     consume(TokenType::SEMICOLON, "Expect ';' after loop condition.");
+
+     std::unique_ptr<expr> increment;
+     if (!check(TokenType::RIGHT_PAREN))     increment = expression();
+     consume(TokenType::RIGHT_PAREN, "Expect ')' after for clauses.");
+
+     std::unique_ptr<stmt> body = statement();
+
+     if (increment)
+     {
+          auto b = std::make_unique<stmt>(stmt_kind::block, keyword);
+          b->body.push_back(std::move(body));
+          b->body.push_back(std::make_unique<stmt>(stmt_kind::expression, keyword, std::move(increment)));
+          body = std::move(b);
+     }
+
+     auto loop = std::make_unique<stmt>(stmt_kind::loop, keyword, std::move(condition));     // none loops forever
+     loop->body.push_back(std::move(body));
+
+     if (!initializer)     return loop;
+
+     auto b = std::make_unique<stmt>(stmt_kind::block, keyword);
+     b->body.push_back(std::move(initializer));
+     b->body.push_back(std::move(loop));
+     return b;
+}
+
+
+std::unique_ptr<stmt> Parser::if_statement ()
+{
+     auto s = std::make_unique<stmt>(stmt_kind::if_else, &previous());
+
+     consume(TokenType::LEFT_PAREN, "Expect '(' after 'if'.");
+     s->value = expression();
+     consume(TokenType::RIGHT_PAREN, "Expect ')' after if condition.");
+
+     s->body.push_back(statement());
+     if (match({TokenType::ELSE}))     s->body.push_back(statement());
+
+     return s;
+}
+
+
+std::unique_ptr<stmt> Parser::return_statement ()
+{
+     auto s = std::make_unique<stmt>(stmt_kind::return_value, &previous());
+     if (!check(TokenType::SEMICOLON))     s->value = expression();
+
+     consume(TokenType::SEMICOLON, "Expect ';' after return value.");
+     return s;
+}
+
+
+std::unique_ptr<stmt> Parser::while_statement ()
+{
+     auto s = std::make_unique<stmt>(stmt_kind::loop, &previous());
+
+     consume(TokenType::LEFT_PAREN, "Expect '(' after 'while'.");
+     s->value = expression();
+     consume(TokenType::RIGHT_PAREN, "Expect ')' after condition.");
+
+     s->body.push_back(statement());
+     return s;
+}
+
+
+std::unique_ptr<stmt> Parser::expression_statement ()
+{
+     auto s = std::make_unique<stmt>(stmt_kind::expression, &peek(), expression());
+     consume(TokenType::SEMICOLON, "Expect ';' after expression.");
+     return s;
+}
+
+
+std::vector<std::unique_ptr<stmt>> Parser::block ()
+{
+     std::vector<std::unique_ptr<stmt>> statements;
+
+     while (!check(TokenType::RIGHT_BRACE) && !is_at_end())
+          if (auto s = declaration())     statements.push_back(std::move(s));
+
+     consume(TokenType::RIGHT_BRACE, "Expect '}' after block.");
+     return statements;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Expressions
+// ---------------------------------------------------------------------------------------------------------------------
+std::unique_ptr<expr> Parser::expression ()
+{
+     return assignment();
+}
+
+
+std::unique_ptr<expr> Parser::assignment ()
+{
+     auto e = logic_or();
+     if (!match({TokenType::EQUAL}))     return e;
+
+     const TokenBase& equals = previous();
+     auto value = assignment();
+
+     if (e->kind == expr_kind::variable)
+     {
+          auto a = std::make_unique<expr>(expr_kind::assign, e->token);
+          a->operands.push_back(std::move(value));
+          return a;
+     }
+
+     if (e->kind == expr_kind::get)
+     {
+          auto s = std::make_unique<expr>(expr_kind::set, e->token, std::move(e->operands));
+          s->operands.push_back(std::move(value));
+          return s;
+     }
+
+     compile_error(equals, "Invalid assignment target.");
+     return e;
+}
+
+
+template <typename Next>
+std::unique_ptr<expr> Parser::binary (expr_kind kind, Next next, std::initializer_list<TokenType> types)
+{
+     auto e = (this->*next)();
+
+     while (match(types))
+     {
+          auto b = std::make_unique<expr>(kind, &previous());
+          b->operands.push_back(std::move(e));
+          b->operands.push_back((this->*next)());
+          e = std::move(b);
+     }
+
+     return e;
+}
+
+
+std::unique_ptr<expr> Parser::logic_or ()
+{
+     return binary(expr_kind::logical, &Parser::logic_and, {TokenType::OR});
+}
+
+std::unique_ptr<expr> Parser::logic_and ()
+{
+     return binary(expr_kind::logical, &Parser::equality, {TokenType::AND});
+}
+
+std::unique_ptr<expr> Parser::equality ()
+{
+     return binary(expr_kind::binary, &Parser::comparison, {TokenType::BANG_EQUAL, TokenType::EQUAL_EQUAL});
+}
+
+std::unique_ptr<expr> Parser::comparison ()
+{
+     using namespace TokenTypeMembers;
+     return binary(expr_kind::binary, &Parser::addition, {GREATER, GREATER_EQUAL, LESS, LESS_EQUAL});
+}
+
+std::unique_ptr<expr> Parser::addition ()
+{
+     return binary(expr_kind::binary, &Parser::multiplication, {TokenType::MINUS, TokenType::PLUS});
+}
+
+std::unique_ptr<expr> Parser::multiplication ()
+{
+     return binary(expr_kind::binary, &Parser::unary, {TokenType::SLASH, TokenType::STAR});
+}
+
+
+std::unique_ptr<expr> Parser::unary ()
+{
+     if (!match({TokenType::BANG, TokenType::MINUS}))     return call();
+
+     auto e = std::make_unique<expr>(expr_kind::unary, &previous());
+     e->operands.push_back(unary());
+     return e;
+}
+
+
+std::unique_ptr<expr> Parser::call ()
+{
+     auto e = primary();
+
+     for (;;)
+     {
+          if (match({TokenType::LEFT_PAREN}))     e = finish_call(std::move(e));
+
+          else if (match({TokenType::DOT}))
+          {
+               auto g = std::make_unique<expr>(expr_kind::get,
+                                               &consume(TokenType::IDENTIFIER, "Expect property name after '.'."));
+               g->operands.push_back(std::move(e));
+               e = std::move(g);
+          }
+
+          else break;
+     }
+
+     return e;
+}
+
+
+std::unique_ptr<expr> Parser::finish_call (std::unique_ptr<expr> callee)
+{
+     std::vector<std::unique_ptr<expr>> operands;
+     operands.push_back(std::move(callee));
+
+     if (!check(TokenType::RIGHT_PAREN))
+     {
+          do {
+               if (operands.size() > 255)     error(peek(), "Can't have more than 255 arguments.");
+               operands.push_back(expression());
+          } while (match({TokenType::COMMA}));
+     }
+
+     const TokenBase& paren = consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments.");
+     return std::make_unique<expr>(expr_kind::call, &paren, std::move(operands));
+}
+
+
+std::unique_ptr<expr> Parser::primary ()
+{
+     using namespace TokenTypeMembers;
+
+     if (match({FALSE, TRUE, NIL, NUMBER, STRING}))     return std::make_unique<expr>(expr_kind::literal, &previous());
+     if (match({THIS}))                                 return std::make_unique<expr>(expr_kind::self, &previous());
+     if (match({IDENTIFIER}))                           return std::make_unique<expr>(expr_kind::variable, &previous());
+
+     if (match({SUPER}))
+     {
+          const TokenBase* keyword = &previous();
+          consume(DOT, "Expect '.' after 'super'.");
+
+          auto e = std::make_unique<expr>(expr_kind::super, &consume(IDENTIFIER, "Expect superclass method name."));
+          e->keyword = keyword;
+          return e;
+     }
+
+     if (match({LEFT_PAREN}))
+     {
+          auto g = std::make_unique<expr>(expr_kind::grouping, &previous());
+          g->operands.push_back(expression());
+          consume(RIGHT_PAREN, "Expect ')' after expression.");
+          return g;
+     }
+
+     throw error(peek(), "Expect expression.");
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Traversal
+// ---------------------------------------------------------------------------------------------------------------------
+const TokenBase& Parser::advance ()
+{
+     if (!is_at_end())     ++current;
+     return previous();
+}
+
+
+bool Parser::match (std::initializer_list<TokenType> types)
+{
+     for (TokenType type : types)
+     {
+          if (check(type))
+          {
+               advance();
+               return true;
+          }
+     }
+
+     return false;
+}
+
+
+const TokenBase& Parser::consume (TokenType type, const std::string& message)
+{
+     if (check(type))     return advance();
+     throw error(peek(), message);
+}
+
+
+Parser::parse_error Parser::error (const TokenBase& token, const std::string& message)
+{
+     compile_error(token, message);
+     return {};
+}
+
+
+// Skips to the start of the next statement after a syntax error
+void Parser::synchronize ()
+{
+     using namespace TokenTypeMembers;
+
+     advance();
+
+     while (!is_at_end())
+     {
+          if (previous().type == SEMICOLON)     return;
+
+          switch (peek().type)
+          {
+               case CLASS: case FUN: case VAR: case FOR: case IF: case WHILE: case PRINT: case RETURN:
+                    return;
+
+               default:
+                    advance();
+          }
+     }
+}
+
+
+// =====================================================================================================================
+// Resolver
+// =====================================================================================================================
+// Binds every variable to its declaration. A variable read by a function other than the one declaring it is captured,
+// and is free in that function and in every function between it and the declaration, which pass its cell inwards.
+class Resolver {
+public:
+     Resolver (program& p) : p {p} {}
+
+     void resolve ();
+
+
+private:
+     struct binding
+     {
+          variable* v;
+          bool      defined;
+     };
+
+     enum class class_kind { none, plain, subclass };
+
+     program& p;
+     std::vector<std::unordered_map<std::string, binding>> scopes;
+     function_info* current_function = nullptr;
+     class_kind     current_class    = class_kind::none;
+
+     void resolve (stmt& s);
+     void resolve (expr& e);
+     void resolve_function (function_info& f);
+
+     variable* declare (const TokenBase& name);
+     variable* define (const TokenBase& name);
+     variable* look_up (const TokenBase& name);
+};
+
+
+void Resolver::resolve ()
+{
+     function_info& script = *p.functions.front();
+     current_function = &script;
+
+     for (auto& s : script.body)     resolve(*s);
+}
+
+
+void Resolver::resolve (stmt& s)
+{
+     switch (s.kind)
+     {
+          case stmt_kind::expression:
+          case stmt_kind::print:
+               resolve(*s.value);
+               break;
+
+          case stmt_kind::var:
+               s.target = declare(*s.token);
+               if (s.value)     resolve(*s.value);
+               define(*s.token);
+               break;
+
+          case stmt_kind::block:
+               scopes.emplace_back();
+               for (auto& b : s.body)     resolve(*b);
+               scopes.pop_back();
+               break;
+
+          case stmt_kind::if_else:
+          case stmt_kind::loop:
+               if (s.value)     resolve(*s.value);
+               for (auto& b : s.body)     resolve(*b);
+               break;
+
+          case stmt_kind::function:
+               declare(*s.token);
+               s.target = define(*s.token);
+               resolve_function(*s.function);
+               break;
+
+          case stmt_kind::return_value:
+               if (current_function->kind == function_kind::script)
+                    compile_error(*s.token, "Can't return from top-level code.");
+
+               if (s.value)
+               {
+                    if (current_function->kind == function_kind::initializer)
+                         compile_error(*s.token, "Can't return a value from an initializer.");
+
+                    resolve(*s.value);
+               }
+               break;
+
+          case stmt_kind::class_decl:
+          {
+               class_kind enclosing = current_class;
+               current_class = class_kind::plain;
+
+               declare(*s.token);
+               s.target = define(*s.token);
+
+               if (s.value)
+               {
+                    if (s.value->token->lexeme == s.token->lexeme)
+                         compile_error(*s.value->token, "A class can't inherit from itself.");
+
+                    current_class = class_kind::subclass;
+                    resolve(*s.value);
+
+                    scopes.emplace_back();
+                    s.super_var = p.new_variable("super", current_function);
+                    scopes.back().emplace("super", binding {s.super_var, true});
+               }
+
+               for (function_info* m : s.methods)     resolve_function(*m);
+
+               if (s.value)     scopes.pop_back();
+               current_class = enclosing;
+               break;
+          }
+     }
+}
+
+
+void Resolver::resolve (expr& e)
+{
+     switch (e.kind)
+     {
+          case expr_kind::variable:
+               if (!scopes.empty())
+               {
+                    auto found = scopes.back().find(e.token->lexeme);
+                    if (found != scopes.back().end() && !found->second.defined)
+                         compile_error(*e.token, "Can't read local variable in its own initializer.");
+               }
+
+               e.target = look_up(*e.token);
+               break;
+
+          case expr_kind::assign:
+               resolve(*e.operands[0]);
+               e.target = look_up(*e.token);
+               e.target->assigned = true;
+               break;
+
+          case expr_kind::self:
+               if (current_class == class_kind::none)
+               {
+                    compile_error(*e.token, "Can't use 'this' outside of a class.");
+                    break;
+               }
+
+               e.target = look_up(*e.token);
+               break;
+
+          case expr_kind::super:
+          {
+               if (current_class == class_kind::none)
+                    compile_error(*e.keyword, "Can't use 'super' outside of a class.");
+               else if (current_class != class_kind::subclass)
+                    compile_error(*e.keyword, "Can't use 'super' in a class with no superclass.");
+
+               if (current_class != class_kind::subclass)     break;
+
+               Token<std::nullptr_t> super {TokenType::SUPER, "super", nullptr, e.token->line};
+               Token<std::nullptr_t> self  {TokenType::THIS,  "this",  nullptr, e.token->line};
+               e.target = look_up(super);
+               e.self   = look_up(self);
+               break;
+          }
+
+          default:
+               for (auto& o : e.operands)     resolve(*o);
+     }
+}
+
+
+void Resolver::resolve_function (function_info& f)
+{
+     function_info* enclosing = current_function;
+     f.enclosing      = enclosing;
+     current_function = &f;
+
+     scopes.emplace_back();
+
+     if (f.kind == function_kind::method || f.kind == function_kind::initializer)
+     {
+          f.self = p.new_variable("this", &f);
+          scopes.back().emplace("this", binding {f.self, true});
+     }
+
+     for (const TokenBase* parameter : f.parameters)
+     {
+          declare(*parameter);
+          f.arguments.push_back(define(*parameter));
+     }
+
+     for (auto& s : f.body)     resolve(*s);
+
+     scopes.pop_back();
+     current_function = enclosing;
+}
+
+
+variable* Resolver::declare (const TokenBase& name)
+{
+     if (scopes.empty())     return p.global(name.lexeme);
+
+     auto& scope = scopes.back();
+
+     if (scope.contains(name.lexeme))
+     {
+          compile_error(name, "Already a variable with this name in this scope.");
+          return scope[name.lexeme].v;
+     }
+
+     variable* v = p.new_variable(name.lexeme, current_function);
+     scope.emplace(name.lexeme, binding {v, false});
+     return v;
+}
+
+
+variable* Resolver::define (const TokenBase& name)
+{
+     if (scopes.empty())     return p.global(name.lexeme);
+
+     auto& b = scopes.back()[name.lexeme];
+     b.defined = true;
+     return b.v;
+}
+
+
+variable* Resolver::look_up (const TokenBase& name)
+{
+     for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope)
+     {
+          auto found = scope->find(name.lexeme);
+          if (found == scope->end())     continue;
+
+          variable* v = found->second.v;
+
+          if (v->owner != current_function)
+          {
+               v->captured = true;
+
+               for (function_info* f = current_function; f != v->owner; f = f->enclosing)
+                    if (std::find(f->free.begin(), f->free.end(), v) == f->free.end())     f->free.push_back(v);
+          }
+
+          return v;
+     }
+
+     return p.global(name.lexeme);
+}
+
+
+// =====================================================================================================================
+// Emitter
+// =====================================================================================================================
+// Writes the program as C++. Every operation with more than one operand takes them as a braced list, which C++
+// evaluates from left to right as Lox requires.
+class Emitter {
+public:
+     Emitter (const program& p) : p {p} {}
+
+     std::string emit ();
+
+
+private:
+     const program& p;
+
+     std::string out;
+     int         depth = 0;
+     const function_info* current = nullptr;
+
+     std::unordered_map<std::string, std::string> names, strings;
+     std::string constants;
+     int         caches  = 0;
+     int         classes = 0;
+
+     void emit_function (const function_info& f);
+     void emit (const stmt& s);
+     void emit_body (const stmt& s);
+     std::string emit (const expr& e);
+
+     std::string construct (const function_info& f);
+     std::string operation (const char* name, const expr& e, bool with_line = true);
+
+     // Variables
+     std::string read (const variable& v, int line);
+     std::string assign (const variable& v, const std::string& value, int line);
+     std::string define (const variable& v, const std::string& value);
+     std::string define_argument (const variable& v, const std::string& value);
+     std::string store (const variable& v, const std::string& value);
+
+     // Constants
+     std::string name_of (const std::string& name);
+     std::string string_of (const std::string& text);
+     std::string new_cache ();
+
+     void line (const std::string& text)     { out.append(5 * depth, ' ') += text + "\n"; }
+};
+
+
+std::string identifier (const variable& v)
+{
+     if (!v.owner)     return "g_" + v.name;
+     return (v.captured ? "c" : "v") + std::to_string(v.id) + "_" + v.name;
+}
+
+
+std::string struct_name (const function_info& f)
+{
+     return "fn" + std::to_string(f.id) + "_" + f.name->lexeme;
+}
+
+
+std::string quote (const std::string& text)
+{
+     std::string q = "\"";
+
+     for (unsigned char c : text)
+     {
+          if (c == '"' || c == '\\')     q += {'\\', static_cast<char>(c)};
+          else if (c == '\n')            q += "\\n";
+          else if (c < 0x20 || c >= 0x7f)
+          {
+               const char octal[] = {'\\', static_cast<char>('0' + (c >> 6)), static_cast<char>('0' + (c >> 3 & 7)),
+                                     static_cast<char>('0' + (c & 7))};
+               q.append(octal, sizeof(octal));
+          }
+          else q += static_cast<char>(c);
+     }
+
+     return q + "\"";
+}
+
+
+std::string Emitter::emit ()
+{
+     // The bodies first, to collect the constants they use
+     std::string bodies;
+
+     for (auto& f : p.functions)
+     {
+          if (f->kind == function_kind::script)     continue;
+
+          emit_function(*f);
+          bodies += out + "\n\n";
+          out.clear();
+     }
+
+     current = p.functions.front().get();
+     line("void lox_main ()");
+     line("{");
+     ++depth;
+     for (auto& s : current->body)     emit(*s);
+     --depth;
+     line("}");
+     bodies += out;
+
+     std::string program = "// Translated from Lox by lox-compile\n"
+                           "#include \"lox-runtime.h\"\n\n\n"
+                           "namespace {\n\n";
+
+     for (auto& [name, v] : p.globals)
+     {
+          std::string initial = name == "clock" ? "new lox::native_clock" : "lox::undefined";
+          program += "lox::stored " + identifier(*v) + " {" + initial + "};\n";
+     }
+
+     program += "\n" + constants + "\n\n";
+
+     for (auto& f : p.functions)
+     {
+          if (f->kind == function_kind::script)     continue;
+
+          std::string name = struct_name(*f), parameters, initializers;
+
+          for (variable* v : f->free)
+          {
+               parameters   += std::string {parameters.empty() ? "" : ", "} + "lox::cell* " + identifier(*v);
+               initializers += ", " + identifier(*v) + " {" + identifier(*v) + "}";
+          }
+
+          program += "struct " + name + " final : lox::function\n{\n";
+          for (variable* v : f->free)     program += "     lox::cell* " + identifier(*v) + ";\n";
+          if (!f->free.empty())           program += "\n";
+
+          program += "     " + name + " (" + parameters + ") : lox::function {" + quote(f->name->lexeme) + ", " +
+                     std::to_string(f->parameters.size()) + "}" + initializers + " {}\n\n";
+          program += "     lox::value call (lox::value self, const lox::value* args) override;\n};\n\n";
+     }
+
+     return program + "\n" + bodies + "\n} // namespace\n\n\n"
+                                      "int main ()\n{\n     return lox::run(lox_main);\n}\n";
+}
+
+
+void Emitter::emit_function (const function_info& f)
+{
+     current = &f;
+
+     line("lox::value " + struct_name(f) + "::call (lox::value self, const lox::value* args)");
+     line("{");
+     ++depth;
+
+     if (f.self)     line(define_argument(*f.self, "self"));
+
+     for (std::size_t i = 0; i < f.arguments.size(); ++i)
+          line(define_argument(*f.arguments[i], "args[" + std::to_string(i) + "]"));
+
+     for (auto& s : f.body)     emit(*s);
+
+     line(f.kind == function_kind::initializer ? "return " + read(*f.self, 0) + ";" : "return lox::nil;");
+
+     --depth;
+     line("}");
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Statements
+// ---------------------------------------------------------------------------------------------------------------------
+void Emitter::emit (const stmt& s)
+{
+     switch (s.kind)
+     {
+          case stmt_kind::expression:
+               line(emit(*s.value) + ";");
+               break;
+
+          case stmt_kind::print:
+               line("lox::print(" + emit(*s.value) + ");");
+               break;
+
+          case stmt_kind::var:
+               line(define(*s.target, s.value ? emit(*s.value) : "lox::nil"));
+               break;
+
+          case stmt_kind::block:
+               emit_body(s);
+               break;
+
+          case stmt_kind::if_else:
+               line("if (lox::truthy(" + emit(*s.value) + "))");
+               emit_body(*s.body[0]);
+
+               if (s.body.size() > 1)
+               {
+                    line("else");
+                    emit_body(*s.body[1]);
+               }
+               break;
+
+          // Each iteration starts where no temporary is alive, so strings no longer held can be freed
+          case stmt_kind::loop:
+               line(s.value ? "while (lox::truthy(" + emit(*s.value) + "))" : "for (;;)");
+               line("{");
+               ++depth;
+               line("lox::collect_garbage();");
+               emit_body(*s.body[0]);
+               --depth;
+               line("}");
+               break;
+
+          case stmt_kind::function:
+               // Defined before its closure is made, which may capture it
+               line(define(*s.target, "lox::nil"));
+               line(store(*s.target, construct(*s.function)));
+               break;
+
+          case stmt_kind::return_value:
+               if (current->kind == function_kind::initializer)     line("return " + read(*current->self, 0) + ";");
+               else     line("return " + (s.value ? emit(*s.value) : "lox::nil") + ";");
+               break;
+
+          case stmt_kind::class_decl:
+          {
+               int line_number = s.token->line;
+               std::string k = "k" + std::to_string(classes++);
+
+               line(define(*s.target, "lox::nil"));
+               line("{");
+               ++depth;
+
+               std::string superclass = "lox::nil";
+
+               if (s.value)
+               {
+                    line(define(*s.super_var, emit(*s.value)));
+                    superclass = read(*s.super_var, line_number);
+               }
+
+               line("lox::klass* " + k + " = lox::new_class(" + quote(s.token->lexeme) + ", " + superclass + ", " +
+                    std::to_string(line_number) + ");");
+
+               for (function_info* m : s.methods)
+                    line(k + "->define(" + name_of(m->name->lexeme) + ", " + construct(*m) + ");");
+
+               line(store(*s.target, "lox::value {" + k + "}"));
+
+               --depth;
+               line("}");
+               break;
+          }
+     }
+}
+
+
+// Emits a statement as a block, so its declarations stay local to it
+void Emitter::emit_body (const stmt& s)
+{
+     line("{");
+     ++depth;
+
+     if (s.kind == stmt_kind::block)     for (auto& b : s.body)     emit(*b);
+     else                                emit(s);
+
+     --depth;
+     line("}");
+}
+
+
+std::string Emitter::construct (const function_info& f)
+{
+     std::string cells;
+     for (variable* v : f.free)     cells += (cells.empty() ? "" : ", ") + identifier(*v);
+
+     return "new " + struct_name(f) + " {" + cells + "}";
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Expressions
+// ---------------------------------------------------------------------------------------------------------------------
+std::string Emitter::emit (const expr& e)
+{
+     const TokenBase& t = *e.token;
+     std::string line_number = std::to_string(t.line);
+
+     switch (e.kind)
+     {
+          case expr_kind::literal:
+               switch (t.type)
+               {
+                    case TokenType::NUMBER:
+                         return "lox::value {" + t.lexeme + (t.lexeme.find('.') == std::string::npos ? ".0}" : "}");
+
+                    case TokenType::STRING:     return string_of(t.lexeme.substr(1, t.lexeme.size() - 2));
+                    case TokenType::TRUE:       return "lox::value {true}";
+                    case TokenType::FALSE:      return "lox::value {false}";
+                    default:                    return "lox::nil";
+               }
+
+          case expr_kind::grouping:     return emit(*e.operands[0]);
+          case expr_kind::variable:     return read(*e.target, t.line);
+          case expr_kind::self:         return read(*e.target, t.line);
+          case expr_kind::assign:       return assign(*e.target, emit(*e.operands[0]), t.line);
+
+          case expr_kind::unary:
+               if (t.type == TokenType::BANG)     return "lox::value {!lox::truthy(" + emit(*e.operands[0]) + ")}";
+               return "lox::negate(" + emit(*e.operands[0]) + ", " + line_number + ")";
+
+          case expr_kind::binary:
+               switch (t.type)
+               {
+                    case TokenType::PLUS:            return operation("lox::add", e);
+                    case TokenType::MINUS:           return operation("lox::subtract", e);
+                    case TokenType::STAR:            return operation("lox::multiply", e);
+                    case TokenType::SLASH:           return operation("lox::divide", e);
+                    case TokenType::GREATER:         return operation("lox::greater", e);
+                    case TokenType::GREATER_EQUAL:   return operation("lox::greater_equal", e);
+                    case TokenType::LESS:            return operation("lox::less", e);
+                    case TokenType::LESS_EQUAL:      return operation("lox::less_equal", e);
+                    case TokenType::EQUAL_EQUAL:     return operation("lox::equal", e, false);
+                    default:                         return operation("lox::not_equal", e, false);
+               }
+
+          // The right operand is evaluated only when the left does not decide the result
+          case expr_kind::logical:
+          {
+               std::string right  = "lox::value {" + emit(*e.operands[1]) + "}";
+               std::string result = t.type == TokenType::OR ? "l : " + right : right + " : l";
+
+               return "[&] { lox::value l = " + emit(*e.operands[0]) + "; return lox::truthy(l) ? " + result + "; }()";
+          }
+
+          case expr_kind::call:
+          {
+               const expr& callee = *e.operands[0];
+               std::string list;
+
+               for (std::size_t i = 1; i < e.operands.size(); ++i)     list += ", " + emit(*e.operands[i]);
+
+               // A method called on an instance is not bound first
+               if (callee.kind == expr_kind::get)
+                    return "lox::invoke({" + emit(*callee.operands[0]) + list + "}, " + name_of(callee.token->lexeme) +
+                           ", " + new_cache() + ", " + line_number + ")";
+
+               return "lox::call({" + emit(callee) + list + "}, " + line_number + ")";
+          }
+
+          case expr_kind::get:
+               return "lox::get(" + emit(*e.operands[0]) + ", " + name_of(t.lexeme) + ", " + new_cache() + ", " +
+                      line_number + ")";
+
+          case expr_kind::set:
+               return "lox::set({" + emit(*e.operands[0]) + ", " + emit(*e.operands[1]) + "}, " + name_of(t.lexeme) +
+                      ", " + new_cache() + ", " + line_number + ")";
+
+          case expr_kind::super:
+               return "lox::super_method(" + read(*e.target, t.line) + ", " + read(*e.self, t.line) + ", " +
+                      name_of(t.lexeme) + ", " + line_number + ")";
+     }
+
+     return "lox::nil";
+}
+
+
+std::string Emitter::operation (const char* name, const expr& e, bool with_line)
+{
+     std::string call = std::string {name} + "({" + emit(*e.operands[0]) + ", " + emit(*e.operands[1]) + "}";
+     if (with_line)     call += ", " + std::to_string(e.token->line);
+
+     return call + ")";
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Variables
+// ---------------------------------------------------------------------------------------------------------------------
+std::string Emitter::read (const variable& v, int line)
+{
+     if (!v.owner)        return "lox::read_global(" + identifier(v) + ", " + quote(v.name) + ", " +
+                                 std::to_string(line) + ")";
+     if (v.captured)      return identifier(v) + "->v";
+
+     return identifier(v);
+}
+
+
+std::string Emitter::assign (const variable& v, const std::string& value, int line)
+{
+     if (!v.owner)        return "lox::assign_global(" + identifier(v) + ", " + value + ", " + quote(v.name) + ", " +
+                                 std::to_string(line) + ")";
+     if (v.captured)      return "(" + identifier(v) + "->v = " + value + ")";
+
+     return "(" + identifier(v) + " = " + value + ")";
+}
+
+
+std::string Emitter::define (const variable& v, const std::string& value)
+{
+     if (!v.owner)        return identifier(v) + " = " + value + ";";
+     if (v.captured)      return "lox::cell* " + identifier(v) + " = lox::new_cell(" + value + ");";
+
+     return "lox::stored " + identifier(v) + " = " + value + ";";
+}
+
+
+// The caller's list of arguments holds them for the call, so an argument that is never assigned need not be stored
+std::string Emitter::define_argument (const variable& v, const std::string& value)
+{
+     if (v.captured || v.assigned)     return define(v, value);
+     return "lox::value " + identifier(v) + " = " + value + ";";
+}
+
+
+std::string Emitter::store (const variable& v, const std::string& value)
+{
+     if (v.captured)     return identifier(v) + "->v = " + value + ";";
+     return identifier(v) + " = " + value + ";";
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Constants
+// ---------------------------------------------------------------------------------------------------------------------
+std::string Emitter::name_of (const std::string& name)
+{
+     auto [found, added] = names.try_emplace(name, "n" + std::to_string(names.size()));
+     if (added)     constants += "lox::string* const " + found->second + " = lox::intern(" + quote(name) + ");\n";
+
+     return found->second;
+}
+
+
+std::string Emitter::string_of (const std::string& text)
+{
+     auto [found, added] = strings.try_emplace(text, "s" + std::to_string(strings.size()));
+     if (added)     constants += "const lox::value " + found->second + " {lox::intern(" + quote(text) + ")};\n";
+
+     return found->second;
+}
+
+
+std::string Emitter::new_cache ()
+{
+     std::string name = "cache" + std::to_string(caches++);
+     constants += "lox::site_cache " + name + ";\n";
+
+     return name;
+}
+
+// =====================================================================================================================
+// Interpreter
+// =====================================================================================================================
+// Walks the syntax tree with the values and operations of lox-runtime.h, as the interpreters of the book do, so the
+// translated code can be measured against it. Each call has a frame holding the locals of its function by slot, or
+// their cells when closures capture them. Properties and methods are looked up by name at every access.
+class Interpreter {
+public:
+     Interpreter (const program& p);
+
+     int run ();
+
+
+private:
+     struct closure;
+
+     struct frame
+     {
+          const function_info*            function;
+          std::vector<lox::stored>        values;       // of its locals, by slot
+          std::vector<lox::cell*>         cells;        // of its captured locals, by slot
+          const std::vector<lox::cell*>*  free;         // of its closure, in the order of function_info::free
+          lox::value                      result = lox::nil;
+     };
+
+     enum class flow { next, returned };
+
+     const program& p;
+
+     std::vector<int>          slot;          // of each variable, in the frame of its function or among the globals
+     std::vector<int>          locals;        // of each function
+     std::vector<lox::stored>  globals;
+     frame*                    current = nullptr;
+
+     std::unordered_map<const expr*, lox::value> literals;
+
+     lox::value call (const closure& c, lox::value self, const lox::value* args);
+     lox::function* make_closure (const function_info& f);
+
+     flow execute (const stmt& s);
+     lox::value evaluate (const expr& e);
+     lox::value literal (const expr& e);
+     lox::value call (const expr& e);
+
+     // Variables
+     lox::cell* cell_of (const variable& v);
+     lox::value read (const variable& v, int line);
+     lox::value assign (const variable& v, lox::value x, int line);
+     void define (const variable& v, lox::value x);
+     void store (const variable& v, lox::value x);
+};
+
+
+struct Interpreter::closure final : lox::function
+{
+     Interpreter&             interpreter;
+     const function_info&     info;
+     std::vector<lox::cell*>  free;
+
+     closure (Interpreter& interpreter, const function_info& info, std::vector<lox::cell*> free)
+          : lox::function {info.name->lexeme.c_str(), static_cast<int>(info.parameters.size())},
+            interpreter {interpreter}, info {info}, free {std::move(free)}
+     {}
+
+     lox::value call (lox::value self, const lox::value* args) override
+     {
+          return interpreter.call(*this, self, args);
+     }
+};
+
+
+Interpreter::Interpreter (const program& p) : p {p}, slot(p.variables.size()), locals(p.functions.size())
+{
+     int global_slots = 0;
+
+     for (auto& v : p.variables)     slot[v->id] = v->owner ? locals[v->owner->id]++ : global_slots++;
+
+     globals.resize(global_slots, lox::undefined);
+     if (auto clock = p.globals.find("clock"); clock != p.globals.end())
+          globals[slot[clock->second->id]] = new lox::native_clock;
+}
+
+
+int Interpreter::run ()
+{
+     const function_info& script = *p.functions.front();
+     int n = locals[script.id];
+
+     std::vector<lox::cell*> none;
+     frame f {&script, std::vector<lox::stored>(n), std::vector<lox::cell*>(n), &none};
+     current = &f;
+
+     return lox::run([&] {
+          for (auto& s : script.body)     execute(*s);
+     });
+}
+
+
+lox::value Interpreter::call (const closure& c, lox::value self, const lox::value* args)
+{
+     const function_info& info = c.info;
+     int n = locals[info.id];
+
+     frame f {&info, std::vector<lox::stored>(n), std::vector<lox::cell*>(n), &c.free};
+     frame* caller = std::exchange(current, &f);
+
+     if (info.self)     define(*info.self, self);
+     for (std::size_t i = 0; i < info.arguments.size(); ++i)     define(*info.arguments[i], args[i]);
+
+     for (auto& s : info.body)
+          if (execute(*s) == flow::returned)     break;
+
+     lox::value result = info.kind == function_kind::initializer ? read(*info.self, 0) : f.result;
+
+     current = caller;
+     return result;
+}
+
+
+lox::function* Interpreter::make_closure (const function_info& f)
+{
+     std::vector<lox::cell*> cells;
+     for (variable* v : f.free)     cells.push_back(cell_of(*v));
+
+     return new closure {*this, f, std::move(cells)};
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Statements
+// ---------------------------------------------------------------------------------------------------------------------
+Interpreter::flow Interpreter::execute (const stmt& s)
+{
+     switch (s.kind)
+     {
+          case stmt_kind::expression:
+               evaluate(*s.value);
+               break;
+
+          case stmt_kind::print:
+               lox::print(evaluate(*s.value));
+               break;
+
+          case stmt_kind::var:
+               define(*s.target, s.value ? evaluate(*s.value) : lox::nil);
+               break;
+
+          case stmt_kind::block:
+               for (auto& b : s.body)
+                    if (execute(*b) == flow::returned)     return flow::returned;
+               break;
+
+          case stmt_kind::if_else:
+               if (lox::truthy(evaluate(*s.value)))     return execute(*s.body[0]);
+               if (s.body.size() > 1)                  return execute(*s.body[1]);
+               break;
+
+          // Each iteration starts where no temporary is alive, as in the translated code
+          case stmt_kind::loop:
+               while (!s.value || lox::truthy(evaluate(*s.value)))
+               {
+                    lox::collect_garbage();
+                    if (execute(*s.body[0]) == flow::returned)     return flow::returned;
+               }
+               break;
+
+          case stmt_kind::function:
+               define(*s.target, lox::nil);
+               store(*s.target, make_closure(*s.function));
+               break;
+
+          case stmt_kind::return_value:
+               current->result = s.value ? evaluate(*s.value) : lox::nil;
+               return flow::returned;
+
+          case stmt_kind::class_decl:
+          {
+               int line = s.token->line;
+               lox::value superclass = lox::nil;
+
+               define(*s.target, lox::nil);
+
+               if (s.value)
+               {
+                    define(*s.super_var, evaluate(*s.value));
+                    superclass = read(*s.super_var, line);
+               }
+
+               lox::klass* k = lox::new_class(s.token->lexeme.c_str(), superclass, line);
+               for (function_info* m : s.methods)     k->define(lox::intern(m->name->lexeme), make_closure(*m));
+
+               store(*s.target, k);
+               break;
+          }
+     }
+
+     return flow::next;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Expressions
+// ---------------------------------------------------------------------------------------------------------------------
+lox::value Interpreter::evaluate (const expr& e)
+{
+     const TokenBase& t = *e.token;
+
+     switch (e.kind)
+     {
+          case expr_kind::literal:      return literal(e);
+          case expr_kind::grouping:     return evaluate(*e.operands[0]);
+          case expr_kind::variable:     return read(*e.target, t.line);
+          case expr_kind::self:         return read(*e.target, t.line);
+          case expr_kind::assign:       return assign(*e.target, evaluate(*e.operands[0]), t.line);
+
+          case expr_kind::unary:
+               if (t.type == TokenType::BANG)     return !lox::truthy(evaluate(*e.operands[0]));
+               return lox::negate(evaluate(*e.operands[0]), t.line);
+
+          case expr_kind::binary:
+          {
+               lox::operands o {evaluate(*e.operands[0]), evaluate(*e.operands[1])};
+
+               switch (t.type)
+               {
+                    case TokenType::PLUS:            return lox::add(o, t.line);
+                    case TokenType::MINUS:           return lox::subtract(o, t.line);
+                    case TokenType::STAR:            return lox::multiply(o, t.line);
+                    case TokenType::SLASH:           return lox::divide(o, t.line);
+                    case TokenType::GREATER:         return lox::greater(o, t.line);
+                    case TokenType::GREATER_EQUAL:   return lox::greater_equal(o, t.line);
+                    case TokenType::LESS:            return lox::less(o, t.line);
+                    case TokenType::LESS_EQUAL:      return lox::less_equal(o, t.line);
+                    case TokenType::EQUAL_EQUAL:     return lox::equal(o);
+                    default:                         return lox::not_equal(o);
+               }
+          }
+
+          // The right operand is evaluated only when the left does not decide the result
+          case expr_kind::logical:
+          {
+               lox::value l = evaluate(*e.operands[0]);
+               if (lox::truthy(l) == (t.type == TokenType::OR))     return l;
+
+               return evaluate(*e.operands[1]);
+          }
+
+          case expr_kind::call:     return call(e);
+
+          case expr_kind::get:
+          {
+               lox::site_cache cache;
+               return lox::get(evaluate(*e.operands[0]), lox::intern(t.lexeme), cache, t.line);
+          }
+
+          case expr_kind::set:
+          {
+               lox::operands   o {evaluate(*e.operands[0]), evaluate(*e.operands[1])};
+               lox::site_cache cache;
+               return lox::set(o, lox::intern(t.lexeme), cache, t.line);
+          }
+
+          case expr_kind::super:
+               return lox::super_method(read(*e.target, t.line), read(*e.self, t.line), lox::intern(t.lexeme),
+                                        t.line);
+     }
+
+     return lox::nil;
+}
+
+
+lox::value Interpreter::literal (const expr& e)
+{
+     const TokenBase& t = *e.token;
+
+     switch (t.type)
+     {
+          case TokenType::TRUE:      return true;
+          case TokenType::FALSE:     return false;
+          case TokenType::NIL:       return lox::nil;
+          default:                   break;
+     }
+
+     auto [found, added] = literals.try_emplace(&e);
+
+     if (added)
+          found->second = t.type == TokenType::NUMBER ? lox::value {std::strtod(t.lexeme.c_str(), nullptr)}
+                                                      : lox::intern(t.lexeme.substr(1, t.lexeme.size() - 2));
+     return found->second;
+}
+
+
+// The callee and arguments are evaluated in order. A method called on an instance is not bound first.
+lox::value Interpreter::call (const expr& e)
+{
+     const expr& callee = *e.operands[0];
+     std::vector<lox::value> list;
+
+     list.push_back(evaluate(callee.kind == expr_kind::get ? *callee.operands[0] : callee));
+     for (std::size_t i = 1; i < e.operands.size(); ++i)     list.push_back(evaluate(*e.operands[i]));
+
+     int count = static_cast<int>(list.size()) - 1;
+     int line  = e.token->line;
+
+     if (callee.kind != expr_kind::get)     return lox::call_with(list[0], list.data() + 1, count, line);
+
+     lox::site_cache cache;
+     return lox::invoke_with(list[0], list.data() + 1, count, lox::intern(callee.token->lexeme), cache, line);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Variables
+// ---------------------------------------------------------------------------------------------------------------------
+// A captured variable is in a cell of the frame declaring it, which its closures, and those between, carry inwards
+lox::cell* Interpreter::cell_of (const variable& v)
+{
+     if (v.owner == current->function)     return current->cells[slot[v.id]];
+
+     auto& free = current->function->free;
+     return (*current->free)[std::find(free.begin(), free.end(), &v) - free.begin()];
+}
+
+
+lox::value Interpreter::read (const variable& v, int line)
+{
+     if (!v.owner)        return lox::read_global(globals[slot[v.id]], v.name.c_str(), line);
+     if (v.captured)      return cell_of(v)->v;
+
+     return current->values[slot[v.id]];
+}
+
+
+lox::value Interpreter::assign (const variable& v, lox::value x, int line)
+{
+     if (!v.owner)        return lox::assign_global(globals[slot[v.id]], x, v.name.c_str(), line);
+
+     store(v, x);
+     return x;
+}
+
+
+void Interpreter::define (const variable& v, lox::value x)
+{
+     if (v.owner && v.captured)     current->cells[slot[v.id]] = lox::new_cell(x);
+     else                           store(v, x);
+}
+
+
+void Interpreter::store (const variable& v, lox::value x)
+{
+          if (!v.owner)        globals[slot[v.id]] = x;
+     else if (v.captured)      cell_of(v)->v = x;
+     else                      current->values[slot[v.id]] = x;
+}
+
+} // namespace
+
+
+// =====================================================================================================================
+// Driver
+// =====================================================================================================================
+#ifndef LOX_RUNTIME_DIR
+#define LOX_RUNTIME_DIR ""
+#endif
+
+
+int main (int argc, char* argv[])
+{
+     const char* usage = "Usage: lox-compile script.lox [-o script.cpp] [--build executable [--benchmark]] "
+                         "[--runtime directory] [--interpret]\n";
+
+     std::string input, output, executable, runtime = LOX_RUNTIME_DIR;
+     bool        interpret = false, benchmark = false;
+
+     for (int i = 1; i < argc; ++i)
+     {
+          std::string_view arg = argv[i];
+
+               if (arg == "-o"          && i + 1 < argc)     output     = argv[++i];
+          else if (arg == "--build"     && i + 1 < argc)     executable = argv[++i];
+          else if (arg == "--runtime"   && i + 1 < argc)     runtime    = argv[++i];
+          else if (arg == "--interpret")                     interpret  = true;
+          else if (arg == "--benchmark")                     benchmark  = true;
+          else if (input.empty() && arg[0] != '-')           input      = arg;
+          else
+          {
+               std::cerr << usage;
+               return 64;
+          }
+     }
+
+     if (input.empty() || (benchmark && executable.empty()))
+     {
+          std::cerr << usage;
+          return 64;
+     }
+
+     if (!executable.empty() && runtime.empty())
+     {
+          std::cerr << "Building needs the directory of lox-runtime.h, given by --runtime\n";
+          return 64;
+     }
+
+     if (output.empty())     output = std::filesystem::path {input}.replace_extension(".cpp").string();
+
+     std::string source;
+
+     try {
+          source = get_file_contents(input);
+     }
+     catch (int) {
+          std::cerr << "Cannot read " << input << "\n";
+          return 66;
+     }
+
+     Scanner scanner(source);
+     auto& tokens = scanner.scan_tokens();
+
+     if (had_error)
+     {
+          std::cout << "\n";
+          return 65;
+     }
+
+     program p;
+     Parser {tokens, p}.parse();
+     if (!had_error)     Resolver {p}.resolve();
+     if (had_error)      return 65;
+
+     if (interpret)     return Interpreter {p}.run();
+
+     std::ofstream {output} << Emitter {p}.emit();
+     if (executable.empty())     return 0;
+
+     const char* compiler = std::getenv("CXX");
+     std::string command  = std::string {compiler ? compiler : "c++"} + " -std=c++20 -O2 -I'" + runtime +
+                            "' '" + output + "' -o '" + executable + "'";
+
+     if (std::system(command.c_str()) != 0)     return 1;
+     if (!benchmark)                            return 0;
+
+     // Both runs print the output of the script
+     using clock = std::chrono::steady_clock;
+     using seconds = std::chrono::duration<double>;
+
+     auto start = clock::now();
+     if (int status = Interpreter {p}.run(); status != 0)     return status;
+     std::fflush(stdout);
+     double interpreted = seconds {clock::now() - start}.count();
+
+     start = clock::now();
+     if (std::system(("'" + std::filesystem::absolute(executable).string() + "'").c_str()) != 0)     return 1;
+     double translated = seconds {clock::now() - start}.count();
+
+     std::cerr << "interpreted: " << interpreted << " s, translated: " << translated << " s, speedup: "
+               << interpreted / translated << "x\n";
+     return 0;
+}
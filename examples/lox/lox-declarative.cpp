@@ -37,6 +37,29 @@ public:
      bool      has_more   ()     { return scanner.has_more(); }
      lox_token next_token ()     { non_token(scanner); return lexer(scanner); }
 
+     // Lexes only to check the source. The scanners are those of the lexer, but no token is built, no number
+     // converted, and no keyword looked up.
+     lox_validation validate ()
+     {
+          const char* first = scanner.data();
+          lox_validation v {.lines = count_lines({first, scanner.size()})};
+
+          while (LoxScan::nontoken(scanner), scanner.has_more())
+          {
+               scanner.save();
+               ++v.tokens;
+
+               if (validator(scanner))     continue;
+
+               // As in lexer, an unterminated string is one error token to the end of the source, not an error at its
+               // quote followed by tokens lexed from its contents
+               if (!LoxScan::partial_string(scanner))     ++scanner;
+               v.error(scanner.skipped().data() - first);
+          }
+
+          return v;
+     }
+
 private:
      scan_view scanner;
 
@@ -49,9 +72,16 @@ private:
           { PatDef::otherwise, unknown }
      )
 
-     inline lox_token make_token (TokenType tag, lox_token_value value = empty)
+     // The scanners of lexer, without its actions. An unterminated string fails.
+     pattern validator = any(any("!=", "==", "<=", ">="),
+                             any('(', ')', '{', '}', ',', '.', '-', '+', ';', '*', '!', '<', '>', '/'),
+                             join(LoxScan::partial_string, '"'),
+                             LoxScan::number,
+                             LoxScan::identifier);
+
+     inline lox_token make_token (TokenType tag)
      {
-          return {tag, value, scanner.skipped()};
+          return {tag, scanner.skipped()};
      }
 
      std::optional<lox_token> double_symbols (scan_view& s)
@@ -93,30 +123,28 @@ private:
 
      lox_token string (parse_tree match)
      {
-          auto [_, contents] = match;
-
-          if (s.eof())    return {TokenType::ERROR, "Unterminated string."sv, match.lexeme()};
+          if (s.eof())    return {TokenType::ERROR, match.lexeme()};
 
           ++s;
-          return {TokenType::STRING, contents, match.lexeme()};
+          return make_token(TokenType::STRING);
      }
 
      lox_token number (parse_tree match)
      {
-          return make_token(TokenType::NUMBER, std::stod(to_string(match.lexeme())));
+          return {TokenType::NUMBER, match.lexeme()};
      }
 
      lox_token identifier (parse_tree match)
      {
           auto keyword = keywords.find(match);
 
-          if (keyword != keywords.end())     return {keyword->second, empty, match.lexeme()};
-          else                               return make_token(TokenType::IDENTIFIER, match.lexeme());
+          if (keyword != keywords.end())     return {keyword->second, match.lexeme()};
+          else                               return {TokenType::IDENTIFIER, match.lexeme()};
      }
 
      lox_token unknown (parse_tree match)
      {
-          return {TokenType::ERROR, "Unexpected character: "sv, match.lexeme()};
+          return {TokenType::ERROR, match.lexeme()};
      }
 
 }; // class LoxLexer
@@ -75,12 +75,36 @@ public:
           return choice(symbol, string, number, identifier, unknown);
      }
 
+
+     // Lexes only to check the source. The scanners are those of next, but no token is built, no number converted,
+     // and no keyword looked up.
+     lox_validation validate ()
+     {
+          const char* first = s.data();
+          lox_validation v {.lines = count_lines({first, s.size()})};
+
+          while (advance_while(s, fn::any(whitespace, line_comment)), s.has_more())
+          {
+               s.save();
+               ++v.tokens;
+
+               if (scan_symbol() || LoxScan::number(s) || LoxScan::identifier(s))     continue;
+
+               if (!LoxScan::partial_string(s))     ++s;
+               else if (!s.eof())                   { ++s; continue; }
+
+               v.error(s.skipped().data() - first);
+          }
+
+          return v;
+     }
+
 private:
      scan_view s;
 
-     lox_token make_token (TokenType type, lox_token_value value = empty)
+     lox_token make_token (TokenType type)
      {
-          return {type, value, s.skipped()};
+          return {type, s.skipped()};
      }
 
      std::optional<lox_token> symbol ()
@@ -112,20 +136,46 @@ private:
           }
      }
 
+     // The scanner of symbol
+     bool scan_symbol ()
+     {
+          switch (*s)
+          {
+               case '(' :
+               case ')' :
+               case '{' :
+               case '}' :
+               case ',' :
+               case '.' :
+               case '-' :
+               case '+' :
+               case ';' :
+               case '*' :
+               case '/' :     ++s; return true;
+
+               case '!' :
+               case '=' :
+               case '<' :
+               case '>' :     ++s; lit('='); return true;
+
+               default  :     return false;
+          }
+     }
+
      std::optional<lox_token> string ()
      {
           if (!LoxScan::partial_string(s))     return {};
 
-          if (s.eof())     return make_token(TokenType::ERROR, "Unterminated string."sv);
+          if (s.eof())     return make_token(TokenType::ERROR);
 
           ++s;
-          return make_token(TokenType::STRING, s.skipped(0, 2));
+          return make_token(TokenType::STRING);
      }
 
      std::optional<lox_token> number ()
      {
           if (!LoxScan::number(s))     return {};
-          return make_token(TokenType::NUMBER, std::stod(s.copy_skipped()));
+          return make_token(TokenType::NUMBER);
      }
 
      std::optional<lox_token> identifier ()
@@ -137,12 +187,12 @@ private:
           auto keyword = keywords.find(match);
 
           if (keyword != keywords.end())     return make_token(keyword->second);
-          else                               return make_token(TokenType::IDENTIFIER, match);
+          else                               return make_token(TokenType::IDENTIFIER);
      }
 
      std::optional<lox_token> unknown ()
      {
-          return make_token(TokenType::ERROR, "Unexpected character: "sv);
+          return make_token(TokenType::ERROR);
      }
 
 }; // class LoxLexer
@@ -32,55 +32,43 @@ public:
 
      lox_token next ()
      {
-          using namespace TokenTypeMembers;
-
-          s.save();
+          TokenType type = TokenType::NONE;
+          while (type == TokenType::NONE && s.has_more())     type = scan_token();
 
-          switch (*s++)
-          {
-               // single symbols
-               case '('  :     return make_token(LEFT_PAREN);
-               case ')'  :     return make_token(RIGHT_PAREN);
-               case '{'  :     return make_token(LEFT_BRACE);
-               case '}'  :     return make_token(RIGHT_BRACE);
-               case ','  :     return make_token(COMMA);
-               case '.'  :     return make_token(DOT);
-               case '-'  :     return make_token(MINUS);
-               case '+'  :     return make_token(PLUS);
-               case ';'  :     return make_token(SEMICOLON);
-               case '*'  :     return make_token(STAR);
+          if (type == TokenType::NONE)           return make_token(TokenType::END);
+          if (type == TokenType::IDENTIFIER)     return identifier();
 
-               case ' '  :
-               case '\r' :
-               case '\t' :
-               case '\n' :     break;    // Ignore whitespace
+          return make_token(type);
+     }
 
 
-               // double symbols
-               case '!'  :     return make_token(match('=') ? BANG_EQUAL    : BANG);
-               case '='  :     return make_token(match('=') ? EQUAL_EAUAL   : EQUAL);
-               case '<'  :     return make_token(match('=') ? LESS_EQUAL    : LESS);
-               case '>'  :     return make_token(match('=') ? GREATER_EQUAL : GREATER);
-               case '/'  :     return *s == '/' ? skip_comment(++s) : make_token(SLASH);
+     // Lexes only to check the source. The dispatch is that of next, but no token is built, no number converted, and
+     // no keyword looked up.
+     lox_validation validate ()
+     {
+          const char* first = s.data();
+          lox_validation v {.lines = count_lines({first, s.size()})};
 
+          while (s.has_more())
+          {
+               TokenType type = scan_token();
 
-               // larger tokens
-               default  :
-                    if (LoxScan::partial_string(s))     return string();
-                    if (LoxScan::number(s))             return make_token(NUMBER, std::stod(s.copy_skipped()));
-                    if (LoxScan::identifier(s))         return identifier();
+               if (type == TokenType::NONE)      continue;
+               if (type == TokenType::ERROR)     v.error(s.skipped().data() - first);
 
-                    return make_token(ERROR, "Unexpected character: "sv);
+               ++v.tokens;
           }
+
+          return v;
      }
 
 
 private:
      scan_view s;
 
-     lox_token make_token (TokenType type, lox_token_value value = empty)
+     lox_token make_token (TokenType type)
      {
-          return {type, value, s.skipped()};
+          return {type, s.skipped()};
      }
 
      bool match (char expected)
@@ -91,28 +79,68 @@ private:
           return true;
      }
 
-     lox_token skip_comment ()
+     // Scans one lexeme and returns its type. Whitespace and comments are NONE, and a keyword is an IDENTIFIER, which
+     // next looks up.
+     TokenType scan_token ()
      {
-          LoxScan::comment_end(s);
-          return next_token();
+          using namespace TokenTypeMembers;
+
+          s.save();
+
+          switch (*s)
+          {
+               // single symbols
+               case '('  :     ++s; return LEFT_PAREN;
+               case ')'  :     ++s; return RIGHT_PAREN;
+               case '{'  :     ++s; return LEFT_BRACE;
+               case '}'  :     ++s; return RIGHT_BRACE;
+               case ','  :     ++s; return COMMA;
+               case '.'  :     ++s; return DOT;
+               case '-'  :     ++s; return MINUS;
+               case '+'  :     ++s; return PLUS;
+               case ';'  :     ++s; return SEMICOLON;
+               case '*'  :     ++s; return STAR;
+
+               case ' '  :
+               case '\r' :
+               case '\t' :
+               case '\n' :     ++s; return NONE;    // Ignore whitespace
+
+
+               // double symbols
+               case '!'  :     ++s; return match('=') ? BANG_EQUAL    : BANG;
+               case '='  :     ++s; return match('=') ? EQUAL_EQUAL   : EQUAL;
+               case '<'  :     ++s; return match('=') ? LESS_EQUAL    : LESS;
+               case '>'  :     ++s; return match('=') ? GREATER_EQUAL : GREATER;
+               case '/'  :     return *++s == '/' && LoxScan::comment_end(s) ? NONE : SLASH;
+
+
+               // larger tokens
+               default   :
+                    if (LoxScan::partial_string(s))     return string();
+                    if (LoxScan::number(s))             return NUMBER;
+                    if (LoxScan::identifier(s))         return IDENTIFIER;
+
+                    ++s;
+                    return ERROR;
+          }
      }
 
      lox_token identifier ()
      {
-          std::string_view match = s.skipped();
-
-          auto keyword = keywords.find(match);
+          auto keyword = keywords.find(s.skipped());
 
           if (keyword != keywords.end())     return make_token(keyword->second);
-          else                               return make_token(TokenType::IDENTIFIER, match);
+          else                               return make_token(TokenType::IDENTIFIER);
      }
 
-     lox_token string ()
+     // Past the closing quote, which partial_string stops at
+     TokenType string ()
      {
-          if (s.eof())     return make_token(TokenType::ERROR, "Unterminated string."sv);
+          if (s.eof())     return TokenType::ERROR;
 
           ++s;
-          return make_token(TokenType::STRING, s.skipped(0, 2));
+          return TokenType::STRING;
      }
 
 }; // class LoxLexer
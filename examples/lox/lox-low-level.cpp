@@ -19,6 +19,60 @@ public:
      bool has_more ()     { return s.has_more(); }
 
      lox_token next ()
+     {
+          TokenType type = TokenType::NONE;
+          while (type == TokenType::NONE && s.has_more())     type = scan_token();
+
+          if (type == TokenType::NONE)           return make_token(TokenType::END);
+          if (type == TokenType::IDENTIFIER)     return identifier();
+
+          return make_token(type);
+     }
+
+
+     // Lexes only to check the source. The dispatch is that of next, but no token is built, no number converted, and
+     // no keyword looked up.
+     lox_validation validate ()
+     {
+          const char* first = s.data();
+          lox_validation v {.lines = count_lines({first, s.size()})};
+
+          while (s.has_more())
+          {
+               TokenType type = scan_token();
+
+               if (type == TokenType::NONE)      continue;
+               if (type == TokenType::ERROR)     v.error(s.skipped().data() - first);
+
+               ++v.tokens;
+          }
+
+          return v;
+     }
+
+
+private:
+     scan_view s;
+
+     lox_token make_token (TokenType type)
+     {
+          return {type, s.skipped()};
+     }
+
+     bool match (char expected)
+     {
+          if (*s != expected)     return false;
+
+          ++s;
+          return true;
+     }
+
+     // --------------------------------------------------
+     // Scanner core, shared by next and validate
+     // --------------------------------------------------
+     // Scans one lexeme and returns its type. Whitespace and comments are NONE, and a keyword is an IDENTIFIER, which
+     // next looks up.
+     TokenType scan_token ()
      {
           s.save();
           char c = *s++;
@@ -28,75 +82,60 @@ public:
                using namespace TokenTypeMembers;
 
                // single symbols
-               case '('  :     return make_token(LEFT_PAREN);
-               case ')'  :     return make_token(RIGHT_PAREN);
-               case '{'  :     return make_token(LEFT_BRACE);
-               case '}'  :     return make_token(RIGHT_BRACE);
-               case ','  :     return make_token(COMMA);
-               case '.'  :     return make_token(DOT);
-               case '-'  :     return make_token(MINUS);
-               case '+'  :     return make_token(PLUS);
-               case ';'  :     return make_token(SEMICOLON);
-               case '*'  :     return make_token(STAR);
+               case '('  :     return LEFT_PAREN;
+               case ')'  :     return RIGHT_PAREN;
+               case '{'  :     return LEFT_BRACE;
+               case '}'  :     return RIGHT_BRACE;
+               case ','  :     return COMMA;
+               case '.'  :     return DOT;
+               case '-'  :     return MINUS;
+               case '+'  :     return PLUS;
+               case ';'  :     return SEMICOLON;
+               case '*'  :     return STAR;
 
                case ' '  :
                case '\r' :
                case '\t' :
-               case '\n' :     break;    // Ignore whitespace
+               case '\n' :     return NONE;    // Ignore whitespace
 
 
                // double symbols
-               case '!'  :     return make_token(match('=') ? BANG_EQUAL    : BANG);
-               case '='  :     return make_token(match('=') ? EQUAL_EAUAL   : EQUAL);
-               case '<'  :     return make_token(match('=') ? LESS_EQUAL    : LESS);
-               case '>'  :     return make_token(match('=') ? GREATER_EQUAL : GREATER);
+               case '!'  :     return match('=') ? BANG_EQUAL    : BANG;
+               case '='  :     return match('=') ? EQUAL_EQUAL   : EQUAL;
+               case '<'  :     return match('=') ? LESS_EQUAL    : LESS;
+               case '>'  :     return match('=') ? GREATER_EQUAL : GREATER;
 
                case '/'  :
-                    if (*s != '/')     return make_token(SLASH);
+                    if (*s != '/')     return SLASH;
 
-                    while (*s != '\n' && !s.eof())    ++s;     // line comment
-                    return next_token();
+                    skip_comment();
+                    return NONE;
 
 
                // larger tokens
-               case '"' :      return string();
+               case '"' :      return scan_string() ? STRING : ERROR;
 
                default  :
-                    if      (is_digit(c))      return number();
-                    else if (is_letter(c))     return identifier();
-                    else                       return make_token(ERROR, "Unexpected character: "sv);
+                    if      (is_digit(c))      { scan_number(); return NUMBER; }
+                    else if (is_letter(c))     { scan_identifier(); return IDENTIFIER; }
+                    else                       return ERROR;
           }
      }
 
-
-private:
-     scan_view s;
-
-     lox_token make_token (TokenType type, lox_token_value value = empty)
+     // --------------------------------------------------
+     // Scanners
+     // --------------------------------------------------
+     void skip_comment ()
      {
-          return {type, value, s.skipped()};
+          while (*s != '\n' && !s.eof())    ++s;
      }
 
-     bool match (char expected)
-     {
-          if (*s != expected)     return false;
-
-          ++s;
-          return true;
-     }
-
-     lox_token identifier ()
+     void scan_identifier ()
      {
           while (is_alphanumeric(*s))    ++s;
-          std::string_view match = s.skipped();
-
-          auto keyword = keywords.find(match);
-
-          if (keyword != keywords.end())     return make_token(keyword->second);
-          else                               return make_token(TokenType::IDENTIFIER, match);
      }
 
-     lox_token number ()
+     void scan_number ()
      {
           while (is_digit(*s))    ++s;
 
@@ -105,19 +144,30 @@ private:
                s += 2;
                while (is_digit(*s))     ++s;
           }
-
-          return make_token(TokenType::NUMBER, std::stod(s.copy_skipped()));
      }
 
-     lox_token string ()
+     // Past the closing quote. Returns false if there is none.
+     bool scan_string ()
      {
           while (s.has_more())
           {
-               if (match('"'))     return make_token(TokenType::STRING, s.skipped(0, 2));
+               if (match('"'))     return true;
                ++s;
           }
 
-          return make_token(TokenType::ERROR, "Unterminated string."sv);
+          return false;
+     }
+
+
+     // --------------------------------------------------
+     // Tokens
+     // --------------------------------------------------
+     lox_token identifier ()
+     {
+          auto keyword = keywords.find(s.skipped());
+
+          if (keyword != keywords.end())     return make_token(keyword->second);
+          else                               return make_token(TokenType::IDENTIFIER);
      }
 
 }; // class LoxLexer
@@ -0,0 +1,684 @@
+// The runtime of Lox programs translated to C++ by lox-compile.cpp, and of its interpreter
+//
+// Values are tagged: nil, a boolean, a number, or a pointer to an object. The strings of the source and the names of
+// properties are interned, so comparing them, and looking up a property by name, compares pointers. A function is a
+// struct holding the cells of the variables it captures, and implementing call. A class gives each property name a slot
+// the first time any of its instances sets it, and its instances hold their fields in a vector indexed by slot, so a
+// property is found by the cache at its site in the translated code, without hashing, as long as the site sees one
+// class.
+//
+// A string made by concatenation is not interned, and is compared by content. It is freed once no variable or field
+// holds it and no temporary can still point to it. Other objects live until the program exits, since translated
+// scripts are short-lived.
+
+#pragma once
+
+#include <algorithm>       // std::max
+#include <charconv>        // std::to_chars
+#include <chrono>
+#include <cmath>           // std::fabs, std::isinf, std::isnan
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>         // std::move
+#include <vector>
+
+
+namespace lox {
+
+struct object;
+struct string;
+struct function;
+struct klass;
+struct instance;
+
+
+// =====================================================================================================================
+// Values
+// =====================================================================================================================
+enum class tag : std::uint8_t { undefined, nil, boolean, number, object };
+
+enum class kind : std::uint8_t { string, function, bound_method, klass, instance };
+
+
+struct object
+{
+     kind type;
+};
+
+
+struct value
+{
+     tag  t       = tag::nil;
+     bool counted = false;     // points to a string made at run time, whose references are counted
+
+     union
+     {
+          bool    boolean;
+          double  number;
+          object* pointer;
+     };
+
+     constexpr value ()                noexcept : number {0}                         {}
+     constexpr value (bool b)          noexcept : t {tag::boolean}, boolean {b}      {}
+     constexpr value (double n)        noexcept : t {tag::number}, number {n}        {}
+     constexpr value (object* o)       noexcept : t {tag::object}, pointer {o}       {}
+     constexpr value (tag t)           noexcept : t {t}, number {0}                  {}
+
+     constexpr bool is_number () const noexcept     { return t == tag::number; }
+     constexpr bool is (kind k) const noexcept      { return t == tag::object && pointer->type == k; }
+};
+
+inline constexpr value nil       {tag::nil};
+inline constexpr value undefined {tag::undefined};     // a global not yet defined, or a field not yet set
+
+
+// A value held by a variable or a field, which counts as a reference to the string made at run time it points to.
+// Temporaries are plain values, so copying one costs nothing.
+class stored
+{
+public:
+     stored (const value& v = nil) noexcept : v {v}     { retain(v); }
+     stored (const stored& s) noexcept : v {s.v}        { retain(v); }
+
+     stored& operator= (const value& x) noexcept
+     {
+          retain(x);
+          release(v);
+          v = x;
+          return *this;
+     }
+
+     stored& operator= (const stored& s) noexcept     { return *this = s.v; }
+
+     ~stored ()     { release(v); }
+
+     // Read into a temporary of the current call
+     operator value () const noexcept;
+
+     bool is_undefined () const noexcept     { return v.t == tag::undefined; }
+
+private:
+     value v;
+
+     static void retain (const value& v) noexcept;
+     static void release (const value& v) noexcept;
+};
+
+
+// A variable captured by a closure
+struct cell
+{
+     stored v;
+};
+
+inline cell* new_cell (value v)     { return new cell {v}; }
+
+
+// =====================================================================================================================
+// Errors
+// =====================================================================================================================
+struct runtime_error : std::runtime_error
+{
+     int line;
+
+     runtime_error (const std::string& message, int line) : std::runtime_error {message}, line {line} {}
+};
+
+[[noreturn]] inline void fail (const std::string& message, int line)     { throw runtime_error {message, line}; }
+
+
+// =====================================================================================================================
+// Strings
+// =====================================================================================================================
+struct string : object
+{
+     std::string text;
+
+     // Of a string made at run time
+     std::uint32_t references   = 0;         // by variables and fields
+     int           depth        = 0;         // of the shallowest call whose temporaries may point to it
+     bool          unreferenced = false;     // listed for collection
+};
+
+
+inline string* intern (std::string_view text)
+{
+     static std::unordered_map<std::string_view, string*> table;
+
+     if (auto found = table.find(text); found != table.end())     return found->second;
+
+     auto s = new string {{kind::string}, std::string {text}};
+     table.emplace(s->text, s);
+     return s;
+}
+
+inline string* as_string (value v)     { return static_cast<string*>(v.pointer); }
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Strings made at run time
+// ---------------------------------------------------------------------------------------------------------------------
+// A string that no variable or field holds is listed as unreferenced, and freed when the program reaches a point where
+// no temporary can point to it. Such points are the start of an iteration of a loop, where no temporary of the current
+// call is alive, and the return from a call, after which the temporaries of deeper calls are gone. A string remembers
+// the shallowest call whose temporaries may point to it: the one that made it, read it from a variable or field, or
+// received it as a result. The list is collected when it has doubled, so the points cost a comparison, and the work on
+// such strings is kept out of line, so values of other types pay a test of a flag.
+
+// Deeper calls fail as a runtime error, as in the interpreters of the book, rather than overflowing the native stack
+inline constexpr int max_call_depth = 4096;
+inline int           call_depth     = 0;
+
+inline std::vector<string*> unreferenced;
+inline std::size_t          next_collection = 256;
+
+
+inline void list_unreferenced (string* s)
+{
+     if (s->unreferenced)     return;
+
+     s->unreferenced = true;
+     unreferenced.push_back(s);
+}
+
+
+inline value new_string (std::string text)
+{
+     auto s = new string {{kind::string}, std::move(text), 0, call_depth};
+     list_unreferenced(s);
+
+     value v {s};
+     v.counted = true;
+     return v;
+}
+
+
+// Notes that the temporaries of the current call may point to a string made at run time
+[[gnu::noinline]] inline void seen (string* s) noexcept
+{
+     if (s->depth > call_depth)     s->depth = call_depth;
+}
+
+inline void seen (const value& v) noexcept
+{
+     if (v.counted) [[unlikely]]     seen(as_string(v));
+}
+
+
+[[gnu::noinline]] inline void drop (string* s)
+{
+     if (--s->references == 0)     list_unreferenced(s);
+}
+
+
+// Frees the unreferenced strings that only the temporaries of calls at least as deep as depth could point to
+[[gnu::noinline]] inline void collect (int depth)
+{
+     std::erase_if(unreferenced, [depth] (string* s)
+     {
+          if (s->references > 0)
+          {
+               s->unreferenced = false;
+               return true;
+          }
+
+          if (s->depth < depth)     return false;
+
+          delete s;
+          return true;
+     });
+
+     next_collection = std::max<std::size_t>(256, 2 * unreferenced.size());
+}
+
+inline void collect_garbage (int depth = call_depth)
+{
+     if (unreferenced.size() >= next_collection) [[unlikely]]     collect(depth);
+}
+
+
+inline stored::operator value () const noexcept
+{
+     seen(v);
+     return v;
+}
+
+inline void stored::retain (const value& v) noexcept
+{
+     if (v.counted) [[unlikely]]     ++as_string(v)->references;
+}
+
+inline void stored::release (const value& v) noexcept
+{
+     if (v.counted) [[unlikely]]     drop(as_string(v));
+}
+
+
+// =====================================================================================================================
+// Functions
+// =====================================================================================================================
+struct function : object
+{
+     string* name;
+     int     arity;
+
+     function (const char* name, int arity) : object {kind::function}, name {intern(name)}, arity {arity} {}
+
+     virtual ~function () = default;
+
+     // self is the receiver of a method, and nil for any other function
+     virtual value call (value self, const value* args) = 0;
+
+     virtual std::string to_string () const     { return "<fn " + name->text + ">"; }
+};
+
+
+struct bound_method : object
+{
+     value     self;
+     function* method;
+};
+
+
+struct native_clock final : function
+{
+     native_clock () : function {"clock", 0} {}
+
+     value call (value, const value*) override
+     {
+          using namespace std::chrono;
+          return duration<double> {steady_clock::now().time_since_epoch()}.count();
+     }
+
+     std::string to_string () const override     { return "<native fn>"; }
+};
+
+
+// =====================================================================================================================
+// Classes
+// =====================================================================================================================
+struct klass : object
+{
+     string*                                 name;
+     klass*                                  superclass;
+     std::unordered_map<string*, function*>  methods;       // including those inherited
+     std::unordered_map<string*, int>        slot_of;       // of every field set on an instance
+     function*                               initializer = nullptr;
+
+     klass (string* name, klass* superclass) : object {kind::klass}, name {name}, superclass {superclass}
+     {
+          if (superclass)     methods = superclass->methods;
+          initializer = find_method(intern("init"));
+     }
+
+     void define (string* name, function* method)
+     {
+          methods[name] = method;
+          if (name->text == "init")     initializer = method;
+     }
+
+     function* find_method (string* name) const
+     {
+          auto found = methods.find(name);
+          return found == methods.end() ? nullptr : found->second;
+     }
+
+     int slot (string* name)
+     {
+          return slot_of.try_emplace(name, static_cast<int>(slot_of.size())).first->second;
+     }
+};
+
+
+struct instance : object
+{
+     klass*             type_of;
+     std::vector<stored> fields;     // by slot, undefined when not set
+};
+
+
+// The class and slot last seen by a property access in the translated code
+struct site_cache
+{
+     klass*      type_of = nullptr;
+     int         slot    = -1;
+     std::size_t slots   = 0;           // of the class when cached
+     function*   method  = nullptr;
+};
+
+
+// =====================================================================================================================
+// Operations
+// =====================================================================================================================
+// The operands of an operation, written as a braced list in the translated code so they are evaluated left to right
+using operands = value[2];
+
+
+inline bool truthy (value v) noexcept
+{
+     return v.t == tag::boolean ? v.boolean : v.t != tag::nil;
+}
+
+
+inline bool same (value a, value b) noexcept
+{
+     if (a.t != b.t)     return false;
+
+     switch (a.t)
+     {
+          case tag::boolean:     return a.boolean == b.boolean;
+          case tag::number:      return a.number == b.number;
+
+          // Only a string made at run time may equal another string without being the same object
+          case tag::object:
+               return a.pointer == b.pointer || ((a.counted || b.counted) && a.is(kind::string) &&
+                                                 b.is(kind::string) && as_string(a)->text == as_string(b)->text);
+          default:               return true;
+     }
+}
+
+inline value equal     (const operands& o) noexcept     { return same(o[0], o[1]); }
+inline value not_equal (const operands& o) noexcept     { return !same(o[0], o[1]); }
+
+
+inline void check_numbers (const operands& o, int line)
+{
+     if (!o[0].is_number() || !o[1].is_number())     fail("Operands must be numbers.", line);
+}
+
+inline value add (const operands& o, int line)
+{
+     if (o[0].is_number() && o[1].is_number())     return o[0].number + o[1].number;
+
+     if (o[0].is(kind::string) && o[1].is(kind::string))
+          return new_string(as_string(o[0])->text + as_string(o[1])->text);
+
+     fail("Operands must be two numbers or two strings.", line);
+}
+
+inline value subtract (const operands& o, int line)     { check_numbers(o, line); return o[0].number - o[1].number; }
+inline value multiply (const operands& o, int line)     { check_numbers(o, line); return o[0].number * o[1].number; }
+inline value divide   (const operands& o, int line)     { check_numbers(o, line); return o[0].number / o[1].number; }
+
+inline value greater       (const operands& o, int line)  { check_numbers(o, line); return o[0].number >  o[1].number; }
+inline value greater_equal (const operands& o, int line)  { check_numbers(o, line); return o[0].number >= o[1].number; }
+inline value less          (const operands& o, int line)  { check_numbers(o, line); return o[0].number <  o[1].number; }
+inline value less_equal    (const operands& o, int line)  { check_numbers(o, line); return o[0].number <= o[1].number; }
+
+inline value negate (value a, int line)
+{
+     if (!a.is_number())     fail("Operand must be a number.", line);
+     return -a.number;
+}
+
+
+// Numbers print as jlox prints them, without a fraction when they are integers, and in plain decimal unless they are
+// very large or small
+inline std::string to_string (double n)
+{
+     if (std::isnan(n))     return "NaN";
+     if (std::isinf(n))     return n > 0 ? "Infinity" : "-Infinity";
+
+     double magnitude = std::fabs(n);
+     auto   format    = n == 0 || (magnitude >= 1e-3 && magnitude < 1e7) ? std::chars_format::fixed
+                                                                          : std::chars_format::general;
+     char buffer[64];
+     auto end = std::to_chars(buffer, buffer + sizeof(buffer), n, format).ptr;
+     return {buffer, end};
+}
+
+
+inline std::string to_string (value v)
+{
+     switch (v.t)
+     {
+          case tag::nil:         return "nil";
+          case tag::boolean:     return v.boolean ? "true" : "false";
+          case tag::number:      return to_string(v.number);
+
+          case tag::object:
+               switch (v.pointer->type)
+               {
+                    case kind::string:           return as_string(v)->text;
+                    case kind::function:         return static_cast<function*>(v.pointer)->to_string();
+                    case kind::bound_method:     return static_cast<bound_method*>(v.pointer)->method->to_string();
+                    case kind::klass:            return static_cast<klass*>(v.pointer)->name->text;
+                    case kind::instance:
+                         return static_cast<instance*>(v.pointer)->type_of->name->text + " instance";
+               }
+               break;
+
+          default:     break;
+     }
+
+     return "undefined";
+}
+
+
+inline void print (value v)
+{
+     std::string s = to_string(v);
+     s += '\n';
+     std::fwrite(s.data(), 1, s.size(), stdout);
+}
+
+
+// =====================================================================================================================
+// Variables
+// =====================================================================================================================
+inline value read_global (value v, const char* name, int line)
+{
+     if (v.t == tag::undefined)     fail(std::string {"Undefined variable '"} + name + "'.", line);
+     return v;
+}
+
+inline value assign_global (stored& v, value x, const char* name, int line)
+{
+     if (v.is_undefined())     fail(std::string {"Undefined variable '"} + name + "'.", line);
+     return v = x;
+}
+
+
+// =====================================================================================================================
+// Calls
+// =====================================================================================================================
+// Returning frees the strings that only the temporaries of the call could point to, but its result
+inline value call_function (function* f, value self, const value* args, int count, int line)
+{
+     if (count != f->arity)
+          fail("Expected " + std::to_string(f->arity) + " arguments but got " + std::to_string(count) + ".", line);
+
+     if (call_depth == max_call_depth)     fail("Stack overflow.", line);
+
+     struct frame
+     {
+          frame ()      { ++call_depth; }
+          ~frame ()     { --call_depth; }
+     };
+
+     value result;
+     {
+          frame entered;
+          result = f->call(self, args);
+     }
+
+     seen(result);
+     collect_garbage(call_depth + 1);
+     return result;
+}
+
+
+inline value call_with (value callee, const value* args, int count, int line)
+{
+     if (callee.t == tag::object)
+     {
+          switch (callee.pointer->type)
+          {
+               case kind::function:
+                    return call_function(static_cast<function*>(callee.pointer), nil, args, count, line);
+
+               case kind::bound_method:
+               {
+                    auto b = static_cast<bound_method*>(callee.pointer);
+                    return call_function(b->method, b->self, args, count, line);
+               }
+
+               case kind::klass:
+               {
+                    auto k    = static_cast<klass*>(callee.pointer);
+                    auto self = value {new instance {{kind::instance}, k, {}}};
+
+                    if (k->initializer)     call_function(k->initializer, self, args, count, line);
+                    else if (count != 0)
+                         fail("Expected 0 arguments but got " + std::to_string(count) + ".", line);
+
+                    return self;
+               }
+
+               default:     break;
+          }
+     }
+
+     fail("Can only call functions and classes.", line);
+}
+
+
+// The callee followed by the arguments
+template <std::size_t N>
+value call (const value (&list)[N], int line)
+{
+     return call_with(list[0], list + 1, N - 1, line);
+}
+
+
+// =====================================================================================================================
+// Properties
+// =====================================================================================================================
+inline instance* as_instance (value v, const char* message, int line)
+{
+     if (!v.is(kind::instance))     fail(message, line);
+     return static_cast<instance*>(v.pointer);
+}
+
+
+// Refreshes the cache of a site for the class of an instance. A name without a slot may gain one whenever any site
+// sets it, so a miss is only trusted while the class has as many slots as when it was cached.
+inline void look_up (instance* i, string* name, site_cache& cache)
+{
+     klass* k = i->type_of;
+     if (cache.type_of == k && (cache.slot >= 0 || cache.slots == k->slot_of.size()))     return;
+
+     auto found = k->slot_of.find(name);
+
+     cache.type_of = k;
+     cache.slots   = k->slot_of.size();
+     cache.slot    = found == k->slot_of.end() ? -1 : found->second;
+     cache.method  = k->find_method(name);
+}
+
+
+inline stored* field (instance* i, const site_cache& cache) noexcept
+{
+     if (cache.slot < 0 || static_cast<std::size_t>(cache.slot) >= i->fields.size())     return nullptr;
+
+     stored* v = &i->fields[cache.slot];
+     return v->is_undefined() ? nullptr : v;
+}
+
+
+inline value get (value object, string* name, site_cache& cache, int line)
+{
+     instance* i = as_instance(object, "Only instances have properties.", line);
+     look_up(i, name, cache);
+
+     if (stored* v = field(i, cache))     return *v;
+     if (cache.method)                   return new bound_method {{kind::bound_method}, object, cache.method};
+
+     fail("Undefined property '" + name->text + "'.", line);
+}
+
+
+// The object followed by the value
+inline value set (const operands& o, string* name, site_cache& cache, int line)
+{
+     instance* i = as_instance(o[0], "Only instances have fields.", line);
+     klass*    k = i->type_of;
+
+     if (cache.type_of != k || cache.slot < 0)
+     {
+          cache.type_of = k;
+          cache.slot    = k->slot(name);
+          cache.slots   = k->slot_of.size();
+          cache.method  = k->find_method(name);
+     }
+
+     if (static_cast<std::size_t>(cache.slot) >= i->fields.size())     i->fields.resize(cache.slot + 1, undefined);
+     return i->fields[cache.slot] = o[1];
+}
+
+
+// Calls a method without binding it, or else the function held by a field of the same name
+inline value invoke_with (value object, const value* args, int count, string* name, site_cache& cache, int line)
+{
+     instance* i = as_instance(object, "Only instances have properties.", line);
+     look_up(i, name, cache);
+
+     if (stored* v = field(i, cache))     return call_with(*v, args, count, line);
+     if (cache.method)                   return call_function(cache.method, object, args, count, line);
+
+     fail("Undefined property '" + name->text + "'.", line);
+}
+
+
+// The object followed by the arguments
+template <std::size_t N>
+value invoke (const value (&list)[N], string* name, site_cache& cache, int line)
+{
+     return invoke_with(list[0], list + 1, N - 1, name, cache, line);
+}
+
+
+inline value super_method (value superclass, value self, string* name, int line)
+{
+     function* method = static_cast<klass*>(superclass.pointer)->find_method(name);
+     if (!method)     fail("Undefined property '" + name->text + "'.", line);
+
+     return new bound_method {{kind::bound_method}, self, method};
+}
+
+
+inline klass* new_class (const char* name, value superclass, int line)
+{
+     if (superclass.t == tag::nil)     return new klass {intern(name), nullptr};
+     if (!superclass.is(kind::klass))  fail("Superclass must be a class.", line);
+
+     return new klass {intern(name), static_cast<klass*>(superclass.pointer)};
+}
+
+
+// =====================================================================================================================
+// Entry Point
+// =====================================================================================================================
+// Runs the translated script, reporting a runtime error as the interpreters of the book do
+template <class Script>
+int run (Script script)
+{
+     try
+     {
+          script();
+     }
+     catch (const runtime_error& e)
+     {
+          std::fflush(stdout);
+          std::fprintf(stderr, "%s\n[line %d]\n", e.what(), e.line);
+          return 70;
+     }
+
+     return 0;
+}
+
+} // namespace lox
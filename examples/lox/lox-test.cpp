@@ -105,14 +105,23 @@ constexpr std::string to_string (T&& val)    { return std::to_string(std::forwar
 
 class TokenBase {
 public:
+    TokenBase (TokenType type, std::string lexeme, int line)
+        : type(type), lexeme(lexeme), line(line)
+    {}
+
+    virtual ~TokenBase () = default;
     virtual std::string to_string () = 0;
+
+    const TokenType   type;
+    const std::string lexeme;
+    const int         line;
 };
 
 
 template <typename ValueType>
 struct Token : TokenBase {
     Token (TokenType type, std::string lexeme, ValueType literal, int line)
-        : type(type), lexeme(lexeme), literal(literal), line(line)
+        : TokenBase(type, lexeme, line), literal(literal)
     {}
 
     std::string to_string () override {
@@ -120,10 +129,7 @@ struct Token : TokenBase {
     }
 
 private:
-    const TokenType   type;
-    const std::string lexeme;
     const ValueType   literal;
-    const int         line;
 };
 
 
@@ -472,6 +478,8 @@ void run_prompt () {
 }
 
 
+// Defined by programs that reuse the scanner, such as lox-compile.cpp
+#ifndef LOX_NO_MAIN
 int main (int argc, char* argv[]) {
     using namespace std;
 
@@ -484,6 +492,7 @@ int main (int argc, char* argv[]) {
         cerr << e.what();
     }
 }
+#endif    // LOX_NO_MAIN
 
 
 /*
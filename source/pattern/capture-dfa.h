@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * Capture DFA
+ *
+ * Extraction of capture groups in a single pass, by a deterministic automaton whose transitions record positions.
+ */
+
+// The automaton is built from patterns which are one-pass: at each position, the next byte determines which way the
+// pattern continues, so there is never more than one thread of the NFA to follow. The states of the automaton are
+// then the states of that one thread, and every save state crossed between two bytes can be attached as a tag to the
+// transition on the second byte. Running the automaton sets each tagged slot to the current offset, so captures cost
+// nothing beyond the match itself: no allocation, no copies, and no scanning of a group a second time.
+//
+// Patterns which are not one-pass are rejected when the automaton is built, as they would need a thread for each way
+// of continuing. A group inside a repetition holds its last iteration.
+
+
+#pragma once
+
+#include <array>
+#include <bit>             // std::countr_zero
+#include <cstdint>
+#include <map>
+#include <stdexcept>       // std::invalid_argument
+#include <string_view>
+#include <utility>         // std::pair
+#include <vector>
+
+#include "pattern-nfa.h"
+#include "runtime-pattern.h"
+
+
+namespace Pattern {
+
+struct capture
+{
+     static constexpr std::size_t npos = std::size_t(-1);
+
+     std::size_t begin = npos;
+     std::size_t end   = npos;
+
+     bool matched () const noexcept     { return begin != npos && end != npos; }
+
+     std::string_view in (std::string_view text) const     { return matched() ? text.substr(begin, end - begin) : ""; }
+};
+
+
+class capture_dfa
+{
+public:
+     static constexpr std::size_t max_groups = 16;
+
+     using captures = std::array<capture, max_groups>;
+
+
+     /**
+      * Build the automaton for a pattern whose groups are numbered below max_groups.
+      *
+      * @throw    std::invalid_argument    When the pattern is not one-pass, or numbers a group too high
+      */
+     explicit capture_dfa (const runtime_pattern& p)
+     {
+          // Checked before compiling, where the slot of a group is twice its number and could wrap around
+          for (pattern_graph::node_id id = 0; id < p.graph().size(); ++id)
+               if (p.graph()[id].op == pattern_op::capture && p.graph()[id].second >= max_groups)
+                    throw std::invalid_argument("capture_dfa: group number too high");
+
+          detail::pattern_nfa nfa;
+
+          int accept = nfa.add({detail::nfa_op::match, 0, 0, 0});
+          int entry  = nfa.compile(p.graph(), p.root(), accept, true);
+
+          classes = nfa.byte_classes(class_of);
+          build(nfa, entry);
+     }
+
+
+     /**
+      * Match the whole of a text, recording the offsets of each group.
+      *
+      * @param    text      Text to match
+      * @param    groups    Receives the offsets of each group; a group not matched holds npos
+      * @return   Whether the pattern matches the whole text. Otherwise groups is unspecified.
+      */
+     bool match (std::string_view text, captures& groups) const
+     {
+          std::array<std::size_t, 2 * max_groups> slots;
+          slots.fill(capture::npos);
+
+          int node = 0;
+
+          for (std::size_t i = 0; i < text.size(); ++i)
+          {
+               const entry& e = table[node * classes + class_of[static_cast<unsigned char>(text[i])]];
+               if (e.next < 0)     return false;
+
+               apply(e.tags, i, slots);
+               node = e.next;
+          }
+
+          const entry& f = finals[node];
+          if (f.next < 0)     return false;
+
+          apply(f.tags, text.size(), slots);
+
+          for (std::size_t g = 0; g < max_groups; ++g)
+               groups[g] = {slots[2 * g], slots[2 * g + 1]};
+
+          return true;
+     }
+
+
+     std::size_t states () const noexcept     { return finals.size(); }
+
+
+private:
+     struct entry
+     {
+          std::int32_t  next;      // node, or -1 when there is no transition
+          std::uint32_t tags;      // slots set to the current offset, one bit each
+     };
+
+     std::array<std::uint8_t, 256> class_of {};
+     int                           classes = 1;
+     std::vector<entry>            table;         // by node and byte class
+     std::vector<entry>            finals;        // by node: whether it accepts at the end of input, and its tags
+
+
+     static void apply (std::uint32_t tags, std::size_t offset, std::array<std::size_t, 2 * max_groups>& slots)
+     {
+          for (; tags != 0; tags &= tags - 1)
+               slots[std::countr_zero(tags)] = offset;
+     }
+
+
+     // A node is a state of the NFA at which a byte has just been consumed, or the entry state. Its closure lists the
+     // byte and match states reachable without consuming input, with the slots saved on the way to each.
+     void build (const detail::pattern_nfa& nfa, int entry_state)
+     {
+          std::map<int, int> node_of {{entry_state, 0}};
+          std::vector<int>   pending {entry_state};
+
+          for (std::size_t node = 0; node < pending.size(); ++node)
+          {
+               auto reached = closure(nfa, pending[node]);
+
+               table.resize(table.size() + classes, entry {-1, 0});
+               finals.push_back({-1, 0});
+
+               for (auto [s, tags] : reached)
+               {
+                    const detail::nfa_state& state = nfa.states[s];
+
+                    if (state.op == detail::nfa_op::match)
+                    {
+                         finals[node] = {0, tags};
+                         continue;
+                    }
+
+                    auto [it, added] = node_of.try_emplace(state.next, static_cast<int>(pending.size()));
+                    if (added)     pending.push_back(state.next);
+
+                    // Each class may be consumed by one byte state only
+                    for (int b = 0; b < 256; ++b)
+                    {
+                         if (!nfa.sets[state.alt].contains(static_cast<char>(b)))     continue;
+
+                         entry& e = table[node * classes + class_of[b]];
+
+                         if (e.next >= 0 && (e.next != it->second || e.tags != tags))
+                              throw std::invalid_argument("capture_dfa: pattern is not one-pass");
+
+                         e = {it->second, tags};
+                    }
+               }
+          }
+     }
+
+
+     static std::vector<std::pair<int, std::uint32_t>> closure (const detail::pattern_nfa& nfa, int from)
+     {
+          std::vector<std::pair<int, std::uint32_t>> reached;
+          std::map<int, std::uint32_t>                seen;
+          std::vector<std::pair<int, std::uint32_t>>  stack {{from, 0}};
+
+          while (!stack.empty())
+          {
+               auto [s, tags] = stack.back();
+               stack.pop_back();
+
+               // Reaching a state again along another path is only unambiguous if that path saved the same slots
+               auto [it, added] = seen.try_emplace(s, tags);
+               if (!added)
+               {
+                    if (it->second != tags)     throw std::invalid_argument("capture_dfa: pattern is not one-pass");
+                    continue;
+               }
+
+               const detail::nfa_state& state = nfa.states[s];
+
+               switch (state.op)
+               {
+               case detail::nfa_op::split:
+                    stack.push_back({state.alt, tags});
+                    stack.push_back({state.next, tags});
+                    break;
+
+               case detail::nfa_op::save:
+                    stack.push_back({state.next, tags | std::uint32_t {1} << state.id});
+                    break;
+
+               case detail::nfa_op::byte:
+               case detail::nfa_op::match:
+                    reached.push_back({s, tags});
+                    break;
+               }
+          }
+
+          return reached;
+     }
+}; // class capture_dfa
+
+} // namespace Pattern
@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * Fingerprints
+ *
+ * Fingerprinting of token streams by winnowing, and an index of fingerprints which reports pairs of documents sharing
+ * code.
+ */
+
+// A document is fingerprinted from the tags of its tokens alone, so identifiers and literals are normalized to their
+// kind, and a copy whose names were changed still matches. Every k consecutive tags, a k-gram, are hashed with a
+// rolling hash. Then in every window of w consecutive hashes the smallest is kept, the rightmost if tied. Each kept
+// hash is a fingerprint, recorded once however many windows select it.
+//
+// Winnowing guarantees that two documents sharing a run of at least w + k - 1 tokens share a fingerprint, while no run
+// shorter than k is considered. It keeps about 2 / (w + 1) of the hashes, spread through the document.
+//
+// A fingerprint_index holds postings, (hash, document, position) triples, in one flat array. Adding appends, and the
+// array is sorted when queried. Workers can each index part of a corpus, then their indexes are merged by merging
+// sorted arrays. Fingerprints common to many documents, such as boilerplate, are passed over when reporting pairs.
+
+
+#pragma once
+
+#include <algorithm>       // std::sort, std::inplace_merge
+#include <array>
+#include <bit>             // std::bit_ceil
+#include <cstdint>
+#include <stdexcept>       // std::invalid_argument
+#include <unordered_map>
+#include <vector>
+
+#include "token-stream.h"
+
+
+namespace Pattern {
+
+struct fingerprint
+{
+     std::uint64_t hash;
+     std::uint32_t position;     // of the first token of the k-gram
+};
+
+
+struct fingerprint_options
+{
+     std::uint32_t k      = 12;     // tokens per k-gram
+     std::uint32_t window = 8;      // consecutive k-grams per window
+
+     friend bool operator== (const fingerprint_options&, const fingerprint_options&) = default;
+};
+
+
+// =====================================================================================================================
+// Winnowing
+// =====================================================================================================================
+namespace detail {
+
+constexpr std::uint64_t mix64 (std::uint64_t x) noexcept
+{
+     x ^= x >> 30;  x *= 0xBF58476D1CE4E5B9;
+     x ^= x >> 27;  x *= 0x94D049BB133111EB;
+     return x ^ (x >> 31);
+}
+
+
+// A fixed random value for each tag, so that every worker hashes alike
+inline constexpr auto tag_values = [] {
+     std::array<std::uint64_t, 256> values {};
+     for (std::uint64_t t = 0; t < 256; ++t)     values[t] = mix64(t + 0x9E3779B97F4A7C15);
+     return values;
+}();
+
+inline constexpr std::uint64_t rolling_base = 0x100000001B3;     // odd, so the hash is invertible modulo 2^64
+
+} // namespace detail
+
+
+/**
+ * Append the fingerprints of a sequence of tags, in order of position.
+ */
+template <token_tag Tag>
+void winnow (const Tag* tags, std::size_t count, fingerprint_options options, std::vector<fingerprint>& out)
+{
+     const std::uint32_t k = std::max<std::uint32_t>(options.k, 1);
+     const std::uint32_t w = std::max<std::uint32_t>(options.window, 1);
+
+     if (count < k)     return;
+
+     // base^(k-1), to remove the oldest tag from the hash
+     std::uint64_t oldest = 1;
+     for (std::uint32_t i = 1; i < k; ++i)     oldest *= detail::rolling_base;
+
+     auto value = [tags] (std::size_t i) { return detail::tag_values[static_cast<std::uint8_t>(tags[i])]; };
+
+     std::uint64_t h = 0;
+     for (std::uint32_t i = 0; i < k; ++i)     h = h * detail::rolling_base + value(i);
+
+     // The candidates of the current window, with increasing hashes, in a ring of a power of two
+     std::vector<fingerprint> ring(std::bit_ceil(w));
+     const std::size_t mask = ring.size() - 1;
+     std::size_t head = 0, size = 0;
+
+     std::uint32_t last_kept = ~std::uint32_t {0};
+     const std::size_t grams = count - k + 1;
+
+     for (std::size_t i = 0; ; )
+     {
+          fingerprint f {detail::mix64(h), static_cast<std::uint32_t>(i)};
+
+          if (size && ring[head].position + w <= i)     { head = (head + 1) & mask; --size; }
+
+          while (size && ring[(head + size - 1) & mask].hash >= f.hash)     --size;
+          ring[(head + size++) & mask] = f;
+
+          // Once the first window is full, keep its minimum if not already kept
+          if (i + 1 >= w && ring[head].position != last_kept)
+          {
+               out.push_back(ring[head]);
+               last_kept = ring[head].position;
+          }
+
+          if (++i == grams)     break;
+
+          h = (h - value(i - 1) * oldest) * detail::rolling_base + value(i + k - 1);
+     }
+
+     // A document shorter than a window still has one fingerprint
+     if (grams < w)     out.push_back(ring[head]);
+}
+
+
+template <token_tag Tag>
+std::vector<fingerprint> winnow (const token_stream<Tag>& tokens, fingerprint_options options = {})
+{
+     std::vector<fingerprint> out;
+     winnow(tokens.tags(), tokens.size(), options, out);
+     return out;
+}
+
+
+// =====================================================================================================================
+// Index
+// =====================================================================================================================
+struct clone_pair
+{
+     std::uint32_t first;               // documents, first < second
+     std::uint32_t second;
+     std::uint32_t shared;              // fingerprints in common
+     std::uint32_t first_position;      // of the earliest fingerprint in common, in each document
+     std::uint32_t second_position;
+};
+
+
+class fingerprint_index
+{
+public:
+     struct posting
+     {
+          std::uint64_t hash;
+          std::uint32_t document;
+          std::uint32_t position;
+
+          friend bool operator< (const posting& a, const posting& b) noexcept
+          {
+               if (a.hash != b.hash)             return a.hash < b.hash;
+               if (a.document != b.document)     return a.document < b.document;
+               return a.position < b.position;
+          }
+     };
+
+
+     explicit fingerprint_index (fingerprint_options options = {}) : options_ {options} {}
+
+     const fingerprint_options& options () const noexcept     { return options_; }
+
+     std::size_t size () const noexcept     { return postings.size(); }
+
+     // Number of fingerprints of a document
+     std::uint32_t fingerprints (std::uint32_t document) const noexcept
+     {
+          return document < counts.size() ? counts[document] : 0;
+     }
+
+
+     template <token_tag Tag>
+     void add (std::uint32_t document, const token_stream<Tag>& tokens)
+     {
+          scratch.clear();
+          winnow(tokens.tags(), tokens.size(), options_, scratch);
+          add(document, scratch);
+     }
+
+     void add (std::uint32_t document, const std::vector<fingerprint>& prints)
+     {
+          for (const auto& f : prints)     postings.push_back({f.hash, document, f.position});
+
+          if (counts.size() <= document)     counts.resize(document + 1);
+          counts[document] += static_cast<std::uint32_t>(prints.size());
+     }
+
+
+     /**
+      * Take the postings of another index, e.g. one built by another worker over other documents.
+      *
+      * @throw    std::invalid_argument    When the indexes were built with different options
+      */
+     void merge (fingerprint_index&& other)
+     {
+          if (other.options_ != options_)
+               throw std::invalid_argument("fingerprint_index::merge: indexes have different options");
+
+          sort();
+          other.sort();
+
+          auto middle = static_cast<std::ptrdiff_t>(postings.size());
+          postings.insert(postings.end(), other.postings.begin(), other.postings.end());
+          std::inplace_merge(postings.begin(), postings.begin() + middle, postings.end());
+          sorted = postings.size();
+
+          if (counts.size() < other.counts.size())     counts.resize(other.counts.size());
+          for (std::size_t d = 0; d < other.counts.size(); ++d)     counts[d] += other.counts[d];
+
+          other.postings.clear();
+          other.counts.clear();
+          other.sorted = 0;
+     }
+
+
+     /**
+      * Report the pairs of documents with at least min_shared fingerprints in common, most shared first. A fingerprint
+      * found in more than max_documents documents is passed over as boilerplate.
+      */
+     std::vector<clone_pair> clone_pairs (std::uint32_t min_shared = 4, std::size_t max_documents = 64)
+     {
+          sort();
+
+          std::unordered_map<std::uint64_t, clone_pair> pairs;
+          std::vector<posting> firsts;     // the earliest posting of each document in a group
+
+          for (std::size_t i = 0; i < postings.size(); )
+          {
+               std::size_t end = i;
+               firsts.clear();
+
+               for (; end < postings.size() && postings[end].hash == postings[i].hash; ++end)
+                    if (firsts.empty() || firsts.back().document != postings[end].document)
+                         firsts.push_back(postings[end]);
+
+               i = end;
+
+               if (firsts.size() < 2 || firsts.size() > max_documents)     continue;
+
+               for (std::size_t a = 0; a < firsts.size(); ++a)
+                    for (std::size_t b = a + 1; b < firsts.size(); ++b)
+                    {
+                         const posting& x = firsts[a];
+                         const posting& y = firsts[b];
+
+                         auto key = std::uint64_t {x.document} << 32 | y.document;
+                         auto [p, inserted] = pairs.try_emplace(key, clone_pair {x.document, y.document, 0,
+                                                                                 x.position, y.position});
+                         ++p->second.shared;
+                         p->second.first_position  = std::min(p->second.first_position, x.position);
+                         p->second.second_position = std::min(p->second.second_position, y.position);
+                    }
+          }
+
+          std::vector<clone_pair> report;
+
+          for (const auto& [key, pair] : pairs)
+               if (pair.shared >= min_shared)     report.push_back(pair);
+
+          std::sort(report.begin(), report.end(), [] (const clone_pair& a, const clone_pair& b) {
+               if (a.shared != b.shared)     return a.shared > b.shared;
+               return a.first != b.first ? a.first < b.first : a.second < b.second;
+          });
+
+          return report;
+     }
+
+
+private:
+     fingerprint_options        options_;
+     std::vector<posting>       postings;
+     std::size_t                sorted = 0;       // length of the sorted prefix of postings
+     std::vector<std::uint32_t> counts;           // fingerprints per document
+     std::vector<fingerprint>   scratch;
+
+
+     void sort ()
+     {
+          if (sorted == postings.size())     return;
+
+          auto middle = postings.begin() + static_cast<std::ptrdiff_t>(sorted);
+          std::sort(middle, postings.end());
+          std::inplace_merge(postings.begin(), middle, postings.end());
+          sorted = postings.size();
+     }
+}; // class fingerprint_index
+
+} // namespace Pattern
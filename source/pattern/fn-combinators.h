@@ -22,100 +22,492 @@
 
 #pragma once
 
+#include <algorithm>       // std::min
+#include <chrono>          // scan_budget deadlines
 #include <concepts>
 #include <cstddef>         // std::size_t
-#include <functional>      // std::invoke, std::bind_front
+#include <functional>      // std::invoke, std::ref
 #include <tuple>           // any, all
 #include <type_traits>     // std::invoke_result_t
-#include <utility>         // std::forward
+#include <utility>         // std::forward, std::index_sequence
 
 #include "scanning-concepts.h"
 
 
 namespace Pattern {
-namespace fn {
 
 // =====================================================================================================================
 // Utilities
 // =====================================================================================================================
-// Modification of std::bind_front
-template <typename F, typename... BoundArgs>
-struct bind_back_t
+namespace detail {
+
+// Storage for the functions and arguments bound by a combinator. Unlike std::tuple, whose assignment operators are
+// user-provided, a pack is an aggregate of [[no_unique_address]] elements, so a pack of stateless functions is empty,
+// and a pack of trivially copyable elements is trivially copyable. Each element is a distinct base, so only repeated
+// elements of one empty type take a byte each.
+template <std::size_t I, class T>
+struct pack_element
+{
+     [[no_unique_address]] T value;
+};
+
+
+template <class Indices, class... T>
+struct pack_impl;
+
+template <std::size_t... I, class... T>
+struct pack_impl<std::index_sequence<I...>, T...> : pack_element<I, T>...
+{};
+
+template <class... T>
+using pack = pack_impl<std::index_sequence_for<T...>, T...>;
+
+
+template <std::size_t I, class T>
+constexpr T& get_element (pack_element<I, T>& e) noexcept                 { return e.value; }
+
+template <std::size_t I, class T>
+constexpr const T& get_element (const pack_element<I, T>& e) noexcept     { return e.value; }
+
+template <std::size_t I, class T>
+constexpr T&& get_element (pack_element<I, T>&& e) noexcept               { return std::move(e.value); }
+
+template <std::size_t I, class T>
+constexpr const T&& get_element (const pack_element<I, T>&& e) noexcept   { return std::move(e.value); }
+
+
+// The result of calling a bind_t, with the bound arguments after (Back) or before the calling arguments. Like
+// std::invoke_result, it has no type if the call is ill-formed.
+template <class... T>
+struct type_list {};
+
+template <bool Back, class F, class Bound, class... CallArgs>
+struct bind_result;
+
+template <class F, class... Bound, class... CallArgs>
+struct bind_result<true, F, type_list<Bound...>, CallArgs...> : std::invoke_result<F, CallArgs..., Bound...>
+{
+     static constexpr bool nothrow = std::is_nothrow_invocable_v<F, CallArgs..., Bound...>;
+};
+
+template <class F, class... Bound, class... CallArgs>
+struct bind_result<false, F, type_list<Bound...>, CallArgs...> : std::invoke_result<F, Bound..., CallArgs...>
+{
+     static constexpr bool nothrow = std::is_nothrow_invocable_v<F, Bound..., CallArgs...>;
+};
+
+} // namespace detail
+
+
+namespace fn {
+
+// Modification of std::bind_front, binding arguments after (Back) or before the calling arguments
+template <bool Back, typename F, typename... BoundArgs>
+struct bind_t
 {
      static_assert(std::is_move_constructible_v<F>);
      static_assert((std::is_move_constructible_v<BoundArgs> && ...));
 
      // First parameter is to ensure this constructor is never used instead of the copy/move constructor.
      template<typename Fn, typename... Args>
-     explicit constexpr bind_back_t (int, Fn&& fn, Args&&... args)
+     explicit constexpr bind_t (int, Fn&& fn, Args&&... args)
           noexcept(std::conjunction_v<std::is_nothrow_constructible<F, Fn>,
                                       std::is_nothrow_constructible<BoundArgs, Args>...>)
-          : f {std::forward<Fn>(fn)}, bound_args {std::forward<Args>(args)...}
+          : f {std::forward<Fn>(fn)}, bound_args {{std::forward<Args>(args)}...}
      {
           static_assert(sizeof...(Args) == sizeof...(BoundArgs));
      }
 
-     bind_back_t (const bind_back_t&)            = default;
-     bind_back_t (bind_back_t&&)                 = default;
-     bind_back_t& operator= (const bind_back_t&) = default;
-     bind_back_t& operator= (bind_back_t&&)      = default;
-     ~bind_back_t ()                             = default;
+     bind_t (const bind_t&)            = default;
+     bind_t (bind_t&&)                 = default;
+     bind_t& operator= (const bind_t&) = default;
+     bind_t& operator= (bind_t&&)      = default;
+     ~bind_t ()                        = default;
+
+     template <class G, class Bound, class... CallArgs>
+     using Result = typename detail::bind_result<Back, G, Bound, CallArgs...>::type;
+
+     template <class G, class Bound, class... CallArgs>
+     static constexpr bool Nothrow = detail::bind_result<Back, G, Bound, CallArgs...>::nothrow;
 
      template<typename... CallArgs>
-     constexpr std::invoke_result_t<F&, CallArgs..., BoundArgs&...>
+     constexpr Result<F&, detail::type_list<BoundArgs&...>, CallArgs...>
      operator() (CallArgs&&... call_args) &
-          noexcept(std::is_nothrow_invocable_v<F&, CallArgs..., BoundArgs&...>)
+          noexcept(Nothrow<F&, detail::type_list<BoundArgs&...>, CallArgs...>)
      {
           return S_call(*this, BoundIndices(), std::forward<CallArgs>(call_args)...);
      }
 
      template<typename... CallArgs>
-     constexpr std::invoke_result_t<const F&, CallArgs..., const BoundArgs&...>
+     constexpr Result<const F&, detail::type_list<const BoundArgs&...>, CallArgs...>
      operator() (CallArgs&&... call_args) const &
-          noexcept(std::is_nothrow_invocable_v<const F&, CallArgs..., const BoundArgs&...>)
+          noexcept(Nothrow<const F&, detail::type_list<const BoundArgs&...>, CallArgs...>)
      {
           return S_call(*this, BoundIndices(), std::forward<CallArgs>(call_args)...);
      }
 
      template<typename... CallArgs>
-     constexpr std::invoke_result_t<F, CallArgs..., BoundArgs...>
+     constexpr Result<F, detail::type_list<BoundArgs...>, CallArgs...>
      operator() (CallArgs&&... call_args) &&
-          noexcept(std::is_nothrow_invocable_v<F, CallArgs..., BoundArgs...>)
+          noexcept(Nothrow<F, detail::type_list<BoundArgs...>, CallArgs...>)
      {
           return S_call(std::move(*this), BoundIndices(), std::forward<CallArgs>(call_args)...);
      }
 
      template<typename... CallArgs>
-     constexpr std::invoke_result_t<const F, CallArgs..., const BoundArgs...>
+     constexpr Result<const F, detail::type_list<const BoundArgs...>, CallArgs...>
      operator() (CallArgs&&... call_args) const &&
-          noexcept(std::is_nothrow_invocable_v<const F, CallArgs..., const BoundArgs...>)
+          noexcept(Nothrow<const F, detail::type_list<const BoundArgs...>, CallArgs...>)
      {
           return S_call(std::move(*this), BoundIndices(), std::forward<CallArgs>(call_args)...);
      }
 
 private:
-     F f;
-     std::tuple<BoundArgs...> bound_args;
+     [[no_unique_address]] F f;
+     [[no_unique_address]] detail::pack<BoundArgs...> bound_args;
 
      using BoundIndices = std::index_sequence_for<BoundArgs...>;
 
      template <class T, size_t... Ind, class... CallArgs>
-     static constexpr decltype(auto)
-     S_call (T&& g, std::index_sequence<Ind...>, CallArgs&&... call_args)
+     static constexpr decltype(auto) S_call (T&& g, std::index_sequence<Ind...>, CallArgs&&... call_args)
      {
-          return std::invoke(std::forward<T>(g).f,
-                             std::forward<CallArgs>(call_args)...,
-                             std::get<Ind>(std::forward<T>(g).bound_args)...);
+          if constexpr (Back)
+               return std::invoke(std::forward<T>(g).f,
+                                  std::forward<CallArgs>(call_args)...,
+                                  detail::get_element<Ind>(std::forward<T>(g).bound_args)...);
+          else
+               return std::invoke(std::forward<T>(g).f,
+                                  detail::get_element<Ind>(std::forward<T>(g).bound_args)...,
+                                  std::forward<CallArgs>(call_args)...);
      }
-}; // struct bind_back_t
+}; // struct bind_t
 
 
+template <typename F, typename... BoundArgs>
+using bind_back_t = bind_t<true, F, BoundArgs...>;
+
+template <typename F, typename... BoundArgs>
+using bind_front_t = bind_t<false, F, BoundArgs...>;
+
+
+// Lifts a function to a stateless function object, so that a function pointer costs nothing to store and its calls
+// can be inlined. Obtained with fo::lift.
+template <auto Fn>
+struct lift_t
+{
+     template <class... Args>
+          requires std::invocable<decltype(Fn), Args...>
+     constexpr decltype(auto) operator() (Args&&... args) const
+          noexcept(std::is_nothrow_invocable_v<decltype(Fn), Args...>)
+     {
+          return std::invoke(Fn, std::forward<Args>(args)...);
+     }
+};
+
 } // namespace fn
 
 
 template <typename F, typename... Args>
 using _bind_back_t = fn::bind_back_t<std::decay_t<F>, std::decay_t<Args>...>;
 
+template <typename F, typename... Args>
+using _bind_front_t = fn::bind_front_t<std::decay_t<F>, std::decay_t<Args>...>;
+
+
+// =====================================================================================================================
+// Scan Budget
+// =====================================================================================================================
+// Limits the work a parse may perform, so that a hostile input cannot monopolize a thread. A budget counts the
+// iterations of the looping algorithms (at_most, n_times, repeat, many, at_least, some), and optionally holds a
+// deadline on the monotonic clock. The clock is only consulted once every clock_interval steps, so the cost of an
+// iteration stays at a decrement and a predictable branch.
+//
+// A budget is installed for the duration of a parse with fn::within_budget. Once exhausted, every loop fails at its next
+// back-edge and the parse unwinds without throwing. A budget installed within another is chained to it, and each step is
+// charged to both, so the limits of the outer budget bound the whole parse.
+namespace detail { class budget_scope; }
+
+class scan_budget
+{
+public:
+     using clock      = std::chrono::steady_clock;
+     using time_point = clock::time_point;
+
+     static constexpr std::size_t unlimited      = std::size_t(-1);
+     static constexpr std::size_t clock_interval = 1024;
+
+     constexpr scan_budget () noexcept
+          : scan_budget {unlimited}
+     {}
+
+     explicit constexpr scan_budget (std::size_t steps) noexcept
+          : reserve {steps}
+     {
+          refill_countdown();
+     }
+
+     explicit constexpr scan_budget (time_point deadline, std::size_t steps = unlimited) noexcept
+          : reserve {steps}, deadline {deadline}, timed {true}
+     {
+          refill_countdown();
+     }
+
+     static scan_budget for_duration (clock::duration d, std::size_t steps = unlimited) noexcept
+     {
+          return scan_budget {clock::now() + d, steps};
+     }
+
+     // Spends one step, of this budget and of those it is chained to. Returns false once any of them is exhausted.
+     constexpr bool spend () noexcept
+     {
+          if (countdown != 0) [[likely]]
+          {
+               --countdown;
+               return !enclosing || enclosing->spend();
+          }
+
+          return refill() && (!enclosing || enclosing->spend());
+     }
+
+     constexpr bool exhausted () const noexcept     { return spent || (enclosing && enclosing->exhausted()); }
+
+
+private:
+     friend class detail::budget_scope;
+
+     std::size_t  reserve;               // steps not yet moved into the countdown
+     std::size_t  countdown = 0;         // steps remaining before the next refill
+     time_point   deadline  = {};
+     bool         timed     = false;
+     bool         spent     = false;
+     scan_budget* enclosing = nullptr;   // the budget this one is installed within, while it is
+
+     constexpr void refill_countdown () noexcept
+     {
+          countdown = std::min(reserve, clock_interval);
+          reserve -= countdown;
+     }
+
+     constexpr bool refill () noexcept
+     {
+          if (spent)     return false;
+
+          if (reserve == 0 || (timed && clock::now() >= deadline))
+          {
+               spent = true;
+               return false;
+          }
+
+          refill_countdown();
+          --countdown;
+          return true;
+     }
+}; // class scan_budget
+
+
+// The outcome of a budgeted scan. Exhaustion is reported separately from failure, since the input was not rejected.
+enum class scan_result { success, failure, exhausted };
+
+
+namespace detail {
+
+// The budget of the innermost fn::within_budget call on this thread, or nullptr if none is active.
+inline thread_local scan_budget* active_budget = nullptr;
+
+
+// The charge of a loop at each back-edge, to the budget active when the loop began. A loop begun without a budget
+// spends nothing, so its back-edges cost nothing.
+struct budgeted_loop
+{
+     scan_budget* budget;
+
+     bool spend () const noexcept     { return budget->spend(); }
+};
+
+
+struct unbudgeted_loop
+{
+     static constexpr bool spend () noexcept     { return true; }
+};
+
+
+// Installs a budget as the active budget of this thread, chained to the budget it replaces, until destroyed. A budget
+// which is already in the chain is not chained again, so that each step is charged to it once.
+class budget_scope
+{
+public:
+     explicit budget_scope (scan_budget& b) noexcept
+          : budget {b}, previous {active_budget}, enclosing {b.enclosing}
+     {
+          bool chained = false;
+          for (scan_budget* p = previous; p; p = p->enclosing)
+               if (p == &budget)     chained = true;
+
+          if (!chained)     budget.enclosing = previous;
+
+          active_budget = &budget;
+     }
+
+     budget_scope (const budget_scope&)            = delete;
+     budget_scope& operator= (const budget_scope&) = delete;
+
+     ~budget_scope ()
+     {
+          active_budget    = previous;
+          budget.enclosing = enclosing;
+     }
+
+private:
+     scan_budget& budget;
+     scan_budget* previous;
+     scan_budget* enclosing;
+};
+
+
+// Runs a loop, given its charge. The thread-local budget is read once, on entry, and the loop is instantiated for each
+// case, so an unbudgeted loop has no check at its back-edges. A budget installed by a child applies only within it.
+template <class Loop>
+decltype(auto) run_loop (Loop&& loop)
+{
+     if (scan_budget* budget = active_budget) [[unlikely]]     return loop(budgeted_loop {budget});
+     return loop(unbudgeted_loop {});
+}
+
+} // namespace detail
+
+
+// =====================================================================================================================
+// Rules
+// =====================================================================================================================
+// Every combinator is inlined into the instantiation of its parent, so a large grammar becomes one enormous function. A
+// rule marks a boundary in a composition where code generation may be controlled: the child may be emitted as a
+// separate, out-of-line function, and its failure path may be marked cold.
+enum class inlining
+{
+     always,        // the child is inlined into the caller
+     never,         // the child is called through an out-of-line function
+     automatic      // leaf children are inlined, composite children are outlined
+};
+
+
+struct rule_options
+{
+     inlining inline_mode  = inlining::automatic;
+     bool     cold_failure = false;     // failure is an error path, e.g. a rule which should always match
+};
+
+
+namespace detail {
+
+// Combinators which hold child functions. A composition of stateless parts is itself empty, so it is recognized by its
+// type rather than its size.
+template <class F>
+inline constexpr bool is_composition = false;
+
+
+// A leaf is a function pointer or a stateless callable, such as a captureless lambda or a lifted predicate.
+template <class F>
+inline constexpr bool is_leaf_rule = !is_composition<F> &&
+                                     (std::is_empty_v<F> || std::is_pointer_v<F> || std::is_member_pointer_v<F>);
+
+
+template <class F, class... Args>
+[[gnu::noinline]] bool call_outlined (F& f, Args&&... args)
+{
+     return std::invoke(f, std::forward<Args>(args)...);
+}
+
+
+[[gnu::cold, gnu::noinline]] inline bool rule_failed () noexcept
+{
+     return false;
+}
+
+} // namespace detail
+
+
+namespace fn {
+
+template <typename F, rule_options Options = rule_options {}>
+struct rule_t
+{
+     static_assert(std::is_move_constructible_v<F>);
+
+     static constexpr bool outlined = Options.inline_mode == inlining::never ||
+                                      (Options.inline_mode == inlining::automatic && !detail::is_leaf_rule<F>);
+
+     [[no_unique_address]] F f;
+
+     template <class... CallArgs>
+          requires boolean_invocable<F&, CallArgs...>
+     constexpr bool operator() (CallArgs&&... call_args)
+     {
+          bool result;
+
+          if constexpr (outlined)     result = detail::call_outlined(f, std::forward<CallArgs>(call_args)...);
+          else                        result = std::invoke(f, std::forward<CallArgs>(call_args)...);
+
+          if constexpr (Options.cold_failure)
+          {
+               if (!result) [[unlikely]]     return detail::rule_failed();
+          }
+
+          return result;
+     }
+}; // struct rule_t
+
+
+// The compositions returned by fo::any and fo::all
+template <class... F>
+struct any_of_t
+{
+     [[no_unique_address]] detail::pack<F...> children;
+
+     template <class... CallArgs>
+          requires (... && boolean_invocable<F&, CallArgs...>)
+     constexpr bool operator() (CallArgs&&... call_args)
+     {
+          return [&] <std::size_t... I> (std::index_sequence<I...>) {
+               return (... || std::invoke(detail::get_element<I>(children), call_args...));
+          }(std::index_sequence_for<F...> {});
+     }
+};
+
+
+template <class... F>
+struct all_of_t
+{
+     [[no_unique_address]] detail::pack<F...> children;
+
+     template <class... CallArgs>
+          requires (... && boolean_invocable<F&, CallArgs...>)
+     constexpr bool operator() (CallArgs&&... call_args)
+     {
+          return [&] <std::size_t... I> (std::index_sequence<I...>) {
+               return (... && std::invoke(detail::get_element<I>(children), call_args...));
+          }(std::index_sequence_for<F...> {});
+     }
+};
+
+} // namespace fn
+
+
+namespace detail {
+
+template <bool Back, class F, class... Args>
+inline constexpr bool is_composition<fn::bind_t<Back, F, Args...>> = true;
+
+template <class F, rule_options Options>
+inline constexpr bool is_composition<fn::rule_t<F, Options>> = true;
+
+template <class... F>
+inline constexpr bool is_composition<fn::any_of_t<F...>> = true;
+
+template <class... F>
+inline constexpr bool is_composition<fn::all_of_t<F...>> = true;
+
+} // namespace detail
+
 
 namespace fn {
 
@@ -127,6 +519,14 @@ constexpr _bind_back_t<F, Args...> bind_back (F&& f, Args&&... args)
 }
 
 
+template <typename F, typename... Args>
+constexpr _bind_front_t<F, Args...> bind_front (F&& f, Args&&... args)
+    noexcept(std::is_nothrow_constructible_v<int, _bind_front_t<F, Args...>, F, Args...>)
+{
+    return _bind_front_t<F, Args...>(0, std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+
 // =====================================================================================================================
 // Algorithms
 // =====================================================================================================================
@@ -158,14 +558,18 @@ auto optional =
 };
 
 
+// Looping algorithms fail early if the active scan budget is exhausted. See fn::within_budget.
 auto at_most =
 []
 <class... Args, boolean_invocable<Args...> F>
 (std::size_t n, F&& f, Args&&... args) -> bool
 {
-     ++n;
-     while (--n && std::invoke(f, args...));
-     return true;
+     return detail::run_loop([&] (auto charge) {
+          ++n;
+          while (--n && std::invoke(f, args...))
+               if (!charge.spend()) [[unlikely]]    return false;
+          return true;
+     });
 };
 
 
@@ -174,10 +578,15 @@ auto n_times =
 <class... Args, boolean_invocable<Args...> F>
 (std::size_t n, F&& f, Args&&... args) -> bool
 {
-     ++n;
-     while (--n)
-         if (!std::invoke(f, args...))    return false;
-     return true;
+     return detail::run_loop([&] (auto charge) {
+          ++n;
+          while (--n)
+          {
+               if (!std::invoke(f, args...))             return false;
+               if (!charge.spend()) [[unlikely]]         return false;
+          }
+          return true;
+     });
 };
 
 
@@ -197,8 +606,11 @@ auto many =
 <class... Args, boolean_invocable<Args...> F>
 (F&& f, Args&&... args) -> bool
 {
-     while (std::invoke(f, args...));
-     return true;
+     return detail::run_loop([&] (auto charge) {
+          while (std::invoke(f, args...))
+               if (!charge.spend()) [[unlikely]]    return false;
+          return true;
+     });
 };
 
 
@@ -220,6 +632,23 @@ auto some =
 };
 
 
+// Invokes f with args... while the budget is the active scan budget of this thread. The previous budget is restored
+// afterwards, so budgeted scans may nest. A nested scan is charged to its own budget and to every enclosing one, and is
+// reported as exhausted when any of them is.
+auto within_budget =
+[]
+<class... Args, boolean_invocable<Args...> F>
+(scan_budget& budget, F&& f, Args&&... args) -> scan_result
+{
+     detail::budget_scope scope {budget};
+
+     bool result = std::invoke(std::forward<F>(f), std::forward<Args>(args)...);
+
+     if (budget.exhausted())     return scan_result::exhausted;
+     return result ? scan_result::success : scan_result::failure;
+};
+
+
 // Should consider providing an overload which works like this: any<3>(arg1, arg2, arg3, f1, f2)
 // This would be less boilerplate for the user.
 // Maybe could write a recursive template that, with specializations, peels the boolean_invocables off one by one.
@@ -273,47 +702,53 @@ namespace fo {
 // =====================================================================================================================
 // Combinators
 // =====================================================================================================================
-auto identity = [] (auto&& f)                { return std::bind_front(fn::identity,   std::forward<decltype(f)>(f)); };
-auto negate   = [] (auto&& f)                { return std::bind_front(fn::negate,     std::forward<decltype(f)>(f)); };
-auto optional = [] (auto&& f)                { return std::bind_front(fn::optional,   std::forward<decltype(f)>(f)); };
-auto at_most  = [] (std::size_t n, auto&& f) { return std::bind_front(fn::at_most, n, std::forward<decltype(f)>(f)); };
-auto n_times  = [] (std::size_t n, auto&& f) { return std::bind_front(fn::n_times, n, std::forward<decltype(f)>(f)); };
+// Each combinator binds its child to an algorithm, so a composition of stateless parts is an empty, trivially copyable
+// type. A function pointer can be made stateless with lift.
+template <auto Fn>
+inline constexpr fn::lift_t<Fn> lift {};
+
+
+auto identity = [] (auto&& f)                { return fn::bind_front(fn::identity,   std::forward<decltype(f)>(f)); };
+auto negate   = [] (auto&& f)                { return fn::bind_front(fn::negate,     std::forward<decltype(f)>(f)); };
+auto optional = [] (auto&& f)                { return fn::bind_front(fn::optional,   std::forward<decltype(f)>(f)); };
+auto at_most  = [] (std::size_t n, auto&& f) { return fn::bind_front(fn::at_most, n, std::forward<decltype(f)>(f)); };
+auto n_times  = [] (std::size_t n, auto&& f) { return fn::bind_front(fn::n_times, n, std::forward<decltype(f)>(f)); };
 
 
 auto repeat = [] (std::size_t min, std::size_t max, auto&& f)
 {
-     return std::bind_front(fn::repeat, min, max, std::forward<decltype(f)>(f));
+     return fn::bind_front(fn::repeat, min, max, std::forward<decltype(f)>(f));
+};
+
+
+auto many     = [] (auto&& f)                { return fn::bind_front(fn::many,        std::forward<decltype(f)>(f)); };
+auto at_least = [] (std::size_t n, auto&& f) { return fn::bind_front(fn::at_least, n, std::forward<decltype(f)>(f)); };
+auto some     = [] (auto&& f)                { return fn::bind_front(fn::some,        std::forward<decltype(f)>(f)); };
+
+
+auto within_budget = [] (scan_budget& budget, auto&& f)
+{
+     return fn::bind_front(fn::within_budget, std::ref(budget), std::forward<decltype(f)>(f));
 };
 
 
-auto many     = [] (auto&& f)                { return std::bind_front(fn::many,        std::forward<decltype(f)>(f)); };
-auto at_least = [] (std::size_t n, auto&& f) { return std::bind_front(fn::at_least, n, std::forward<decltype(f)>(f)); };
-auto some     = [] (auto&& f)                { return std::bind_front(fn::some,        std::forward<decltype(f)>(f)); };
+// Marks a rule boundary. See rule_options.
+template <rule_options Options = rule_options {}, class F>
+constexpr fn::rule_t<std::decay_t<F>, Options> rule (F&& f)
+{
+     return {std::forward<F>(f)};
+}
 
 
 auto any = [] (auto&&... f)
 {
-     return
-          [f...]
-          <class... CallArgs>
-               requires (... && boolean_invocable<decltype(f), CallArgs...>)
-          (CallArgs&&... call_args) mutable -> bool
-          {
-               return (... || std::invoke(f, call_args...));
-          };
+     return fn::any_of_t<std::decay_t<decltype(f)>...> {{{std::forward<decltype(f)>(f)}...}};
 };
 
 
 auto all = [] (auto&&... f)
 {
-     return
-          [f...]
-          <class... CallArgs>
-               requires (... && boolean_invocable<decltype(f), CallArgs...>)
-          (CallArgs&&... call_args) mutable -> bool
-          {
-               return (... && std::invoke(f, call_args...));
-          };
+     return fn::all_of_t<std::decay_t<decltype(f)>...> {{{std::forward<decltype(f)>(f)}...}};
 };
 
 } // namespace fo
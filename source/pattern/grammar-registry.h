@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * Grammar Registry
+ *
+ * Replacement of compiled grammars in a running service, without blocking the threads which use them.
+ */
+
+// The registry holds the current version of an immutable grammar behind an atomic pointer. Workers read it through a
+// reader, which announces the epoch in which it began reading before loading the pointer. Publishing a new version
+// swaps the pointer, retires the old version with the epoch it was replaced in, and advances the epoch. A retired
+// version is destroyed once every reader is either idle or began reading in a later epoch, and so cannot hold it.
+//
+// Reading costs one store and one load, touches no shared cache line that is written by other readers, and never
+// waits. Publishing never waits for readers either: versions still in use are left for a later reclaim.
+//
+// The grammar must be safe to use from several threads at once through a const reference. For example, jit_pattern
+// and capture_dfa are, but pattern_set is not, since its cache of states is built while it scans.
+
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>          // std::unique_ptr
+#include <mutex>
+#include <stdexcept>       // std::runtime_error
+#include <utility>         // std::exchange
+#include <vector>
+
+
+namespace Pattern {
+
+template <class Grammar>
+class grammar_registry
+{
+     struct alignas(64) reader_slot
+     {
+          std::atomic<std::uint64_t> epoch  {0};         // 0 while idle
+          std::atomic<bool>          in_use {false};
+     };
+
+
+public:
+     static constexpr std::size_t max_readers = 128;
+
+
+     explicit grammar_registry (std::unique_ptr<const Grammar> initial)
+          : current {initial.release()}
+     {}
+
+     grammar_registry (const grammar_registry&)            = delete;
+     grammar_registry& operator= (const grammar_registry&) = delete;
+
+     // Requires that no reader is active
+     ~grammar_registry ()
+     {
+          delete current.load();
+     }
+
+
+     // --------------------------------------------------
+     // Reading
+     // --------------------------------------------------
+     class reader;
+
+     // Keeps the version which was current when it was created alive, until it is destroyed
+     class guard
+     {
+     public:
+          guard (const guard&)            = delete;
+          guard& operator= (const guard&) = delete;
+
+          ~guard ()     { slot->epoch.store(0, std::memory_order_release); }
+
+          const Grammar& operator*  () const noexcept     { return *grammar; }
+          const Grammar* operator-> () const noexcept     { return grammar;  }
+
+     private:
+          friend class reader;
+
+          reader_slot*   slot;
+          const Grammar* grammar;
+
+          guard (reader_slot* slot, const Grammar* grammar)
+               : slot {slot}, grammar {grammar}
+          {}
+     };
+
+
+     // A handle for one thread, claiming one of max_readers slots
+     class reader
+     {
+     public:
+          reader (const reader&)            = delete;
+          reader& operator= (const reader&) = delete;
+
+          reader (reader&& other) noexcept
+               : registry {other.registry}, slot {std::exchange(other.slot, nullptr)}
+          {}
+
+          ~reader ()
+          {
+               if (slot)     slot->in_use.store(false, std::memory_order_release);
+          }
+
+          // Pins the current version. Guards of one reader must not overlap.
+          guard read () const
+          {
+               // The announcement must be visible before the pointer is loaded, so both are sequentially consistent
+               slot->epoch.store(registry->epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+               return {slot, registry->current.load(std::memory_order_seq_cst)};
+          }
+
+     private:
+          friend class grammar_registry;
+
+          const grammar_registry* registry;
+          reader_slot*            slot;
+
+          reader (const grammar_registry* registry, reader_slot* slot)
+               : registry {registry}, slot {slot}
+          {}
+     };
+
+
+     reader make_reader ()
+     {
+          for (auto& s : slots)
+          {
+               bool expected = false;
+               if (s.in_use.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                    return {this, &s};
+          }
+
+          throw std::runtime_error("grammar_registry: too many readers");
+     }
+
+
+     // --------------------------------------------------
+     // Publishing
+     // --------------------------------------------------
+     /**
+      * Replace the current version. Readers pick it up at their next read, and the old version is destroyed once no
+      * reader can hold it.
+      *
+      * @return   The number of versions published so far
+      */
+     std::uint64_t publish (std::unique_ptr<const Grammar> next)
+     {
+          std::lock_guard lock {writer};
+
+          const Grammar* old = current.exchange(next.release(), std::memory_order_seq_cst);
+          retired.push_back({epoch.fetch_add(1, std::memory_order_seq_cst), std::unique_ptr<const Grammar> {old}});
+
+          reclaim_locked();
+          return ++versions;
+     }
+
+
+     // Destroys retired versions which no reader can hold, returning the number still waiting
+     std::size_t reclaim ()
+     {
+          std::lock_guard lock {writer};
+          return reclaim_locked();
+     }
+
+
+private:
+     struct retired_version
+     {
+          std::uint64_t                  epoch;
+          std::unique_ptr<const Grammar> grammar;
+     };
+
+     std::atomic<const Grammar*>          current;
+     std::atomic<std::uint64_t>           epoch {1};
+     std::array<reader_slot, max_readers> slots;
+
+     std::mutex                           writer;
+     std::vector<retired_version>         retired;
+     std::uint64_t                        versions = 1;
+
+
+     std::size_t reclaim_locked ()
+     {
+          // The earliest epoch in which an active reader began
+          std::uint64_t oldest = UINT64_MAX;
+
+          for (auto& s : slots)
+          {
+               std::uint64_t e = s.epoch.load(std::memory_order_seq_cst);
+               if (e != 0 && e < oldest)     oldest = e;
+          }
+
+          std::erase_if(retired, [oldest] (const retired_version& r) { return r.epoch < oldest; });
+          return retired.size();
+     }
+}; // class grammar_registry
+
+} // namespace Pattern
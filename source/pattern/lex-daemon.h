@@ -0,0 +1,652 @@
+/*
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * Lexing Daemon
+ *
+ * A resident server which lexes files and buffers on request over a Unix domain socket, and its client.
+ */
+
+// Starting a process for each file pays for process start-up, page faults, and the initialization of tables every
+// time. The server is started once and keeps all of that warm: each worker thread holds its own copy of the lexer,
+// its own token stream, and its own buffers, all reused from one request to the next.
+//
+// Workers share one epoll instance. Each connection is registered as one-shot, so exactly one worker is woken for it,
+// and it is rearmed once its complete requests have been served. Stopping the server signals an eventfd which wakes
+// every worker.
+//
+// A worker never waits on a client. What a socket will not take at once is queued on its connection, which is then
+// watched for writability instead of for requests, so a client which stops reading stops being served without holding
+// up any worker. Requests already received are still served after the client closes its end.
+//
+// Messages are framed as a header of two 32-bit words in host byte order, since both ends run on the same host:
+//
+//      request      kind, size,    then size bytes of a path or of source text
+//      response     status, count, then count tags, count 32-bit offsets, and count 32-bit lengths
+//
+// A response holds the arrays of a token_stream as they are in memory, so encoding and decoding are a copy each.
+// A bad request is answered, and its connection closed once every response queued on it has been written.
+//
+// The lexer is any callable (std::string_view source, token_stream<Tag>& tokens), which appends the tokens of the
+// source to the stream.
+
+
+#pragma once
+
+#include <algorithm>       // std::max
+#include <atomic>
+#include <cerrno>
+#include <concepts>
+#include <cstdint>
+#include <cstring>         // std::memcpy
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_set>
+#include <utility>         // std::exchange
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "token-stream.h"
+
+
+namespace Pattern {
+
+enum class lex_request : std::uint32_t { path, source };
+
+enum class lex_status : std::uint32_t
+{
+     ok,
+     unreadable_file,
+     file_too_large,     // token offsets are 32-bit
+     bad_request,
+     lexer_failed,       // the lexer threw
+     disconnected        // reported by the client when the connection failed
+};
+
+
+template <class Lexer, class Tag>
+concept stream_lexer = token_tag<Tag> && std::invocable<Lexer&, std::string_view, token_stream<Tag>&>;
+
+
+namespace detail {
+
+struct frame_header
+{
+     std::uint32_t first;      // request kind, or response status
+     std::uint32_t second;     // payload size, or token count
+};
+
+
+// Requests larger than this are refused, and their connection closed
+constexpr std::uint32_t max_request = 64 << 20;
+
+
+inline sockaddr_un unix_address (const std::string& path)
+{
+     sockaddr_un address {};
+
+     if (path.size() >= sizeof(address.sun_path))
+          throw std::system_error(ENAMETOOLONG, std::generic_category(), "unix socket path");
+
+     address.sun_family = AF_UNIX;
+     path.copy(address.sun_path, path.size());
+     return address;
+}
+
+
+[[noreturn]] inline void throw_errno (const char* what)
+{
+     throw std::system_error(errno, std::generic_category(), what);
+}
+
+
+// Writes as much of the buffers as the socket takes without waiting, and consumes what was written. Returns false on an
+// error other than a full socket.
+inline bool write_some (int fd, iovec*& buffers, int& count)
+{
+     while (count > 0)
+     {
+          msghdr message {};
+          message.msg_iov    = buffers;
+          message.msg_iovlen = static_cast<std::size_t>(count);
+
+          ssize_t n = ::sendmsg(fd, &message, MSG_NOSIGNAL);
+
+          if (n < 0)
+          {
+               if (errno == EINTR)     continue;
+               return errno == EAGAIN || errno == EWOULDBLOCK;
+          }
+
+          auto done = static_cast<std::size_t>(n);
+
+          while (count > 0 && done >= buffers->iov_len)
+          {
+               done -= buffers->iov_len;
+               ++buffers;
+               --count;
+          }
+
+          if (count > 0)
+          {
+               buffers->iov_base = static_cast<char*>(buffers->iov_base) + done;
+               buffers->iov_len -= done;
+          }
+     }
+
+     return true;
+}
+
+
+// Writes every buffer to a blocking socket
+inline bool write_all (int fd, iovec* buffers, int count)
+{
+     return write_some(fd, buffers, count) && count == 0;
+}
+
+
+inline bool read_all (int fd, void* data, std::size_t size)
+{
+     auto p = static_cast<char*>(data);
+
+     while (size > 0)
+     {
+          ssize_t n = ::read(fd, p, size);
+
+          if (n < 0 && errno == EINTR)     continue;
+          if (n <= 0)                      return false;
+
+          p    += n;
+          size -= static_cast<std::size_t>(n);
+     }
+
+     return true;
+}
+
+} // namespace detail
+
+
+// =====================================================================================================================
+// Server
+// =====================================================================================================================
+template <token_tag Tag, stream_lexer<Tag> Lexer>
+class lex_server
+{
+public:
+     static constexpr std::uint32_t max_request = detail::max_request;
+
+
+     /**
+      * Listen on a Unix domain socket, replacing any file at its path, and start the workers.
+      *
+      * @param    lexer      Copied into each worker
+      * @throw    std::system_error    When the socket cannot be created
+      */
+     lex_server (std::string socket_path, Lexer lexer, unsigned threads = 2)
+          : path {std::move(socket_path)}, prototype {std::move(lexer)}
+     {
+          auto address = detail::unix_address(path);
+
+          listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+          if (listener < 0)     detail::throw_errno("lex_server: socket");
+
+          ::unlink(path.c_str());
+
+          if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+              ::listen(listener, SOMAXCONN) < 0)
+          {
+               int error = errno;
+               ::close(listener);
+               throw std::system_error(error, std::generic_category(), "lex_server: bind");
+          }
+
+          epoll   = ::epoll_create1(EPOLL_CLOEXEC);
+          stopper = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+          if (epoll < 0 || stopper < 0)
+          {
+               int error = errno;
+               close_all();
+               throw std::system_error(error, std::generic_category(), "lex_server: epoll");
+          }
+
+          // The stopper is level-triggered and never drained, so it wakes every worker
+          watch(stopper, &stopper, EPOLLIN, EPOLL_CTL_ADD);
+          watch(listener, &listener, EPOLLIN | EPOLLONESHOT, EPOLL_CTL_ADD);
+
+          for (unsigned i = 0; i < std::max(threads, 1u); ++i)
+               workers.emplace_back([this] { work(); });
+     }
+
+     lex_server (const lex_server&)            = delete;
+     lex_server& operator= (const lex_server&) = delete;
+
+     ~lex_server ()
+     {
+          stop();
+          wait();
+
+          for (connection* c : connections)
+          {
+               ::close(c->fd);
+               delete c;
+          }
+
+          close_all();
+          ::unlink(path.c_str());
+     }
+
+
+     void stop () noexcept
+     {
+          std::uint64_t one = 1;
+          [[maybe_unused]] auto n = ::write(stopper, &one, sizeof(one));
+     }
+
+     // Blocks until the server is stopped, e.g. from a signal handler or another thread
+     void wait ()
+     {
+          for (auto& w : workers)
+               if (w.joinable())     w.join();
+     }
+
+     std::uint64_t requests () const noexcept     { return served.load(std::memory_order_relaxed); }
+
+
+private:
+     struct connection
+     {
+          int               fd;
+          std::vector<char> input;
+          std::vector<char> output;              // responses the socket has not yet taken
+          bool              closed  = false;     // by the client, which may still read its responses
+          bool              closing = false;     // after a bad request, once its response has been written
+     };
+
+     std::string                     path;
+     Lexer                           prototype;
+     int                             listener = -1;
+     int                             epoll    = -1;
+     int                             stopper  = -1;
+     std::vector<std::thread>        workers;
+     std::atomic<std::uint64_t>      served {0};
+
+     std::mutex                      connections_mutex;
+     std::unordered_set<connection*> connections;
+
+
+     void close_all () noexcept
+     {
+          for (int fd : {listener, epoll, stopper})
+               if (fd >= 0)     ::close(fd);
+     }
+
+
+     void watch (int fd, void* data, std::uint32_t events, int operation)
+     {
+          epoll_event e {};
+          e.events   = events;
+          e.data.ptr = data;
+          ::epoll_ctl(epoll, operation, fd, &e);
+     }
+
+
+     // --------------------------------------------------
+     // Workers
+     // --------------------------------------------------
+     // The state each worker keeps warm between requests
+     struct worker_state
+     {
+          Lexer             lexer;
+          token_stream<Tag> tokens;
+          std::string       file;
+     };
+
+
+     void work ()
+     {
+          worker_state state {prototype, {}, {}};
+          epoll_event  events[16];
+
+          while (true)
+          {
+               int n = ::epoll_wait(epoll, events, 16, -1);
+
+               if (n < 0)
+               {
+                    if (errno == EINTR)     continue;
+                    return;
+               }
+
+               for (int i = 0; i < n; ++i)
+               {
+                    void* data = events[i].data.ptr;
+
+                    if      (data == &stopper)      return;
+                    else if (data == &listener)     accept_all();
+                    else                            serve(static_cast<connection*>(data), state);
+               }
+          }
+     }
+
+
+     void accept_all ()
+     {
+          while (true)
+          {
+               int fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+               if (fd < 0)
+               {
+                    if (errno == EINTR)     continue;
+                    break;
+               }
+
+               auto c = new connection {fd, {}, {}};
+
+               {
+                    std::lock_guard lock {connections_mutex};
+                    connections.insert(c);
+               }
+
+               watch(fd, c, EPOLLIN | EPOLLRDHUP | EPOLLONESHOT, EPOLL_CTL_ADD);
+          }
+
+          watch(listener, &listener, EPOLLIN | EPOLLONESHOT, EPOLL_CTL_MOD);
+     }
+
+
+     void serve (connection* c, worker_state& state)
+     {
+          // Nothing more is read until what is queued has been written
+          bool open = flush(*c);
+
+          if (open && c->output.empty() && !c->closing)
+          {
+               if (!c->closed && !receive(*c))     c->closed = true;
+
+               open = process(*c, state);
+          }
+
+          if (open && !c->output.empty())
+          {
+               watch(c->fd, c, EPOLLOUT | EPOLLONESHOT, EPOLL_CTL_MOD);
+               return;
+          }
+
+          if (open && !c->closed && !c->closing)
+          {
+               watch(c->fd, c, EPOLLIN | EPOLLRDHUP | EPOLLONESHOT, EPOLL_CTL_MOD);
+               return;
+          }
+
+          {
+               std::lock_guard lock {connections_mutex};
+               connections.erase(c);
+          }
+
+          ::epoll_ctl(epoll, EPOLL_CTL_DEL, c->fd, nullptr);
+          ::close(c->fd);
+          delete c;
+     }
+
+
+     // Serves the complete requests received, until a response must wait for the socket or a bad request is answered.
+     // Returns false if the connection failed.
+     bool process (connection& c, worker_state& state)
+     {
+          std::size_t used = 0;
+          bool        open = true;
+
+          while (open && !c.closing && c.output.empty() && c.input.size() - used >= sizeof(detail::frame_header))
+          {
+               detail::frame_header h;
+               std::memcpy(&h, c.input.data() + used, sizeof(h));
+
+               if (h.second > max_request)
+               {
+                    c.closing = true;
+                    open = respond(c, lex_status::bad_request, state.tokens);
+                    break;
+               }
+
+               if (c.input.size() - used - sizeof(h) < h.second)     break;
+
+               std::string_view payload {c.input.data() + used + sizeof(h), h.second};
+               used += sizeof(h) + h.second;
+
+               // Counted before responding, so a client which has its response also sees its request counted
+               served.fetch_add(1, std::memory_order_relaxed);
+               open = handle(c, static_cast<lex_request>(h.first), payload, state);
+          }
+
+          c.input.erase(c.input.begin(), c.input.begin() + static_cast<std::ptrdiff_t>(used));
+          return open;
+     }
+
+
+     // Reads whatever is available, until the first request is found too large or a request of the largest size is
+     // buffered, so a client which keeps writing neither holds the worker nor grows its input without bound. The rest
+     // is left in the socket, which wakes a worker again. Returns false once the client has closed its end.
+     static bool receive (connection& c)
+     {
+          char buffer[16384];
+
+          while (c.input.size() <= sizeof(detail::frame_header) + max_request)
+          {
+               if (c.input.size() >= sizeof(detail::frame_header))
+               {
+                    detail::frame_header h;
+                    std::memcpy(&h, c.input.data(), sizeof(h));
+                    if (h.second > max_request)     break;
+               }
+
+               ssize_t n = ::read(c.fd, buffer, sizeof(buffer));
+
+               if (n > 0)                      c.input.insert(c.input.end(), buffer, buffer + n);
+               else if (n == 0)                return false;
+               else if (errno == EINTR)        continue;
+               else                            return errno == EAGAIN;
+          }
+
+          return true;
+     }
+
+
+     bool handle (connection& c, lex_request kind, std::string_view payload, worker_state& state)
+     {
+          state.tokens.clear();
+
+          try
+          {
+               switch (kind)
+               {
+               case lex_request::source:
+                    state.lexer(payload, state.tokens);
+                    return respond(c, lex_status::ok, state.tokens);
+
+               case lex_request::path:
+                    if (lex_status status = read_file(std::string {payload}, state.file); status != lex_status::ok)
+                         return respond(c, status, state.tokens);
+
+                    state.lexer(std::string_view {state.file}, state.tokens);
+                    return respond(c, lex_status::ok, state.tokens);
+               }
+          }
+          catch (...)
+          {
+               // The worker keeps serving; its stream is cleared by the next request
+               return respond(c, lex_status::lexer_failed, state.tokens);
+          }
+
+          c.closing = true;
+          return respond(c, lex_status::bad_request, state.tokens);
+     }
+
+
+     // Offsets in a token stream are 32-bit, so larger files are refused
+     static lex_status read_file (const std::string& file_path, std::string& contents)
+     {
+          std::ifstream file {file_path, std::ios::in | std::ios::binary | std::ios::ate};
+          if (!file)     return lex_status::unreadable_file;
+
+          auto size = static_cast<std::uint64_t>(file.tellg());
+          if (size > 0xffffffff)     return lex_status::file_too_large;
+
+          contents.resize(size);
+          file.seekg(0);
+
+          if (!file.read(contents.data(), static_cast<std::streamsize>(size)))     return lex_status::unreadable_file;
+          return lex_status::ok;
+     }
+
+
+     static bool respond (connection& c, lex_status status, const token_stream<Tag>& tokens)
+     {
+          std::size_t n = status == lex_status::ok ? tokens.size() : 0;
+          detail::frame_header h {static_cast<std::uint32_t>(status), static_cast<std::uint32_t>(n)};
+
+          iovec buffers[4] = {
+               {&h, sizeof(h)},
+               {const_cast<Tag*>(tokens.tags()), n * sizeof(Tag)},
+               {const_cast<std::uint32_t*>(tokens.offsets()), n * sizeof(std::uint32_t)},
+               {const_cast<std::uint32_t*>(tokens.lengths()), n * sizeof(std::uint32_t)}
+          };
+
+          iovec* pending = buffers;
+          int    count   = 4;
+
+          if (c.output.empty() && !detail::write_some(c.fd, pending, count))     return false;
+
+          for (; count > 0; ++pending, --count)
+          {
+               auto data = static_cast<const char*>(pending->iov_base);
+               c.output.insert(c.output.end(), data, data + pending->iov_len);
+          }
+
+          return true;
+     }
+
+
+     // Writes what is queued, as far as the socket takes it. Returns false if the connection failed.
+     static bool flush (connection& c)
+     {
+          if (c.output.empty())     return true;
+
+          iovec  buffer {c.output.data(), c.output.size()};
+          iovec* pending = &buffer;
+          int    count   = 1;
+
+          if (!detail::write_some(c.fd, pending, count))     return false;
+
+          std::size_t left = count > 0 ? buffer.iov_len : 0;
+          c.output.erase(c.output.begin(), c.output.end() - static_cast<std::ptrdiff_t>(left));
+          return true;
+     }
+}; // class lex_server
+
+
+// =====================================================================================================================
+// Client
+// =====================================================================================================================
+// A connection to a lex_server, for one thread at a time
+template <token_tag Tag>
+class lex_client
+{
+public:
+     /**
+      * @throw    std::system_error    When the server cannot be reached
+      */
+     explicit lex_client (const std::string& socket_path)
+     {
+          auto address = detail::unix_address(socket_path);
+
+          fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+          if (fd < 0)     detail::throw_errno("lex_client: socket");
+
+          if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+          {
+               int error = errno;
+               ::close(fd);
+               throw std::system_error(error, std::generic_category(), "lex_client: connect");
+          }
+     }
+
+     lex_client (lex_client&& other) noexcept
+          : fd {std::exchange(other.fd, -1)}
+     {}
+
+     lex_client (const lex_client&)            = delete;
+     lex_client& operator= (const lex_client&) = delete;
+
+     ~lex_client ()
+     {
+          if (fd >= 0)     ::close(fd);
+     }
+
+
+     // Lex a file, which is read by the server. Offsets are within the file.
+     lex_status lex_file (std::string_view path, token_stream<Tag>& tokens)
+     {
+          return request(lex_request::path, path, tokens);
+     }
+
+     // Lex a buffer, which is sent to the server. Offsets are within the buffer.
+     lex_status lex_source (std::string_view source, token_stream<Tag>& tokens)
+     {
+          return request(lex_request::source, source, tokens);
+     }
+
+
+private:
+     int                        fd = -1;
+     std::vector<Tag>           tags;          // received arrays, reused between requests
+     std::vector<std::uint32_t> offsets;
+     std::vector<std::uint32_t> lengths;
+
+
+     lex_status request (lex_request kind, std::string_view payload, token_stream<Tag>& tokens)
+     {
+          tokens.clear();
+
+          // The server would close the connection on reading the header, so it is not sent
+          if (payload.size() > detail::max_request)     return lex_status::bad_request;
+
+          detail::frame_header h {static_cast<std::uint32_t>(kind), static_cast<std::uint32_t>(payload.size())};
+
+          iovec buffers[2] = {
+               {&h, sizeof(h)},
+               {const_cast<char*>(payload.data()), payload.size()}
+          };
+
+          if (!detail::write_all(fd, buffers, 2) || !detail::read_all(fd, &h, sizeof(h)))
+               return lex_status::disconnected;
+
+          const std::size_t n = h.second;
+
+          tags.resize(n);
+          offsets.resize(n);
+          lengths.resize(n);
+
+          if (!detail::read_all(fd, tags.data(), n * sizeof(Tag)) ||
+              !detail::read_all(fd, offsets.data(), n * sizeof(std::uint32_t)) ||
+              !detail::read_all(fd, lengths.data(), n * sizeof(std::uint32_t)))
+               return lex_status::disconnected;
+
+          tokens.assign(n, tags.data(), offsets.data(), lengths.data());
+          return static_cast<lex_status>(h.first);
+     }
+}; // class lex_client
+
+} // namespace Pattern
@@ -21,6 +21,7 @@
 
 #include "../include/scanning-algorithms.h"
 #include "../include/matching-algorithms.h"
+#include "fn-combinators.h"     // detail::pack
 
 
 using std::forward;
@@ -49,7 +50,7 @@ namespace PatLib {
     class class_name                                                                                             \
     {                                                                                                            \
     public:                                                                                                      \
-        class_name (Parameters... params) : parameters {move(params)...} {}                                      \
+        class_name (Parameters... params) : parameters {{move(params)}...} {}                                    \
                                                                                                                  \
         template <typename Output>                                                                               \
         bool operator() (Output out, mutable_range& in)                                                          \
@@ -80,12 +81,12 @@ namespace PatLib {
         }                                                                                                        \
                                                                                                                  \
     private:                                                                                                     \
-        const std::tuple<Parameters...> parameters;                                                              \
+        [[no_unique_address]] Pattern::detail::pack<Parameters...> parameters;                                   \
                                                                                                                  \
         template <typename Output, typename Tuple, std::size_t... I>                                             \
         bool range_impl (Output out, mutable_range& in, Tuple&& t, std::index_sequence<I...>)                    \
         {                                                                                                        \
-            return match_with_if(out, in, function_name, std::get<I>(forward<Tuple>(t))...);                     \
+            return match_with_if(out, in, function_name, Pattern::detail::get_element<I>(forward<Tuple>(t))...); \
         }                                                                                                        \
                                                                                                                  \
         template <forward_iterator Iterator, typename Tuple, std::size_t... I>                                   \
@@ -93,7 +94,8 @@ namespace PatLib {
                          mutable_range& in,                                                                      \
                          Tuple&& t, std::index_sequence<I...>)                                                   \
         {                                                                                                        \
-            return match_with_if(first_out, last_out, in, function_name, std::get<I>(forward<Tuple>(t))...);     \
+            return match_with_if(first_out, last_out, in,                                                        \
+                                 function_name, Pattern::detail::get_element<I>(forward<Tuple>(t))...);          \
         }                                                                                                        \
                                                                                                                  \
         template <typename Output,                                                                               \
@@ -105,7 +107,8 @@ namespace PatLib {
                         Iterator& first_in, Sentinel last_in,                                                    \
                         Tuple&& t, std::index_sequence<I...>)                                                    \
         {                                                                                                        \
-            return match_with_if(out, first_in, last_in, function_name, std::get<I>(std::forward<Tuple>(t))...); \
+            return match_with_if(out, first_in, last_in,                                                         \
+                                 function_name, Pattern::detail::get_element<I>(std::forward<Tuple>(t))...);     \
         }                                                                                                        \
                                                                                                                  \
         template <forward_iterator Iterator,                                                                     \
@@ -117,7 +120,7 @@ namespace PatLib {
                         Tuple&& t, std::index_sequence<I...>)                                                    \
         {                                                                                                        \
             return match_with_if(first_out, last_out, first_in, last_in,                                         \
-                                 function_name, std::get<I>(std::forward<Tuple>(t))...);                         \
+                                 function_name, Pattern::detail::get_element<I>(std::forward<Tuple>(t))...);     \
         }                                                                                                        \
     };                                                                                                           \
 
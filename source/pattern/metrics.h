@@ -0,0 +1,615 @@
+/*
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * Metrics
+ *
+ * Latency histograms and counters for lexing and parsing workloads, exported in the Prometheus text format.
+ */
+
+// Each thread records into its own shard, which only that thread writes. Recording is then a relaxed load and store
+// of a counter in a cache line no other thread writes: no locks, no read-modify-write instructions, and no contention,
+// so metrics may be left on permanently. Merging reads every shard while they are being written, and sees each counter
+// at some recent value.
+//
+// Latencies are recorded in nanoseconds into log-linear buckets, in the manner of HDR histograms: each power of two is
+// divided into 32 buckets, so any quantile is reported within about 3% of its true value, from a fixed array of about
+// 10 KB per histogram, whatever the number of samples.
+//
+// A shard is released when its thread no longer records, e.g. by a scoped_shard as the thread exits. Its totals are
+// kept by the registry and its memory is freed, so threads may come and go without the shards accumulating.
+//
+// A snapshot merges the shards of every thread. It is written in the Prometheus text format, counters as counters and
+// histograms as summaries with the 0.5, 0.99, and 0.999 quantiles in seconds, to a stream, a file which is replaced
+// atomically (e.g. for the textfile collector of the node exporter), or a local socket. A metrics_exporter does so
+// periodically from a background thread.
+
+
+#pragma once
+
+#include <algorithm>       // std::max, std::min
+#include <array>
+#include <atomic>
+#include <bit>             // std::bit_width
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>          // std::rename
+#include <fstream>
+#include <functional>      // std::hash
+#include <list>
+#include <memory>          // std::unique_ptr
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>       // std::invalid_argument, std::logic_error
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+
+namespace Pattern {
+
+// =====================================================================================================================
+// Histograms
+// =====================================================================================================================
+struct histogram_buckets
+{
+     static constexpr int         sub_bucket_bits = 5;
+     static constexpr int         max_bits        = 44;     // values up to 2^44 ns, about 4.9 hours
+     static constexpr std::size_t sub_buckets     = std::size_t {1} << sub_bucket_bits;
+     static constexpr std::size_t count           = (max_bits - sub_bucket_bits + 1) * sub_buckets;
+
+     // Values below sub_buckets have a bucket each. Above, the bucket is chosen by the leading bits of the value.
+     static constexpr std::size_t of (std::uint64_t value) noexcept
+     {
+          if (value < sub_buckets)     return value;
+
+          int msb = std::bit_width(value) - 1;
+          if (msb >= max_bits)     return count - 1;
+
+          int shift = msb - sub_bucket_bits;
+          return (shift + 1) * sub_buckets + ((value >> shift) - sub_buckets);
+     }
+
+     // The largest value in a bucket
+     static constexpr std::uint64_t highest (std::size_t bucket) noexcept
+     {
+          if (bucket < sub_buckets)     return bucket;
+
+          int shift = static_cast<int>(bucket / sub_buckets) - 1;
+          return ((bucket % sub_buckets + sub_buckets + 1) << shift) - 1;
+     }
+};
+
+
+// The samples of one thread. Only that thread may record.
+class latency_histogram
+{
+public:
+     void record (std::uint64_t nanoseconds) noexcept
+     {
+          bump(counts[histogram_buckets::of(nanoseconds)], 1);
+          bump(samples, 1);
+          bump(sum, nanoseconds);
+
+          if (nanoseconds > largest.load(std::memory_order_relaxed))
+               largest.store(nanoseconds, std::memory_order_relaxed);
+     }
+
+
+private:
+     friend class histogram_snapshot;
+
+     std::array<std::atomic<std::uint64_t>, histogram_buckets::count> counts {};
+     std::atomic<std::uint64_t> samples {0};
+     std::atomic<std::uint64_t> sum     {0};
+     std::atomic<std::uint64_t> largest {0};
+
+     // With a single writer, an increment needs no read-modify-write
+     static void bump (std::atomic<std::uint64_t>& a, std::uint64_t n) noexcept
+     {
+          a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+     }
+}; // class latency_histogram
+
+
+// The merged samples of any number of histograms
+class histogram_snapshot
+{
+public:
+     histogram_snapshot ()
+          : counts(histogram_buckets::count)
+     {}
+
+     void merge (const latency_histogram& h)
+     {
+          for (std::size_t i = 0; i < counts.size(); ++i)
+               counts[i] += h.counts[i].load(std::memory_order_relaxed);
+
+          samples += h.samples.load(std::memory_order_relaxed);
+          sum     += h.sum.load(std::memory_order_relaxed);
+          largest  = std::max(largest, h.largest.load(std::memory_order_relaxed));
+     }
+
+     void merge (const histogram_snapshot& h)
+     {
+          for (std::size_t i = 0; i < counts.size(); ++i)
+               counts[i] += h.counts[i];
+
+          samples += h.samples;
+          sum     += h.sum;
+          largest  = std::max(largest, h.largest);
+     }
+
+
+     std::uint64_t count () const noexcept     { return samples; }
+     std::uint64_t total () const noexcept     { return sum;     }
+     std::uint64_t max   () const noexcept     { return largest; }
+
+     /**
+      * The value below which a fraction q of the samples lie, within the precision of the buckets.
+      *
+      * @param    q    Between 0 and 1
+      * @return   The quantile in nanoseconds, or 0 without samples
+      */
+     std::uint64_t quantile (double q) const noexcept
+     {
+          if (samples == 0)     return 0;
+
+          // Merging reads counters as they are written, so the buckets may hold slightly more than samples
+          auto rank = static_cast<std::uint64_t>(q * static_cast<double>(samples - 1)) + 1;
+          std::uint64_t seen = 0;
+
+          for (std::size_t i = 0; i < counts.size(); ++i)
+          {
+               seen += counts[i];
+               if (seen < rank)     continue;
+
+               // The last bucket also holds every value too large for the others
+               return i + 1 == counts.size() ? largest : std::min(histogram_buckets::highest(i), largest);
+          }
+
+          return largest;
+     }
+
+
+private:
+     std::vector<std::uint64_t> counts;
+     std::uint64_t              samples = 0;
+     std::uint64_t              sum     = 0;
+     std::uint64_t              largest = 0;
+}; // class histogram_snapshot
+
+
+// =====================================================================================================================
+// Registry
+// =====================================================================================================================
+struct histogram_id { std::uint32_t index; };
+struct counter_id   { std::uint32_t index; };
+
+
+struct metrics_snapshot
+{
+     struct histogram
+     {
+          std::string        name;
+          std::string        help;
+          histogram_snapshot value;
+     };
+
+     struct counter
+     {
+          std::string   name;
+          std::string   help;
+          std::uint64_t value;
+     };
+
+     std::vector<histogram> histograms;
+     std::vector<counter>   counters;
+
+
+     void write_prometheus (std::ostream& out) const
+     {
+          for (const auto& c : counters)
+          {
+               out << "# HELP " << c.name << ' ' << c.help << '\n'
+                   << "# TYPE " << c.name << " counter\n"
+                   << c.name << ' ' << c.value << '\n';
+          }
+
+          for (const auto& h : histograms)
+          {
+               out << "# HELP " << h.name << ' ' << h.help << '\n'
+                   << "# TYPE " << h.name << " summary\n";
+
+               for (double q : {0.5, 0.99, 0.999})
+                    out << h.name << "{quantile=\"" << q << "\"} " << seconds(h.value.quantile(q)) << '\n';
+
+               out << h.name << "_sum "   << seconds(h.value.total()) << '\n'
+                   << h.name << "_count " << h.value.count()          << '\n';
+          }
+     }
+
+     std::string prometheus () const
+     {
+          std::ostringstream out;
+          write_prometheus(out);
+          return out.str();
+     }
+
+
+private:
+     static std::string seconds (std::uint64_t nanoseconds)
+     {
+          std::ostringstream out;
+          out.precision(9);
+          out << static_cast<double>(nanoseconds) / 1e9;
+          return out.str();
+     }
+}; // struct metrics_snapshot
+
+
+class metrics_registry
+{
+public:
+     // --------------------------------------------------
+     // Definitions
+     // --------------------------------------------------
+     // Metrics must be defined before the first shard is made.
+
+     /**
+      * @param    name    A Prometheus metric name, such as lox_lex_seconds
+      * @throw    std::invalid_argument    When the name is not a valid metric name
+      * @throw    std::logic_error         When a shard has already been made
+      */
+     histogram_id histogram (std::string name, std::string help)
+     {
+          define(name);
+          histogram_info.push_back({std::move(name), std::move(help)});
+          return {static_cast<std::uint32_t>(histogram_info.size() - 1)};
+     }
+
+     counter_id counter (std::string name, std::string help)
+     {
+          define(name);
+          counter_info.push_back({std::move(name), std::move(help)});
+          return {static_cast<std::uint32_t>(counter_info.size() - 1)};
+     }
+
+
+     // --------------------------------------------------
+     // Recording
+     // --------------------------------------------------
+     // The metrics of one thread
+     class shard
+     {
+     public:
+          shard (std::size_t histograms, std::size_t counters)
+               : histogram_array {std::make_unique<latency_histogram[]>(histograms)},
+                 counter_array   {std::make_unique<std::atomic<std::uint64_t>[]>(counters)}
+          {}
+
+          void record (histogram_id h, std::uint64_t nanoseconds) noexcept
+          {
+               histogram_array[h.index].record(nanoseconds);
+          }
+
+          void record (histogram_id h, std::chrono::nanoseconds elapsed) noexcept
+          {
+               record(h, static_cast<std::uint64_t>(elapsed.count()));
+          }
+
+          void add (counter_id c, std::uint64_t n = 1) noexcept
+          {
+               auto& a = counter_array[c.index];
+               a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+          }
+
+     private:
+          friend class metrics_registry;
+
+          std::unique_ptr<latency_histogram[]>          histogram_array;
+          std::unique_ptr<std::atomic<std::uint64_t>[]> counter_array;
+     };
+
+
+     // Makes a shard for the calling thread, which lives until it is released, or else as long as the registry
+     shard& make_shard ()
+     {
+          std::lock_guard lock {shards_mutex};
+
+          if (!sharded)
+          {
+               retired_histograms.resize(histogram_info.size());
+               retired_counters.resize(counter_info.size());
+               sharded = true;
+          }
+
+          return shards.emplace_back(histogram_info.size(), counter_info.size());
+     }
+
+
+     // Folds the totals of a shard into the registry and frees it. The shard must no longer be recorded into.
+     void release_shard (shard& released)
+     {
+          std::lock_guard lock {shards_mutex};
+
+          merge(released, retired_histograms, retired_counters);
+          shards.remove_if([&released] (const shard& s) { return &s == &released; });
+     }
+
+
+     std::size_t live_shards () const
+     {
+          std::lock_guard lock {shards_mutex};
+          return shards.size();
+     }
+
+
+     // --------------------------------------------------
+     // Merging
+     // --------------------------------------------------
+     metrics_snapshot snapshot () const
+     {
+          metrics_snapshot s;
+
+          for (const auto& h : histogram_info)     s.histograms.push_back({h.name, h.help, {}});
+          for (const auto& c : counter_info)       s.counters.push_back({c.name, c.help, 0});
+
+          std::lock_guard lock {shards_mutex};
+
+          for (std::size_t i = 0; i < retired_histograms.size(); ++i)
+               s.histograms[i].value.merge(retired_histograms[i]);
+
+          for (std::size_t i = 0; i < retired_counters.size(); ++i)
+               s.counters[i].value += retired_counters[i];
+
+          for (const auto& shard : shards)
+          {
+               for (std::size_t i = 0; i < s.histograms.size(); ++i)
+                    s.histograms[i].value.merge(shard.histogram_array[i]);
+
+               for (std::size_t i = 0; i < s.counters.size(); ++i)
+                    s.counters[i].value += shard.counter_array[i].load(std::memory_order_relaxed);
+          }
+
+          return s;
+     }
+
+
+     // --------------------------------------------------
+     // Export
+     // --------------------------------------------------
+     void write_prometheus (std::ostream& out) const     { snapshot().write_prometheus(out); }
+
+
+     // Replaces the file atomically, so a reader never sees a partial export. The temporary file is named for the
+     // process and thread, so that exporters to the same path do not write into each other's.
+     bool export_to_file (const std::string& path) const
+     {
+          const std::string temporary = path + ".tmp." + std::to_string(process_id()) + "." +
+                                        std::to_string(std::hash<std::thread::id> {}(std::this_thread::get_id()));
+
+          bool written = false;
+
+          {
+               std::ofstream file {temporary, std::ios::trunc};
+               if (!file)     return false;
+
+               write_prometheus(file);
+               written = static_cast<bool>(file.flush());
+          }
+
+          if (written && std::rename(temporary.c_str(), path.c_str()) == 0)     return true;
+
+          std::remove(temporary.c_str());
+          return false;
+     }
+
+
+     // Sends an export to a listener on a Unix domain socket
+     bool export_to_socket (const std::string& path) const
+     {
+#if defined(__unix__)
+          sockaddr_un address {};
+          if (path.size() >= sizeof(address.sun_path))     return false;
+
+          address.sun_family = AF_UNIX;
+          path.copy(address.sun_path, path.size());
+
+          int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+          if (fd < 0)     return false;
+
+          bool sent = ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+
+          const std::string text = snapshot().prometheus();
+
+          for (std::size_t done = 0; sent && done < text.size(); )
+          {
+               ssize_t n = ::send(fd, text.data() + done, text.size() - done, MSG_NOSIGNAL);
+               if (n <= 0)     sent = false;
+               else            done += static_cast<std::size_t>(n);
+          }
+
+          ::close(fd);
+          return sent;
+#else
+          (void) path;
+          return false;
+#endif
+     }
+
+
+private:
+     struct info
+     {
+          std::string name;
+          std::string help;
+     };
+
+     std::vector<info>  histogram_info;
+     std::vector<info>  counter_info;
+
+     mutable std::mutex                 shards_mutex;
+     std::list<shard>                   shards;                  // never moved, as threads hold references
+     bool                               sharded = false;         // whether a shard was ever made
+     std::vector<histogram_snapshot>    retired_histograms;      // the totals of released shards
+     std::vector<std::uint64_t>         retired_counters;
+
+
+     static void merge (const shard& from, std::vector<histogram_snapshot>& histograms,
+                        std::vector<std::uint64_t>& counters)
+     {
+          for (std::size_t i = 0; i < histograms.size(); ++i)
+               histograms[i].merge(from.histogram_array[i]);
+
+          for (std::size_t i = 0; i < counters.size(); ++i)
+               counters[i] += from.counter_array[i].load(std::memory_order_relaxed);
+     }
+
+
+     static long process_id () noexcept
+     {
+#if defined(__unix__)
+          return static_cast<long>(::getpid());
+#else
+          return 0;
+#endif
+     }
+
+
+     void define (std::string_view name)
+     {
+          {
+               std::lock_guard lock {shards_mutex};
+               if (sharded)
+                    throw std::logic_error("metrics_registry: metric defined after a shard was made");
+          }
+
+          auto valid = [] (char c, bool first) {
+               return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == ':' ||
+                      (!first && c >= '0' && c <= '9');
+          };
+
+          if (name.empty())     throw std::invalid_argument("metrics_registry: empty metric name");
+
+          for (std::size_t i = 0; i < name.size(); ++i)
+               if (!valid(name[i], i == 0))     throw std::invalid_argument("metrics_registry: invalid metric name");
+     }
+}; // class metrics_registry
+
+
+// A shard for the scope of a thread, released when the scope ends
+class scoped_shard
+{
+public:
+     explicit scoped_shard (metrics_registry& registry)
+          : registry {registry}, shard {registry.make_shard()}
+     {}
+
+     scoped_shard (const scoped_shard&)            = delete;
+     scoped_shard& operator= (const scoped_shard&) = delete;
+
+     ~scoped_shard ()     { registry.release_shard(shard); }
+
+     metrics_registry::shard& operator*  () noexcept     { return shard;  }
+     metrics_registry::shard* operator-> () noexcept     { return &shard; }
+
+private:
+     metrics_registry&        registry;
+     metrics_registry::shard& shard;
+};
+
+
+// Records the time from its construction to its destruction
+class scoped_timer
+{
+public:
+     using clock = std::chrono::steady_clock;
+
+     scoped_timer (metrics_registry::shard& shard, histogram_id h) noexcept
+          : shard {shard}, id {h}, start {clock::now()}
+     {}
+
+     scoped_timer (const scoped_timer&)            = delete;
+     scoped_timer& operator= (const scoped_timer&) = delete;
+
+     ~scoped_timer ()     { shard.record(id, clock::now() - start); }
+
+private:
+     metrics_registry::shard& shard;
+     histogram_id             id;
+     clock::time_point        start;
+};
+
+
+// =====================================================================================================================
+// Periodic Export
+// =====================================================================================================================
+enum class export_target { file, socket };
+
+
+// Exports a registry from a background thread at a fixed interval, and once more when destroyed
+class metrics_exporter
+{
+public:
+     metrics_exporter (const metrics_registry& registry, std::string path, std::chrono::milliseconds interval,
+                       export_target target = export_target::file)
+          : registry {registry}, path {std::move(path)}, interval {interval}, target {target},
+            worker {[this] (std::stop_token stop) { run(stop); }}
+     {}
+
+     metrics_exporter (const metrics_exporter&)            = delete;
+     metrics_exporter& operator= (const metrics_exporter&) = delete;
+
+     ~metrics_exporter ()
+     {
+          worker.request_stop();
+          wake.notify_all();
+          worker.join();
+     }
+
+     std::uint64_t exports () const noexcept     { return succeeded.load(std::memory_order_relaxed); }
+
+
+private:
+     const metrics_registry&      registry;
+     std::string                  path;
+     std::chrono::milliseconds    interval;
+     export_target                target;
+     std::atomic<std::uint64_t>   succeeded {0};
+
+     std::mutex                   mutex;
+     std::condition_variable_any  wake;
+     std::jthread                 worker;     // last, so it starts once the other members are initialized
+
+
+     void run (std::stop_token stop)
+     {
+          while (!stop.stop_requested())
+          {
+               export_once();
+
+               std::unique_lock lock {mutex};
+               wake.wait_for(lock, stop, interval, [] { return false; });
+          }
+
+          export_once();
+     }
+
+     void export_once ()
+     {
+          bool ok = target == export_target::file ? registry.export_to_file(path) : registry.export_to_socket(path);
+          if (ok)     succeeded.fetch_add(1, std::memory_order_relaxed);
+     }
+}; // class metrics_exporter
+
+} // namespace Pattern
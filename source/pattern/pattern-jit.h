@@ -0,0 +1,481 @@
+/*
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * Pattern JIT
+ *
+ * Translation of runtime patterns into native code for x86-64, so that patterns assembled at run time scan about as
+ * fast as patterns composed from templates.
+ */
+
+// The generated function has the signature const char* (const char* first, const char* last), returning the end of the
+// match or nullptr. The cursor lives in rax and the end of input in rsi for the whole function. Each node is compiled
+// with a label to jump to on failure:
+//
+//   literal       a length check, then inline comparisons eight bytes at a time
+//   set           a bit test against the bitmap of the set, held in a constant pool after the code
+//   sequence      the first node, falling through into the second
+//   alternative   the cursor is pushed, and a failure of the first branch jumps directly to the second
+//   many          a tight loop for sets; otherwise a loop which saves the cursor on each iteration
+//   while_not     a 16-byte SSE2 loop comparing against each member, for sets of up to four bytes, then a bit-test loop
+//
+// Every node leaves the stack as it found it, whether it succeeds or fails, so no unwinding is needed.
+//
+// Code is written into an anonymous mapping which is made executable, and never writable, once complete. On other
+// architectures, or where the mapping cannot be made executable, jit_pattern falls back to the interpreter.
+
+
+#pragma once
+
+#include <bit>             // std::popcount
+#include <cstdint>
+#include <cstring>         // std::memcpy
+#include <initializer_list>
+#include <utility>         // std::exchange
+#include <vector>
+
+#include "runtime-pattern.h"
+#include "scan_view.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define PATTERN_JIT_X86_64 1
+#include <sys/mman.h>      // mmap, mprotect
+#endif
+
+
+namespace Pattern {
+
+#ifdef PATTERN_JIT_X86_64
+
+namespace detail {
+
+// =====================================================================================================================
+// Assembler
+// =====================================================================================================================
+// Accumulates machine code with forward jumps to labels and RIP-relative references to a constant pool.
+class x64_assembler
+{
+public:
+     using label = std::size_t;
+
+     enum condition : std::uint8_t { below = 0x2, above_equal = 0x3, equal = 0x4, not_equal = 0x5 };
+
+
+     void bytes (std::initializer_list<std::uint8_t> bs)     { code.insert(code.end(), bs); }
+
+     void imm32 (std::uint32_t v)
+     {
+          for (int i = 0; i < 4; ++i)     code.push_back(static_cast<std::uint8_t>(v >> (8 * i)));
+     }
+
+     void imm64 (std::uint64_t v)
+     {
+          for (int i = 0; i < 8; ++i)     code.push_back(static_cast<std::uint8_t>(v >> (8 * i)));
+     }
+
+
+     // --------------------------------------------------
+     // Labels
+     // --------------------------------------------------
+     label new_label ()     { labels.push_back(unbound); return labels.size() - 1; }
+     void  bind (label l)   { labels[l] = code.size(); }
+
+     void jmp (label l)                  { bytes({0xE9}); rel32(l); }
+     void jcc (condition c, label l)     { bytes({0x0F, static_cast<std::uint8_t>(0x80 | c)}); rel32(l); }
+
+
+     // --------------------------------------------------
+     // Constant Pool
+     // --------------------------------------------------
+     // Returns an identifier for a constant of 16 or 32 bytes, reusing an identical one
+     std::size_t constant (const void* data, std::size_t size)
+     {
+          const auto* p = static_cast<const std::uint8_t*>(data);
+
+          for (std::size_t i = 0; i < pool_entries.size(); ++i)
+               if (pool_entries[i].size == size && std::memcmp(pool.data() + pool_entries[i].offset, p, size) == 0)
+                    return i;
+
+          pool_entries.push_back({pool.size(), size});
+          pool.insert(pool.end(), p, p + size);
+          pool.resize((pool.size() + 15) & ~std::size_t {15});
+
+          return pool_entries.size() - 1;
+     }
+
+     // Emits the disp32 of a RIP-relative operand, which must end the instruction
+     void rip (std::size_t constant_id)     { rip_fixups.push_back({code.size(), constant_id}); imm32(0); }
+
+
+     // Resolves every reference, and returns the code followed by the constant pool
+     std::vector<std::uint8_t> finish ()
+     {
+          for (auto [at, l] : jump_fixups)
+               patch(at, labels[l]);
+
+          std::size_t pool_base = (code.size() + 15) & ~std::size_t {15};
+          for (auto [at, id] : rip_fixups)
+               patch(at, pool_base + pool_entries[id].offset);
+
+          std::vector<std::uint8_t> image = std::move(code);
+          image.resize(pool_base, 0xCC);
+          image.insert(image.end(), pool.begin(), pool.end());
+
+          return image;
+     }
+
+
+private:
+     static constexpr std::size_t unbound = ~std::size_t {0};
+
+     struct fixup      { std::size_t at, target; };
+     struct pool_entry { std::size_t offset, size; };
+
+     std::vector<std::uint8_t> code;
+     std::vector<std::size_t>  labels;
+     std::vector<fixup>        jump_fixups;
+     std::vector<fixup>        rip_fixups;
+     std::vector<std::uint8_t> pool;
+     std::vector<pool_entry>   pool_entries;
+
+
+     void rel32 (label l)     { jump_fixups.push_back({code.size(), l}); imm32(0); }
+
+     // Displacements are relative to the end of the 4-byte field
+     void patch (std::size_t at, std::size_t target)
+     {
+          auto disp = static_cast<std::uint32_t>(static_cast<std::int64_t>(target) - static_cast<std::int64_t>(at + 4));
+          for (int i = 0; i < 4; ++i)     code[at + i] = static_cast<std::uint8_t>(disp >> (8 * i));
+     }
+}; // class x64_assembler
+
+
+// =====================================================================================================================
+// Compiler
+// =====================================================================================================================
+class pattern_compiler
+{
+public:
+     explicit pattern_compiler (const pattern_graph& g)
+          : g {g}
+     {}
+
+     std::vector<std::uint8_t> compile (pattern_graph::node_id root)
+     {
+          auto fail = a.new_label();
+
+          a.bytes({0x48, 0x89, 0xF8});          // mov rax, rdi
+          emit(root, fail);
+          a.bytes({0xC3});                      // ret
+
+          a.bind(fail);
+          a.bytes({0x31, 0xC0, 0xC3});          // xor eax, eax; ret
+
+          return a.finish();
+     }
+
+
+private:
+     using label = x64_assembler::label;
+     using enum x64_assembler::condition;
+
+     const pattern_graph& g;
+     x64_assembler        a;
+
+
+     void emit (pattern_graph::node_id id, label fail)
+     {
+          const pattern_node& n = g[id];
+
+          switch (n.op)
+          {
+          case pattern_op::literal:        emit_literal(g.literal_of(n), fail);           break;
+          case pattern_op::set:            emit_set(g.set_of(n), fail);                   break;
+          case pattern_op::sequence:       emit(n.first, fail); emit(n.second, fail);     break;
+          case pattern_op::alternative:    emit_alternative(n, fail);                     break;
+          case pattern_op::many:           emit_many(n);                                  break;
+          case pattern_op::optional:       emit_optional(n);                              break;
+          case pattern_op::while_not:      emit_while_not(g.set_of(n));                   break;
+          case pattern_op::capture:        emit(n.first, fail);                           break;
+          }
+     }
+
+
+     void emit_literal (std::string_view lit, label fail)
+     {
+          if (lit.empty())     return;
+
+          a.bytes({0x48, 0x89, 0xF1});                              // mov rcx, rsi
+          a.bytes({0x48, 0x29, 0xC1});                              // sub rcx, rax
+          a.bytes({0x48, 0x81, 0xF9}); a.imm32(lit.size());         // cmp rcx, size
+          a.jcc(below, fail);
+
+          std::size_t i = 0;
+
+          for (; i + 8 <= lit.size(); i += 8)
+          {
+               std::uint64_t chunk;
+               std::memcpy(&chunk, lit.data() + i, 8);
+
+               a.bytes({0x48, 0xB9}); a.imm64(chunk);                // mov rcx, chunk
+               a.bytes({0x48, 0x39, 0x88}); a.imm32(i);              // cmp [rax + i], rcx
+               a.jcc(not_equal, fail);
+          }
+
+          for (; i < lit.size(); ++i)
+          {
+               a.bytes({0x80, 0xB8}); a.imm32(i);                    // cmp byte [rax + i], c
+               a.bytes({static_cast<std::uint8_t>(lit[i])});
+               a.jcc(not_equal, fail);
+          }
+
+          a.bytes({0x48, 0x05}); a.imm32(lit.size());              // add rax, size
+     }
+
+
+     // Sets the carry flag when the byte at the cursor is a member; requires the cursor to be before the end
+     void emit_test_member (const simd::byte_class& c)
+     {
+          a.bytes({0x0F, 0xB6, 0x08});                              // movzx ecx, byte [rax]
+          a.bytes({0x48, 0x0F, 0xA3, 0x0D});                        // bt [rip + bitmap], rcx
+          a.rip(a.constant(c.bitmap.data(), sizeof(c.bitmap)));
+     }
+
+
+     void emit_set (const simd::byte_class& c, label fail)
+     {
+          a.bytes({0x48, 0x39, 0xF0});                              // cmp rax, rsi
+          a.jcc(above_equal, fail);
+          emit_test_member(c);
+          a.jcc(above_equal, fail);                               // jnc
+          a.bytes({0x48, 0xFF, 0xC0});                              // inc rax
+     }
+
+
+     void emit_alternative (const pattern_node& n, label fail)
+     {
+          auto next = a.new_label();
+          auto done = a.new_label();
+
+          a.bytes({0x50});                                          // push rax
+          emit(n.first, next);
+          a.bytes({0x48, 0x8D, 0x64, 0x24, 0x08});                  // lea rsp, [rsp + 8]
+          a.jmp(done);
+
+          a.bind(next);
+          a.bytes({0x58});                                          // pop rax
+          emit(n.second, fail);
+
+          a.bind(done);
+     }
+
+
+     void emit_optional (const pattern_node& n)
+     {
+          auto failed = a.new_label();
+          auto done   = a.new_label();
+
+          a.bytes({0x50});                                          // push rax
+          emit(n.first, failed);
+          a.bytes({0x48, 0x8D, 0x64, 0x24, 0x08});                  // lea rsp, [rsp + 8]
+          a.jmp(done);
+
+          a.bind(failed);
+          a.bytes({0x58});                                          // pop rax
+
+          a.bind(done);
+     }
+
+
+     void emit_many (const pattern_node& n)
+     {
+          auto loop = a.new_label();
+          auto done = a.new_label();
+
+          a.bind(loop);
+
+          if (g[n.first].op == pattern_op::set)
+          {
+               a.bytes({0x48, 0x39, 0xF0});                         // cmp rax, rsi
+               a.jcc(above_equal, done);
+               emit_test_member(g.set_of(g[n.first]));
+               a.jcc(above_equal, done);                          // jnc
+               a.bytes({0x48, 0xFF, 0xC0});                         // inc rax
+               a.jmp(loop);
+
+               a.bind(done);
+               return;
+          }
+
+          auto exit = a.new_label();
+
+          a.bytes({0x50});                                          // push rax
+          emit(n.first, exit);
+          a.bytes({0x48, 0x3B, 0x04, 0x24});                        // cmp rax, [rsp]
+          a.bytes({0x48, 0x8D, 0x64, 0x24, 0x08});                  // lea rsp, [rsp + 8]
+          a.jcc(not_equal, loop);                                 // stop once an iteration makes no progress
+          a.jmp(done);
+
+          a.bind(exit);
+          a.bytes({0x58});                                          // pop rax
+
+          a.bind(done);
+     }
+
+
+     void emit_while_not (const simd::byte_class& c)
+     {
+          int members = 0;
+          for (auto word : c.bitmap)     members += std::popcount(word);
+
+          if (members == 0)
+          {
+               a.bytes({0x48, 0x89, 0xF0});                         // mov rax, rsi
+               return;
+          }
+
+          auto tail = a.new_label();
+          auto done = a.new_label();
+
+          if (members <= 4)
+          {
+               auto vector_loop = a.new_label();
+               auto found       = a.new_label();
+
+               // Splat each member into xmm2 onwards
+               std::uint8_t reg = 2;
+               for (int b = 0; b < 256; ++b)
+                    if (c.contains(static_cast<char>(b)))
+                    {
+                         std::uint8_t splat[16];
+                         std::memset(splat, b, sizeof(splat));
+
+                         // movdqu xmmN, [rip + splat]
+                         a.bytes({0xF3, 0x0F, 0x6F, static_cast<std::uint8_t>(reg++ << 3 | 0x05)});
+                         a.rip(a.constant(splat, sizeof(splat)));
+                    }
+
+               a.bind(vector_loop);
+               a.bytes({0x48, 0x89, 0xF1});                         // mov rcx, rsi
+               a.bytes({0x48, 0x29, 0xC1});                         // sub rcx, rax
+               a.bytes({0x48, 0x83, 0xF9, 0x10});                   // cmp rcx, 16
+               a.jcc(below, tail);
+
+               a.bytes({0xF3, 0x0F, 0x6F, 0x00});                   // movdqu xmm0, [rax]
+               a.bytes({0x66, 0x0F, 0x6F, 0xC8});                   // movdqa xmm1, xmm0
+               a.bytes({0x66, 0x0F, 0x74, 0xCA});                   // pcmpeqb xmm1, xmm2
+
+               for (std::uint8_t r = 3; r < reg; ++r)
+               {
+                    a.bytes({0x66, 0x0F, 0x6F, 0xF0});              // movdqa xmm6, xmm0
+                    a.bytes({0x66, 0x0F, 0x74, static_cast<std::uint8_t>(0xF0 | r)});    // pcmpeqb xmm6, xmmN
+                    a.bytes({0x66, 0x0F, 0xEB, 0xCE});              // por xmm1, xmm6
+               }
+
+               a.bytes({0x66, 0x0F, 0xD7, 0xC9});                   // pmovmskb ecx, xmm1
+               a.bytes({0x85, 0xC9});                               // test ecx, ecx
+               a.jcc(not_equal, found);
+               a.bytes({0x48, 0x83, 0xC0, 0x10});                   // add rax, 16
+               a.jmp(vector_loop);
+
+               a.bind(found);
+               a.bytes({0x0F, 0xBC, 0xC9});                         // bsf ecx, ecx
+               a.bytes({0x48, 0x01, 0xC8});                         // add rax, rcx
+               a.jmp(done);
+          }
+
+          a.bind(tail);
+          a.bytes({0x48, 0x39, 0xF0});                              // cmp rax, rsi
+          a.jcc(above_equal, done);
+          emit_test_member(c);
+          a.jcc(below, done);                                     // jc
+          a.bytes({0x48, 0xFF, 0xC0});                              // inc rax
+          a.jmp(tail);
+
+          a.bind(done);
+     }
+}; // class pattern_compiler
+
+} // namespace detail
+
+#endif // PATTERN_JIT_X86_64
+
+
+// =====================================================================================================================
+// JIT Pattern
+// =====================================================================================================================
+// A runtime pattern compiled to native code where possible, and interpreted otherwise. Scans like runtime_pattern.
+class jit_pattern
+{
+public:
+     explicit jit_pattern (runtime_pattern p)
+          : pattern {std::move(p)}
+     {
+#ifdef PATTERN_JIT_X86_64
+          auto image = detail::pattern_compiler {pattern.graph()}.compile(pattern.root());
+
+          void* mapping = mmap(nullptr, image.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+          if (mapping == MAP_FAILED)     return;
+
+          std::memcpy(mapping, image.data(), image.size());
+
+          if (mprotect(mapping, image.size(), PROT_READ | PROT_EXEC) != 0)
+          {
+               munmap(mapping, image.size());
+               return;
+          }
+
+          memory = mapping;
+          size   = image.size();
+          code   = reinterpret_cast<function_type*>(mapping);
+#endif
+     }
+
+     jit_pattern (const jit_pattern&)            = delete;
+     jit_pattern& operator= (const jit_pattern&) = delete;
+
+     jit_pattern (jit_pattern&& other) noexcept
+          : pattern {std::move(other.pattern)},
+            code    {std::exchange(other.code, nullptr)},
+            memory  {std::exchange(other.memory, nullptr)},
+            size    {std::exchange(other.size, 0)}
+     {}
+
+     ~jit_pattern ()
+     {
+#ifdef PATTERN_JIT_X86_64
+          if (memory)     munmap(memory, size);
+#endif
+     }
+
+
+     // Whether native code is used, rather than the interpreter
+     bool compiled () const noexcept     { return code != nullptr; }
+
+     const runtime_pattern& source () const noexcept     { return pattern; }
+
+     const char* match (const char* first, const char* last) const
+     {
+          return code ? code(first, last) : pattern.match(first, last);
+     }
+
+     bool operator() (scan_view& s) const
+     {
+          const char* p = match(s.data(), s.end());
+          if (!p)     return false;
+
+          s += p - s.data();
+          return true;
+     }
+
+
+private:
+     using function_type = const char* (const char* first, const char* last);
+
+     runtime_pattern pattern;
+     function_type*  code   = nullptr;
+     void*           memory = nullptr;
+     std::size_t     size   = 0;
+};
+
+} // namespace Pattern
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * Pattern NFA
+ *
+ * Thompson construction of nondeterministic automata from runtime patterns, shared by the automaton-based engines.
+ */
+
+// Patterns are read as regular expressions: an alternative is any of its branches, and repetition may stop after any
+// iteration. A while_not node becomes a repetition of the complement of its set.
+//
+// States are built back to front: each node is compiled with the state that follows it, and returns its entry state,
+// so no list of dangling exits needs to be patched.
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string_view>
+#include <utility>         // std::pair
+#include <vector>
+
+#include "runtime-pattern.h"
+#include "simd.h"
+
+
+namespace Pattern {
+namespace detail {
+
+enum class nfa_op : std::uint8_t
+{
+     byte,         // consume a byte within a set, then go to next
+     split,        // go to both next and alt without consuming input
+     save,         // record the position in a capture slot, then go to next
+     match         // the pattern numbered id has matched
+};
+
+
+struct nfa_state
+{
+     nfa_op        op;
+     int           next;
+     int           alt;       // second successor for split, or index of the set for byte
+     std::uint32_t id;        // pattern for match, or capture slot for save
+};
+
+
+struct pattern_nfa
+{
+     std::vector<nfa_state>        states;
+     std::vector<simd::byte_class> sets;
+
+
+     int add (nfa_state s)
+     {
+          states.push_back(s);
+          return static_cast<int>(states.size() - 1);
+     }
+
+     int byte_state (const simd::byte_class& c, int next)
+     {
+          sets.push_back(c);
+          return add({nfa_op::byte, next, static_cast<int>(sets.size() - 1), 0});
+     }
+
+     int split_state (int a, int b)     { return add({nfa_op::split, a, b, 0}); }
+
+
+     /**
+      * Compile a node into states leading to next.
+      *
+      * @param    captures    Whether to emit save states for groups, which record their start in slot 2 * group and
+      *                       their end in slot 2 * group + 1. Otherwise groups are transparent.
+      * @return   The entry state of the node
+      */
+     int compile (const pattern_graph& g, pattern_graph::node_id id, int next, bool captures = false)
+     {
+          const pattern_node& n = g[id];
+
+          switch (n.op)
+          {
+          case pattern_op::literal:
+          {
+               std::string_view lit = g.literal_of(n);
+
+               for (auto c = lit.rbegin(); c != lit.rend(); ++c)
+                    next = byte_state(simd::byte_class::of({&*c, 1}), next);
+
+               return next;
+          }
+
+          case pattern_op::set:
+               return byte_state(g.set_of(n), next);
+
+          case pattern_op::sequence:
+               return compile(g, n.first, compile(g, n.second, next, captures), captures);
+
+          case pattern_op::alternative:
+               return split_state(compile(g, n.first, next, captures), compile(g, n.second, next, captures));
+
+          case pattern_op::optional:
+               return split_state(compile(g, n.first, next, captures), next);
+
+          case pattern_op::many:
+          {
+               int loop = split_state(-1, next);
+               states[loop].next = compile(g, n.first, loop, captures);
+               return loop;
+          }
+
+          case pattern_op::while_not:
+          {
+               int loop = split_state(-1, next);
+               states[loop].next = byte_state(g.set_of(n).complement(), loop);
+               return loop;
+          }
+
+          case pattern_op::capture:
+               if (!captures)     return compile(g, n.first, next, captures);
+
+               next = add({nfa_op::save, next, 0, 2 * n.second + 1});
+               next = compile(g, n.first, next, captures);
+               return add({nfa_op::save, next, 0, 2 * n.second});
+          }
+
+          return next;
+     }
+
+
+     /**
+      * Partition the bytes into classes which every set treats alike.
+      *
+      * @return   The number of classes, at most 256
+      */
+     int byte_classes (std::array<std::uint8_t, 256>& class_of) const
+     {
+          class_of.fill(0);
+          int classes = 1;
+
+          for (const auto& c : sets)
+          {
+               std::map<std::pair<int, bool>, int> refined;
+
+               for (int b = 0; b < 256; ++b)
+               {
+                    auto [it, added] = refined.try_emplace({class_of[b], c.contains(static_cast<char>(b))},
+                                                           static_cast<int>(refined.size()));
+                    class_of[b] = static_cast<std::uint8_t>(it->second);
+               }
+
+               classes = static_cast<int>(refined.size());
+          }
+
+          return classes;
+     }
+}; // struct pattern_nfa
+
+} // namespace detail
+} // namespace Pattern
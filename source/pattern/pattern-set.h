@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * Pattern Sets
+ *
+ * Matching many runtime patterns simultaneously, in a single pass over the input.
+ */
+
+// Every pattern is compiled into one combined NFA, which is run as a lazily built DFA: each DFA state is a set of NFA
+// states, and its transitions are computed the first time they are taken, then cached in a table. Once the states in
+// use have been built, each byte costs a single table lookup, however many patterns the set contains.
+//
+// The search is unanchored, so every pattern is started again at each position, and each match is reported with the
+// id of its pattern and the offset where it ends. Since matches of different patterns may overlap, patterns are read
+// as regular expressions: an alternative is any of its branches, and repetition may stop after any iteration. This
+// differs from runtime_pattern, whose alternatives are ordered and whose repetition is greedy.
+//
+// While no pattern is partly matched, the search skips ahead to the next byte that can begin a match, using the SIMD
+// kernels. The skip is only worth its setup when such bytes are rare, so it is limited to sets of patterns which begin
+// with a few distinct bytes, none of which matches the empty string.
+
+
+#pragma once
+
+#include <algorithm>       // std::sort
+#include <array>
+#include <bit>             // std::popcount
+#include <climits>         // INT_MAX
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "pattern-nfa.h"
+#include "runtime-pattern.h"
+#include "scan_view.h"
+#include "simd.h"
+
+
+namespace Pattern {
+
+class pattern_set
+{
+public:
+     using pattern_id = std::uint32_t;
+
+     // Cached DFA states beyond which the cache is discarded, bounding its memory
+     static constexpr std::size_t default_state_limit = 10000;
+
+     // Most cached DFA states whose table entries, a row of up to 256 classes doubled with a match bit, fit in an int
+     static constexpr std::size_t max_state_limit = INT_MAX / 512 - 1;
+
+     // Most distinct first bytes for which the search skips ahead between matches
+     static constexpr int max_skip_bytes = 8;
+
+
+     /**
+      * @throw    std::invalid_argument    When state_limit is above max_state_limit
+      */
+     explicit pattern_set (std::size_t state_limit = default_state_limit)
+          : limit {state_limit}
+     {
+          if (limit > max_state_limit)     throw std::invalid_argument("pattern_set: state limit too high");
+     }
+
+
+     // --------------------------------------------------
+     // Construction
+     // --------------------------------------------------
+     /**
+      * Add a pattern to the set, invalidating any cached states.
+      *
+      * @return   The id reported for matches of the pattern, counting from 0
+      */
+     pattern_id add (const runtime_pattern& p)
+     {
+          auto id = static_cast<pattern_id>(starts.size());
+
+          auto accept = nfa.add({nfa_op::match, 0, 0, id});
+          starts.push_back(nfa.compile(p.graph(), p.root(), accept));
+
+          prepared = false;
+          return id;
+     }
+
+     std::size_t size () const noexcept     { return starts.size(); }
+
+
+     // --------------------------------------------------
+     // Matching
+     // --------------------------------------------------
+     /**
+      * Report every match of every pattern within the text.
+      *
+      * @param    text      Text to search
+      * @param    report    Callable (pattern_id, std::size_t end), where end is the offset just past the match
+      */
+     template <class Report>
+     void scan (std::string_view text, Report&& report)
+     {
+          prepare();
+
+          const char* first = text.data();
+          const char* last  = first + text.size();
+          const char* p     = first;
+
+          int row = start_row;
+          report_matches(row, 0, report);
+
+          while (p != last)
+          {
+               if (row == start_row && skip_ok)
+               {
+                    p = simd::find_in_class(p, last, first_bytes);
+                    if (p == last)     break;
+               }
+
+               int entry = table[row + class_of[static_cast<unsigned char>(*p)]];
+               if (entry < 0) [[unlikely]]     entry = transition(row, *p);
+
+               row = entry >> 1;
+               ++p;
+
+               if (entry & 1) [[unlikely]]     report_matches(row, p - first, report);
+          }
+     }
+
+     template <class Report>
+     void scan (const scan_view& s, Report&& report)
+     {
+          scan(std::string_view {s.data(), static_cast<std::size_t>(s.size())}, report);
+     }
+
+
+     // The ids of the patterns matching anywhere within the text, in increasing order
+     std::vector<pattern_id> matching (std::string_view text)
+     {
+          std::vector<bool> seen(size());
+          scan(text, [&seen] (pattern_id id, std::size_t) { seen[id] = true; });
+
+          std::vector<pattern_id> ids;
+          for (pattern_id id = 0; id < seen.size(); ++id)
+               if (seen[id])     ids.push_back(id);
+
+          return ids;
+     }
+
+
+     // Number of DFA states currently cached
+     std::size_t cached_states () const noexcept     { return dfa.size(); }
+
+
+private:
+     // --------------------------------------------------
+     // NFA
+     // --------------------------------------------------
+     using nfa_op = detail::nfa_op;
+
+     detail::pattern_nfa nfa;
+     std::vector<int>    starts;      // one per pattern
+
+
+     // Adds the byte and match states reachable from s without consuming input
+     void closure (int s, std::vector<int>& out, std::vector<bool>& visited) const
+     {
+          std::vector<int> stack {s};
+
+          while (!stack.empty())
+          {
+               int t = stack.back();
+               stack.pop_back();
+
+               if (visited[t])     continue;
+               visited[t] = true;
+
+               if (nfa.states[t].op == nfa_op::split)
+               {
+                    stack.push_back(nfa.states[t].alt);
+                    stack.push_back(nfa.states[t].next);
+               }
+               else
+                    out.push_back(t);
+          }
+     }
+
+
+     // --------------------------------------------------
+     // Lazy DFA
+     // --------------------------------------------------
+     struct dfa_state
+     {
+          std::vector<int>        nfa_states;     // sorted
+          std::vector<pattern_id> matches;
+     };
+
+     std::size_t                     limit;
+     bool                            prepared = false;
+     std::vector<int>                initial;            // closure of every start state
+     std::array<std::uint8_t, 256>   class_of {};
+     int                             classes  = 1;
+     simd::byte_class                first_bytes;        // bytes which can begin a match
+     bool                            skip_ok  = false;
+
+     std::vector<dfa_state>          dfa;
+     std::map<std::vector<int>, int> index;
+     std::vector<int>                table;              // entries by row and byte class, or -1 until computed
+     int                             start_row = 0;
+
+     // A state is identified in the table by its row, the index of its first entry. An entry holds the row of the next
+     // state shifted left by one, with the low bit set when that state reports matches.
+
+
+     void prepare ()
+     {
+          if (prepared)     return;
+
+          classes = nfa.byte_classes(class_of);
+
+          initial.clear();
+          std::vector<bool> visited(nfa.states.size());
+          for (int s : starts)     closure(s, initial, visited);
+          std::sort(initial.begin(), initial.end());
+
+          skip_ok = !initial.empty();
+          first_bytes = {};
+
+          for (int s : initial)
+          {
+               if (nfa.states[s].op == nfa_op::match)     skip_ok = false;
+               else
+                    for (int w = 0; w < 4; ++w)     first_bytes.bitmap[w] |= nfa.sets[nfa.states[s].alt].bitmap[w];
+          }
+
+          first_bytes = simd::byte_class::from([bits = first_bytes] (char c) { return bits.contains(c); });
+
+          int members = 0;
+          for (auto word : first_bytes.bitmap)     members += std::popcount(word);
+          skip_ok = skip_ok && members <= max_skip_bytes;
+
+          reset_cache();
+          prepared = true;
+     }
+
+
+     void reset_cache ()
+     {
+          dfa.clear();
+          index.clear();
+          table.clear();
+          start_row = intern(initial) >> 1;
+     }
+
+
+     // Returns the table entry for a state, adding the state if it is new
+     int intern (const std::vector<int>& states)
+     {
+          auto [it, added] = index.try_emplace(states, static_cast<int>(dfa.size()));
+
+          if (added)
+          {
+               dfa_state d {states, {}};
+               for (int s : states)
+                    if (nfa.states[s].op == nfa_op::match)     d.matches.push_back(nfa.states[s].id);
+
+               dfa.push_back(std::move(d));
+               table.resize(table.size() + classes, -1);
+          }
+
+          int state = it->second;
+          return (state * classes) << 1 | !dfa[state].matches.empty();
+     }
+
+
+     int transition (int row, char c)
+     {
+          std::vector<int>  next;
+          std::vector<bool> visited(nfa.states.size());
+
+          for (int s : dfa[row / classes].nfa_states)
+               if (nfa.states[s].op == nfa_op::byte && nfa.sets[nfa.states[s].alt].contains(c))
+                    closure(nfa.states[s].next, next, visited);
+
+          // Every pattern starts again at the next position
+          for (int s : initial)
+               if (!visited[s])     next.push_back(s);
+
+          std::sort(next.begin(), next.end());
+
+          // The cache is flushed only when a state must be added to a full cache; a known state is still recorded
+          if (dfa.size() >= limit && !index.contains(next))
+          {
+               reset_cache();
+               return intern(next);
+          }
+
+          int entry = intern(next);
+          table[row + class_of[static_cast<unsigned char>(c)]] = entry;
+          return entry;
+     }
+
+
+     template <class Report>
+     void report_matches (int row, std::size_t end, Report& report) const
+     {
+          for (pattern_id id : dfa[row / classes].matches)     report(id, end);
+     }
+}; // class pattern_set
+
+} // namespace Pattern
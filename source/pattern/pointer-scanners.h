@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * Pointer Scanners
+ *
+ * Scanners which take the cursor by value and return where they stopped, with adapters to and from the scanners which
+ * advance an iterator in place.
+ */
+
+// The scanning algorithms and the fn combinators take the iterator by reference and return bool. A composition passes
+// one iterator down by reference, so it lives in memory, and a choice must copy it to restore the position after a
+// failed alternative. A pointer scanner is instead a pure function of its input:
+//
+//      const char* scanner (const char* p, const char* end);
+//
+// It returns the position after its match, or nullptr if there was none. Nothing is written through a reference, so a
+// sequence threads the returned pointer into its next child, and a choice calls each alternative on the same p. The
+// cursor stays in a register through a whole composition.
+//
+// The combinators of namespace ps mirror those of fo. Like them, each stores its children without padding, so a
+// composition of stateless parts is empty and trivially copyable. Scanners of the other protocol are wrapped with
+// ps::from_boolean, and a pointer scanner is given the other protocol with ps::to_boolean, e.g. to be passed to
+// fn::many or fo::rule:
+//
+//      auto digits = ps::some(ps::one_if(is_digit));
+//      auto number = ps::seq(digits, ps::optional(ps::seq(ps::lit('.'), digits)));
+//
+//      const char* end = number(text.data(), text.data() + text.size());
+//
+// p must not be null, since a match at p would then read as a failure. ps::to_boolean accepts the null data pointer of
+// an empty view.
+
+
+#pragma once
+
+#include <concepts>
+#include <cstddef>         // std::size_t
+#include <cstring>         // std::memcmp
+#include <functional>      // std::invoke
+#include <string_view>
+#include <type_traits>     // std::decay_t
+#include <utility>         // std::forward, std::index_sequence
+
+#include "fn-combinators.h"
+#include "scanning-concepts.h"
+
+
+namespace Pattern {
+
+// =====================================================================================================================
+// Concepts
+// =====================================================================================================================
+template <class F>
+concept pointer_scanner = std::invocable<F&, const char*, const char*> &&
+                          std::same_as<std::invoke_result_t<F&, const char*, const char*>, const char*>;
+
+
+namespace ps {
+
+// =====================================================================================================================
+// Primitives
+// =====================================================================================================================
+struct char_t
+{
+     char c;
+
+     constexpr const char* operator() (const char* p, const char* end) const noexcept
+     {
+          return p != end && *p == c ? p + 1 : nullptr;
+     }
+};
+
+
+// The view must outlive the scanner
+struct string_t
+{
+     std::string_view s;
+
+     const char* operator() (const char* p, const char* end) const noexcept
+     {
+          if (static_cast<std::size_t>(end - p) < s.size())     return nullptr;
+          return std::memcmp(p, s.data(), s.size()) == 0 ? p + s.size() : nullptr;
+     }
+};
+
+
+template <class P>
+struct one_if_t
+{
+     [[no_unique_address]] P pred;
+
+     constexpr const char* operator() (const char* p, const char* end)
+     {
+          return p != end && std::invoke(pred, *p) ? p + 1 : nullptr;
+     }
+};
+
+
+// Matches any one character
+struct one_t
+{
+     constexpr const char* operator() (const char* p, const char* end) const noexcept
+     {
+          return p != end ? p + 1 : nullptr;
+     }
+};
+
+
+// Matches only at the end of the input
+struct eoi_t
+{
+     constexpr const char* operator() (const char* p, const char* end) const noexcept
+     {
+          return p == end ? p : nullptr;
+     }
+};
+
+
+// =====================================================================================================================
+// Combinators
+// =====================================================================================================================
+template <class... F>
+struct seq_t
+{
+     [[no_unique_address]] detail::pack<F...> children;
+
+     constexpr const char* operator() (const char* p, const char* end)
+          requires (... && pointer_scanner<F>)
+     {
+          return [&] <std::size_t... I> (std::index_sequence<I...>) {
+               // Stops at the first child to fail, leaving p null
+               (void) (... && (p = std::invoke(detail::get_element<I>(children), p, end)));
+               return p;
+          }(std::index_sequence_for<F...> {});
+     }
+};
+
+
+// Each alternative starts from the same p, so a failed one leaves nothing to restore
+template <class... F>
+struct any_t
+{
+     [[no_unique_address]] detail::pack<F...> children;
+
+     constexpr const char* operator() (const char* p, const char* end)
+          requires (... && pointer_scanner<F>)
+     {
+          return [&] <std::size_t... I> (std::index_sequence<I...>) {
+               const char* q = nullptr;
+               (void) (... || (q = std::invoke(detail::get_element<I>(children), p, end)));
+               return q;
+          }(std::index_sequence_for<F...> {});
+     }
+};
+
+
+template <class F>
+struct optional_t
+{
+     [[no_unique_address]] F f;
+
+     constexpr const char* operator() (const char* p, const char* end)
+          requires pointer_scanner<F>
+     {
+          const char* q = std::invoke(f, p, end);
+          return q ? q : p;
+     }
+};
+
+
+// Succeeds where f fails, without consuming
+template <class F>
+struct negate_t
+{
+     [[no_unique_address]] F f;
+
+     constexpr const char* operator() (const char* p, const char* end)
+          requires pointer_scanner<F>
+     {
+          return std::invoke(f, p, end) ? nullptr : p;
+     }
+};
+
+} // namespace ps
+
+
+namespace detail {
+
+// Matches f between min and max times. Like the looping algorithms of fn, it fails early if the active scan budget is
+// exhausted. It also stops once f matches without consuming, which would otherwise repeat forever.
+template <class F>
+constexpr const char* scan_repeat (F& f, const char* p, const char* end, std::size_t min, std::size_t max)
+{
+     return run_loop([&] (auto charge) -> const char* {
+          std::size_t n = 0;
+
+          for (; n < max; ++n)
+          {
+               const char* q = std::invoke(f, p, end);
+
+               if (q == nullptr)                        break;
+               if (!charge.spend()) [[unlikely]]        return nullptr;
+               if (q == p)                              { n = max; break; }
+
+               p = q;
+          }
+
+          return n >= min ? p : nullptr;
+     });
+}
+
+
+// Stands in for the null data of an empty view
+inline constexpr char empty_input = 0;
+
+} // namespace detail
+
+
+namespace ps {
+
+template <class F>
+struct repeat_t
+{
+     [[no_unique_address]] F f;
+     std::size_t min;
+     std::size_t max;
+
+     constexpr const char* operator() (const char* p, const char* end)
+          requires pointer_scanner<F>
+     {
+          return detail::scan_repeat(f, p, end, min, max);
+     }
+};
+
+
+// many and some, whose bounds are part of the type, so that they stay empty
+template <class F, std::size_t Min>
+struct at_least_t
+{
+     [[no_unique_address]] F f;
+
+     constexpr const char* operator() (const char* p, const char* end)
+          requires pointer_scanner<F>
+     {
+          return detail::scan_repeat(f, p, end, Min, std::size_t(-1));
+     }
+};
+
+
+// =====================================================================================================================
+// Adapters
+// =====================================================================================================================
+// Gives a scanner of the form bool(const char*& first, const char* last), e.g. a fn combinator or a bound scan, the
+// pointer protocol. The copy of p is local, so it can still be kept in a register once f is inlined.
+template <class F>
+struct from_boolean_t
+{
+     [[no_unique_address]] F f;
+
+     constexpr const char* operator() (const char* p, const char* end)
+          requires boolean_invocable<F&, const char*&, const char*>
+     {
+          return std::invoke(f, p, end) ? p : nullptr;
+     }
+};
+
+
+// Gives a pointer scanner the protocol of the scanning algorithms. first is advanced only on success.
+template <class F>
+struct to_boolean_t
+{
+     [[no_unique_address]] F f;
+
+     constexpr bool operator() (const char*& first, const char* last)
+          requires pointer_scanner<F>
+     {
+          if (first == nullptr) [[unlikely]]
+               return std::invoke(f, &detail::empty_input, &detail::empty_input) != nullptr;
+
+          const char* p = std::invoke(f, first, last);
+          if (p == nullptr)     return false;
+
+          first = p;
+          return true;
+     }
+
+     bool operator() (std::string_view& s)
+          requires pointer_scanner<F>
+     {
+          const char* first = s.data();
+          if (!operator()(first, s.data() + s.size()))     return false;
+
+          s.remove_prefix(static_cast<std::size_t>(first - s.data()));
+          return true;
+     }
+};
+
+
+// =====================================================================================================================
+// Factories
+// =====================================================================================================================
+constexpr char_t lit (char c) noexcept                       { return {c}; }
+constexpr string_t lit (std::string_view s) noexcept         { return {s}; }
+
+inline constexpr one_t one {};
+inline constexpr eoi_t eoi {};
+
+
+template <class P>
+constexpr one_if_t<std::decay_t<P>> one_if (P&& pred)
+{
+     return {std::forward<P>(pred)};
+}
+
+
+template <class... F>
+constexpr seq_t<std::decay_t<F>...> seq (F&&... f)
+{
+     return {{{std::forward<F>(f)}...}};
+}
+
+
+template <class... F>
+constexpr any_t<std::decay_t<F>...> any (F&&... f)
+{
+     return {{{std::forward<F>(f)}...}};
+}
+
+
+template <class F>
+constexpr optional_t<std::decay_t<F>> optional (F&& f)        { return {std::forward<F>(f)}; }
+
+template <class F>
+constexpr negate_t<std::decay_t<F>> negate (F&& f)            { return {std::forward<F>(f)}; }
+
+
+template <class F>
+constexpr repeat_t<std::decay_t<F>> repeat (std::size_t min, std::size_t max, F&& f)
+{
+     return {std::forward<F>(f), min, max};
+}
+
+template <class F>
+constexpr at_least_t<std::decay_t<F>, 0> many (F&& f)                 { return {std::forward<F>(f)}; }
+
+template <class F>
+constexpr at_least_t<std::decay_t<F>, 1> some (F&& f)                 { return {std::forward<F>(f)}; }
+
+template <class F>
+constexpr repeat_t<std::decay_t<F>> n_times (std::size_t n, F&& f)     { return repeat(n, n, std::forward<F>(f)); }
+
+
+template <class F>
+constexpr from_boolean_t<std::decay_t<F>> from_boolean (F&& f)     { return {std::forward<F>(f)}; }
+
+template <class F>
+constexpr to_boolean_t<std::decay_t<F>> to_boolean (F&& f)         { return {std::forward<F>(f)}; }
+
+} // namespace ps
+
+
+// So that fo::rule outlines compositions of pointer scanners, as it does those of fo
+namespace detail {
+
+template <class... F>
+inline constexpr bool is_composition<ps::seq_t<F...>> = true;
+
+template <class... F>
+inline constexpr bool is_composition<ps::any_t<F...>> = true;
+
+template <class F>
+inline constexpr bool is_composition<ps::optional_t<F>> = true;
+
+template <class F>
+inline constexpr bool is_composition<ps::negate_t<F>> = true;
+
+template <class F>
+inline constexpr bool is_composition<ps::repeat_t<F>> = true;
+
+template <class F, std::size_t Min>
+inline constexpr bool is_composition<ps::at_least_t<F, Min>> = true;
+
+template <class F>
+inline constexpr bool is_composition<ps::from_boolean_t<F>> = is_composition<F>;
+
+template <class F>
+inline constexpr bool is_composition<ps::to_boolean_t<F>> = is_composition<F>;
+
+} // namespace detail
+} // namespace Pattern
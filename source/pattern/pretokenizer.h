@@ -0,0 +1,512 @@
+/*
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * Pre-tokenizer
+ *
+ * Splits natural language text into pieces of words, numbers, punctuation, and whitespace.
+ */
+
+// Pieces follow the rules of GPT-2, matched in order at each position:
+//
+//      's 't 'm 'd 're 've 'll        a contraction
+//      ' '? letter+                  a word, which takes the single space before it
+//      ' '? digit+                   a number
+//      ' '? symbol+                  punctuation, which is anything else but whitespace
+//      whitespace+ (?! non-space)    whitespace, leaving its last character to the piece after it
+//      whitespace+                   whitespace at the end of the text
+//
+// The ASCII classes are those of PatDef (letter, digit, whitespace, and ascii_symbol). Text is split in blocks of 64
+// bytes: the SIMD kernels give a mask of each class for the block, and where pieces begin follows from the masks and
+// their shifts, so there is no branch per byte, only one per piece. The pieces next to an apostrophe or a byte from
+// 0x80 are matched one character at a time instead, and the rest of the block by its masks. Those characters are
+// decoded from UTF-8 and classified by a table of ranges: letters of every script are letters, except for the digits,
+// punctuation, symbols, and spaces listed. A byte which does not begin a valid sequence is punctuation by itself.
+//
+// Pieces are appended to a token_stream, so the buffer is reused from one call to the next, and the pieces may be
+// matched by tag like any other tokens. Since offsets are 32-bit, a larger text is split into chunks at line breaks
+// between two characters which are not whitespace, where no piece can span the split, and the chunks are split in
+// parallel.
+
+
+#pragma once
+
+#include <algorithm>       // std::max, std::min, std::upper_bound
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "scan_view.h"
+#include "simd.h"
+#include "token-stream.h"
+
+
+namespace Pattern {
+
+enum class piece_kind : std::uint8_t { word, number, punctuation, whitespace };
+
+
+// A chunk of a larger text, with offsets relative to its base
+struct piece_chunk
+{
+     std::size_t              base = 0;
+     token_stream<piece_kind> pieces;
+};
+
+
+namespace detail {
+
+enum class char_class : std::uint8_t { letter, digit, symbol, whitespace, multibyte };
+
+
+// The ASCII classes of PatDef. Bytes from 0x80 begin or continue a multibyte character.
+constexpr std::array<char_class, 256> ascii_classes = [] {
+     std::array<char_class, 256> table {};
+
+     for (int c = 0; c < 256; ++c)
+     {
+          if (c >= 0x80)                                             table[c] = char_class::multibyte;
+          else if (('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z'))     table[c] = char_class::letter;
+          else if ('0' <= c && c <= '9')                             table[c] = char_class::digit;
+          else if (c == ' ' || c == '\t' || c == '\r' || c == '\n')  table[c] = char_class::whitespace;
+          else                                                       table[c] = char_class::symbol;
+     }
+
+     return table;
+}();
+
+
+// Ranges of code points which are not letters, in order. Code points between ranges are letters.
+struct code_point_range
+{
+     char32_t   first;
+     char32_t   last;
+     char_class type;
+};
+
+constexpr code_point_range code_point_ranges[] = {
+     {0x0080, 0x0084, char_class::symbol},
+     {0x0085, 0x0085, char_class::whitespace},
+     {0x0086, 0x009f, char_class::symbol},
+     {0x00a0, 0x00a0, char_class::whitespace},
+     {0x00a1, 0x00a9, char_class::symbol},
+     {0x00ab, 0x00b1, char_class::symbol},
+     {0x00b2, 0x00b3, char_class::digit},
+     {0x00b4, 0x00b4, char_class::symbol},
+     {0x00b6, 0x00b8, char_class::symbol},
+     {0x00b9, 0x00b9, char_class::digit},
+     {0x00bb, 0x00bb, char_class::symbol},
+     {0x00bc, 0x00be, char_class::digit},
+     {0x00bf, 0x00bf, char_class::symbol},
+     {0x00d7, 0x00d7, char_class::symbol},
+     {0x00f7, 0x00f7, char_class::symbol},
+     {0x0660, 0x0669, char_class::digit},        // Arabic-Indic
+     {0x06f0, 0x06f9, char_class::digit},
+     {0x0966, 0x096f, char_class::digit},        // Devanagari
+     {0x1680, 0x1680, char_class::whitespace},
+     {0x2000, 0x200a, char_class::whitespace},
+     {0x200b, 0x2027, char_class::symbol},       // general punctuation
+     {0x2028, 0x2029, char_class::whitespace},
+     {0x202a, 0x202e, char_class::symbol},
+     {0x202f, 0x202f, char_class::whitespace},
+     {0x2030, 0x205e, char_class::symbol},
+     {0x205f, 0x205f, char_class::whitespace},
+     {0x2060, 0x206f, char_class::symbol},
+     {0x2070, 0x2079, char_class::digit},        // superscripts and subscripts
+     {0x2080, 0x2089, char_class::digit},
+     {0x20a0, 0x20cf, char_class::symbol},       // currency
+     {0x2100, 0x214f, char_class::symbol},       // letterlike symbols
+     {0x2150, 0x218f, char_class::digit},        // number forms
+     {0x2190, 0x2bff, char_class::symbol},       // arrows, mathematical operators, box drawing, and shapes
+     {0x2e00, 0x2e7f, char_class::symbol},       // supplemental punctuation
+     {0x3000, 0x3000, char_class::whitespace},
+     {0x3001, 0x3004, char_class::symbol},       // CJK punctuation
+     {0x3008, 0x3020, char_class::symbol},
+     {0xfe30, 0xfe6f, char_class::symbol},       // CJK compatibility forms and small forms
+     {0xfeff, 0xfeff, char_class::symbol},
+     {0xff01, 0xff0f, char_class::symbol},       // fullwidth forms
+     {0xff10, 0xff19, char_class::digit},
+     {0xff1a, 0xff20, char_class::symbol},
+     {0xff3b, 0xff40, char_class::symbol},
+     {0xff5b, 0xff65, char_class::symbol},
+     {0x1f000, 0x1faff, char_class::symbol},     // emoji and pictographs
+};
+
+
+inline char_class classify_code_point (char32_t c) noexcept
+{
+     auto r = std::upper_bound(std::begin(code_point_ranges), std::end(code_point_ranges), c,
+                               [] (char32_t c, const code_point_range& r) { return c < r.first; });
+
+     if (r != std::begin(code_point_ranges) && c <= (--r)->last)     return r->type;
+     return char_class::letter;
+}
+
+
+struct decoded
+{
+     char_class type;
+     unsigned   length;
+};
+
+
+// Decodes the character at p, which begins with a byte from 0x80
+inline decoded decode_multibyte (const char* p, const char* last) noexcept
+{
+     auto byte = [p] (int i) { return static_cast<unsigned char>(p[i]); };
+     auto cont = [&] (int i) { return p + i < last && (byte(i) & 0xc0) == 0x80; };
+
+     unsigned  lead = byte(0);
+     unsigned  length;
+     char32_t  c;
+
+     if      (0xc2 <= lead && lead <= 0xdf)     { length = 2; c = lead & 0x1f; }
+     else if (0xe0 <= lead && lead <= 0xef)     { length = 3; c = lead & 0x0f; }
+     else if (0xf0 <= lead && lead <= 0xf4)     { length = 4; c = lead & 0x07; }
+     else     return {char_class::symbol, 1};
+
+     for (unsigned i = 1; i < length; ++i)
+     {
+          if (!cont(i))     return {char_class::symbol, 1};
+          c = (c << 6) | (byte(i) & 0x3f);
+     }
+
+     // Overlong encodings, surrogates, and code points beyond Unicode are invalid
+     if ((length == 3 && c < 0x800) || (0xd800 <= c && c <= 0xdfff) || (length == 4 && (c < 0x10000 || c > 0x10ffff)))
+          return {char_class::symbol, 1};
+
+     return {classify_code_point(c), length};
+}
+
+
+inline decoded classify (const char* p, const char* last) noexcept
+{
+     char_class type = ascii_classes[static_cast<unsigned char>(*p)];
+
+     if (type != char_class::multibyte)     return {type, 1};
+     return decode_multibyte(p, last);
+}
+
+
+// Advances p past the characters of a class
+inline const char* skip_run (const char* p, const char* last, char_class type) noexcept
+{
+     while (p != last)
+     {
+          char_class next = ascii_classes[static_cast<unsigned char>(*p)];
+
+          if (next == type)     { ++p; continue; }
+          if (next != char_class::multibyte)     break;
+
+          decoded d = decode_multibyte(p, last);
+          if (d.type != type)     break;
+
+          p += d.length;
+     }
+
+     return p;
+}
+
+
+// The length of a contraction beginning with the apostrophe at p, or 0
+inline unsigned contraction (const char* p, const char* last) noexcept
+{
+     if (last - p >= 2)
+     {
+          char c = p[1];
+          if (c == 's' || c == 't' || c == 'm' || c == 'd')     return 2;
+     }
+
+     if (last - p >= 3)
+     {
+          std::string_view s {p + 1, 2};
+          if (s == "re" || s == "ve" || s == "ll")     return 3;
+     }
+
+     return 0;
+}
+
+
+constexpr piece_kind kind_of (char_class type) noexcept
+{
+     switch (type)
+     {
+          case char_class::letter:     return piece_kind::word;
+          case char_class::digit:      return piece_kind::number;
+          case char_class::symbol:     return piece_kind::punctuation;
+          default:                     return piece_kind::whitespace;
+     }
+}
+
+
+struct piece
+{
+     const char* end;
+     piece_kind  kind;
+};
+
+
+// Matches the piece which begins at p, one character at a time
+inline piece match_piece (const char* p, const char* last) noexcept
+{
+     const char* start = p;
+     decoded     c     = classify(p, last);
+
+     if (*p == ' ' && p + 1 != last)
+     {
+          // A single space is taken by the piece which follows it
+          decoded next = classify(p + 1, last);
+
+          if (next.type != char_class::whitespace)
+               return {skip_run(p + 1 + next.length, last, next.type), kind_of(next.type)};
+     }
+
+     if (*p == '\'')
+          if (unsigned n = contraction(p, last))     return {p + n, piece_kind::word};
+
+     p = skip_run(p + c.length, last, c.type);
+
+     // Whitespace before other text leaves its last character to the piece after it
+     if (c.type == char_class::whitespace && p != last && p - start > c.length)
+          while ((*--p & 0xc0) == 0x80) {}
+
+     return {p, kind_of(c.type)};
+}
+
+
+// The kind of a piece, by its last byte, when that is ASCII
+constexpr std::array<piece_kind, 128> ascii_kinds = [] {
+     std::array<piece_kind, 128> table {};
+     for (int c = 0; c < 128; ++c)     table[c] = kind_of(ascii_classes[c]);
+     return table;
+}();
+
+
+// Classes of bytes for finding the pieces of a block at once. A block holding a special byte is matched by match_piece.
+inline const std::array<simd::byte_class, 5> block_classes = {
+     simd::byte_class::from([] (char c) { return ascii_classes[static_cast<unsigned char>(c)] == char_class::letter; }),
+     simd::byte_class::from([] (char c) { return ascii_classes[static_cast<unsigned char>(c)] == char_class::digit; }),
+     simd::byte_class::from([] (char c) {
+          return ascii_classes[static_cast<unsigned char>(c)] == char_class::whitespace;
+     }),
+     simd::byte_class::of(" "),
+     simd::byte_class::from([] (char c) { return c == '\'' || static_cast<unsigned char>(c) >= 0x80; })
+};
+
+enum block_class { letters, digits, spaces, space, special };
+
+} // namespace detail
+
+
+// =====================================================================================================================
+// Pre-tokenizer
+// =====================================================================================================================
+class pretokenizer
+{
+public:
+     /**
+      * Split a text into pieces, appending them to a stream. A stream_lexer, so it may serve a lex_server.
+      *
+      * @throw    std::length_error    When the text is too large for 32-bit offsets; see split
+      */
+     void operator() (std::string_view source, token_stream<piece_kind>& pieces) const
+     {
+          if (source.size() > UINT32_MAX)     throw std::length_error("pretokenizer: text larger than 4 GiB");
+
+          scan_view v {source};
+          split_view(v, pieces);
+     }
+
+
+     // Split the rest of a view into pieces, advancing it to its end. Offsets are relative to the start of the view.
+     void split_view (scan_view& v, token_stream<piece_kind>& pieces) const
+     {
+          using namespace detail;
+
+          const char* const first = v.data();
+          const char* const last  = v.end();
+          const char*       start = first;     // of the piece not yet emitted
+
+          pieces.reserve(pieces.size() + v.size() / 4);
+
+          // Each block of 64 bytes is tested for where pieces begin, from after the start of the first piece
+          for (const char* block = first + 1; start != last; )
+          {
+               if (last - block <= 64)
+               {
+                    // The rest of the text is matched one character at a time
+                    piece next = match_piece(start, last);
+
+                    emit(pieces, next.kind, first, start, next.end);
+                    start = next.end;
+                    continue;
+               }
+
+               std::uint64_t masks[5];
+               simd::block_masks(block, block_classes.data(), 5, masks);
+
+               auto before = [block] (block_class c) -> std::uint64_t {
+                    return block_classes[c].contains(block[-1]);
+               };
+
+               std::uint64_t letter = masks[letters], digit = masks[digits], white = masks[spaces];
+
+               std::uint64_t letter_before = letter << 1 | before(letters);
+               std::uint64_t digit_before  = digit  << 1 | before(digits);
+               std::uint64_t white_before  = white  << 1 | before(spaces);
+               std::uint64_t space_before  = masks[space] << 1 | before(space);
+               std::uint64_t white_after   = white >> 1 | std::uint64_t {is_white(block[64])} << 63;
+
+               std::uint64_t changed = (letter ^ letter_before) | (digit ^ digit_before) | (white ^ white_before);
+
+               // A piece begins where the class changes, unless after a single space, and at the last character of
+               // whitespace before other text
+               std::uint64_t begins = (changed & ~(space_before & ~white)) | (white & white_before & ~white_after);
+
+               // Where a piece begins is only known from the masks next to bytes which are not special
+               std::uint64_t special_bytes = masks[special];
+               std::uint64_t unknown       = special_bytes | special_bytes << 1 | before(special) |
+                                             special_bytes >> 1 | std::uint64_t {is_special(block[64])} << 63;
+
+               // The pieces of a block are gathered, then appended at once. Each begins at a byte from block[-1].
+               piece_kind    kinds[65];
+               std::uint32_t offsets[65], lengths[65];
+               std::size_t   n = 0;
+
+               auto gather = [&] (piece_kind kind, const char* end) {
+                    kinds[n]   = kind;
+                    offsets[n] = static_cast<std::uint32_t>(start - first);
+                    lengths[n] = static_cast<std::uint32_t>(end - start);
+                    start      = end;
+                    ++n;
+               };
+
+               for (;;)
+               {
+                    // The pieces up to the first unknown byte follow from the masks
+                    for (std::uint64_t known = begins & ((unknown & -unknown) - 1); known; known &= known - 1)
+                    {
+                         const char* end = block + std::countr_zero(known);
+                         gather(ascii_kinds[static_cast<unsigned char>(end[-1])], end);
+                    }
+
+                    if (!unknown)     break;
+
+                    // The pieces around it are matched one character at a time, until one begins past it
+                    std::ptrdiff_t at = std::countr_zero(unknown);
+
+                    do
+                    {
+                         piece next = match_piece(start, last);
+                         gather(next.kind, next.end);
+                    }
+                    while (start != last && start - block <= at);
+
+                    if (start == last || start - block >= 64)     break;
+
+                    std::uint64_t past = (std::uint64_t {2} << (start - block)) - 1;
+                    begins  &= ~past;
+                    unknown &= ~past;
+               }
+
+               pieces.append(n, kinds, offsets, lengths);
+               block = std::max(block + 64, start + 1);
+          }
+
+          v.begin() = last;
+     }
+
+
+     /**
+      * Split a large text into chunks at line breaks, then split the chunks into pieces on several threads. The
+      * pieces are the same as those found by splitting the whole text at once.
+      *
+      * @param    chunks          Resized to the number of chunks; the streams of chunks kept from before are reused
+      * @param    chunk_size      The approximate size of each chunk
+      * @throw    std::length_error    When no split is found for more than 4 GiB
+      */
+     void split (std::string_view source, std::vector<piece_chunk>& chunks, unsigned threads,
+                 std::size_t chunk_size = 16 << 20) const
+     {
+          std::size_t count = 0;
+
+          for (std::size_t base = 0; base < source.size(); ++count)
+          {
+               std::size_t next = find_split(source, base + std::max<std::size_t>(chunk_size, 1));
+
+               if (next - base > UINT32_MAX)     throw std::length_error("pretokenizer: no split within 4 GiB");
+               if (count == chunks.size())       chunks.emplace_back();
+
+               chunks[count].base = base;
+               chunks[count].pieces.clear();
+               base = next;
+          }
+
+          chunks.resize(count);
+
+          std::atomic<std::size_t> next_chunk {0};
+
+          auto work = [&] {
+               for (std::size_t i; (i = next_chunk.fetch_add(1, std::memory_order_relaxed)) < count; )
+               {
+                    std::size_t end = i + 1 < count ? chunks[i + 1].base : source.size();
+                    scan_view v {source.substr(chunks[i].base, end - chunks[i].base)};
+                    split_view(v, chunks[i].pieces);
+               }
+          };
+
+          std::vector<std::jthread> workers;
+          for (unsigned t = 1; t < std::min<std::size_t>(threads, count); ++t)     workers.emplace_back(work);
+
+          work();
+     }
+
+
+private:
+     static bool is_special (char c) noexcept
+     {
+          return detail::block_classes[detail::special].contains(c);
+     }
+
+     static bool is_white (char c) noexcept
+     {
+          return detail::ascii_classes[static_cast<unsigned char>(c)] == detail::char_class::whitespace;
+     }
+
+
+     static void emit (token_stream<piece_kind>& pieces, piece_kind kind, const char* first, const char* start,
+                       const char* end)
+     {
+          pieces.push_back(kind, static_cast<std::uint32_t>(start - first), static_cast<std::uint32_t>(end - start));
+     }
+
+
+     // The first line break from a target at which a piece must begin whichever way the text is split: one between
+     // two characters which are not whitespace, so that it is a piece by itself. Or the end of the text.
+     static std::size_t find_split (std::string_view source, std::size_t target)
+     {
+          using namespace detail;
+
+          const char* const first = source.data();
+          const char* const last  = first + source.size();
+
+          if (target >= source.size())     return source.size();
+
+          for (const char* p = first + std::max<std::size_t>(target, 1); ; ++p)
+          {
+               p = simd::find_byte(p, last, '\n');
+               if (p == last || p + 1 == last)     return source.size();
+
+               // The character before is only known to be whole when it is ASCII
+               if (ascii_classes[static_cast<unsigned char>(p[-1])] < char_class::whitespace &&
+                   classify(p + 1, last).type != char_class::whitespace)
+                    return p - first;
+          }
+     }
+}; // class pretokenizer
+
+} // namespace Pattern
@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * Push Scanner
+ *
+ * A resumable scanner for input which arrives in fragments, such as from a socket.
+ */
+
+#pragma once
+
+#include <cmath>           // std::pow
+#include <cstdint>
+#include <limits>
+#include <string_view>
+
+
+namespace Pattern {
+
+// =====================================================================================================================
+// Tokens
+// =====================================================================================================================
+enum class push_token_kind : std::uint8_t
+{
+     identifier,     // (letter | '_') (alphanumeric | '_')*
+     number,         // digits ('.' digits)?
+     string,         // '"' (escape | !'"')* '"'
+     symbol,         // a single ASCII symbol
+     error           // an unexpected byte, or an unterminated string
+};
+
+
+// Positions are offsets into the whole stream rather than into a fragment, since a token may span several fragments.
+struct push_token
+{
+     push_token_kind kind;
+     std::uint64_t   position;
+     std::uint64_t   span;
+     double          value = 0;     // decoded value of a number
+};
+
+
+// =====================================================================================================================
+// Push Scanner
+// =====================================================================================================================
+// Scans a stream of bytes pushed to it in fragments of any size, calling a sink with each token as soon as it is
+// complete. Whitespace and line comments ("//") are skipped. When a fragment ends in the middle of a token, the scanner
+// suspends with the position within the rule, the partial value of a number, and whether an escape is pending in a
+// string, then resumes with the next call to feed without rescanning any byte.
+//
+// The whole state is a small trivially copyable object, so that one thread can keep a scanner per connection.
+class push_scanner
+{
+public:
+     constexpr push_scanner () noexcept = default;
+
+     // Scans a fragment. sink is invoked with a const push_token& for each token completed within the fragment.
+     template <class Sink>
+     void feed (std::string_view bytes, Sink&& sink)
+     {
+          const char* const base = bytes.data();
+          const char* p          = base;
+          const char* const end  = base + bytes.size();
+
+          auto at = [this, base] (const char* q) -> std::uint64_t { return offset + (q - base); };
+
+          while (p != end)
+          {
+               switch (rule)
+               {
+                    case rule_t::start:
+                    {
+                         const char c = *p;
+
+                         if (is_whitespace(c))     { ++p; break; }
+
+                         start = at(p++);
+
+                         if      (is_identifier_start(c))     rule = rule_t::identifier;
+                         else if (is_digit(c))                start_number(c);
+                         else if (c == '"')                   rule = rule_t::string;
+                         else if (c == '/')                   rule = rule_t::slash;
+                         else     emit(sink, is_ascii_symbol(c) ? push_token_kind::symbol : push_token_kind::error, at(p));
+
+                         break;
+                    }
+
+                    case rule_t::identifier:
+                         while (p != end && is_identifier_rest(*p))     ++p;
+                         if (p != end)     emit(sink, push_token_kind::identifier, at(p));
+                         break;
+
+                    case rule_t::integer:
+                         while (p != end && is_digit(*p))     accumulate(*p++, false);
+                         if (p == end)     break;
+
+                         if (*p == '.')
+                         {
+                              rule = rule_t::number_dot;
+                              ++p;
+                         }
+                         else     emit_number(sink, at(p));
+
+                         break;
+
+                    case rule_t::number_dot:
+                         // The dot belongs to the number only if a digit follows it
+                         if (is_digit(*p))
+                         {
+                              rule = rule_t::fraction;
+                              break;
+                         }
+
+                         emit_number(sink, at(p) - 1);
+                         start = at(p) - 1;
+                         emit(sink, push_token_kind::symbol, at(p));
+                         break;
+
+                    case rule_t::fraction:
+                         while (p != end && is_digit(*p))     accumulate(*p++, true);
+                         if (p != end)     emit_number(sink, at(p));
+                         break;
+
+                    case rule_t::string:
+                         while (p != end && *p != '"' && *p != '\\')     ++p;
+                         if (p == end)     break;
+
+                         if (*p++ == '\\')     rule = rule_t::string_escape;
+                         else                  emit(sink, push_token_kind::string, at(p));
+
+                         break;
+
+                    case rule_t::string_escape:
+                         ++p;
+                         rule = rule_t::string;
+                         break;
+
+                    case rule_t::slash:
+                         if (*p == '/')
+                         {
+                              rule = rule_t::comment;
+                              ++p;
+                         }
+                         else     emit(sink, push_token_kind::symbol, start + 1);
+
+                         break;
+
+                    case rule_t::comment:
+                         while (p != end && *p != '\n')     ++p;
+                         if (p != end)     rule = rule_t::start;
+                         break;
+               }
+          }
+
+          offset += bytes.size();
+     }
+
+
+     // Ends the stream, completing or rejecting any suspended token.
+     template <class Sink>
+     void finish (Sink&& sink)
+     {
+          switch (rule)
+          {
+               case rule_t::start:
+               case rule_t::comment:          break;
+
+               case rule_t::identifier:       emit(sink, push_token_kind::identifier, offset);     break;
+               case rule_t::integer:
+               case rule_t::fraction:         emit_number(sink, offset);                            break;
+               case rule_t::slash:            emit(sink, push_token_kind::symbol, offset);         break;
+
+               case rule_t::number_dot:
+                    emit_number(sink, offset - 1);
+                    start = offset - 1;
+                    emit(sink, push_token_kind::symbol, offset);
+                    break;
+
+               case rule_t::string:
+               case rule_t::string_escape:    emit(sink, push_token_kind::error, offset);          break;
+          }
+
+          rule = rule_t::start;
+     }
+
+
+     // Number of bytes fed so far.
+     constexpr std::uint64_t position () const noexcept     { return offset; }
+
+     // Whether the scanner is suspended in the middle of a token.
+     constexpr bool in_token () const noexcept     { return rule != rule_t::start && rule != rule_t::comment; }
+
+
+private:
+     enum class rule_t : std::uint8_t
+     {
+          start, identifier, integer, number_dot, fraction, string, string_escape, slash, comment
+     };
+
+     std::uint64_t offset   = 0;     // stream position of the start of the next fragment
+     std::uint64_t start    = 0;     // stream position of the current token
+     std::uint64_t mantissa = 0;     // digits of the current number
+     std::int16_t  scale    = 0;     // power of ten to apply to the mantissa
+     rule_t        rule     = rule_t::start;
+     bool          saturated = false;     // the mantissa can hold no more digits
+
+
+     // Same character classes as PatDef
+     static constexpr bool is_digit        (char c)     { return '0' <= c && c <= '9'; }
+     static constexpr bool is_letter       (char c)     { return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z'); }
+     static constexpr bool is_whitespace   (char c)     { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+     static constexpr bool is_ascii_symbol (char c)
+     {
+          return ('!' <= c && c <= '/') || (':' <= c && c <= '@') || ('[' <= c && c <= '`') || ('{' <= c && c <= '~');
+     }
+
+     static constexpr bool is_identifier_start (char c)     { return is_letter(c) || c == '_'; }
+     static constexpr bool is_identifier_rest  (char c)     { return is_identifier_start(c) || is_digit(c); }
+
+
+     constexpr void start_number (char c) noexcept
+     {
+          rule      = rule_t::integer;
+          mantissa  = c - '0';
+          scale     = 0;
+          saturated = false;
+     }
+
+     constexpr void accumulate (char c, bool fractional) noexcept
+     {
+          constexpr std::uint64_t limit = (std::numeric_limits<std::uint64_t>::max() - 9) / 10;
+
+          if (mantissa > limit)     saturated = true;
+
+          if (!saturated)
+          {
+               mantissa = mantissa * 10 + (c - '0');
+               if (fractional)     --scale;
+          }
+          else if (!fractional)     ++scale;     // drop an integer digit, keeping the magnitude
+     }
+
+     template <class Sink>
+     void emit (Sink& sink, push_token_kind kind, std::uint64_t last, double value = 0)
+     {
+          sink(push_token {kind, start, last - start, value});
+          rule = rule_t::start;
+     }
+
+     template <class Sink>
+     void emit_number (Sink& sink, std::uint64_t last)
+     {
+          double value = static_cast<double>(mantissa);
+
+          if      (scale < 0)     value /= std::pow(10.0, -scale);
+          else if (scale > 0)     value *= std::pow(10.0, scale);
+
+          emit(sink, push_token_kind::number, last, value);
+     }
+}; // class push_scanner
+
+
+} // namespace Pattern
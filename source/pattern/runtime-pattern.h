@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * Runtime Patterns
+ *
+ * Patterns assembled at run time, such as from a configuration file, rather than composed from templates at compile
+ * time.
+ */
+
+// A pattern is a graph of nodes held in a pattern_graph, which is interpreted directly. The semantics follow the
+// combinators in fn-combinators.h: sequences and alternatives are ordered, repetition is greedy and never backtracks
+// into what it has matched, and a failed pattern leaves the cursor where it started.
+//
+// Each node is a plain record indexed by its id, so a graph is cheap to copy and easy to translate into other forms,
+// such as native code (see pattern-jit.h).
+
+
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>        // std::rbegin
+#include <stdexcept>       // std::invalid_argument
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "scan_view.h"
+#include "simd.h"
+
+
+namespace Pattern {
+
+// =====================================================================================================================
+// Pattern Graph
+// =====================================================================================================================
+enum class pattern_op : std::uint8_t
+{
+     literal,          // a string of bytes
+     set,              // one byte within a set
+     sequence,         // first, then second
+     alternative,      // first, or else second
+     many,             // first, zero or more times
+     optional,         // first, zero or one time
+     while_not,        // bytes up to the first within a set, possibly none
+     capture           // first, marking its match as a numbered group
+};
+
+
+struct pattern_node
+{
+     pattern_op    op;
+     std::uint32_t first;      // child, offset of a literal, or index of a set
+     std::uint32_t second;     // child, length of a literal, or number of a group
+};
+
+
+class pattern_graph
+{
+public:
+     using node_id = std::uint32_t;
+
+
+     // --------------------------------------------------
+     // Construction
+     // --------------------------------------------------
+     node_id literal (std::string_view bytes)
+     {
+          auto offset = static_cast<std::uint32_t>(text.size());
+          text += bytes;
+          return add({pattern_op::literal, offset, static_cast<std::uint32_t>(bytes.size())});
+     }
+
+     node_id set       (const simd::byte_class& c)     { return add({pattern_op::set, add_set(c), 0});       }
+     node_id while_not (const simd::byte_class& c)     { return add({pattern_op::while_not, add_set(c), 0}); }
+
+     node_id sequence    (node_id a, node_id b)     { return add({pattern_op::sequence, check(a), check(b)});    }
+     node_id alternative (node_id a, node_id b)     { return add({pattern_op::alternative, check(a), check(b)}); }
+     node_id many        (node_id a)                { return add({pattern_op::many, check(a), 0});               }
+     node_id optional    (node_id a)                { return add({pattern_op::optional, check(a), 0});           }
+
+     // Groups are extracted by engines which support them, such as capture_dfa. Elsewhere they are transparent.
+     node_id capture (node_id a, std::uint32_t group)     { return add({pattern_op::capture, check(a), group}); }
+
+     node_id sequence    (std::initializer_list<node_id> nodes)     { return fold(pattern_op::sequence, nodes);    }
+     node_id alternative (std::initializer_list<node_id> nodes)     { return fold(pattern_op::alternative, nodes); }
+
+
+     // --------------------------------------------------
+     // Access
+     // --------------------------------------------------
+     const pattern_node& operator[] (node_id id) const     { return nodes[id]; }
+     std::size_t         size       () const               { return nodes.size(); }
+
+     std::string_view        literal_of (const pattern_node& n) const     { return {text.data() + n.first, n.second}; }
+     const simd::byte_class& set_of     (const pattern_node& n) const     { return sets[n.first]; }
+
+
+     // --------------------------------------------------
+     // Interpretation
+     // --------------------------------------------------
+     // Returns the end of the match of node root at first, or nullptr on failure.
+     const char* match (node_id root, const char* first, const char* last) const
+     {
+          const pattern_node& n = nodes[root];
+
+          switch (n.op)
+          {
+          case pattern_op::literal:
+          {
+               std::string_view lit = literal_of(n);
+               if (static_cast<std::size_t>(last - first) < lit.size() || std::string_view {first, lit.size()} != lit)
+                    return nullptr;
+               return first + lit.size();
+          }
+
+          case pattern_op::set:
+               return first != last && sets[n.first].contains(*first) ? first + 1 : nullptr;
+
+          case pattern_op::sequence:
+               if (const char* p = match(n.first, first, last))     return match(n.second, p, last);
+               return nullptr;
+
+          case pattern_op::alternative:
+               if (const char* p = match(n.first, first, last))     return p;
+               return match(n.second, first, last);
+
+          case pattern_op::many:
+               // Stops when an iteration makes no progress, which would otherwise repeat forever
+               while (const char* p = match(n.first, first, last))
+               {
+                    if (p == first)     break;
+                    first = p;
+               }
+               return first;
+
+          case pattern_op::optional:
+               if (const char* p = match(n.first, first, last))     return p;
+               return first;
+
+          case pattern_op::while_not:
+               return simd::find_in_class(first, last, sets[n.first]);
+
+          case pattern_op::capture:
+               return match(n.first, first, last);
+          }
+
+          return nullptr;
+     }
+
+
+private:
+     std::vector<pattern_node>     nodes;
+     std::vector<simd::byte_class> sets;
+     std::string                   text;      // bytes of every literal
+
+
+     node_id add (pattern_node n)
+     {
+          nodes.push_back(n);
+          return static_cast<node_id>(nodes.size() - 1);
+     }
+
+     std::uint32_t add_set (const simd::byte_class& c)
+     {
+          sets.push_back(c);
+          return static_cast<std::uint32_t>(sets.size() - 1);
+     }
+
+     node_id check (node_id id) const
+     {
+          if (id >= nodes.size())     throw std::invalid_argument("pattern_graph: unknown node");
+          return id;
+     }
+
+     node_id fold (pattern_op op, std::initializer_list<node_id> ids)
+     {
+          if (ids.size() == 0)     throw std::invalid_argument("pattern_graph: empty sequence or alternative");
+
+          // Nest to the right, so the first node is tested first
+          auto it = std::rbegin(ids);
+          node_id result = check(*it++);
+
+          for (; it != std::rend(ids); ++it)
+               result = add({op, check(*it), result});
+
+          return result;
+     }
+}; // class pattern_graph
+
+
+// =====================================================================================================================
+// Runtime Pattern
+// =====================================================================================================================
+// A pattern graph with a root node, which scans like any other scanner: on success the cursor is advanced past the
+// match, and on failure it is left in place.
+class runtime_pattern
+{
+public:
+     runtime_pattern (pattern_graph graph, pattern_graph::node_id root)
+          : g {std::move(graph)}, r {root}
+     {
+          if (r >= g.size())     throw std::invalid_argument("runtime_pattern: unknown root node");
+     }
+
+     const pattern_graph&   graph () const     { return g; }
+     pattern_graph::node_id root  () const     { return r; }
+
+     const char* match (const char* first, const char* last) const     { return g.match(r, first, last); }
+
+     bool operator() (scan_view& s) const
+     {
+          const char* p = match(s.data(), s.end());
+          if (!p)     return false;
+
+          s += p - s.data();
+          return true;
+     }
+
+private:
+     pattern_graph          g;
+     pattern_graph::node_id r;
+};
+
+} // namespace Pattern
@@ -2,9 +2,9 @@
 #define SCANNER_GENERATORS
 
 #include <cstring>    // strlen
-#include <tuple>      // scanner-type parameters
 #include <utility>    // scanner-type index_sequence
 #include "../include/scanning-algorithms.h"
+#include "fn-combinators.h"     // detail::pack
 
 using std::forward;
 using std::move;
@@ -35,7 +35,7 @@ namespace PatLib {
     class class_name                                                                             \
     {                                                                                            \
     public:                                                                                      \
-        class_name (Parameters... params) : parameters {move(params)...} {}                      \
+        class_name (Parameters... params) : parameters {{move(params)}...} {}                    \
                                                                                                  \
         bool operator() (mutable_range auto& r)                                                  \
         {                                                                                        \
@@ -49,12 +49,12 @@ namespace PatLib {
         }                                                                                        \
                                                                                                  \
     private:                                                                                     \
-        const std::tuple<Parameters...> parameters;                                              \
+        [[no_unique_address]] Pattern::detail::pack<Parameters...> parameters;                   \
                                                                                                  \
         template <typename Tuple, std::size_t... I>                                              \
         bool range_impl (mutable_range auto& r, Tuple&& t, std::index_sequence<I...>)            \
         {                                                                                        \
-            return function_name(r, std::get<I>(forward<Tuple>(t))...);                          \
+            return function_name(r, Pattern::detail::get_element<I>(forward<Tuple>(t))...);      \
         }                                                                                        \
                                                                                                  \
         template <forward_iterator Iterator,                                                     \
@@ -63,7 +63,8 @@ namespace PatLib {
                   std::size_t... I>                                                              \
         bool iter_impl(Iterator& first, Sentinel last, Tuple&& t, std::index_sequence<I...>)     \
         {                                                                                        \
-            return function_name(first, last, std::get<I>(std::forward<Tuple>(t))...);           \
+            return function_name(first, last,                                                    \
+                                 Pattern::detail::get_element<I>(std::forward<Tuple>(t))...);    \
         }                                                                                        \
     };                                                                                           \
 
@@ -1,7 +1,18 @@
 #ifndef SCOUTING_ITERATOR
 #define SCOUTING_ITERATOR
 
+#include <algorithm>   // std::max
+#include <compare>     // std::weak_ordering
+#include <cstddef>     // std::size_t
+#include <deque>
+#include <functional>  // std::invoke
 #include <iterator>    // type traits
+#include <stdexcept>   // std::out_of_range
+#include <type_traits> // std::enable_if
+#include <utility>     // std::exchange, std::move
+#include <vector>
+
+#include "scanning-concepts.h"     // boolean_invocable
 
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -186,298 +197,272 @@ operator- (const scouting_iterator<IterL, Container>& lhs,
 }
 
 
-// // ---------------------------------------------------------------------------------------------------------------------
-// // Speculative Iterator
-// // ---------------------------------------------------------------------------------------------------------------------
-// // A speculative iterator maintains a stack of iterators for speculative advancement through a sequence.
-// // Container is used to distinguish iterators of containers with the same underlying type
-// template <typename Iter, typename Container>
-// class speculative_iterator
-// {
-//     using traits_type = std::iterator_traits<Iter>;
-
-//     template<typename _Iter>
-//     using convertible_type = speculative_iterator<
-//         _Iter,
-//         typename std::enable_if<
-//             std::is_same_v<_Iter, typename Container::pointer>,
-//             Container
-//             >::type
-//         >;
-
-//     using self_type = speculative_iterator<Iter, Container>;
-
-//     std::vector<Iter> iters;
-//     Iter              current;
-
-
-//     // think about how to manage input iterators properly
-//     // -- the book recommends never clearing the container while speculating,
-//     // -- this should work
-
-//     // and about implementing actual lookahead
-//     // -- easy enough by never letting the pointer go pass a certain point before
-//     // -- the end, however, clearing the container will be more expensive, since
-//     // -- we'd have to copy the lookahead, since we might be using an input iterator
-
-
-
-
-
-// public:
-//     // Traits
-//     using iterator_category = typename traits_type::iterator_category;
-//     using value_type        = typename traits_type::value_type;
-//     using pointer           = typename traits_type::pointer;
-//     using reference         = typename traits_type::reference;
-//     using difference_type   = typename traits_type::difference_type;
-//     using size_type         = std::size_t;
-
-
-//     // Constructors
-//     constexpr speculative_iterator () noexcept
-//         : iters {Iter()}, current {iters.front()}
-//     {}
-
-//     template <typename ValueType>
-//     explicit constexpr speculative_iterator (const ValueType*... is) noexcept
-//         : iters {is...}, current {iters.front()}
-//     {}
-
-//     // Allow iterator to const_iterator conversion
-//     template <typename _Iter>
-//     constexpr speculative_iterator (const convertible_type<_Iter>& i) noexcept
-//         : iters {i.iters}, current {current}
-//     {}
-
-//     template <typename _Iter>
-//     self_type& operator= (const convertible_type<_Iter>& i) noexcept
-//     {
-//         iters = i.iters;
-//         return *this;
-//     }
-
-//     // Element access
-//     self_type& save () noexcept
-//     {
-//         iters.push_back(iters.back());
-//         return *this;
-//     }
-
-//     constexpr self_type& restore () noexcept
-//     {
-//         iters.pop_back();
-//         return *this;
-//     }
-
-
-//     // Operations
-//     reference operator*  () const noexcept    { return *current; }
-//     pointer   operator-> () const noexcept    { return current;  }
-
-//     self_type& operator++ () noexcept
-//     {
-//         advance();
-//         return *this;
-//     }
-
-//     self_type operator++ (int) noexcept
-//     {
-//         sync(1);                  // can't assume a forward iterator, so sync before copying
-//         self_type copy = *this;
-//         advance();
-
-//         return copy;
-//     }
-
-//     self_type& operator-- () noexcept
-//     {
-//         --current;
-//         return *this;
-//     }
-
-//     self_type operator-- (int) noexcept
-//     {
-//         return {iters, current--};
-//     }
-
-//      self_type& operator+= (difference_type n) noexcept
-//     {
-//         advance(n)
-//         return *this;
-//     }
-
-//     self_type operator+ (difference_type n) const noexcept
-//     {
-//         self_type copy = *this;
-//         copy.advance(n);
-//         return copy;
-//     }
-
-//     friend self_type operator+ (difference_type n, const self_type& i) noexcept
-//     {
-//         return i + n;
-//     }
-
-//     self_type& operator-= (difference_type n) noexcept
-//     {
-//         current -= n;
-//         return *this;
-//     }
-
-//     self_type operator- (difference_type n)
-//     {
-//         self_type copy = *this;
-//         copy -= n;
-//         return copy;
-//     }
-
-//     difference_type operator- (const Iter& i) const noexcept
-//     {
-//         return current - i.current;
-//     }
-
-//     friend difference_type operator- (const Iter& lhs, const self_type& rhs) noexcept
-//     {
-//         return lhs - rhs.scout;
-//     }
-
-//     bool operator== (const Iter& i) const noexcept
-//     {
-//         return current = i.current;
-//     }
-
-//     friend bool operator== (const Iter& lhs, const self_type& rhs) noexcept
-//     {
-//         return lhs == rhs.current;
-//     }
-
-//     bool operator!= (const Iter& i) const noexcept
-//     {
-//         return current != i.current;
-//     }
-
-//     friend bool operator!= (const Iter& lhs, const self_type& rhs) noexcept
-//     {
-//         return lhs != rhs.current;
-//     }
-
-//     bool operator< (const Iter& i) const noexcept
-//     {
-//         return current < i.current;
-//     }
-
-//     friend bool operator< (const Iter& lhs, const self_type& rhs) noexcept
-//     {
-//         return lhs < rhs.current;
-//     }
-
-//     bool operator<= (const Iter& i) const noexcept
-//     {
-//         return current <= i.current;
-//     }
-
-//     friend bool operator<= (const Iter& lhs, const self_type& rhs) noexcept
-//     {
-//         return lhs <= rhs.current;
-//     }
-
-//     bool operator> (const Iter& i) const noexcept
-//     {
-//         return current > i.current;
-//     }
-
-//     friend bool operator> (const Iter& lhs, const self_type& rhs) noexcept
-//     {
-//         return lhs > rhs.current;
-//     }
-
-//     bool operator>= (const Iter& i) const noexcept
-//     {
-//         return current >= i.current;
-//     }
-
-//     friend bool operator>= (const Iter& lhs, const self_type& rhs) noexcept
-//     {
-//         return lhs >= rhs.current;
-//     }
-
-// private:
-//     void advance (int n = 1)
-//     {
-//         ++current;
-
-//         if (current = lookahead.size() && iters.empty())
-//         {
-//             lookahead.clear();
-//             current = lookahead.front();
-//         }
-
-//         sync(1);
-//     }
-
-//     void sync (int i)
-//     {
-//         int diff = lookahead.back() - current + i;
-//         if (diff > 0)    fill(diff);
-//     }
-
-//     void fill (int n)
-//     {
-//         while (n--)    lookahead.push_back(*(++current););
-//     }
-
-// }; // speculative_iterator
-
-
-// template <typename IterL, typename IterR, typename Container>
-// inline bool operator== (const speculative_iterator<IterL, Container>& lhs,
-//                         const speculative_iterator<IterR, Container>& rhs) noexcept
-// {
-//     return lhs.current == rhs.current;
-// }
-
-// template <typename IterL, typename IterR, typename Container>
-// inline bool operator!= (const speculative_iterator<IterL, Container>& lhs,
-//                         const speculative_iterator<IterR, Container>& rhs) noexcept
-// {
-//     return lhs.current != rhs.current;
-// }
-
-// template <typename IterL, typename IterR, typename Container>
-// inline bool operator< (const speculative_iterator<IterL, Container>& lhs,
-//                        const speculative_iterator<IterR, Container>& rhs) noexcept
-// {
-//     return lhs.current < rhs.current;
-// }
-
-// template <typename IterL, typename IterR, typename Container>
-// inline bool operator<= (const speculative_iterator<IterL, Container>& lhs,
-//                         const speculative_iterator<IterR, Container>& rhs) noexcept
-// {
-//     return lhs.current <= rhs.current;
-// }
-
-// template <typename IterL, typename IterR, typename Container>
-// inline bool operator> (const speculative_iterator<IterL, Container>& lhs,
-//                        const speculative_iterator<IterR, Container>& rhs) noexcept
-// {
-//     return lhs.current > rhs.current;
-// }
-
-// template <typename IterL, typename IterR, typename Container>
-// inline bool operator>= (const speculative_iterator<IterL, Container>& lhs,
-//                         const speculative_iterator<IterR, Container>& rhs) noexcept
-// {
-//     return lhs.current >= rhs.current;
-// }
-
-// template <typename IterL, typename IterR, typename Container>
-// inline typename speculative_iterator<IterL, Container>::difference_type
-// operator- (const speculative_iterator<IterL, Container>& lhs,
-//            const speculative_iterator<IterR, Container>& rhs) noexcept
-// {
-//     return lhs.current - rhs.current;
-// }
+// ---------------------------------------------------------------------------------------------------------------------
+// Speculative Iterator
+// ---------------------------------------------------------------------------------------------------------------------
+
+// A speculative input adapts a single-pass input, such as std::istreambuf_iterator, so that it can be scanned by
+//     algorithms which require forward iterators. Elements read from the input are kept in a buffer while an iterator
+//     or a speculation mark is at or before them. A mark is pushed before an attempt which may need to backtrack, then
+//     either committed or rolled back, returning to the marked position. Memory is therefore bounded by the distance
+//     from the oldest live iterator or mark to the furthest element read, not by the size of the input.
+
+//     speculative_input input {std::istreambuf_iterator<char> {stream}, std::istreambuf_iterator<char> {}};
+//     auto first = input.begin();
+
+//     input.speculate(first, [&] (auto& i, auto last) { return scan(i, last, "while"sv); });
+
+// Its iterators are positions in the input, so they may be copied and compared as forward iterators require. The input
+//     counts the iterators at each position, and discards an element once none is at or before it. A scan which works
+//     on a copy of its iterator and leaves it in place when it fails, as the scanning algorithms do, may so be retried
+//     from the same position, and plain fo::any and fo::optional backtrack over the input without a mark. The input
+//     must outlive its iterators.
+
+template <std::input_iterator I, std::sentinel_for<I> S>
+class speculative_input;
+
+
+template <std::input_iterator I, std::sentinel_for<I> S>
+class speculative_iterator
+{
+     using input_type = speculative_input<I, S>;
+
+     input_type* input    = nullptr;
+     std::size_t position = 0;
+
+     friend input_type;
+
+     speculative_iterator (input_type* input, std::size_t position)
+          : input {input}, position {position}
+     {
+          input->hold(position);
+     }
+
+public:
+     // Traits
+     using iterator_concept  = std::forward_iterator_tag;
+     using iterator_category = std::forward_iterator_tag;
+     using value_type        = std::iter_value_t<I>;
+     using difference_type   = std::ptrdiff_t;
+
+
+     // Constructors
+     constexpr speculative_iterator () noexcept = default;
+
+     speculative_iterator (const speculative_iterator& i)
+          : input {i.input}, position {i.position}
+     {
+          if (input)     input->hold(position);
+     }
+
+     speculative_iterator (speculative_iterator&& i) noexcept
+          : input {std::exchange(i.input, nullptr)}, position {i.position}
+     {}
+
+     speculative_iterator& operator= (const speculative_iterator& i)
+     {
+          if (i.input)     i.input->hold(i.position);
+          if (input)       input->let_go(position);
+
+          input    = i.input;
+          position = i.position;
+          return *this;
+     }
+
+     speculative_iterator& operator= (speculative_iterator&& i) noexcept
+     {
+          if (this != &i)
+          {
+               if (input)     input->let_go(position);
+
+               input    = std::exchange(i.input, nullptr);
+               position = i.position;
+          }
+          return *this;
+     }
+
+     ~speculative_iterator ()
+     {
+          if (input)     input->let_go(position);
+     }
+
+
+     // Element access
+     value_type  operator* () const             { return input->at(position); }
+     std::size_t offset    () const noexcept    { return position;            }
+
+
+     // Operations
+     speculative_iterator& operator++ ()
+     {
+          input->hold(position + 1);
+          input->let_go(position);
+          ++position;
+          return *this;
+     }
+
+     speculative_iterator operator++ (int)
+     {
+          speculative_iterator previous = *this;
+          ++*this;
+          return previous;
+     }
+
+     friend bool operator== (const speculative_iterator& lhs, const speculative_iterator& rhs) noexcept
+     {
+          return lhs.position == rhs.position;
+     }
+
+     friend bool operator== (const speculative_iterator& i, std::default_sentinel_t)
+     {
+          return i.at_end();
+     }
+
+private:
+     bool at_end () const     { return !input->fill(position); }
+}; // speculative_iterator
+
+
+template <std::input_iterator I, std::sentinel_for<I> S>
+class speculative_input
+{
+public:
+     using iterator   = speculative_iterator<I, S>;
+     using value_type = std::iter_value_t<I>;
+
+
+     // Constructors
+     speculative_input (I first, S last)
+          : in {std::move(first)}, last {std::move(last)}
+     {}
+
+     speculative_input (const speculative_input&)            = delete;     // iterators refer to the input
+     speculative_input& operator= (const speculative_input&) = delete;
+
+
+     iterator                begin ()          { return {this, base}; }
+     std::default_sentinel_t end   () const    { return {}; }
+
+
+     // Speculation
+     /**
+      * Record the input from a position, so that it may be returned to.
+      */
+     void mark (const iterator& at)
+     {
+          hold(at.position);
+          marks.push_back(at.position);
+     }
+
+     /**
+      * Accept the innermost speculation. The input it recorded is kept only while other iterators or marks need it.
+      */
+     void commit (const iterator&)
+     {
+          std::size_t position = marks.back();
+          marks.pop_back();
+          let_go(position);
+     }
+
+     /**
+      * Abandon the innermost speculation.
+      *
+      * @return   The marked position, whose elements are replayed from the buffer
+      */
+     iterator rollback ()
+     {
+          iterator at {this, marks.back()};
+          marks.pop_back();
+          let_go(at.position);
+          return at;
+     }
+
+     /**
+      * Invoke f with first and the end, as a scanning algorithm, restoring first if it fails.
+      */
+     template <class F>
+          requires Pattern::boolean_invocable<F, iterator&, std::default_sentinel_t>
+     bool speculate (iterator& first, F&& f)
+     {
+          mark(first);
+
+          if (std::invoke(std::forward<F>(f), first, end()))
+          {
+               commit(first);
+               return true;
+          }
+
+          first = rollback();
+          return false;
+     }
+
+
+     std::size_t speculating () const noexcept     { return marks.size();  }
+     std::size_t buffered    () const noexcept     { return buffer.size(); }
+
+     // Largest number of elements buffered at once
+     std::size_t peak        () const noexcept     { return peak_;         }
+
+
+private:
+     friend iterator;
+
+     I                        in;
+     S                        last;
+     std::deque<value_type>   buffer;
+     std::deque<std::size_t>  holders;       // number of iterators and marks at each position from base
+     std::size_t              base  = 0;     // position of buffer.front() and holders.front()
+     std::size_t              peak_ = 0;
+     std::vector<std::size_t> marks;
+
+
+     // Reads the input up to a position
+     bool fill (std::size_t position)
+     {
+          while (base + buffer.size() <= position)
+          {
+               if (in == last)     return false;
+
+               buffer.push_back(*in);
+               ++in;
+               peak_ = std::max(peak_, buffer.size());
+               discard_unheld();
+          }
+
+          return true;
+     }
+
+
+     value_type at (std::size_t position)
+     {
+          if (!fill(position))     throw std::out_of_range("speculative_input: position is past the end");
+          return buffer[position - base];
+     }
+
+
+     // A held position is never discarded, so it is at or after base
+     void hold (std::size_t position)
+     {
+          if (position - base >= holders.size())     holders.resize(position - base + 1);
+          ++holders[position - base];
+     }
+
+     void let_go (std::size_t position)
+     {
+          if (--holders[position - base] == 0 && position == base)     discard_unheld();
+     }
+
+
+     // Discards the elements read before the first position held
+     void discard_unheld ()
+     {
+          while (!buffer.empty() && (holders.empty() || holders.front() == 0))
+          {
+               buffer.pop_front();
+               if (!holders.empty())     holders.pop_front();
+               ++base;
+          }
+     }
+}; // speculative_input
 
 #endif // SCOUTING_ITERATOR
@@ -0,0 +1,933 @@
+/*
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * Shard Coordinator
+ *
+ * Bulk lexing of a corpus by worker processes, with a coordinator which hands out shards of the corpus and collects
+ * their results.
+ */
+
+// The corpus is split into shards of about equal size, largest files first, so that the longest shards start early
+// and small ones fill in at the end. There are many more shards than workers: a worker is given its next shard only
+// when it returns the last, so faster workers take more of the corpus.
+//
+// Workers return compact results, the status and token count of each file and a histogram of token tags, rather than
+// the tokens themselves. The coordinator adds them into one corpus_report.
+//
+// A worker which disconnects, breaks the protocol, or holds a shard past the shard timeout is dropped, and its shard is
+// queued again at the front. A shard which has lost as many workers as the options allow is given up instead, and its
+// files reported as abandoned, so that a file which crashes every worker cannot stall the corpus.
+//
+// Once no shards are queued, a shard which has run much longer than its size predicts, from the throughput of the
+// shards completed so far, is copied to an idle worker, and whichever copy finishes first is taken. So a single slow
+// node delays the corpus by at most about one shard.
+//
+// The coordinator is a single thread polling every connection. It never waits on one worker: what a socket will not
+// take at once is queued on its connection, and sent as the socket drains. Workers connect to it over any stream
+// socket: a Unix domain socket on one host, or TCP across hosts given a listening socket. Every field on the wire is a
+// little-endian integer of fixed width, and a worker announces the protocol version when it connects, so mixed hosts
+// interoperate.
+//
+//      frame        type u32, size u32, then size bytes
+//      hello        magic u32, version u32                              worker to coordinator
+//      assign       shard u32, count u32, then count of:                coordinator to worker
+//                        file u32, path size u32, path
+//      result       shard u32, count u32, then count of:                worker to coordinator
+//                        file u32, status u32, bytes u64, tokens u64
+//                   then tags u32, and tags of: tag u32, count u64
+//      shutdown     empty                                               coordinator to worker
+
+
+#pragma once
+
+#include <algorithm>       // std::stable_sort, std::count_if
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "lex-daemon.h"
+#include "token-stream.h"
+
+
+namespace Pattern {
+
+// =====================================================================================================================
+// Corpus
+// =====================================================================================================================
+struct corpus_file
+{
+     std::string   path;
+     std::uint64_t size;
+};
+
+
+struct shard
+{
+     std::vector<std::uint32_t> files;     // indices into the corpus
+     std::uint64_t              bytes = 0;
+};
+
+
+// Files which cannot be read are listed with a size of 0, and reported as unreadable by the worker
+inline std::vector<corpus_file> list_corpus (const std::vector<std::string>& paths)
+{
+     std::vector<corpus_file> corpus;
+     corpus.reserve(paths.size());
+
+     for (const auto& path : paths)
+     {
+          std::error_code error;
+          auto size = std::filesystem::file_size(path, error);
+          corpus.push_back({path, error ? 0 : static_cast<std::uint64_t>(size)});
+     }
+
+     return corpus;
+}
+
+
+/**
+ * Group the files of a corpus into shards of about shard_bytes each, largest first. A file larger than shard_bytes is a
+ * shard of its own.
+ */
+inline std::vector<shard> make_shards (const std::vector<corpus_file>& corpus, std::uint64_t shard_bytes)
+{
+     std::vector<std::uint32_t> order(corpus.size());
+     for (std::uint32_t i = 0; i < order.size(); ++i)     order[i] = i;
+
+     std::stable_sort(order.begin(), order.end(), [&] (auto a, auto b) { return corpus[a].size > corpus[b].size; });
+
+     std::vector<shard> shards;
+
+     for (std::uint32_t i : order)
+     {
+          if (shards.empty() || shards.back().bytes >= shard_bytes)     shards.emplace_back();
+
+          shards.back().files.push_back(i);
+          shards.back().bytes += corpus[i].size;
+     }
+
+     return shards;
+}
+
+
+enum class file_status : std::uint32_t { pending, ok, unreadable, too_large, abandoned };
+
+
+struct file_result
+{
+     file_status   status = file_status::pending;
+     std::uint64_t tokens = 0;
+};
+
+
+struct corpus_report
+{
+     std::vector<file_result>         files;             // in the order of the corpus
+     std::uint64_t                    bytes        = 0;
+     std::uint64_t                    tokens       = 0;
+     std::uint64_t                    failed_files = 0;
+     std::array<std::uint64_t, 256>   tag_counts   {};
+
+     std::uint32_t                    shards       = 0;
+     std::uint32_t                    reassigned   = 0;     // shards queued again after their worker was lost
+     std::uint32_t                    backups      = 0;     // copies of straggling shards
+     std::uint32_t                    abandoned    = 0;     // shards given up after losing too many workers
+     std::uint32_t                    workers_lost = 0;
+     std::chrono::steady_clock::duration elapsed {};
+};
+
+
+// =====================================================================================================================
+// Protocol
+// =====================================================================================================================
+namespace detail {
+
+inline constexpr std::uint32_t shard_magic   = 0x44485350;     // "PSHD" in little-endian order
+inline constexpr std::uint32_t shard_version = 1;
+
+enum class shard_message : std::uint32_t { hello = 1, assign, result, shutdown };
+
+
+class wire_writer
+{
+public:
+     std::string bytes;
+
+     void u32 (std::uint32_t x)     { for (int i = 0; i < 4; ++i)     bytes += static_cast<char>(x >> 8 * i); }
+     void u64 (std::uint64_t x)     { for (int i = 0; i < 8; ++i)     bytes += static_cast<char>(x >> 8 * i); }
+     void text (std::string_view s) { u32(static_cast<std::uint32_t>(s.size()));  bytes += s; }
+
+     // Starts a frame, whose size is filled in by finish
+     void begin (shard_message type)
+     {
+          bytes.clear();
+          u32(static_cast<std::uint32_t>(type));
+          u32(0);
+     }
+
+     void finish ()
+     {
+          auto size = static_cast<std::uint32_t>(bytes.size() - 8);
+          for (int i = 0; i < 4; ++i)     bytes[4 + i] = static_cast<char>(size >> 8 * i);
+     }
+};
+
+
+// Reads fields from a payload. Reading past its end sets failed and yields zeros.
+class wire_reader
+{
+public:
+     explicit wire_reader (std::string_view payload) : rest {payload} {}
+
+     bool failed = false;
+
+     std::uint32_t u32 ()     { return static_cast<std::uint32_t>(field(4)); }
+     std::uint64_t u64 ()     { return field(8); }
+
+     std::string_view text ()
+     {
+          std::uint32_t n = u32();
+          if (failed || rest.size() < n)     return fail(), std::string_view {};
+
+          auto s = rest.substr(0, n);
+          rest.remove_prefix(n);
+          return s;
+     }
+
+     bool done () const noexcept     { return !failed && rest.empty(); }
+
+
+private:
+     std::string_view rest;
+
+     void fail () noexcept     { failed = true;  rest = {}; }
+
+     std::uint64_t field (int size)
+     {
+          if (rest.size() < static_cast<std::size_t>(size))     return fail(), 0;
+
+          std::uint64_t x = 0;
+          for (int i = 0; i < size; ++i)     x |= std::uint64_t {static_cast<unsigned char>(rest[i])} << 8 * i;
+
+          rest.remove_prefix(static_cast<std::size_t>(size));
+          return x;
+     }
+};
+
+
+inline std::uint32_t frame_word (const char* p)
+{
+     std::uint32_t x = 0;
+     for (int i = 0; i < 4; ++i)     x |= std::uint32_t {static_cast<unsigned char>(p[i])} << 8 * i;
+     return x;
+}
+
+
+// Sends as much of bytes as the socket takes without waiting, and removes it. A lost peer is an error rather than
+// SIGPIPE.
+inline bool send_some (int fd, std::string& bytes)
+{
+     std::size_t done = 0;
+
+     while (done < bytes.size())
+     {
+          ssize_t n = ::send(fd, bytes.data() + done, bytes.size() - done, MSG_NOSIGNAL);
+
+          if (n >= 0)                                          done += static_cast<std::size_t>(n);
+          else if (errno == EAGAIN || errno == EWOULDBLOCK)    break;
+          else if (errno != EINTR)                             return false;
+     }
+
+     bytes.erase(0, done);
+     return true;
+}
+
+
+// Sends a whole frame over a blocking socket
+inline bool send_frame (int fd, const wire_writer& w)
+{
+     std::string bytes = w.bytes;
+     return send_some(fd, bytes) && bytes.empty();
+}
+
+
+inline int connect_unix (const std::string& path, const char* what)
+{
+     auto address = unix_address(path);
+
+     int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+     if (fd < 0)     throw_errno(what);
+
+     if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+     {
+          int error = errno;
+          ::close(fd);
+          throw std::system_error(error, std::generic_category(), what);
+     }
+
+     return fd;
+}
+
+} // namespace detail
+
+
+// =====================================================================================================================
+// Coordinator
+// =====================================================================================================================
+struct coordinator_options
+{
+     using milliseconds = std::chrono::milliseconds;
+
+     milliseconds shard_timeout    {0};          // a worker holding a shard longer is dropped; 0 for no limit
+     double       straggler_factor = 4;          // a shard running this many times longer than predicted is copied
+     milliseconds straggler_floor  {100};        // and only once it has run this long
+     milliseconds worker_wait      {10000};      // shards are pending but no worker has been ready for this long
+     int          max_attempts     = 3;          // workers a shard may lose before it is given up
+};
+
+
+class shard_coordinator
+{
+public:
+     static constexpr std::uint32_t max_frame = 64 << 20;
+
+
+     /**
+      * Listen for workers on a Unix domain socket, replacing any file at its path.
+      *
+      * @throw    std::system_error    When the socket cannot be created
+      */
+     explicit shard_coordinator (std::string socket_path)
+          : path {std::move(socket_path)}
+     {
+          auto address = detail::unix_address(path);
+
+          listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+          if (listener < 0)     detail::throw_errno("shard_coordinator: socket");
+
+          ::unlink(path.c_str());
+
+          if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+              ::listen(listener, SOMAXCONN) < 0)
+          {
+               int error = errno;
+               ::close(listener);
+               throw std::system_error(error, std::generic_category(), "shard_coordinator: bind");
+          }
+     }
+
+     /**
+      * Adopt a listening stream socket of any family, e.g. TCP for workers on other hosts. The socket is made
+      * non-blocking, as connections are accepted until none is waiting.
+      *
+      * @throw    std::system_error    When the socket cannot be made non-blocking. It is then left open.
+      */
+     explicit shard_coordinator (int listening_socket)
+          : listener {listening_socket}
+     {
+          int flags = ::fcntl(listener, F_GETFL);
+
+          if (flags < 0 || ::fcntl(listener, F_SETFL, flags | O_NONBLOCK) < 0)
+               detail::throw_errno("shard_coordinator: fcntl");
+     }
+
+     shard_coordinator (const shard_coordinator&)            = delete;
+     shard_coordinator& operator= (const shard_coordinator&) = delete;
+
+     // Shuts down the workers still connected. A worker whose socket is full finds its connection closed instead.
+     ~shard_coordinator ()
+     {
+          detail::wire_writer w;
+          w.begin(detail::shard_message::shutdown);
+          w.finish();
+
+          for (auto& c : connections)
+          {
+               if (c.ready)
+               {
+                    c.output += w.bytes;
+                    detail::send_some(c.fd, c.output);
+               }
+
+               ::close(c.fd);
+          }
+
+          ::close(listener);
+          if (!path.empty())     ::unlink(path.c_str());
+     }
+
+
+     /**
+      * Lex every shard of a corpus with the connected workers, and any which connect while it runs. The workers stay
+      * connected for the next corpus.
+      *
+      * @throw    std::runtime_error    When shards are pending and no worker has said hello for options.worker_wait
+      */
+     corpus_report run (const std::vector<corpus_file>& corpus, const std::vector<shard>& shards,
+                        coordinator_options options = {})
+     {
+          auto start = clock::now();
+
+          job j {corpus, shards, options};
+          j.report.files.resize(corpus.size());
+          j.report.shards = static_cast<std::uint32_t>(shards.size());
+          j.states.resize(shards.size());
+          for (std::uint32_t i = 0; i < shards.size(); ++i)     j.pending.push_back(i);
+
+          auto last_worker = clock::now();
+
+          while (j.completed < shards.size())
+          {
+               poll_once(j);
+               dispatch(j);
+
+               if (workers() != 0)     last_worker = clock::now();
+               else if (clock::now() - last_worker > options.worker_wait)
+                    throw std::runtime_error("shard_coordinator: no workers");
+          }
+
+          // A copy of a shard may still be running; its worker is idle again once its result arrives
+          ++runs;
+          j.report.elapsed = clock::now() - start;
+          return std::move(j.report);
+     }
+
+
+     // Waits until at least n workers have connected. Returns false on timeout.
+     bool await_workers (std::size_t n, std::chrono::milliseconds timeout)
+     {
+          std::vector<corpus_file> corpus;
+          std::vector<shard>       shards;
+          job idle {corpus, shards, {}};
+
+          auto deadline = clock::now() + timeout;
+
+          while (workers() < n)
+          {
+               if (clock::now() > deadline)     return false;
+               poll_once(idle);
+          }
+
+          return true;
+     }
+
+     std::size_t workers () const noexcept
+     {
+          return static_cast<std::size_t>(std::count_if(connections.begin(), connections.end(),
+                                                        [] (const auto& c) { return c.ready; }));
+     }
+
+
+private:
+     using clock = std::chrono::steady_clock;
+
+     struct connection
+     {
+          int               fd;
+          std::vector<char> input;
+          std::string       output;            // frames the socket has not yet taken
+          bool              ready = false;     // has sent a valid hello
+          int               shard = -1;        // being run, if any
+          std::uint32_t     run   = 0;         // which assigned it; earlier runs are stale
+          clock::time_point started {};
+     };
+
+     struct shard_state
+     {
+          bool done   = false;
+          int  copies = 0;                     // running
+          int  lost   = 0;                     // workers dropped while running it
+     };
+
+     struct job
+     {
+          const std::vector<corpus_file>& corpus;
+          const std::vector<shard>&       shards;
+          coordinator_options             options;
+
+          corpus_report                   report {};
+          std::vector<shard_state>        states {};
+          std::deque<std::uint32_t>       pending {};
+          std::size_t                     completed = 0;
+
+          std::uint64_t                   bytes_done = 0;     // for the throughput of a worker
+          clock::duration                 busy_time  {};
+     };
+
+     std::string             path;
+     int                     listener = -1;
+     std::uint32_t           runs     = 0;
+     std::vector<connection> connections;
+     detail::wire_writer     writer;
+
+
+     // --------------------------------------------------
+     // Connections
+     // --------------------------------------------------
+     void poll_once (job& j)
+     {
+          std::vector<pollfd> fds;
+          fds.push_back({listener, POLLIN, 0});
+          for (auto& c : connections)
+               fds.push_back({c.fd, static_cast<short>(c.output.empty() ? POLLIN : POLLIN | POLLOUT), 0});
+
+          // Wake regularly to look for stragglers and timeouts
+          int n = ::poll(fds.data(), fds.size(), 20);
+          if (n < 0 && errno != EINTR)     detail::throw_errno("shard_coordinator: poll");
+
+          std::vector<std::size_t> dropped;
+
+          for (std::size_t i = 1; i < fds.size(); ++i)
+          {
+               connection& c = connections[i - 1];
+
+               bool alive = !(fds[i].revents & (POLLIN | POLLHUP | POLLERR)) || (receive(c) && handle_frames(j, c));
+
+               if (alive && (fds[i].revents & POLLOUT))
+                    alive = detail::send_some(c.fd, c.output);
+
+               if (alive && c.shard >= 0 && j.options.shard_timeout.count() > 0 &&
+                   clock::now() - c.started > j.options.shard_timeout)
+                    alive = false;
+
+               if (!alive)     dropped.push_back(i - 1);
+          }
+
+          for (auto i = dropped.rbegin(); i != dropped.rend(); ++i)     drop(j, *i);
+
+          if (fds[0].revents & POLLIN)     accept_all();
+     }
+
+
+     void accept_all ()
+     {
+          while (true)
+          {
+               int fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+               if (fd >= 0)                   connections.push_back({fd, {}, {}});
+               else if (errno != EINTR)       return;
+          }
+     }
+
+
+     // Reads whatever is available. Returns false once the worker has closed its end.
+     static bool receive (connection& c)
+     {
+          char buffer[16384];
+
+          while (true)
+          {
+               ssize_t n = ::read(c.fd, buffer, sizeof(buffer));
+
+               if (n > 0)                      c.input.insert(c.input.end(), buffer, buffer + n);
+               else if (n == 0)                return false;
+               else if (errno == EINTR)        continue;
+               else                            return errno == EAGAIN;
+          }
+     }
+
+
+     // A lost worker's shard is queued again, unless another copy of it is still running, or it has lost too many
+     void drop (job& j, std::size_t i)
+     {
+          connection& c = connections[i];
+
+          if (c.shard >= 0 && c.run == runs)
+          {
+               shard_state& s = j.states[c.shard];
+               ++s.lost;
+
+               if (--s.copies == 0 && !s.done)
+               {
+                    if (s.lost >= j.options.max_attempts)
+                         abandon(j, static_cast<std::uint32_t>(c.shard));
+                    else
+                    {
+                         j.pending.push_front(static_cast<std::uint32_t>(c.shard));
+                         ++j.report.reassigned;
+                    }
+               }
+          }
+
+          if (c.ready)     ++j.report.workers_lost;
+
+          ::close(c.fd);
+          connections.erase(connections.begin() + static_cast<std::ptrdiff_t>(i));
+     }
+
+
+     static void abandon (job& j, std::uint32_t id)
+     {
+          j.states[id].done = true;
+          ++j.completed;
+          ++j.report.abandoned;
+
+          for (std::uint32_t file : j.shards[id].files)
+               j.report.files[file].status = file_status::abandoned;
+
+          j.report.failed_files += j.shards[id].files.size();
+     }
+
+
+     // --------------------------------------------------
+     // Messages
+     // --------------------------------------------------
+     bool handle_frames (job& j, connection& c)
+     {
+          std::size_t used = 0;
+          bool ok = true;
+
+          while (ok && c.input.size() - used >= 8)
+          {
+               auto type = static_cast<detail::shard_message>(detail::frame_word(c.input.data() + used));
+               std::uint32_t size = detail::frame_word(c.input.data() + used + 4);
+
+               if (size > max_frame)                            return false;
+               if (c.input.size() - used - 8 < size)            break;
+
+               detail::wire_reader r {{c.input.data() + used + 8, size}};
+               used += 8 + size;
+
+               if (type == detail::shard_message::hello)
+               {
+                    ok      = !c.ready && r.u32() == detail::shard_magic && r.u32() == detail::shard_version &&
+                              r.done();
+                    c.ready = true;
+               }
+               else if (type == detail::shard_message::result && c.ready && c.shard >= 0 && c.run != runs)
+                    c.shard = -1;          // a copy left running by an earlier corpus
+               else if (type == detail::shard_message::result && c.ready && c.shard >= 0)
+                    ok = record(j, c, r);
+               else
+                    ok = false;
+          }
+
+          c.input.erase(c.input.begin(), c.input.begin() + static_cast<std::ptrdiff_t>(used));
+          return ok;
+     }
+
+
+     bool record (job& j, connection& c, detail::wire_reader& r)
+     {
+          std::uint32_t id    = r.u32();
+          std::uint32_t count = r.u32();
+
+          if (r.failed || id != static_cast<std::uint32_t>(c.shard))     return false;
+
+          shard_state& s = j.states[id];
+          bool first = !s.done;
+
+          corpus_report& report = j.report;
+          corpus_report  update {};          // applied only if the result is complete
+
+          std::vector<std::pair<std::uint32_t, file_result>> files;
+          files.reserve(count);
+
+          for (std::uint32_t i = 0; i < count; ++i)
+          {
+               std::uint32_t file   = r.u32();
+               auto          status = static_cast<file_status>(r.u32());
+               std::uint64_t bytes  = r.u64();
+               std::uint64_t tokens = r.u64();
+
+               if (r.failed || file >= j.corpus.size())     return false;
+
+               files.push_back({file, {status, tokens}});
+               update.bytes  += bytes;
+               update.tokens += tokens;
+               if (status != file_status::ok)     ++update.failed_files;
+          }
+
+          std::uint32_t tags = r.u32();
+
+          for (std::uint32_t i = 0; i < tags; ++i)
+          {
+               std::uint32_t tag   = r.u32();
+               std::uint64_t n     = r.u64();
+               if (r.failed || tag > 255)     return false;
+
+               update.tag_counts[tag] += n;
+          }
+
+          if (!r.done())     return false;
+
+          --s.copies;
+          c.shard = -1;
+
+          if (!first)     return true;
+
+          s.done = true;
+          ++j.completed;
+
+          for (auto& [file, result] : files)     report.files[file] = result;
+
+          report.bytes        += update.bytes;
+          report.tokens       += update.tokens;
+          report.failed_files += update.failed_files;
+          for (int t = 0; t < 256; ++t)     report.tag_counts[t] += update.tag_counts[t];
+
+          j.bytes_done += j.shards[id].bytes;
+          j.busy_time  += clock::now() - c.started;
+          return true;
+     }
+
+
+     // --------------------------------------------------
+     // Scheduling
+     // --------------------------------------------------
+     void dispatch (job& j)
+     {
+          for (std::size_t i = 0; i < connections.size(); )
+          {
+               connection& c = connections[i];
+
+               if (!c.ready || c.shard >= 0)     { ++i; continue; }
+
+               int next = -1;
+
+               if (!j.pending.empty())
+               {
+                    next = static_cast<int>(j.pending.front());
+                    j.pending.pop_front();
+               }
+               else if ((next = straggler(j)) >= 0)     ++j.report.backups;
+               else                                     return;
+
+               if (assign(j, c, static_cast<std::uint32_t>(next)))     { ++i; continue; }
+
+               // The assignment is undone by dropping the worker
+               drop(j, i);
+          }
+     }
+
+
+     bool assign (job& j, connection& c, std::uint32_t id)
+     {
+          writer.begin(detail::shard_message::assign);
+          writer.u32(id);
+          writer.u32(static_cast<std::uint32_t>(j.shards[id].files.size()));
+
+          for (std::uint32_t file : j.shards[id].files)
+          {
+               writer.u32(file);
+               writer.text(j.corpus[file].path);
+          }
+
+          writer.finish();
+
+          c.shard   = static_cast<int>(id);
+          c.run     = runs;
+          c.started = clock::now();
+          ++j.states[id].copies;
+
+          // What the socket does not take now is sent from poll_once
+          c.output += writer.bytes;
+          return detail::send_some(c.fd, c.output);
+     }
+
+
+     // A running shard with a single copy that has run far longer than its size predicts, or -1
+     int straggler (const job& j) const
+     {
+          if (j.bytes_done == 0)     return -1;
+
+          double seconds_per_byte = std::chrono::duration<double> {j.busy_time}.count() / j.bytes_done;
+          auto   now              = clock::now();
+
+          for (const auto& c : connections)
+          {
+               if (c.shard < 0 || c.run != runs)     continue;
+
+               const shard_state& s = j.states[c.shard];
+               if (s.done || s.copies != 1)     continue;
+
+               double predicted = seconds_per_byte * j.shards[c.shard].bytes;
+               auto   running   = now - c.started;
+
+               if (running > j.options.straggler_floor &&
+                   std::chrono::duration<double> {running}.count() > j.options.straggler_factor * predicted)
+                    return c.shard;
+          }
+
+          return -1;
+     }
+}; // class shard_coordinator
+
+
+// =====================================================================================================================
+// Worker
+// =====================================================================================================================
+template <token_tag Tag, stream_lexer<Tag> Lexer>
+class shard_worker
+{
+public:
+     explicit shard_worker (Lexer lexer) : lexer {std::move(lexer)} {}
+
+
+     /**
+      * Serve shards to the coordinator listening on a Unix domain socket, until it shuts down or disconnects.
+      *
+      * @return   The number of shards completed
+      * @throw    std::system_error    When the coordinator cannot be reached
+      */
+     std::size_t run (const std::string& socket_path)
+     {
+          int fd = detail::connect_unix(socket_path, "shard_worker: connect");
+          std::size_t n = run_on(fd);
+          ::close(fd);
+          return n;
+     }
+
+     // Serves shards over a connected, blocking stream socket, which is not closed
+     std::size_t run_on (int fd)
+     {
+          detail::wire_writer w;
+          w.begin(detail::shard_message::hello);
+          w.u32(detail::shard_magic);
+          w.u32(detail::shard_version);
+          w.finish();
+
+          if (!detail::send_frame(fd, w))     return 0;
+
+          std::size_t completed = 0;
+          std::string payload;
+
+          while (true)
+          {
+               char header[8];
+               if (!detail::read_all(fd, header, 8))     return completed;
+
+               auto          type = static_cast<detail::shard_message>(detail::frame_word(header));
+               std::uint32_t size = detail::frame_word(header + 4);
+
+               payload.resize(size);
+               if (!detail::read_all(fd, payload.data(), size))     return completed;
+
+               if (type != detail::shard_message::assign)     return completed;
+
+               detail::wire_reader r {payload};
+               if (!lex_shard(r, w) || !detail::send_frame(fd, w))     return completed;
+
+               ++completed;
+          }
+     }
+
+
+private:
+     Lexer                          lexer;
+     token_stream<Tag>              tokens;
+     std::string                    source;          // reused between files
+     std::array<std::uint64_t, 256> tag_counts {};
+
+
+     bool lex_shard (detail::wire_reader& r, detail::wire_writer& w)
+     {
+          std::uint32_t id    = r.u32();
+          std::uint32_t count = r.u32();
+
+          w.begin(detail::shard_message::result);
+          w.u32(id);
+          w.u32(count);
+          tag_counts.fill(0);
+
+          for (std::uint32_t i = 0; i < count; ++i)
+          {
+               std::uint32_t    file = r.u32();
+               std::string_view path = r.text();
+               if (r.failed)     return false;
+
+               file_status status = read_file(std::string {path});
+               tokens.clear();
+
+               if (status == file_status::ok)
+               {
+                    lexer(std::string_view {source}, tokens);
+                    for (std::size_t t = 0; t < tokens.size(); ++t)
+                         ++tag_counts[static_cast<std::uint8_t>(tokens.tag(t))];
+               }
+
+               w.u32(file);
+               w.u32(static_cast<std::uint32_t>(status));
+               w.u64(status == file_status::ok ? source.size() : 0);
+               w.u64(tokens.size());
+          }
+
+          auto used = static_cast<std::uint32_t>(std::count_if(tag_counts.begin(), tag_counts.end(),
+                                                               [] (auto n) { return n != 0; }));
+          w.u32(used);
+
+          for (std::uint32_t t = 0; t < 256; ++t)
+          {
+               if (tag_counts[t] == 0)     continue;
+
+               w.u32(t);
+               w.u64(tag_counts[t]);
+          }
+
+          w.finish();
+          return r.done();
+     }
+
+
+     // Offsets in a token stream are 32-bit, so larger files are refused
+     file_status read_file (const std::string& file_path)
+     {
+          std::ifstream file {file_path, std::ios::in | std::ios::binary | std::ios::ate};
+          if (!file)     return file_status::unreadable;
+
+          auto size = static_cast<std::uint64_t>(file.tellg());
+          if (size > 0xffffffff)     return file_status::too_large;
+
+          source.resize(size);
+          file.seekg(0);
+
+          if (!file.read(source.data(), static_cast<std::streamsize>(size)))     return file_status::unreadable;
+          return file_status::ok;
+     }
+}; // class shard_worker
+
+
+/**
+ * Start a worker in a child process, which exits once the coordinator shuts it down or is lost. Call this before any
+ * threads are started, as only the calling thread is copied into the child.
+ *
+ * @return   The process id of the child
+ * @throw    std::system_error    When the process cannot be created
+ */
+template <token_tag Tag, stream_lexer<Tag> Lexer>
+pid_t spawn_shard_worker (const std::string& socket_path, Lexer lexer)
+{
+     pid_t pid = ::fork();
+     if (pid < 0)     detail::throw_errno("spawn_shard_worker: fork");
+     if (pid > 0)     return pid;
+
+     int status = 0;
+
+     try {
+          shard_worker<Tag, Lexer> {std::move(lexer)}.run(socket_path);
+     }
+     catch (...) {
+          status = 1;
+     }
+
+     ::_exit(status);
+}
+
+} // namespace Pattern
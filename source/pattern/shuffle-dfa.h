@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * Shuffle DFA
+ *
+ * Execution of small deterministic automata, of up to 16 states, by composing transition functions with byte shuffles.
+ */
+
+// A table-driven automaton costs one dependent load per byte, as each lookup needs the state produced by the last. Here
+// the automaton is run from every state at once: a 16-byte vector maps each possible starting state to the state
+// reached so far. Each input byte has a vector holding the next state for each state, so consuming a byte composes two
+// functions with a single shuffle (pshufb):
+//
+//     after[s] = transition[before[s]]
+//
+// Since composition does not depend on the state actually reached, the input is split into chunks whose functions are
+// computed independently, interleaved so their shuffles overlap in the pipeline, and then composed in order. The same
+// composition combines the functions of chunks computed on different threads.
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <set>
+#include <stdexcept>       // std::invalid_argument
+#include <string_view>
+#include <vector>
+
+#include "simd.h"
+
+
+namespace Pattern {
+
+class shuffle_dfa
+{
+public:
+     using state          = std::uint8_t;
+     using transition_map = std::array<std::uint8_t, 16>;     // state reached from each state
+
+     static constexpr int max_states = 16;
+
+
+     // --------------------------------------------------
+     // Construction
+     // --------------------------------------------------
+     /**
+      * Build an automaton from its transition function.
+      *
+      * @param    states       Number of states, from 1 to 16
+      * @param    start        Initial state
+      * @param    accepting    Set of accepting states, one bit per state
+      * @param    next         Callable (state, unsigned char) -> state
+      */
+     template <class Next>
+     shuffle_dfa (int states, state start, std::uint16_t accepting, Next next)
+          : n {states}, initial {start}, accept {accepting}, by_byte(256)
+     {
+          if (states < 1 || states > max_states)     throw std::invalid_argument("shuffle_dfa: at most 16 states");
+          if (start >= states)                       throw std::invalid_argument("shuffle_dfa: unknown start state");
+
+          std::set<transition_map> distinct;
+
+          for (int b = 0; b < 256; ++b)
+          {
+               transition_map t = identity();
+
+               for (int s = 0; s < states; ++s)
+               {
+                    auto to = static_cast<int>(next(static_cast<state>(s), static_cast<unsigned char>(b)));
+                    if (to < 0 || to >= states)     throw std::invalid_argument("shuffle_dfa: unknown next state");
+                    t[s] = static_cast<std::uint8_t>(to);
+               }
+
+               distinct.insert(t);
+               by_byte[b] = t;
+          }
+
+          classes = static_cast<int>(distinct.size());
+     }
+
+
+     // --------------------------------------------------
+     // Access
+     // --------------------------------------------------
+     int   states       () const noexcept           { return n; }
+     int   byte_classes () const noexcept           { return classes; }
+     state start        () const noexcept           { return initial; }
+     bool  accepting    (state s) const noexcept    { return accept >> s & 1; }
+
+     state next (state s, char c) const noexcept
+     {
+          return by_byte[static_cast<unsigned char>(c)][s];
+     }
+
+
+     // --------------------------------------------------
+     // Execution
+     // --------------------------------------------------
+     static constexpr transition_map identity () noexcept
+     {
+          return {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+     }
+
+     // The function mapping each state to the state reached after consuming the bytes
+     transition_map compose (const char* first, const char* last) const;
+
+     // The function of consuming the bytes of f, then those of g
+     static transition_map then (const transition_map& f, const transition_map& g) noexcept
+     {
+          transition_map h;
+          for (int s = 0; s < 16; ++s)     h[s] = g[f[s] & 0x0f];
+          return h;
+     }
+
+     // The state reached from a state, one byte at a time
+     state run_serial (const char* first, const char* last, state from) const noexcept
+     {
+          for (; first != last; ++first)     from = next(from, *first);
+          return from;
+     }
+
+     state run (const char* first, const char* last, state from) const     { return compose(first, last)[from]; }
+
+     bool matches (std::string_view text) const
+     {
+          return accepting(run(text.data(), text.data() + text.size(), initial));
+     }
+
+
+private:
+     int                         n;
+     state                       initial;
+     std::uint16_t               accept;
+     int                         classes;          // distinct transitions among all bytes
+     std::vector<transition_map> by_byte;          // 4 KiB, so it stays in the L1 cache
+};
+
+
+// =====================================================================================================================
+// Kernels
+// =====================================================================================================================
+namespace detail {
+
+// Number of chunks whose functions are computed in an interleaved loop
+inline constexpr std::size_t shuffle_dfa_chains = 8;
+
+// Below this size, the setup of the chains costs more than a serial run
+inline constexpr std::size_t shuffle_dfa_threshold = 64;
+
+
+template <class V>
+shuffle_dfa::transition_map compose_dfa (const shuffle_dfa::transition_map* by_byte,
+                                         const char* first, const char* last)
+{
+     constexpr std::size_t k = shuffle_dfa_chains;
+
+     std::size_t size  = last - first;
+     std::size_t chunk = size / k;
+
+     V chain[k];
+     for (auto& f : chain)     f = V::table(shuffle_dfa::identity());
+
+     const char* start[k];
+     for (std::size_t j = 0; j < k; ++j)     start[j] = first + j * chunk;
+
+     for (std::size_t i = 0; i < chunk; ++i)
+          for (std::size_t j = 0; j < k; ++j)
+               chain[j] = lookup(V::table(by_byte[static_cast<unsigned char>(start[j][i])]), chain[j]);
+
+     // Bytes left over after the chunks extend the last chain
+     for (const char* p = first + k * chunk; p != last; ++p)
+          chain[k - 1] = lookup(V::table(by_byte[static_cast<unsigned char>(*p)]), chain[k - 1]);
+
+     // Compose in order: applying a later chain to the result of the earlier ones
+     V result = chain[0];
+     for (std::size_t j = 1; j < k; ++j)     result = lookup(chain[j], result);
+
+     alignas(16) char out[16];
+     store(out, result);
+
+     shuffle_dfa::transition_map m;
+     for (int s = 0; s < 16; ++s)     m[s] = static_cast<std::uint8_t>(out[s]);
+     return m;
+}
+
+
+using compose_dfa_function = shuffle_dfa::transition_map (const shuffle_dfa::transition_map*, const char*, const char*);
+
+#ifdef PATTERN_SIMD_X86
+
+[[PATTERN_SIMD_SSE, gnu::flatten]]
+inline shuffle_dfa::transition_map compose_dfa_sse (const shuffle_dfa::transition_map* by_byte,
+                                                    const char* first, const char* last)
+{
+     return compose_dfa<simd::sse_vec>(by_byte, first, last);
+}
+
+#endif
+
+
+// Shuffles within 16-byte lanes are all that is needed, so wider instruction sets use the same entry point
+inline compose_dfa_function* select_compose_dfa (simd::isa level) noexcept
+{
+#ifdef PATTERN_SIMD_X86
+     if (level >= simd::isa::sse)     return &compose_dfa_sse;
+#endif
+
+     return &compose_dfa<simd::scalar_vec>;
+}
+
+} // namespace detail
+
+
+inline shuffle_dfa::transition_map shuffle_dfa::compose (const char* first, const char* last) const
+{
+     if (static_cast<std::size_t>(last - first) < detail::shuffle_dfa_threshold)
+     {
+          transition_map m = identity();
+          for (int s = 0; s < n; ++s)     m[s] = run_serial(first, last, static_cast<state>(s));
+          return m;
+     }
+
+     static detail::compose_dfa_function* const kernel = detail::select_compose_dfa(simd::detect());
+     return kernel(by_byte.data(), first, last);
+}
+
+} // namespace Pattern
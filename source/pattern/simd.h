@@ -0,0 +1,675 @@
+/*
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * SIMD
+ *
+ * A thin layer over vector intrinsics, and kernels for scanning bytes which select the best instruction set available on
+ * the running host.
+ */
+
+// Each instruction set provides a vector type with the same small set of operations: load, store, splat, cmpeq,
+// bitwise and, nibble extraction, shuffle-lookup (pshufb), and movemask, along with tzcnt on the resulting masks.
+// Kernels are written once as templates over the vector type, then instantiated in entry points compiled for each
+// target. Kernels are always inlined, even without optimization, so a vector is only ever passed between functions
+// compiled for its own target. Entry points are also marked flatten, which inlines the operations into them.
+//
+// The dispatcher queries CPUID once per process and selects a table of entry points, so one binary uses the best
+// instruction set on each host without recompilation.
+
+
+#pragma once
+
+#include <array>
+#include <bit>             // std::countr_zero, std::popcount
+#include <cstddef>         // std::size_t
+#include <cstdint>
+#include <cstring>         // std::memcpy
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PATTERN_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace Pattern {
+namespace simd {
+
+enum class isa : std::uint8_t
+{
+     scalar,
+     sse,          // SSE2 and SSSE3
+     avx2,
+     avx512        // AVX-512 F and BW
+};
+
+
+// =====================================================================================================================
+// Byte Classes
+// =====================================================================================================================
+// A set of bytes, with tables for classifying 16 bytes at a time by shuffle-lookup of their nibbles. Each high nibble is
+// assigned to a bucket holding the set of low nibbles it is paired with. A byte is a member when the buckets of its two
+// nibbles intersect. A set which needs more than 8 buckets is classified by its bitmap instead.
+class byte_class
+{
+public:
+     std::array<std::uint64_t, 4> bitmap {};
+     std::array<std::uint8_t, 16> low    {};
+     std::array<std::uint8_t, 16> high   {};
+     bool                         shuffle_ok = true;
+
+     constexpr byte_class () noexcept = default;
+
+     template <class Predicate>
+     static constexpr byte_class from (Predicate pred)
+     {
+          byte_class c;
+
+          for (int i = 0; i < 256; ++i)
+               if (pred(static_cast<char>(i)))     c.bitmap[i >> 6] |= std::uint64_t {1} << (i & 63);
+
+          c.build_tables();
+          return c;
+     }
+
+     static constexpr byte_class of (std::string_view bytes)
+     {
+          byte_class c;
+
+          for (unsigned char b : bytes)     c.bitmap[b >> 6] |= std::uint64_t {1} << (b & 63);
+
+          c.build_tables();
+          return c;
+     }
+
+     constexpr bool contains (char c) const noexcept
+     {
+          auto b = static_cast<unsigned char>(c);
+          return (bitmap[b >> 6] >> (b & 63)) & 1;
+     }
+
+     constexpr byte_class complement () const
+     {
+          byte_class c;
+
+          for (int i = 0; i < 4; ++i)     c.bitmap[i] = ~bitmap[i];
+
+          c.build_tables();
+          return c;
+     }
+
+
+private:
+     constexpr void build_tables ()
+     {
+          std::uint16_t buckets[8] = {};
+          int           used       = 0;
+
+          for (int h = 0; h < 16; ++h)
+          {
+               std::uint16_t lows = 0;
+
+               for (int l = 0; l < 16; ++l)
+                    if (contains(static_cast<char>(h << 4 | l)))     lows |= std::uint16_t(1u << l);
+
+               if (lows == 0)     continue;
+
+               int b = 0;
+               while (b < used && buckets[b] != lows)     ++b;
+
+               if (b == used)
+               {
+                    if (used == 8)
+                    {
+                         shuffle_ok = false;
+                         return;
+                    }
+
+                    buckets[used++] = lows;
+               }
+
+               high[h] |= std::uint8_t(1u << b);
+
+               for (int l = 0; l < 16; ++l)
+                    if (lows & (1u << l))     low[l] |= std::uint8_t(1u << b);
+          }
+     }
+}; // class byte_class
+
+
+// =====================================================================================================================
+// Vector Types
+// =====================================================================================================================
+struct scalar_vec
+{
+     static constexpr std::size_t width = 16;
+
+     std::array<std::uint8_t, 16> b;
+
+     static scalar_vec load (const char* p)     { scalar_vec v; std::memcpy(v.b.data(), p, width); return v; }
+     static scalar_vec splat (char c)           { scalar_vec v; v.b.fill(static_cast<std::uint8_t>(c)); return v; }
+     static scalar_vec table (const std::array<std::uint8_t, 16>& t)     { return {t}; }
+
+     friend void store (char* p, scalar_vec x)     { std::memcpy(p, x.b.data(), width); }
+
+     friend scalar_vec cmpeq (scalar_vec x, scalar_vec y)
+     {
+          for (std::size_t i = 0; i < width; ++i)     x.b[i] = x.b[i] == y.b[i] ? 0xff : 0;
+          return x;
+     }
+
+     friend scalar_vec bit_and (scalar_vec x, scalar_vec y)
+     {
+          for (std::size_t i = 0; i < width; ++i)     x.b[i] &= y.b[i];
+          return x;
+     }
+
+     friend scalar_vec low_nibbles (scalar_vec x)
+     {
+          for (auto& e : x.b)     e &= 0x0f;
+          return x;
+     }
+
+     friend scalar_vec high_nibbles (scalar_vec x)
+     {
+          for (auto& e : x.b)     e >>= 4;
+          return x;
+     }
+
+     // Same semantics as pshufb: an index with its high bit set yields zero
+     friend scalar_vec lookup (scalar_vec table, scalar_vec indices)
+     {
+          for (auto& e : indices.b)     e = (e & 0x80) ? 0 : table.b[e & 0x0f];
+          return indices;
+     }
+
+     friend std::uint64_t movemask (scalar_vec x)
+     {
+          std::uint64_t m = 0;
+          for (std::size_t i = 0; i < width; ++i)     m |= std::uint64_t(x.b[i] >> 7) << i;
+          return m;
+     }
+}; // struct scalar_vec
+
+
+#ifdef PATTERN_SIMD_X86
+
+#define PATTERN_SIMD_SSE    gnu::target("sse2,ssse3")
+#define PATTERN_SIMD_AVX2   gnu::target("avx2")
+#define PATTERN_SIMD_AVX512 gnu::target("avx512f,avx512bw")
+
+
+struct sse_vec
+{
+     static constexpr std::size_t width = 16;
+
+     __m128i r;
+
+     [[PATTERN_SIMD_SSE]] static sse_vec load  (const char* p)     { return {_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))}; }
+     [[PATTERN_SIMD_SSE]] static sse_vec splat (char c)            { return {_mm_set1_epi8(c)}; }
+
+     [[PATTERN_SIMD_SSE]] static sse_vec table (const std::array<std::uint8_t, 16>& t)
+     {
+          return {_mm_loadu_si128(reinterpret_cast<const __m128i*>(t.data()))};
+     }
+
+     [[PATTERN_SIMD_SSE]] friend void store (char* p, sse_vec x)     { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), x.r); }
+
+     [[PATTERN_SIMD_SSE]] friend sse_vec cmpeq        (sse_vec x, sse_vec y)     { return {_mm_cmpeq_epi8(x.r, y.r)}; }
+     [[PATTERN_SIMD_SSE]] friend sse_vec bit_and      (sse_vec x, sse_vec y)     { return {_mm_and_si128(x.r, y.r)}; }
+     [[PATTERN_SIMD_SSE]] friend sse_vec low_nibbles  (sse_vec x)     { return {_mm_and_si128(x.r, _mm_set1_epi8(0x0f))}; }
+
+     [[PATTERN_SIMD_SSE]] friend sse_vec high_nibbles (sse_vec x)
+     {
+          return {_mm_and_si128(_mm_srli_epi16(x.r, 4), _mm_set1_epi8(0x0f))};
+     }
+
+     [[PATTERN_SIMD_SSE]] friend sse_vec lookup (sse_vec table, sse_vec indices)
+     {
+          return {_mm_shuffle_epi8(table.r, indices.r)};
+     }
+
+     [[PATTERN_SIMD_SSE]] friend std::uint64_t movemask (sse_vec x)
+     {
+          return static_cast<std::uint16_t>(_mm_movemask_epi8(x.r));
+     }
+}; // struct sse_vec
+
+
+struct avx2_vec
+{
+     static constexpr std::size_t width = 32;
+
+     __m256i r;
+
+     [[PATTERN_SIMD_AVX2]] static avx2_vec load  (const char* p)     { return {_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))}; }
+     [[PATTERN_SIMD_AVX2]] static avx2_vec splat (char c)            { return {_mm256_set1_epi8(c)}; }
+
+     // Shuffles stay within 128-bit lanes, so the table is repeated in each lane
+     [[PATTERN_SIMD_AVX2]] static avx2_vec table (const std::array<std::uint8_t, 16>& t)
+     {
+          return {_mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(t.data())))};
+     }
+
+     [[PATTERN_SIMD_AVX2]] friend void store (char* p, avx2_vec x)     { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), x.r); }
+
+     [[PATTERN_SIMD_AVX2]] friend avx2_vec cmpeq   (avx2_vec x, avx2_vec y)     { return {_mm256_cmpeq_epi8(x.r, y.r)}; }
+     [[PATTERN_SIMD_AVX2]] friend avx2_vec bit_and (avx2_vec x, avx2_vec y)     { return {_mm256_and_si256(x.r, y.r)}; }
+
+     [[PATTERN_SIMD_AVX2]] friend avx2_vec low_nibbles (avx2_vec x)
+     {
+          return {_mm256_and_si256(x.r, _mm256_set1_epi8(0x0f))};
+     }
+
+     [[PATTERN_SIMD_AVX2]] friend avx2_vec high_nibbles (avx2_vec x)
+     {
+          return {_mm256_and_si256(_mm256_srli_epi16(x.r, 4), _mm256_set1_epi8(0x0f))};
+     }
+
+     [[PATTERN_SIMD_AVX2]] friend avx2_vec lookup (avx2_vec table, avx2_vec indices)
+     {
+          return {_mm256_shuffle_epi8(table.r, indices.r)};
+     }
+
+     [[PATTERN_SIMD_AVX2]] friend std::uint64_t movemask (avx2_vec x)
+     {
+          return static_cast<std::uint32_t>(_mm256_movemask_epi8(x.r));
+     }
+}; // struct avx2_vec
+
+
+struct avx512_vec
+{
+     static constexpr std::size_t width = 64;
+
+     __m512i r;
+
+     [[PATTERN_SIMD_AVX512]] static avx512_vec load  (const char* p)     { return {_mm512_loadu_si512(p)}; }
+     [[PATTERN_SIMD_AVX512]] static avx512_vec splat (char c)            { return {_mm512_set1_epi8(c)}; }
+
+     // The zero-masked broadcast, since the unmasked one merges into an undefined vector, which GCC warns of
+     [[PATTERN_SIMD_AVX512]] static avx512_vec table (const std::array<std::uint8_t, 16>& t)
+     {
+          return {_mm512_maskz_broadcast_i32x4(0xffff, _mm_loadu_si128(reinterpret_cast<const __m128i*>(t.data())))};
+     }
+
+     [[PATTERN_SIMD_AVX512]] friend void store (char* p, avx512_vec x)     { _mm512_storeu_si512(p, x.r); }
+
+     [[PATTERN_SIMD_AVX512]] friend avx512_vec cmpeq (avx512_vec x, avx512_vec y)
+     {
+          return {_mm512_movm_epi8(_mm512_cmpeq_epi8_mask(x.r, y.r))};
+     }
+
+     [[PATTERN_SIMD_AVX512]] friend avx512_vec bit_and (avx512_vec x, avx512_vec y)
+     {
+          return {_mm512_and_si512(x.r, y.r)};
+     }
+
+     [[PATTERN_SIMD_AVX512]] friend avx512_vec low_nibbles (avx512_vec x)
+     {
+          return {_mm512_and_si512(x.r, _mm512_set1_epi8(0x0f))};
+     }
+
+     [[PATTERN_SIMD_AVX512]] friend avx512_vec high_nibbles (avx512_vec x)
+     {
+          return {_mm512_and_si512(_mm512_srli_epi16(x.r, 4), _mm512_set1_epi8(0x0f))};
+     }
+
+     [[PATTERN_SIMD_AVX512]] friend avx512_vec lookup (avx512_vec table, avx512_vec indices)
+     {
+          return {_mm512_shuffle_epi8(table.r, indices.r)};
+     }
+
+     [[PATTERN_SIMD_AVX512]] friend std::uint64_t movemask (avx512_vec x)
+     {
+          return _mm512_movepi8_mask(x.r);
+     }
+}; // struct avx512_vec
+
+#endif // PATTERN_SIMD_X86
+
+
+inline unsigned tzcnt (std::uint64_t mask) noexcept     { return std::countr_zero(mask); }
+
+
+// =====================================================================================================================
+// Kernels
+// =====================================================================================================================
+namespace detail {
+
+template <class V>
+constexpr std::uint64_t full_mask = V::width == 64 ? ~std::uint64_t {0} : (std::uint64_t {1} << V::width) - 1;
+
+
+// Mask of the bytes of v which are members of c
+template <class V>
+[[gnu::always_inline]] inline
+std::uint64_t member_mask (const V& v, const V& low_table, const V& high_table)
+{
+     V buckets = bit_and(lookup(low_table, low_nibbles(v)), lookup(high_table, high_nibbles(v)));
+     return ~movemask(cmpeq(buckets, V::splat(0))) & full_mask<V>;
+}
+
+
+template <class V>
+[[gnu::always_inline]] inline
+const char* find_byte (const char* first, const char* last, char c)
+{
+     const V needle = V::splat(c);
+
+     for (; static_cast<std::size_t>(last - first) >= V::width; first += V::width)
+          if (std::uint64_t m = movemask(cmpeq(V::load(first), needle)))     return first + tzcnt(m);
+
+     for (; first != last; ++first)
+          if (*first == c)     return first;
+
+     return last;
+}
+
+
+template <class V>
+[[gnu::always_inline]] inline
+std::size_t count_byte (const char* first, const char* last, char c)
+{
+     const V needle = V::splat(c);
+     std::size_t count = 0;
+
+     for (; static_cast<std::size_t>(last - first) >= V::width; first += V::width)
+          count += std::popcount(movemask(cmpeq(V::load(first), needle)));
+
+     for (; first != last; ++first)
+          count += *first == c;
+
+     return count;
+}
+
+
+// Finds the first byte which is (Member) or is not (!Member) in the class
+template <bool Member, class V>
+[[gnu::always_inline]] inline
+const char* find_class (const char* first, const char* last, const byte_class& c)
+{
+     if (c.shuffle_ok)
+     {
+          const V low_table  = V::table(c.low);
+          const V high_table = V::table(c.high);
+
+          for (; static_cast<std::size_t>(last - first) >= V::width; first += V::width)
+          {
+               std::uint64_t m = member_mask(V::load(first), low_table, high_table);
+               if (!Member)     m = ~m & full_mask<V>;
+
+               if (m)     return first + tzcnt(m);
+          }
+     }
+
+     for (; first != last; ++first)
+          if (c.contains(*first) == Member)     return first;
+
+     return last;
+}
+
+
+// Finds the first byte with its high bit set
+template <class V>
+[[gnu::always_inline]] inline
+const char* find_non_ascii (const char* first, const char* last)
+{
+     for (; static_cast<std::size_t>(last - first) >= V::width; first += V::width)
+          if (std::uint64_t m = movemask(V::load(first)))     return first + tzcnt(m);
+
+     for (; first != last; ++first)
+          if (static_cast<unsigned char>(*first) >= 0x80)     return first;
+
+     return last;
+}
+
+
+// Finds the first UTF-16 code unit which is not ASCII, or a trailing odd byte. A unit is ASCII when its high byte is
+// zero and its low byte is below 0x80.
+template <class V>
+[[gnu::always_inline]] inline
+const char* find_non_ascii16 (const char* first, const char* last, bool big_endian)
+{
+     constexpr std::uint64_t unit_starts = 0x5555555555555555 & full_mask<V>;
+     const V zero = V::splat(0);
+
+     for (; static_cast<std::size_t>(last - first) >= V::width; first += V::width)
+     {
+          V v = V::load(first);
+          std::uint64_t high_bits = movemask(v);
+          std::uint64_t zeros     = movemask(cmpeq(v, zero));
+
+          std::uint64_t bad = big_endian ? (high_bits >> 1) | ~zeros : high_bits | ~(zeros >> 1);
+          if (bad &= unit_starts)     return first + tzcnt(bad);
+     }
+
+     for (; last - first >= 2; first += 2)
+     {
+          auto low  = static_cast<unsigned char>(first[big_endian]);
+          auto high = static_cast<unsigned char>(first[!big_endian]);
+
+          if (high != 0 || low >= 0x80)     return first;
+     }
+
+     return first;
+}
+
+
+// Masks of the 64 bytes of a block which are members of each class
+template <class V>
+[[gnu::always_inline]] inline
+void block_masks (const char* block, const byte_class* classes, std::size_t count, std::uint64_t* masks)
+{
+     for (std::size_t k = 0; k < count; ++k)
+     {
+          const byte_class& c = classes[k];
+          std::uint64_t     m = 0;
+
+          if (c.shuffle_ok)
+          {
+               const V low_table  = V::table(c.low);
+               const V high_table = V::table(c.high);
+
+               for (std::size_t i = 0; i < 64; i += V::width)
+                    m |= member_mask(V::load(block + i), low_table, high_table) << i;
+          }
+          else
+               for (std::size_t i = 0; i < 64; ++i)     m |= std::uint64_t {c.contains(block[i])} << i;
+
+          masks[k] = m;
+     }
+}
+
+} // namespace detail
+
+
+struct kernels
+{
+     isa level;
+
+     const char* (*find_byte)         (const char* first, const char* last, char c);
+     std::size_t (*count_byte)        (const char* first, const char* last, char c);
+     const char* (*find_in_class)     (const char* first, const char* last, const byte_class& c);
+     const char* (*find_not_in_class) (const char* first, const char* last, const byte_class& c);
+     void        (*block_masks)       (const char* block, const byte_class* classes, std::size_t count,
+                                       std::uint64_t* masks);
+     const char* (*find_non_ascii)    (const char* first, const char* last);
+     const char* (*find_non_ascii16)  (const char* first, const char* last, bool big_endian);
+};
+
+
+namespace detail {
+
+template <class V>
+struct entry_points
+{
+     static constexpr kernels table (isa level)
+     {
+          return {level, &find_byte<V>, &count_byte<V>, &find_class<true, V>, &find_class<false, V>, &block_masks<V>,
+                  &find_non_ascii<V>, &find_non_ascii16<V>};
+     }
+};
+
+
+#ifdef PATTERN_SIMD_X86
+
+// Entry points compiled for a target, so the operations of its vector type can be inlined into them
+#define PATTERN_SIMD_ENTRY_POINTS(V, TARGET)                                                                          \
+     template <>                                                                                                     \
+     struct entry_points<V>                                                                                          \
+     {                                                                                                               \
+          [[TARGET, gnu::flatten]] static const char* find_byte (const char* first, const char* last, char c)        \
+          {                                                                                                          \
+               return detail::find_byte<V>(first, last, c);                                                          \
+          }                                                                                                          \
+                                                                                                                     \
+          [[TARGET, gnu::flatten]] static std::size_t count_byte (const char* first, const char* last, char c)       \
+          {                                                                                                          \
+               return detail::count_byte<V>(first, last, c);                                                         \
+          }                                                                                                          \
+                                                                                                                     \
+          [[TARGET, gnu::flatten]]                                                                                   \
+          static const char* find_in_class (const char* first, const char* last, const byte_class& c)                \
+          {                                                                                                          \
+               return detail::find_class<true, V>(first, last, c);                                                   \
+          }                                                                                                          \
+                                                                                                                     \
+          [[TARGET, gnu::flatten]]                                                                                   \
+          static const char* find_not_in_class (const char* first, const char* last, const byte_class& c)            \
+          {                                                                                                          \
+               return detail::find_class<false, V>(first, last, c);                                                  \
+          }                                                                                                          \
+                                                                                                                     \
+          [[TARGET, gnu::flatten]]                                                                                   \
+          static void block_masks (const char* block, const byte_class* classes, std::size_t count,                  \
+                                   std::uint64_t* masks)                                                             \
+          {                                                                                                          \
+               detail::block_masks<V>(block, classes, count, masks);                                                 \
+          }                                                                                                          \
+                                                                                                                     \
+          [[TARGET, gnu::flatten]] static const char* find_non_ascii (const char* first, const char* last)           \
+          {                                                                                                          \
+               return detail::find_non_ascii<V>(first, last);                                                        \
+          }                                                                                                          \
+                                                                                                                     \
+          [[TARGET, gnu::flatten]]                                                                                   \
+          static const char* find_non_ascii16 (const char* first, const char* last, bool big_endian)                 \
+          {                                                                                                          \
+               return detail::find_non_ascii16<V>(first, last, big_endian);                                          \
+          }                                                                                                          \
+                                                                                                                     \
+          static constexpr kernels table (isa level)                                                                 \
+          {                                                                                                          \
+               return {level, &find_byte, &count_byte, &find_in_class, &find_not_in_class, &block_masks,             \
+                       &find_non_ascii, &find_non_ascii16};                                                          \
+          }                                                                                                          \
+     };
+
+PATTERN_SIMD_ENTRY_POINTS(sse_vec,    PATTERN_SIMD_SSE)
+PATTERN_SIMD_ENTRY_POINTS(avx2_vec,   PATTERN_SIMD_AVX2)
+PATTERN_SIMD_ENTRY_POINTS(avx512_vec, PATTERN_SIMD_AVX512)
+
+#undef PATTERN_SIMD_ENTRY_POINTS
+
+#endif // PATTERN_SIMD_X86
+
+} // namespace detail
+
+
+// =====================================================================================================================
+// Dispatch
+// =====================================================================================================================
+// The best instruction set supported by the running host.
+inline isa detect () noexcept
+{
+#ifdef PATTERN_SIMD_X86
+     __builtin_cpu_init();
+
+     if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))     return isa::avx512;
+     if (__builtin_cpu_supports("avx2"))                                                return isa::avx2;
+     if (__builtin_cpu_supports("ssse3"))                                               return isa::sse;
+#endif
+
+     return isa::scalar;
+}
+
+
+// The kernels for an instruction set. The caller is responsible for checking that the host supports it.
+inline const kernels& kernels_for (isa level) noexcept
+{
+     static constexpr kernels scalar = detail::entry_points<scalar_vec>::table(isa::scalar);
+
+#ifdef PATTERN_SIMD_X86
+     static constexpr kernels sse    = detail::entry_points<sse_vec>::table(isa::sse);
+     static constexpr kernels avx2   = detail::entry_points<avx2_vec>::table(isa::avx2);
+     static constexpr kernels avx512 = detail::entry_points<avx512_vec>::table(isa::avx512);
+
+     switch (level)
+     {
+          case isa::avx512:     return avx512;
+          case isa::avx2:       return avx2;
+          case isa::sse:        return sse;
+          case isa::scalar:     break;
+     }
+#endif
+
+     return scalar;
+}
+
+
+// The kernels for the best instruction set of the host, selected once per process.
+inline const kernels& dispatch () noexcept
+{
+     static const kernels& selected = kernels_for(detect());
+     return selected;
+}
+
+
+inline const char* find_byte (const char* first, const char* last, char c)
+{
+     return dispatch().find_byte(first, last, c);
+}
+
+
+inline std::size_t count_byte (const char* first, const char* last, char c)
+{
+     return dispatch().count_byte(first, last, c);
+}
+
+
+inline const char* find_in_class (const char* first, const char* last, const byte_class& c)
+{
+     return dispatch().find_in_class(first, last, c);
+}
+
+
+inline const char* find_not_in_class (const char* first, const char* last, const byte_class& c)
+{
+     return dispatch().find_not_in_class(first, last, c);
+}
+
+
+// Sets masks[k] to the mask of the 64 bytes from block which are members of classes[k]
+inline void block_masks (const char* block, const byte_class* classes, std::size_t count, std::uint64_t* masks)
+{
+     dispatch().block_masks(block, classes, count, masks);
+}
+
+
+inline const char* find_non_ascii (const char* first, const char* last)
+{
+     return dispatch().find_non_ascii(first, last);
+}
+
+
+// Finds the first UTF-16 code unit from first which is not ASCII, or a trailing odd byte
+inline const char* find_non_ascii16 (const char* first, const char* last, bool big_endian)
+{
+     return dispatch().find_non_ascii16(first, last, big_endian);
+}
+
+
+} // namespace simd
+} // namespace Pattern
@@ -0,0 +1,278 @@
+/**
+ * @file
+ * @author Mike Castillo
+ *
+ * @section License
+ *
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * @section Description
+ *
+ * Facilities for managing the source code of a whole program, spread over many files.
+ */
+
+#pragma once
+
+#include <algorithm>    // std::upper_bound
+#include <cerrno>
+#include <cstdint>
+#include <map>          // buffer lookup by address
+#include <memory>       // std::unique_ptr
+#include <mutex>        // std::once_flag
+#include <stdexcept>    // std::length_error, std::out_of_range
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>      // open
+#include <sys/mman.h>   // mmap
+#include <sys/stat.h>   // fstat
+#include <unistd.h>     // close
+
+#include "syntax.h"
+
+
+/**
+ * A position in the global location space of a source_manager. Every loaded buffer is assigned a distinct range of
+ * offsets, so a single offset identifies both a buffer and a position within it.
+ */
+using source_offset = std::uint32_t;
+
+
+/**
+ * A buffer of source code owned by a source_manager, either mapped from a file or held in memory.
+ */
+class source_file
+{
+public:
+    source_file (const source_file&)            = delete;
+    source_file& operator= (const source_file&) = delete;
+
+    ~source_file ()
+    {
+        if (mapped)    munmap(const_cast<char*>(data), size);
+    }
+
+    const std::string& name     () const    { return path; }
+    std::string_view   contents () const    { return {data, size}; }
+    source_offset      base     () const    { return first; }
+
+    /**
+     * The range of global offsets assigned to this buffer. The range includes one past the last character, so that the
+     * end of the buffer has a location of its own.
+     */
+    source_offset      last     () const    { return first + static_cast<source_offset>(size); }
+    bool contains (source_offset offset) const    { return first <= offset && offset <= last(); }
+
+
+    /**
+     * Convert a position within the buffer to a line and column, both counting from 1. The table of line starts is
+     * built on first use and cached.
+     */
+    source_location location (std::size_t position) const
+    {
+        std::call_once(lines_built, [this] { build_line_table(); });
+
+        auto next_line = std::upper_bound(line_starts.begin(), line_starts.end(), position);
+        auto line      = static_cast<int>(next_line - line_starts.begin());
+
+        return {line, static_cast<int>(position - line_starts[line - 1]) + 1};
+    }
+
+
+private:
+    friend class source_manager;
+
+    std::string   path;
+    std::string   owned;               // contents, when not mapped
+    const char*   data   = nullptr;
+    std::size_t   size   = 0;
+    bool          mapped = false;
+    source_offset first  = 0;
+
+    mutable std::once_flag             lines_built;
+    mutable std::vector<std::size_t>   line_starts;
+
+
+    source_file (std::string path)
+        : path {std::move(path)}
+    {}
+
+    void build_line_table () const
+    {
+        line_starts.push_back(0);
+
+        for (std::size_t i = 0;    i < size;    ++i)
+            if (data[i] == '\n')    line_starts.push_back(i + 1);
+    }
+}; // class source_file
+
+
+/**
+ * A location resolved from a global offset.
+ */
+struct global_location
+{
+    const source_file* file;
+    source_location    location;
+
+    const std::string& path   () const    { return file->name();     }
+    int                line   () const    { return location.line;    }
+    int                column () const    { return location.column;  }
+};
+
+
+/**
+ * Owns the source buffers of a program and assigns each a range in one global 32-bit offset space. Tokens from any
+ * buffer can then carry a single source_offset, from which the buffer, line, and column are recovered on demand.
+ *
+ * Loading buffers is not thread-safe. Resolving offsets is thread-safe once all buffers are loaded.
+ */
+class source_manager
+{
+public:
+    /**
+     * Map a file into memory and assign it a range of offsets.
+     *
+     * @param    path    Pathname of the file to open
+     * @return   The file, whose base() is the offset of its first character
+     */
+    const source_file& load (const std::string& path)
+    {
+        auto file = std::unique_ptr<source_file> {new source_file {path}};
+
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)    throw (errno);
+
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            int error = errno;
+            close(fd);
+            throw (error);
+        }
+
+        file->size = static_cast<std::size_t>(info.st_size);
+
+        if (file->size != 0)
+        {
+            void* mapping = mmap(nullptr, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (mapping == MAP_FAILED)
+            {
+                int error = errno;
+                close(fd);
+                throw (error);
+            }
+
+            file->data   = static_cast<const char*>(mapping);
+            file->mapped = true;
+        }
+
+        close(fd);
+        return add(std::move(file));
+    }
+
+
+    /**
+     * Take ownership of a buffer held in memory and assign it a range of offsets.
+     *
+     * @param    name        Name reported for locations in the buffer
+     * @param    contents    Source code
+     * @return   The buffer, whose base() is the offset of its first character
+     */
+    const source_file& add (std::string name, std::string contents)
+    {
+        auto file = std::unique_ptr<source_file> {new source_file {std::move(name)}};
+
+        file->owned = std::move(contents);
+        file->data  = file->owned.data();
+        file->size  = file->owned.size();
+
+        return add(std::move(file));
+    }
+
+
+    /**
+     * Find the buffer which was assigned an offset.
+     */
+    const source_file& file (source_offset offset) const
+    {
+        auto next = std::upper_bound(files.begin(), files.end(), offset,
+                                     [] (source_offset o, const auto& f) { return o < f->base(); });
+
+        if (next == files.begin() || !(*std::prev(next))->contains(offset))
+            throw std::out_of_range("source_manager::file: offset not assigned to a buffer");
+
+        return **std::prev(next);
+    }
+
+
+    /**
+     * Resolve an offset to its buffer, line, and column.
+     */
+    global_location locate (source_offset offset) const
+    {
+        const source_file& f = file(offset);
+        return {&f, f.location(offset - f.base())};
+    }
+
+
+    /**
+     * Find the offset of a character within one of the managed buffers, such as the start of a lexeme.
+     */
+    source_offset offset_of (const char* position) const
+    {
+        auto next = by_address.upper_bound(position);
+
+        if (next != by_address.begin())
+        {
+            const source_file& f = *std::prev(next)->second;
+
+            if (position <= f.data + f.size)
+                return f.base() + static_cast<source_offset>(position - f.data);
+        }
+
+        throw std::out_of_range("source_manager::offset_of: position not within a managed buffer");
+    }
+
+
+    source_offset offset_of (std::string_view lexeme) const    { return offset_of(lexeme.data()); }
+
+
+    /**
+     * Retrieve the text spanning a range of offsets within one buffer.
+     */
+    std::string_view text (source_offset offset, std::size_t span) const
+    {
+        const source_file& f = file(offset);
+        return f.contents().substr(offset - f.base(), span);
+    }
+
+
+    std::size_t size () const    { return files.size(); }
+
+
+private:
+    std::vector<std::unique_ptr<source_file>> files;        // ordered by base offset
+    std::map<const char*, const source_file*> by_address;
+    std::uint64_t                             next_base = 0;
+
+
+    const source_file& add (std::unique_ptr<source_file> file)
+    {
+        // Reserve one offset past the end, so the end of each buffer has a distinct location
+        std::uint64_t last = next_base + file->size;
+
+        if (last > UINT32_MAX)    throw std::length_error("source_manager: global offset space exhausted");
+
+        file->first = static_cast<source_offset>(next_base);
+        next_base   = last + 1;
+
+        if (file->size != 0)    by_address.emplace(file->data, file.get());
+
+        files.push_back(std::move(file));
+        return *files.back();
+    }
+}; // class source_manager
@@ -14,8 +14,12 @@
 
 #pragma once
 
+#include <algorithm>  // std::min
 #include <fstream>    // file_to_string, string_to_file
+#include <optional>   // token_lazy
 #include <string>
+#include <string_view>
+#include <type_traits>  // std::conditional_t, std::invoke_result_t
 
 
 /**
@@ -90,10 +94,10 @@ std::string file_to_string (const std::string& path, std::size_t start = 0, std:
     if (!file)   throw (errno);
 
     // Allocate string memory
-    span = std::min(span, (std::std::size_t) file.tellg() - start);
+    span = std::min(span, (std::size_t) file.tellg() - start);
 
     std::string contents;
-    contents.resize((std::string::std::size_type) span);
+    contents.resize((std::string::size_type) span);
 
     // Read file contents into string
     file.seekg(start);
@@ -272,6 +276,62 @@ struct token_lex
 };
 
 
+/**
+ * A token whose value is decoded from its lexeme when it is read.
+ *
+ * A lexer building token_lex converts every literal as it is scanned, though most consumers, such as formatters,
+ * linters, and highlighters, read only tags and lexemes. A token_lazy holds only its tag and lexeme, and value() calls
+ * Decoder, a stateless function object, with both. When Memo is true, the first value decoded is kept in the token and
+ * returned by later calls, at the cost of its storage.
+ *
+ * With Memo, value() writes the memo although it is const, so concurrent calls on one token are a data race until a
+ * value has been decoded. Such a token must be read by one thread at a time, or decoded before it is shared.
+ */
+template <typename TagType, typename Decoder, bool Memo = false, typename CharT = char>
+struct token_lazy
+{
+    using value_type = std::invoke_result_t<const Decoder&, TagType, std::basic_string_view<CharT>>;
+
+    TagType                       tag;
+    std::basic_string_view<CharT> lexeme;
+
+    constexpr token_lazy (TagType tag)
+        : tag {tag}, lexeme {}
+    {}
+
+    constexpr token_lazy (TagType tag, std::basic_string_view<CharT> lexeme)
+        : tag {tag}, lexeme {lexeme}
+    {}
+
+    constexpr value_type value () const
+    {
+        if constexpr (Memo)
+        {
+            if (!memo)    memo = Decoder {}(tag, lexeme);
+            return *memo;
+        }
+        else
+            return Decoder {}(tag, lexeme);
+    }
+
+    constexpr bool decoded () const noexcept
+    {
+        if constexpr (Memo)    return memo.has_value();
+        else                   return false;
+    }
+
+    constexpr std::size_t       position        (const CharT* data) const    { return lexeme.data() - data; }
+    constexpr std::size_t       span            ()                  const    { return lexeme.length();      }
+    constexpr ::source_position source_position (const CharT* data) const    { return {data, lexeme};       }
+    constexpr ::source_location source_location (const CharT* data) const    { return {data, lexeme};       }
+
+private:
+    struct no_memo {};
+
+    [[no_unique_address]] mutable std::conditional_t<Memo, std::optional<value_type>, no_memo> memo;
+};
+
+
 
 // Need to clean this up
 
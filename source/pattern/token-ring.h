@@ -0,0 +1,468 @@
+/*
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * Token Ring
+ *
+ * Hands token streams from one process to another through a ring in shared memory.
+ */
+
+// The ring lives in a memfd: a header page holding the capacity and the two positions, followed by the data. The
+// producer maps it read-write, and the consumer maps the header read-write, to publish how far it has read, and the
+// data read-only. The descriptor is passed to the consumer over a Unix domain socket, or inherited by a child.
+//
+// Each record holds the arrays of a token_stream followed by its source text:
+//
+//      header       count, source size, record size
+//      tags         count bytes, padded to 4
+//      offsets      count 32-bit words
+//      lengths      count 32-bit words
+//      source       source size bytes, padded to 8
+//
+// A record is written whole before the head is advanced past it, so handing it over is one release store, and the
+// consumer views the tokens in place through a token_view, the same view as in process. A record never straddles the
+// end of the data: the producer marks the rest of the lap as skipped and starts again at the beginning.
+//
+// There is one producer and one consumer per ring. The producer must not write through the ring from more than one
+// thread at a time, nor the consumer read.
+
+
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>         // std::memcpy
+#include <new>             // std::launder, placement new
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <utility>         // std::exchange
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "token-stream.h"
+
+
+namespace Pattern {
+
+namespace detail {
+
+struct ring_header
+{
+     static constexpr std::uint64_t expected_magic = 0x676e6972'6e6b6f74;     // "tokn" "ring"
+
+     std::uint64_t magic;
+     std::uint64_t capacity;
+
+     alignas(64) std::atomic<std::uint64_t> head;     // written by the producer
+     alignas(64) std::atomic<std::uint64_t> tail;     // written by the consumer
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "ring positions are shared between processes");
+
+
+struct ring_record
+{
+     static constexpr std::uint32_t wrap = 0xffff'ffff;     // the rest of the lap is skipped
+
+     std::uint32_t count;
+     std::uint32_t source_size;
+     std::uint64_t size;
+};
+
+
+constexpr std::size_t round_up (std::size_t n, std::size_t to) noexcept     { return (n + to - 1) / to * to; }
+
+constexpr std::size_t tags_size (std::size_t count) noexcept     { return round_up(count, 4); }
+
+constexpr std::size_t record_size (std::size_t count, std::size_t source_size) noexcept
+{
+     return round_up(sizeof(ring_record) + tags_size(count) + 8 * count + source_size, 8);
+}
+
+
+inline std::size_t page_size () noexcept     { return static_cast<std::size_t>(::sysconf(_SC_PAGESIZE)); }
+
+
+[[noreturn]] inline void throw_ring_error (const char* what)
+{
+     throw std::system_error(errno, std::generic_category(), what);
+}
+
+} // namespace detail
+
+
+template <token_tag Tag>
+struct ring_entry
+{
+     token_view<Tag>  tokens;
+     std::string_view source;     // the text which the offsets of the tokens index
+};
+
+
+// =====================================================================================================================
+// Producer
+// =====================================================================================================================
+template <token_tag Tag>
+class token_ring
+{
+public:
+     /**
+      * Create the shared memory of a ring. Its size is sealed, so a consumer can map it without fear of it shrinking.
+      *
+      * @param    capacity     Bytes of data, rounded up to whole pages
+      * @throw    std::system_error    When the memory cannot be created or mapped
+      */
+     explicit token_ring (std::size_t capacity)
+     {
+          std::size_t page = detail::page_size();
+          data_capacity    = detail::round_up(capacity, page);
+          mapped_size      = page + data_capacity;
+
+          fd = ::memfd_create("token_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+          if (fd < 0)     detail::throw_ring_error("token_ring: memfd_create");
+
+          if (::ftruncate(fd, static_cast<off_t>(mapped_size)) < 0 ||
+              ::fcntl(fd, F_ADD_SEALS, F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL) < 0)
+          {
+               int error = errno;
+               ::close(fd);
+               throw std::system_error(error, std::generic_category(), "token_ring: ftruncate");
+          }
+
+          void* p = ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+          if (p == MAP_FAILED)
+          {
+               int error = errno;
+               ::close(fd);
+               throw std::system_error(error, std::generic_category(), "token_ring: mmap");
+          }
+
+          // Both positions start at the beginning of the data
+          header = new (p) detail::ring_header {detail::ring_header::expected_magic, data_capacity, {0}, {0}};
+          data   = static_cast<char*>(p) + page;
+     }
+
+     token_ring (token_ring&& other) noexcept
+          : fd            {std::exchange(other.fd, -1)},
+            header        {std::exchange(other.header, nullptr)},
+            data          {other.data},
+            data_capacity {other.data_capacity},
+            mapped_size   {other.mapped_size}
+     {}
+
+     token_ring (const token_ring&)            = delete;
+     token_ring& operator= (const token_ring&) = delete;
+
+     ~token_ring ()
+     {
+          if (header)     ::munmap(header, mapped_size);
+          if (fd >= 0)    ::close(fd);
+     }
+
+
+     // The descriptor to pass to the consumer. It stays owned by the ring.
+     int descriptor () const noexcept     { return fd; }
+
+     std::size_t capacity () const noexcept     { return data_capacity; }
+
+
+     /**
+      * Copy a token stream and its source into the ring, and hand it over. A record which would straddle the end of
+      * the data first hands over the skip of the rest of the lap on its own, so it waits for the reader to pass the end
+      * rather than for the ring to hold the skip and the record at once.
+      *
+      * @return   false when the ring is too full for the record, in which case the record is not written
+      * @throw    std::length_error    When the record is larger than the ring could ever hold
+      */
+     bool try_write (const token_stream<Tag>& tokens, std::string_view source)
+     {
+          std::size_t count = tokens.size();
+          std::size_t size  = detail::record_size(count, source.size());
+
+          if (size > data_capacity || count >= detail::ring_record::wrap || source.size() > UINT32_MAX)
+               throw std::length_error("token_ring: record larger than the ring");
+
+          std::uint64_t head = header->head.load(std::memory_order_relaxed);
+          std::uint64_t tail = header->tail.load(std::memory_order_acquire);
+
+          std::size_t position = head % data_capacity;
+          std::size_t rest     = data_capacity - position;
+          std::size_t skip     = size > rest ? rest : 0;
+
+          std::size_t available = data_capacity - (head - tail);
+
+          if (available < skip + size)
+          {
+               if (skip && available >= skip)
+               {
+                    mark_wrap(position, rest);
+                    header->head.store(head + skip, std::memory_order_release);
+               }
+
+               return false;
+          }
+
+          if (skip)
+          {
+               mark_wrap(position, rest);
+               position = 0;
+          }
+
+          char* p = data + position;
+          auto n = static_cast<std::uint32_t>(count);
+          new (p) detail::ring_record {n, static_cast<std::uint32_t>(source.size()), size};
+          p += sizeof(detail::ring_record);
+
+          if (count)
+          {
+               std::memcpy(p, tokens.tags(), count);
+               p += detail::tags_size(count);
+
+               std::memcpy(p, tokens.offsets(), 4 * count);
+               p += 4 * count;
+
+               std::memcpy(p, tokens.lengths(), 4 * count);
+               p += 4 * count;
+          }
+
+          if (!source.empty())     std::memcpy(p, source.data(), source.size());
+
+          header->head.store(head + skip + size, std::memory_order_release);
+          return true;
+     }
+
+
+     // Whether every record written has been released by the consumer
+     bool drained () const noexcept
+     {
+          return header->tail.load(std::memory_order_acquire) == header->head.load(std::memory_order_relaxed);
+     }
+
+
+private:
+     // Marks the rest of the lap as skipped. Less room than a record header is skipped without a mark.
+     void mark_wrap (std::size_t position, std::size_t rest) noexcept
+     {
+          if (rest >= sizeof(detail::ring_record))
+               new (data + position) detail::ring_record {detail::ring_record::wrap, 0, rest};
+     }
+
+
+     int                  fd            = -1;
+     detail::ring_header* header        = nullptr;
+     char*                data          = nullptr;
+     std::size_t          data_capacity = 0;
+     std::size_t          mapped_size   = 0;
+}; // class token_ring
+
+
+// =====================================================================================================================
+// Consumer
+// =====================================================================================================================
+template <token_tag Tag>
+class token_ring_reader
+{
+public:
+     /**
+      * Map the ring created by a producer, possibly in another process. The descriptor may be closed afterwards.
+      *
+      * @throw    std::system_error       When the memory cannot be mapped
+      * @throw    std::invalid_argument   When the descriptor is not of a token ring
+      */
+     explicit token_ring_reader (int descriptor)
+     {
+          std::size_t page = detail::page_size();
+
+          struct stat status;
+          if (::fstat(descriptor, &status) < 0)     detail::throw_ring_error("token_ring_reader: fstat");
+
+          if (static_cast<std::size_t>(status.st_size) <= page)
+               throw std::invalid_argument("token_ring_reader: not a token ring");
+
+          void* h = ::mmap(nullptr, page, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+          if (h == MAP_FAILED)     detail::throw_ring_error("token_ring_reader: mmap");
+
+          header = std::launder(static_cast<detail::ring_header*>(h));
+          header_size = page;
+
+          if (header->magic != detail::ring_header::expected_magic ||
+              header->capacity != static_cast<std::size_t>(status.st_size) - page)
+          {
+               ::munmap(h, page);
+               throw std::invalid_argument("token_ring_reader: not a token ring");
+          }
+
+          data_capacity = header->capacity;
+
+          void* d = ::mmap(nullptr, data_capacity, PROT_READ, MAP_SHARED, descriptor, static_cast<off_t>(page));
+
+          if (d == MAP_FAILED)
+          {
+               int error = errno;
+               ::munmap(h, page);
+               throw std::system_error(error, std::generic_category(), "token_ring_reader: mmap");
+          }
+
+          data = static_cast<const char*>(d);
+          next = header->tail.load(std::memory_order_relaxed);
+     }
+
+     token_ring_reader (token_ring_reader&& other) noexcept
+          : header        {std::exchange(other.header, nullptr)},
+            data          {other.data},
+            header_size   {other.header_size},
+            data_capacity {other.data_capacity},
+            next          {other.next}
+     {}
+
+     token_ring_reader (const token_ring_reader&)            = delete;
+     token_ring_reader& operator= (const token_ring_reader&) = delete;
+
+     ~token_ring_reader ()
+     {
+          if (header)
+          {
+               ::munmap(const_cast<char*>(data), data_capacity);
+               ::munmap(header, header_size);
+          }
+     }
+
+
+     /**
+      * View the next record in place, without copying it.
+      *
+      * @return   the record, valid until it is released; or nothing when the ring is empty
+      */
+     std::optional<ring_entry<Tag>> try_read () noexcept
+     {
+          std::uint64_t head = header->head.load(std::memory_order_acquire);
+
+          if (next == head)     return std::nullopt;
+
+          std::size_t position = next % data_capacity;
+          std::size_t rest     = data_capacity - position;
+
+          if (rest < sizeof(detail::ring_record) || record_at(position)->count == detail::ring_record::wrap)
+          {
+               // With every record before it released, the skip is given back at once, as the producer may be
+               // waiting on it with nothing else in the ring
+               if (header->tail.load(std::memory_order_relaxed) == next)
+                    header->tail.store(next + rest, std::memory_order_release);
+
+               next    += rest;
+               position = 0;
+
+               if (next == head)     return std::nullopt;
+          }
+
+          const detail::ring_record* record = record_at(position);
+          const char* p = data + position + sizeof(detail::ring_record);
+
+          std::size_t count = record->count;
+
+          auto tags    = reinterpret_cast<const Tag*>(p);
+          auto offsets = reinterpret_cast<const std::uint32_t*>(p + detail::tags_size(count));
+          auto lengths = offsets + count;
+          auto source  = reinterpret_cast<const char*>(lengths + count);
+
+          next += record->size;
+
+          return ring_entry<Tag> {token_view<Tag> {tags, offsets, lengths, count}, {source, record->source_size}};
+     }
+
+
+     // Give back the space of every record read so far, which the producer may then overwrite
+     void release () noexcept
+     {
+          header->tail.store(next, std::memory_order_release);
+     }
+
+
+private:
+     const detail::ring_record* record_at (std::size_t position) const noexcept
+     {
+          return reinterpret_cast<const detail::ring_record*>(data + position);
+     }
+
+
+     detail::ring_header* header        = nullptr;
+     const char*          data          = nullptr;
+     std::size_t          header_size   = 0;
+     std::size_t          data_capacity = 0;
+     std::uint64_t        next          = 0;     // position after the last record read
+}; // class token_ring_reader
+
+
+// =====================================================================================================================
+// Passing Descriptors
+// =====================================================================================================================
+/**
+ * Send a descriptor over a connected Unix domain socket.
+ *
+ * @throw    std::system_error    When the message cannot be sent
+ */
+inline void send_descriptor (int socket, int descriptor)
+{
+     char byte = 0;
+     iovec payload {&byte, 1};
+
+     alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] {};
+
+     msghdr message {};
+     message.msg_iov        = &payload;
+     message.msg_iovlen     = 1;
+     message.msg_control    = control;
+     message.msg_controllen = sizeof(control);
+
+     cmsghdr* c    = CMSG_FIRSTHDR(&message);
+     c->cmsg_level = SOL_SOCKET;
+     c->cmsg_type  = SCM_RIGHTS;
+     c->cmsg_len   = CMSG_LEN(sizeof(int));
+     std::memcpy(CMSG_DATA(c), &descriptor, sizeof(int));
+
+     while (::sendmsg(socket, &message, MSG_NOSIGNAL) < 0)
+          if (errno != EINTR)     detail::throw_ring_error("send_descriptor");
+}
+
+
+/**
+ * Receive a descriptor sent by send_descriptor. The caller owns the descriptor received.
+ *
+ * @throw    std::system_error    When no descriptor is received
+ */
+inline int receive_descriptor (int socket)
+{
+     char byte;
+     iovec payload {&byte, 1};
+
+     alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] {};
+
+     msghdr message {};
+     message.msg_iov        = &payload;
+     message.msg_iovlen     = 1;
+     message.msg_control    = control;
+     message.msg_controllen = sizeof(control);
+
+     ssize_t n;
+     while ((n = ::recvmsg(socket, &message, MSG_CMSG_CLOEXEC)) < 0)
+          if (errno != EINTR)     detail::throw_ring_error("receive_descriptor");
+
+     cmsghdr* c = CMSG_FIRSTHDR(&message);
+
+     if (n == 0 || !c || c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+          throw std::system_error(EBADMSG, std::generic_category(), "receive_descriptor");
+
+     int descriptor;
+     std::memcpy(&descriptor, CMSG_DATA(c), sizeof(int));
+     return descriptor;
+}
+
+} // namespace Pattern
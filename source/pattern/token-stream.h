@@ -0,0 +1,470 @@
+/*
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * Token Streams
+ *
+ * Storage of lexed tokens as parallel arrays, and matching of patterns over their tags.
+ */
+
+// A token stream keeps the tags, offsets, and lengths of its tokens in three separate arrays, so that a pattern which
+// only looks at tags reads a contiguous array of bytes: 64 tokens per cache line, which the SIMD kernels can search
+// directly. Offsets and lengths are only read when a match is reported.
+//
+// A token view is a mutable range over the tags of a stream, in the manner of scan_view: its begin iterator is held by
+// reference, so scan, scan_if, and the other scanning algorithms advance it, and the combinators of fn and fo compose
+// token patterns exactly as they compose character patterns. The scanners in namespace tk match tokens by tag.
+//
+// A tag dispatch holds several patterns, each with the tags it may begin with. Only the patterns which may begin with
+// the current tag are tried, and when searching, tokens which begin no pattern are skipped with the SIMD kernels.
+
+
+#pragma once
+
+#include <array>
+#include <concepts>
+#include <cstdint>
+#include <cstring>         // std::memcmp
+#include <functional>      // std::invoke
+#include <initializer_list>
+#include <string_view>
+#include <tuple>
+#include <type_traits>     // std::is_enum_v
+#include <utility>         // std::index_sequence
+#include <vector>
+
+#include "simd.h"
+
+
+namespace Pattern {
+
+// A tag is stored in one byte, e.g. an enumeration with an underlying type of std::uint8_t
+template <class Tag>
+concept token_tag = (std::is_enum_v<Tag> || std::integral<Tag>) && sizeof(Tag) == 1;
+
+
+template <token_tag Tag>
+class token_view;
+
+
+// =====================================================================================================================
+// Token Stream
+// =====================================================================================================================
+template <token_tag Tag>
+class token_stream
+{
+public:
+     using tag_type = Tag;
+
+     void push_back (Tag tag, std::uint32_t offset, std::uint32_t length)
+     {
+          tag_array.push_back(tag);
+          offset_array.push_back(offset);
+          length_array.push_back(length);
+     }
+
+     void reserve (std::size_t n)
+     {
+          tag_array.reserve(n);
+          offset_array.reserve(n);
+          length_array.reserve(n);
+     }
+
+     void clear () noexcept
+     {
+          tag_array.clear();
+          offset_array.clear();
+          length_array.clear();
+     }
+
+
+     std::size_t size  () const noexcept     { return tag_array.size();  }
+     bool        empty () const noexcept     { return tag_array.empty(); }
+
+     Tag           tag    (std::size_t i) const noexcept     { return tag_array[i];    }
+     std::uint32_t offset (std::size_t i) const noexcept     { return offset_array[i]; }
+     std::uint32_t length (std::size_t i) const noexcept     { return length_array[i]; }
+
+     std::string_view lexeme (std::size_t i, std::string_view source) const
+     {
+          return source.substr(offset_array[i], length_array[i]);
+     }
+
+     // The contiguous arrays of tags, offsets, and lengths
+     const Tag*           tags    () const noexcept     { return tag_array.data();    }
+     const std::uint32_t* offsets () const noexcept     { return offset_array.data(); }
+     const std::uint32_t* lengths () const noexcept     { return length_array.data(); }
+
+     // Replaces the tokens with n tokens copied from parallel arrays
+     void assign (std::size_t n, const Tag* tags, const std::uint32_t* offsets, const std::uint32_t* lengths)
+     {
+          tag_array.assign(tags, tags + n);
+          offset_array.assign(offsets, offsets + n);
+          length_array.assign(lengths, lengths + n);
+     }
+
+     // Appends n tokens copied from parallel arrays
+     void append (std::size_t n, const Tag* tags, const std::uint32_t* offsets, const std::uint32_t* lengths)
+     {
+          tag_array.insert(tag_array.end(), tags, tags + n);
+          offset_array.insert(offset_array.end(), offsets, offsets + n);
+          length_array.insert(length_array.end(), lengths, lengths + n);
+     }
+
+     token_view<Tag> view () const noexcept     { return token_view<Tag> {*this}; }
+
+
+private:
+     std::vector<Tag>           tag_array;
+     std::vector<std::uint32_t> offset_array;
+     std::vector<std::uint32_t> length_array;
+}; // class token_stream
+
+
+// =====================================================================================================================
+// Token View
+// =====================================================================================================================
+template <token_tag Tag>
+class token_view
+{
+public:
+     using value_type      = Tag;
+     using iterator        = const Tag*;
+     using difference_type = std::ptrdiff_t;
+
+
+     constexpr token_view () noexcept = default;
+
+     explicit constexpr token_view (const token_stream<Tag>& s) noexcept
+          : token_view {s.tags(), s.offsets(), s.lengths(), s.size()}
+     {}
+
+     // Views parallel arrays held elsewhere, such as in shared memory
+     constexpr token_view (const Tag* tags, const std::uint32_t* offsets, const std::uint32_t* lengths,
+                           std::size_t n) noexcept
+          : first {tags}, offset_array {offsets}, length_array {lengths},
+            retainer {tags}, cursor {tags}, last {tags + n}
+     {}
+
+
+     // --------------------------------------------------
+     // Iterators
+     // --------------------------------------------------
+     constexpr iterator& begin ()       noexcept     { return cursor; }
+     constexpr iterator  end   () const noexcept     { return last;   }
+
+     // Found by the scanning algorithms, which advance the iterator it returns
+     friend constexpr iterator& begin (token_view& v) noexcept     { return v.cursor; }
+     friend constexpr iterator  end   (token_view& v) noexcept     { return v.last;   }
+
+
+     // --------------------------------------------------
+     // Capacity
+     // --------------------------------------------------
+     constexpr std::size_t size     () const noexcept     { return last - cursor;  }
+     constexpr bool        empty    () const noexcept     { return cursor == last; }
+     constexpr bool        has_more () const noexcept     { return cursor != last; }
+
+
+     // --------------------------------------------------
+     // Element Access
+     // --------------------------------------------------
+     constexpr Tag peek       ()              const noexcept     { return *cursor;   }
+     constexpr Tag operator[] (std::size_t n) const noexcept     { return cursor[n]; }
+
+     // Position of the current token within the stream
+     constexpr std::size_t index () const noexcept     { return cursor - first; }
+
+     // Offset and length of the current token within the source
+     constexpr std::uint32_t offset () const noexcept     { return offset_array[index()]; }
+     constexpr std::uint32_t length () const noexcept     { return length_array[index()]; }
+
+     // Offset and length of any token of the underlying stream, by index
+     constexpr std::uint32_t offset (std::size_t i) const noexcept     { return offset_array[i]; }
+     constexpr std::uint32_t length (std::size_t i) const noexcept     { return length_array[i]; }
+
+
+     // --------------------------------------------------
+     // Iterator Operations
+     // --------------------------------------------------
+     constexpr token_view& advance (difference_type n = 1)     { cursor += n; return *this; }
+     constexpr token_view& operator++ ()                       { ++cursor; return *this;    }
+
+     constexpr bool operator== (const token_view& other) const noexcept     { return cursor == other.cursor; }
+
+     constexpr token_view& save    ()     { retainer = cursor; return *this; }
+     constexpr token_view& restore ()     { cursor = retainer; return *this; }
+
+     constexpr std::size_t saved_index () const noexcept     { return retainer - first; }
+
+     // The source text from the saved token up to the current one
+     std::string_view skipped (std::string_view source) const
+     {
+          if (cursor == retainer)     return {};
+
+          std::uint32_t begin = offset(saved_index());
+          std::uint32_t end   = offset(index() - 1) + length(index() - 1);
+
+          return source.substr(begin, end - begin);
+     }
+
+
+private:
+     const Tag*           first        = nullptr;
+     const std::uint32_t* offset_array = nullptr;
+     const std::uint32_t* length_array = nullptr;
+     const Tag*           retainer     = nullptr;
+     const Tag*           cursor       = nullptr;
+     const Tag*           last         = nullptr;
+}; // class token_view
+
+
+// =====================================================================================================================
+// Searching
+// =====================================================================================================================
+// Tags are searched as bytes by the SIMD kernels.
+namespace detail {
+
+template <token_tag Tag>
+const char* as_bytes (const Tag* p) noexcept     { return reinterpret_cast<const char*>(p); }
+
+} // namespace detail
+
+
+template <token_tag Tag>
+const Tag* find_tag (const Tag* first, const Tag* last, Tag tag)
+{
+     const char* f = detail::as_bytes(first);
+     return first + (simd::find_byte(f, f + (last - first), static_cast<char>(tag)) - f);
+}
+
+
+template <token_tag Tag>
+std::size_t count_tag (const Tag* first, const Tag* last, Tag tag)
+{
+     const char* f = detail::as_bytes(first);
+     return simd::count_byte(f, f + (last - first), static_cast<char>(tag));
+}
+
+
+// Finds the first token whose tag is a member of the class
+template <token_tag Tag>
+const Tag* find_tag_in (const Tag* first, const Tag* last, const simd::byte_class& tags)
+{
+     const char* f = detail::as_bytes(first);
+     return first + (simd::find_in_class(f, f + (last - first), tags) - f);
+}
+
+
+/**
+ * Find the first occurrence of a sequence of tags, such as IDENTIFIER LEFT_PAREN. Candidates are located by their
+ * first tag with the SIMD kernels, then compared in full.
+ *
+ * @return   The beginning of the occurrence, or last if there is none
+ */
+template <token_tag Tag>
+const Tag* find_tags (const Tag* first, const Tag* last, std::initializer_list<Tag> sequence)
+{
+     const std::size_t n = sequence.size();
+     if (n == 0)     return first;
+
+     const Tag* p = first;
+
+     while (static_cast<std::size_t>(last - p) >= n)
+     {
+          p = find_tag(p, last - (n - 1), *sequence.begin());
+          if (p == last - (n - 1))     break;
+
+          if (std::memcmp(p + 1, sequence.begin() + 1, n - 1) == 0)     return p;
+          ++p;
+     }
+
+     return last;
+}
+
+
+// =====================================================================================================================
+// Token Scanners
+// =====================================================================================================================
+// Each returns a scanner which advances a token view, for composition with the combinators of fn and fo.
+namespace tk {
+
+// One token with any of the tags
+auto is = [] <token_tag Tag> (Tag tag, std::same_as<Tag> auto... more)
+{
+     return [=] (token_view<Tag>& v) -> bool
+     {
+          if (v.empty() || !(v.peek() == tag || ((v.peek() == more) || ...)))     return false;
+          ++v;
+          return true;
+     };
+};
+
+
+// One token with none of the tags
+auto except = [] <token_tag Tag> (Tag tag, std::same_as<Tag> auto... more)
+{
+     return [=] (token_view<Tag>& v) -> bool
+     {
+          if (v.empty() || v.peek() == tag || ((v.peek() == more) || ...))     return false;
+          ++v;
+          return true;
+     };
+};
+
+
+// Consecutive tokens with the tags, in order
+auto sequence = [] <token_tag Tag> (Tag tag, std::same_as<Tag> auto... more)
+{
+     return [=] (token_view<Tag>& v) -> bool
+     {
+          constexpr std::size_t n = 1 + sizeof...(more);
+          const Tag expected[n] = {tag, more...};
+
+          if (v.size() < n || std::memcmp(v.begin(), expected, n) != 0)     return false;
+          v.advance(n);
+          return true;
+     };
+};
+
+} // namespace tk
+
+
+// =====================================================================================================================
+// Tag Dispatch
+// =====================================================================================================================
+template <token_tag Tag, class F>
+struct tag_case
+{
+     simd::byte_class first_tags;
+     F                pattern;
+};
+
+
+// A pattern with the tags it may begin with
+template <token_tag Tag, class F>
+tag_case<Tag, std::decay_t<F>> on (std::initializer_list<Tag> first_tags, F&& pattern)
+{
+     auto c = simd::byte_class::from([first_tags] (char b) {
+          for (Tag t : first_tags)
+               if (static_cast<char>(t) == b)     return true;
+
+          return false;
+     });
+
+     return {c, std::forward<F>(pattern)};
+}
+
+template <token_tag Tag, class F>
+tag_case<Tag, std::decay_t<F>> on (Tag first_tag, F&& pattern)
+{
+     return on({first_tag}, std::forward<F>(pattern));
+}
+
+
+template <token_tag Tag, class... F>
+class tag_dispatch
+{
+     static_assert(sizeof...(F) <= 64, "tag_dispatch: at most 64 cases");
+
+public:
+     static constexpr int no_match = -1;
+
+
+     explicit tag_dispatch (tag_case<Tag, F>... cases)
+          : patterns {std::move(cases.pattern)...}
+     {
+          std::size_t i = 0;
+          ((add_case(i++, cases.first_tags)), ...);
+
+          first_tags = simd::byte_class::from([this] (char t) {
+               return candidates[static_cast<unsigned char>(t)] != 0;
+          });
+     }
+
+
+     /**
+      * Try the cases which may begin with the current tag, in order, as an ordered choice.
+      *
+      * @return   The index of the case which matched, leaving the view past its match, or no_match, leaving the view
+      *           in place
+      */
+     int match (token_view<Tag>& v)
+     {
+          if (v.empty())     return no_match;
+
+          std::uint64_t mask = candidates[static_cast<unsigned char>(v.peek())];
+          if (mask == 0)     return no_match;
+
+          return match_cases(v, mask, std::index_sequence_for<F...> {});
+     }
+
+     bool operator() (token_view<Tag>& v)     { return match(v) != no_match; }
+
+
+     /**
+      * Report every match in the view, searching from each token which is not part of an earlier match. A case which
+      * matches no tokens is reported with an empty range, and the search resumes at the next token.
+      *
+      * @param    report    Callable (int case, std::size_t first, std::size_t last), with the range of token indices
+      *                     matched by the case
+      */
+     template <class Report>
+     void find_all (token_view<Tag> v, Report&& report)
+     {
+          const Tag* last = v.end();
+
+          while (true)
+          {
+               v.begin() = find_tag_in(v.begin(), last, first_tags);
+               if (v.empty())     return;
+
+               std::size_t first = v.index();
+               int         c     = match(v);
+
+               if (c != no_match)          report(c, first, v.index());
+
+               // An empty match is reported like any other, then skipped so that the search makes progress
+               if (v.index() == first)     ++v;
+          }
+     }
+
+
+private:
+     std::tuple<F...>               patterns;
+     std::array<std::uint64_t, 256> candidates {};     // by tag, the cases which may begin with it
+     simd::byte_class               first_tags;       // tags which may begin some case
+
+
+     void add_case (std::size_t i, const simd::byte_class& c)
+     {
+          for (int t = 0; t < 256; ++t)
+               if (c.contains(static_cast<char>(t)))     candidates[t] |= std::uint64_t {1} << i;
+     }
+
+
+     template <std::size_t I>
+     bool try_case (token_view<Tag>& v, const Tag* start)
+     {
+          if (std::invoke(std::get<I>(patterns), v))     return true;
+
+          v.begin() = start;
+          return false;
+     }
+
+
+     template <std::size_t... I>
+     int match_cases (token_view<Tag>& v, std::uint64_t mask, std::index_sequence<I...>)
+     {
+          const Tag* start = v.begin();
+          int matched = no_match;
+
+          (((mask >> I & 1) && try_case<I>(v, start) && (matched = I, true)) || ...);
+          return matched;
+     }
+}; // class tag_dispatch
+
+template <token_tag Tag, class... F>
+tag_dispatch (tag_case<Tag, F>...) -> tag_dispatch<Tag, F...>;
+
+} // namespace Pattern
@@ -0,0 +1,366 @@
+/*
+ * Copyright (c) 2020 Mike Castillo. All rights reserved.
+ * Licensed under the MIT License. See the LICENSE file for full license information.
+ *
+ * Transcoding Source
+ *
+ * An input source which converts UTF-16 or Latin-1 text to UTF-8 a block at a time, for scanners which expect bytes.
+ */
+
+// The encoding is taken from a byte order mark, or else from a hint. Each call to next_block converts the next block of
+// the original into a buffer which is reused, so the whole text never exists in UTF-8 at once. The blocks suit a
+// push_scanner, which accepts fragments split anywhere:
+//
+//      transcoding_source source {file.contents()};
+//      push_scanner       scanner;
+//
+//      for (auto block = source.next_block(); !block.empty(); block = source.next_block())
+//           scanner.feed(block, sink);
+//
+// Runs of ASCII are found with the SIMD kernels and copied in bulk. Other code points are decoded one at a time, with
+// invalid sequences replaced by U+FFFD.
+//
+// Positions in the UTF-8 stream map back to the original through a checkpoint at the start of each block: the offsets
+// in both texts, and the line and column reached. A query decodes again from the nearest checkpoint, so it costs at
+// most one block, and the mapping costs 24 bytes per block. UTF-8 input passes through without copying, though it is
+// still split into blocks and checkpointed.
+
+
+#pragma once
+
+#include <algorithm>       // std::min, std::upper_bound
+#include <cstdint>
+#include <cstring>         // std::memcpy
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "simd.h"
+#include "syntax.h"        // source_location
+
+
+namespace Pattern {
+
+enum class source_encoding : std::uint8_t { utf8, utf16le, utf16be, latin1 };
+
+
+// The encoding marked by a byte order mark at the start of bytes, or else the hint, along with the size of the mark
+struct detected_encoding
+{
+     source_encoding encoding;
+     std::size_t     bom_size;
+};
+
+
+inline detected_encoding detect_encoding (std::string_view bytes, source_encoding hint = source_encoding::utf8)
+{
+     if (bytes.starts_with("\xEF\xBB\xBF"))     return {source_encoding::utf8,    3};
+     if (bytes.starts_with("\xFF\xFE"))         return {source_encoding::utf16le, 2};
+     if (bytes.starts_with("\xFE\xFF"))         return {source_encoding::utf16be, 2};
+
+     return {hint, 0};
+}
+
+
+// =====================================================================================================================
+// Decoding
+// =====================================================================================================================
+namespace detail {
+
+// A code point decoded from the original, with its size there and in UTF-8
+struct decoded_point
+{
+     char32_t      c;
+     std::uint32_t in;
+     std::uint32_t out;
+};
+
+
+constexpr std::uint32_t utf8_size (char32_t c) noexcept
+{
+     return c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+}
+
+
+inline char* encode_utf8 (char32_t c, char* out) noexcept
+{
+     if (c < 0x80)          *out++ = static_cast<char>(c);
+     else if (c < 0x800)
+     {
+          *out++ = static_cast<char>(0xC0 | (c >> 6));
+          *out++ = static_cast<char>(0x80 | (c & 0x3F));
+     }
+     else if (c < 0x10000)
+     {
+          *out++ = static_cast<char>(0xE0 | (c >> 12));
+          *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+          *out++ = static_cast<char>(0x80 | (c & 0x3F));
+     }
+     else
+     {
+          *out++ = static_cast<char>(0xF0 | (c >> 18));
+          *out++ = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+          *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+          *out++ = static_cast<char>(0x80 | (c & 0x3F));
+     }
+
+     return out;
+}
+
+
+// Decodes one code point from UTF-16 or Latin-1. first must be before last.
+inline decoded_point decode_point (source_encoding encoding, const char* first, const char* last) noexcept
+{
+     constexpr char32_t replacement = 0xFFFD;
+
+     if (encoding == source_encoding::latin1)
+     {
+          char32_t c = static_cast<unsigned char>(*first);
+          return {c, 1, utf8_size(c)};
+     }
+
+     if (last - first < 2)     return {replacement, 1, 3};
+
+     bool big_endian = encoding == source_encoding::utf16be;
+
+     auto unit = [big_endian] (const char* p) -> char32_t {
+          auto low  = static_cast<unsigned char>(p[big_endian]);
+          auto high = static_cast<unsigned char>(p[!big_endian]);
+          return static_cast<char32_t>(high << 8 | low);
+     };
+
+     char32_t c = unit(first);
+
+     if (c < 0xD800 || c > 0xDFFF)     return {c, 2, utf8_size(c)};
+
+     if (c <= 0xDBFF && last - first >= 4)
+     {
+          char32_t low = unit(first + 2);
+          if (0xDC00 <= low && low <= 0xDFFF)     return {0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00), 4, 4};
+     }
+
+     return {replacement, 2, 3};
+}
+
+} // namespace detail
+
+
+// =====================================================================================================================
+// Transcoding Source
+// =====================================================================================================================
+class transcoding_source
+{
+public:
+     static constexpr std::size_t default_block_size = 16384;
+
+
+     /**
+      * @param    original      The whole input, which must outlive the source, e.g. from a source_manager
+      * @param    hint          Encoding to assume when there is no byte order mark
+      * @param    block_size    Size of the UTF-8 blocks. Every block but the last holds at least block_size - 3 bytes.
+      */
+     explicit transcoding_source (std::string_view original, source_encoding hint = source_encoding::utf8,
+                                  std::size_t block_size = default_block_size)
+          : original {original},
+            block_size {std::max<std::size_t>(block_size, 16)}
+     {
+          auto detected = detect_encoding(original, hint);
+
+          encoding_ = detected.encoding;
+          position  = detected.bom_size;
+     }
+
+
+     source_encoding encoding () const noexcept     { return encoding_; }
+     bool            done     () const noexcept     { return position == original.size(); }
+
+     // Total size of the blocks returned so far
+     std::uint64_t   produced () const noexcept     { return output; }
+
+     // Number of blocks, each with one checkpoint
+     std::size_t     blocks   () const noexcept     { return checkpoints.size(); }
+
+
+     /**
+      * Convert the next block of the original to UTF-8.
+      *
+      * @return   The block, valid until the next call, or an empty view once the original is exhausted
+      */
+     std::string_view next_block ()
+     {
+          if (done())     return {};
+
+          checkpoints.push_back({output, position, line, column});
+
+          std::string_view block = encoding_ == source_encoding::utf8
+                                   ? original.substr(position, block_size)
+                                   : transcode();
+
+          if (encoding_ == source_encoding::utf8)     position += block.size();
+
+          count_lines(block);
+          output += block.size();
+          return block;
+     }
+
+
+     /**
+      * Find the position in the original of the character holding a byte of the UTF-8 stream. The offset must be within
+      * the blocks returned so far, or at their end. In UTF-8 input, the position is that of the byte itself.
+      */
+     std::uint64_t original_offset (std::uint64_t utf8_offset) const
+     {
+          return walk(utf8_offset).in;
+     }
+
+
+     /**
+      * Find the line and column of a byte of the UTF-8 stream, where the column counts characters rather than bytes or
+      * code units, so it is the same in every encoding.
+      */
+     source_location location (std::uint64_t utf8_offset) const
+     {
+          auto w = walk(utf8_offset);
+          return {static_cast<int>(w.line), static_cast<int>(w.column) + 1};
+     }
+
+
+private:
+     struct checkpoint
+     {
+          std::uint64_t out;
+          std::uint64_t in;
+          std::uint32_t line;
+          std::uint32_t column;     // characters since the start of the line
+     };
+
+     std::string_view        original;
+     std::size_t             block_size;
+     source_encoding         encoding_;
+     std::uint64_t           position = 0;     // in the original
+     std::uint64_t           output   = 0;
+     std::uint32_t           line     = 1;
+     std::uint32_t           column   = 0;
+     std::string             buffer;
+     std::vector<checkpoint> checkpoints;
+
+
+     std::string_view transcode ()
+     {
+          buffer.resize(block_size);
+
+          const char* p    = original.data() + position;
+          const char* end  = original.data() + original.size();
+          char*       out  = buffer.data();
+          char* const stop = out + block_size - 3;     // room for any code point, after the last to start before it
+
+          bool utf16      = encoding_ != source_encoding::latin1;
+          bool big_endian = encoding_ == source_encoding::utf16be;
+
+          while (p != end && out < stop)
+          {
+               // A run of ASCII, up to the space left
+               std::size_t room = static_cast<std::size_t>(stop - out);
+
+               if (utf16)
+               {
+                    const char* limit = p + std::min<std::size_t>(end - p, 2 * room);
+                    const char* run   = simd::find_non_ascii16(p, limit, big_endian);
+
+                    for (; p != run; p += 2)     *out++ = p[big_endian];
+               }
+               else
+               {
+                    const char* run = simd::find_non_ascii(p, p + std::min<std::size_t>(end - p, room));
+
+                    std::memcpy(out, p, static_cast<std::size_t>(run - p));
+                    out += run - p;
+                    p    = run;
+               }
+
+               // Then one code point which is not
+               if (p != end && out < stop)
+               {
+                    auto d = detail::decode_point(encoding_, p, end);
+
+                    out  = detail::encode_utf8(d.c, out);
+                    p   += d.in;
+               }
+          }
+
+          position = static_cast<std::uint64_t>(p - original.data());
+          return {buffer.data(), static_cast<std::size_t>(out - buffer.data())};
+     }
+
+
+     // Advances the line and column over a block. Continuation bytes do not start a character.
+     void count_lines (std::string_view block)
+     {
+          const char* first = block.data();
+          const char* last  = first + block.size();
+
+          if (std::size_t newlines = simd::count_byte(first, last, '\n'))
+          {
+               line  += static_cast<std::uint32_t>(newlines);
+               column = 0;
+
+               while (last[-1] != '\n')     --last;
+               first = last;
+               last  = block.data() + block.size();
+          }
+
+          for (; first != last; ++first)
+               column += (static_cast<unsigned char>(*first) & 0xC0) != 0x80;
+     }
+
+
+     // Decodes from the checkpoint before a UTF-8 offset up to the character holding it
+     struct walk_state
+     {
+          std::uint64_t in;
+          std::uint64_t out;
+          std::uint32_t line;
+          std::uint32_t column;
+     };
+
+     walk_state walk (std::uint64_t utf8_offset) const
+     {
+          constexpr char32_t continuation = 0x110000;     // beyond Unicode
+
+          if (checkpoints.empty())     return {position, 0, 1, 0};
+
+          auto next = std::upper_bound(checkpoints.begin(), checkpoints.end(), utf8_offset,
+                                       [] (std::uint64_t o, const checkpoint& c) { return o < c.out; });
+
+          const checkpoint& c = *std::prev(next);
+          walk_state w {c.in, c.out, c.line, c.column};
+
+          const char* end = original.data() + position;
+
+          while (w.in < position)
+          {
+               const char* p = original.data() + w.in;
+               detail::decoded_point d;
+
+               if (encoding_ == source_encoding::utf8)
+               {
+                    auto byte = static_cast<unsigned char>(*p);
+                    d = {(byte & 0xC0) == 0x80 ? continuation : char32_t {byte}, 1, 1};
+               }
+               else
+                    d = detail::decode_point(encoding_, p, end);
+
+               if (w.out + d.out > utf8_offset)     break;
+
+               if (d.c == '\n')               { ++w.line; w.column = 0; }
+               else if (d.c != continuation)  ++w.column;
+
+               w.in  += d.in;
+               w.out += d.out;
+          }
+
+          return w;
+     }
+}; // class transcoding_source
+
+} // namespace Pattern
@@ -0,0 +1,173 @@
+#include <random>
+#include <regex>
+#include <stdexcept>
+#include <string>
+
+#include "catch2/catch.hpp"
+#include "pattern/capture-dfa.h"
+
+
+using namespace Pattern;
+
+
+namespace {
+
+auto digit = simd::byte_class::from([] (char c) { return '0' <= c && c <= '9'; });
+auto lower = simd::byte_class::from([] (char c) { return 'a' <= c && c <= 'z'; });
+
+
+// ([a-z]+)=([0-9]*)(;([a-z]+))?
+runtime_pattern make_field_pattern ()
+{
+     pattern_graph g;
+
+     auto word   = g.sequence(g.set(lower), g.many(g.set(lower)));
+     auto number = g.many(g.set(digit));
+     auto key    = g.capture(word, 1);
+     auto value  = g.capture(number, 2);
+     auto name   = g.capture(g.sequence(g.set(lower), g.many(g.set(lower))), 4);
+     auto unit   = g.capture(g.sequence(g.literal(";"), name), 3);
+     auto root   = g.capture(g.sequence({key, g.literal("="), value, g.optional(unit)}), 0);
+
+     return {std::move(g), root};
+}
+
+} // namespace
+
+
+// =====================================================================================================================
+// capture_dfa
+// =====================================================================================================================
+SCENARIO("A capture DFA should record the offsets of each group in a single pass.")
+{
+     GIVEN("A one-pass pattern for a field with a key, a value, and an optional unit")
+     {
+          capture_dfa fields {make_field_pattern()};
+          capture_dfa::captures groups;
+
+
+          WHEN("a text matches with every group")
+          {
+               std::string_view text = "width=120;px";
+
+               REQUIRE( fields.match(text, groups) );
+
+
+               THEN("each group should hold its part of the text.")
+               {
+                    REQUIRE( groups[0].in(text) == "width=120;px" );
+                    REQUIRE( groups[1].in(text) == "width" );
+                    REQUIRE( groups[2].in(text) == "120" );
+                    REQUIRE( groups[3].in(text) == ";px" );
+                    REQUIRE( groups[4].in(text) == "px" );
+                    REQUIRE_FALSE( groups[5].matched() );
+               }
+          }
+
+
+          WHEN("a text matches without the optional group")
+          {
+               std::string_view text = "height=";
+
+               REQUIRE( fields.match(text, groups) );
+
+
+               THEN("the empty group should be matched, and the optional group should not.")
+               {
+                    REQUIRE( groups[2].matched() );
+                    REQUIRE( groups[2].in(text) == "" );
+                    REQUIRE( groups[2].begin == 7 );
+                    REQUIRE_FALSE( groups[3].matched() );
+               }
+          }
+
+
+          THEN("texts which do not match entirely should be rejected.")
+          {
+               REQUIRE_FALSE( fields.match("=5", groups) );
+               REQUIRE_FALSE( fields.match("x=5;", groups) );
+               REQUIRE_FALSE( fields.match("x=5 ", groups) );
+               REQUIRE_FALSE( fields.match("", groups) );
+          }
+
+
+          THEN("the groups should agree with a regular expression for random texts.")
+          {
+               std::regex expression {"([a-z]+)=([0-9]*)(;([a-z]+))?"};
+               std::mt19937 gen {17};
+
+               for (int i = 0; i < 500; ++i)
+               {
+                    std::string text(gen() % 12, ' ');
+                    for (auto& c : text)     c = "ab19=;"[gen() % 6];
+
+                    std::smatch m;
+                    bool expected = std::regex_match(text, m, expression);
+
+                    REQUIRE( fields.match(text, groups) == expected );
+
+                    if (expected)
+                         for (int g = 0; g < 5; ++g)
+                         {
+                              REQUIRE( groups[g].matched() == m[g].matched );
+                              if (m[g].matched)     REQUIRE( groups[g].in(text) == m[g].str() );
+                         }
+               }
+          }
+     }
+
+
+     GIVEN("A group inside a repetition")
+     {
+          pattern_graph g;
+          auto item = g.sequence(g.capture(g.set(digit), 0), g.literal(","));
+          auto root = g.many(item);
+
+          capture_dfa list {runtime_pattern {g, root}};
+
+
+          THEN("the group should hold its last iteration.")
+          {
+               capture_dfa::captures groups;
+               std::string_view text = "1,2,3,";
+
+               REQUIRE( list.match(text, groups) );
+               REQUIRE( groups[0].begin == 4 );
+               REQUIRE( groups[0].in(text) == "3" );
+          }
+     }
+
+
+     GIVEN("Patterns which need more than one thread to follow")
+     {
+          pattern_graph g1;
+          auto root1 = g1.alternative(g1.literal("ab"), g1.literal("ac"));
+
+          pattern_graph g2;
+          auto root2 = g2.sequence(g2.many(g2.capture(g2.literal("a"), 0)), g2.capture(g2.literal("a"), 1));
+
+
+          THEN("building the automaton should fail.")
+          {
+               REQUIRE_THROWS_AS( capture_dfa {runtime_pattern(g1, root1)}, std::invalid_argument );
+               REQUIRE_THROWS_AS( capture_dfa {runtime_pattern(g2, root2)}, std::invalid_argument );
+          }
+     }
+
+
+     GIVEN("Groups numbered too high, one of which has a slot that wraps around to zero")
+     {
+          pattern_graph g1;
+          auto root1 = g1.capture(g1.literal("a"), capture_dfa::max_groups);
+
+          pattern_graph g2;
+          auto root2 = g2.capture(g2.literal("a"), 0x80000000);
+
+
+          THEN("building the automaton should fail.")
+          {
+               REQUIRE_THROWS_AS( capture_dfa {runtime_pattern(g1, root1)}, std::invalid_argument );
+               REQUIRE_THROWS_AS( capture_dfa {runtime_pattern(g2, root2)}, std::invalid_argument );
+          }
+     }
+}
@@ -0,0 +1,279 @@
+#include <algorithm>      // std::find, std::is_sorted
+#include <cctype>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "pattern/fingerprint.h"
+
+
+using namespace Pattern;
+
+
+namespace {
+
+// Keywords and symbols are tagged by their spelling, while all identifiers share one tag, as do all numbers
+token_stream<std::uint8_t> lex (std::string_view source)
+{
+     static const std::vector<std::string_view> keywords = {"var", "fun", "if", "else", "return", "while", "print"};
+     constexpr std::uint8_t identifier = 200, number = 201;
+
+     token_stream<std::uint8_t> tokens;
+
+     for (std::size_t i = 0; i < source.size(); )
+     {
+          auto start = static_cast<std::uint32_t>(i);
+          unsigned char c = source[i];
+          std::uint8_t tag;
+
+          if (std::isspace(c))     { ++i; continue; }
+
+          if (std::isalnum(c))
+          {
+               while (i < source.size() && std::isalnum(static_cast<unsigned char>(source[i])))     ++i;
+
+               auto word    = source.substr(start, i - start);
+               auto keyword = std::find(keywords.begin(), keywords.end(), word);
+
+               tag = std::isdigit(c)              ? number
+                   : keyword != keywords.end()    ? static_cast<std::uint8_t>(1 + (keyword - keywords.begin()))
+                   :                                identifier;
+          }
+          else
+               tag = source[i++];
+
+          tokens.push_back(tag, start, static_cast<std::uint32_t>(i) - start);
+     }
+
+     return tokens;
+}
+
+
+// A program of random functions, whose names are drawn from a list
+std::string random_program (unsigned seed, int functions, const std::vector<std::string>& names)
+{
+     std::mt19937 gen {seed};
+     auto name = [&] { return names[gen() % names.size()]; };
+
+     auto expression = [&] {
+          std::string e = name();
+
+          for (int i = 0, n = static_cast<int>(gen() % 4); i < n; ++i)
+          {
+               e += std::string {" "} + "+-*/<"[gen() % 5] + " ";
+               e += gen() % 2 ? name() : std::to_string(gen() % 100);
+               if (gen() % 3 == 0)     e = "(" + e + ")";
+          }
+
+          return e;
+     };
+
+     std::string s;
+
+     for (int f = 0; f < functions; ++f)
+     {
+          s += "fun " + name() + "(" + name() + ") {\n";
+
+          for (int i = 0, n = 3 + static_cast<int>(gen() % 6); i < n; ++i)
+               switch (gen() % 5)
+               {
+                    case 0:     s += "  var " + name() + " = " + expression() + ";\n";                           break;
+                    case 1:     s += "  if (" + expression() + ") print " + expression() + ";\n";                break;
+                    case 2:     s += "  while (" + expression() + ") " + name() + " = " + expression() + ";\n";  break;
+                    case 3:     s += "  print " + name() + "(" + expression() + ", " + expression() + ");\n";    break;
+                    default:    s += "  " + name() + " = " + expression() + ";\n";
+               }
+
+          s += "  return " + expression() + ";\n}\n";
+     }
+
+     return s;
+}
+
+
+bool share_a_fingerprint (const std::vector<fingerprint>& a, const std::vector<fingerprint>& b)
+{
+     for (const auto& x : a)
+          for (const auto& y : b)
+               if (x.hash == y.hash)     return true;
+
+     return false;
+}
+
+} // namespace
+
+
+// =====================================================================================================================
+// winnow
+// =====================================================================================================================
+SCENARIO("Winnowing should select fingerprints which any long enough shared run of tokens will contain.")
+{
+     fingerprint_options options {.k = 5, .window = 4};
+
+     GIVEN("Random tag sequences with a run in common, placed differently in each")
+     {
+          std::mt19937 gen {7};
+          auto random_tags = [&] (std::size_t n) {
+               std::vector<std::uint8_t> tags(n);
+               for (auto& t : tags)     t = static_cast<std::uint8_t>(gen() % 16);
+               return tags;
+          };
+
+          THEN("they should share a fingerprint whenever the run spans w + k - 1 tokens.")
+          {
+               for (int trial = 0; trial < 200; ++trial)
+               {
+                    auto run = random_tags(options.k + options.window - 1);
+                    auto a   = random_tags(gen() % 50);
+                    auto b   = random_tags(gen() % 50);
+
+                    a.insert(a.begin() + static_cast<std::ptrdiff_t>(gen() % (a.size() + 1)), run.begin(), run.end());
+                    b.insert(b.begin() + static_cast<std::ptrdiff_t>(gen() % (b.size() + 1)), run.begin(), run.end());
+
+                    std::vector<fingerprint> fa, fb;
+                    winnow(a.data(), a.size(), options, fa);
+                    winnow(b.data(), b.size(), options, fb);
+
+                    REQUIRE( share_a_fingerprint(fa, fb) );
+                    REQUIRE( std::is_sorted(fa.begin(), fa.end(),
+                                            [] (auto x, auto y) { return x.position < y.position; }) );
+               }
+          }
+
+          THEN("about 2 / (w + 1) of the k-grams should be kept.")
+          {
+               auto tags = random_tags(100000);
+               std::vector<fingerprint> prints;
+               winnow(tags.data(), tags.size(), options, prints);
+
+               double density = static_cast<double>(prints.size()) / (tags.size() - options.k + 1);
+               REQUIRE( density == Approx(2.0 / (options.window + 1)).epsilon(0.1) );
+          }
+     }
+
+
+     GIVEN("Sequences shorter than a k-gram, or than a window")
+     {
+          std::vector<std::uint8_t> tags = {1, 2, 3, 4, 5, 6};
+          std::vector<fingerprint> prints;
+
+          THEN("the first should have no fingerprints, and the second one.")
+          {
+               winnow(tags.data(), 4, options, prints);
+               REQUIRE( prints.empty() );
+
+               winnow(tags.data(), 6, options, prints);
+               REQUIRE( prints.size() == 1 );
+          }
+     }
+
+
+     GIVEN("A program, and a copy with its identifiers renamed")
+     {
+          auto original = lex(random_program(1, 5, {"a", "b", "c", "d"}));
+          auto renamed  = lex(random_program(1, 5, {"w", "x", "y", "z"}));
+
+          THEN("their fingerprints should be the same.")
+          {
+               auto fa = winnow(original);
+               auto fb = winnow(renamed);
+
+               REQUIRE( fa.size() == fb.size() );
+               for (std::size_t i = 0; i < fa.size(); ++i)
+               {
+                    REQUIRE( fa[i].hash == fb[i].hash );
+                    REQUIRE( fa[i].position == fb[i].position );
+               }
+          }
+     }
+}
+
+
+// =====================================================================================================================
+// fingerprint_index
+// =====================================================================================================================
+SCENARIO("A fingerprint index should report the pairs of documents which share code.")
+{
+     std::vector<std::string> names = {"total", "count", "index", "limit", "value", "result"};
+
+     // Document 1 pastes three functions of document 0 into code of its own, under other names
+     std::string copied = random_program(10, 3, names);
+     std::vector<std::string> documents = {
+          random_program(11, 4, names) + copied,
+          random_program(12, 6, {"n", "m", "k"}) + random_program(10, 3, {"p", "q", "r", "s"}),
+          random_program(13, 8, names),
+          random_program(14, 8, names)
+     };
+
+     GIVEN("An index of every document")
+     {
+          fingerprint_index index;
+          for (std::uint32_t d = 0; d < documents.size(); ++d)     index.add(d, lex(documents[d]));
+
+          THEN("only the documents which share code should be paired.")
+          {
+               auto pairs = index.clone_pairs(8);
+
+               REQUIRE( pairs.size() == 1 );
+               REQUIRE( pairs[0].first == 0 );
+               REQUIRE( pairs[0].second == 1 );
+               REQUIRE( pairs[0].shared >= 10 );
+               REQUIRE( pairs[0].shared <= std::min(index.fingerprints(0), index.fingerprints(1)) );
+
+               // The earliest shared code in document 0 is in the pasted functions
+               auto tokens = lex(documents[0]);
+               auto pasted = lex(random_program(11, 4, names)).size();
+               REQUIRE( pairs[0].first_position + 12 >= pasted );
+               REQUIRE( pairs[0].first_position < tokens.size() );
+          }
+
+          THEN("a fingerprint found in too many documents should be passed over.")
+          {
+               REQUIRE( index.clone_pairs(8, 1).empty() );
+          }
+     }
+
+
+     GIVEN("Indexes built by separate workers")
+     {
+          fingerprint_index whole, first, second;
+
+          for (std::uint32_t d = 0; d < documents.size(); ++d)
+          {
+               whole.add(d, lex(documents[d]));
+               (d % 2 ? first : second).add(d, lex(documents[d]));
+          }
+
+          THEN("merging them should give the same report as one index of everything.")
+          {
+               first.merge(std::move(second));
+
+               REQUIRE( first.size() == whole.size() );
+               REQUIRE( second.size() == 0 );
+
+               auto merged   = first.clone_pairs(1);
+               auto expected = whole.clone_pairs(1);
+
+               REQUIRE( merged.size() == expected.size() );
+
+               for (std::size_t i = 0; i < merged.size(); ++i)
+               {
+                    REQUIRE( merged[i].first == expected[i].first );
+                    REQUIRE( merged[i].second == expected[i].second );
+                    REQUIRE( merged[i].shared == expected[i].shared );
+                    REQUIRE( merged[i].first_position == expected[i].first_position );
+               }
+
+               for (std::uint32_t d = 0; d < documents.size(); ++d)
+                    REQUIRE( first.fingerprints(d) == whole.fingerprints(d) );
+          }
+
+          THEN("indexes built with different options should not be merged.")
+          {
+               fingerprint_index other {{.k = 8, .window = 4}};
+               REQUIRE_THROWS_AS( first.merge(std::move(other)), std::invalid_argument );
+          }
+     }
+}
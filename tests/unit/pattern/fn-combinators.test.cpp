@@ -1,5 +1,6 @@
 #include <functional>     // std::ref, std::reference_wrapper
 #include <tuple>
+#include <type_traits>
 #include <utility>        // std::forward
 
 #include "catch2/catch.hpp"
@@ -1429,3 +1430,277 @@ SCENARIO("Every algorithm and combinators should call a function a specific numb
           }
      }
 }
+
+
+// =====================================================================================================================
+// Scan budgets
+// =====================================================================================================================
+SCENARIO("A scan budget should stop looping algorithms once it is exhausted.")
+{
+     GIVEN("A function object which always succeeds, counting its calls")
+     {
+          int count = 0;
+          auto forever = [&count] () { ++count; return true; };
+
+
+          WHEN("the many combinator is run within a budget of 100 steps")
+          {
+               scan_budget budget {100};
+               scan_result result = fn::within_budget(budget, fo::many(forever));
+
+
+               THEN("the scan should be reported as exhausted after a bounded number of calls.")
+               {
+                    REQUIRE( result == scan_result::exhausted );
+                    REQUIRE( budget.exhausted() );
+                    REQUIRE( count == 101 );
+               }
+          }
+
+
+          WHEN("the at_least combinator is run within a deadline that has already passed")
+          {
+               auto budget = scan_budget::for_duration(std::chrono::nanoseconds {0});
+               scan_result result = fo::within_budget(budget, fo::at_least(1, forever))();
+
+
+               THEN("the scan should be reported as exhausted.")
+               {
+                    REQUIRE( result == scan_result::exhausted );
+               }
+          }
+
+
+          WHEN("the many combinator is run within a larger budget, nested within a budget of 100 steps")
+          {
+               scan_budget outer {100};
+               scan_budget inner {10000};
+               scan_result inner_result = scan_result::success;
+
+               scan_result result = fn::within_budget(outer, [&] {
+                    inner_result = fn::within_budget(inner, fo::many(forever));
+                    return inner_result == scan_result::success;
+               });
+
+
+               THEN("the outer budget should bound the nested scan, and both should be reported as exhausted.")
+               {
+                    REQUIRE( inner_result == scan_result::exhausted );
+                    REQUIRE( result == scan_result::exhausted );
+                    REQUIRE( outer.exhausted() );
+                    REQUIRE( !inner.exhausted() );
+                    REQUIRE( count == 101 );
+               }
+          }
+
+
+          WHEN("an unlimited budget is nested within a deadline that has already passed")
+          {
+               auto outer = scan_budget::for_duration(std::chrono::nanoseconds {0});
+               scan_budget inner;
+
+               scan_result result = fn::within_budget(outer, [&] {
+                    return fn::within_budget(inner, fo::many(forever)) == scan_result::success;
+               });
+
+
+               THEN("the outer deadline should stop the nested scan.")
+               {
+                    REQUIRE( result == scan_result::exhausted );
+                    REQUIRE( count <= 2 * scan_budget::clock_interval );
+               }
+          }
+     }
+
+
+     GIVEN("A function object which returns true until it has been called m times, then returns false")
+     {
+          int count = 0;
+
+          auto counts_to_m = [] (int m, int& count)
+          {
+               if (count == m)     return false;
+
+               ++count;
+               return true;
+          };
+
+
+          WHEN("it is run with the many algorithm within a sufficient budget")
+          {
+               scan_budget budget {100};
+               scan_result result = fn::within_budget(budget, fn::many, counts_to_m, 10, count);
+
+
+               THEN("the scan should succeed without exhausting the budget.")
+               {
+                    REQUIRE( result == scan_result::success );
+                    REQUIRE( !budget.exhausted() );
+                    REQUIRE( count == 10 );
+               }
+          }
+
+
+          WHEN("it is run with the n_times algorithm, asking for more calls than the function allows")
+          {
+               scan_budget budget;
+               scan_result result = fn::within_budget(budget, fn::n_times, 20, counts_to_m, 10, count);
+
+
+               THEN("the scan should fail rather than be exhausted.")
+               {
+                    REQUIRE( result == scan_result::failure );
+               }
+          }
+
+
+          WHEN("the budget is no longer active")
+          {
+               scan_budget budget {0};
+               fn::within_budget(budget, fn::identity, [] () { return true; });
+
+
+               THEN("looping algorithms should run unbounded.")
+               {
+                    REQUIRE( fn::many(counts_to_m, 5000, count) );
+                    REQUIRE( count == 5000 );
+               }
+          }
+     }
+}
+
+
+// =====================================================================================================================
+// Rules
+// =====================================================================================================================
+SCENARIO("A rule should forward its calling arguments to its child and return the child's result.")
+{
+     GIVEN("A function object which returns true until it has been called m times, then returns false")
+     {
+          int count = 0;
+
+          auto counts_to_m = [] (int m, int& count)
+          {
+               if (count == m)     return false;
+
+               ++count;
+               return true;
+          };
+
+
+          THEN("every inlining mode should behave like the child function.")
+          {
+               REQUIRE( fo::rule<{.inline_mode = inlining::always}>(counts_to_m)(1, count) == true );
+               REQUIRE( fo::rule<{.inline_mode = inlining::never}>(counts_to_m)(1, count) == false );
+               REQUIRE( fo::rule<{.cold_failure = true}>(fo::many(counts_to_m))(3, count) == true );
+               REQUIRE( count == 3 );
+          }
+     }
+
+
+     GIVEN("A leaf function and a composition")
+     {
+          auto leaf = [] () { return true; };
+          auto composite = fo::many(fo::negate(leaf));
+
+
+          THEN("the automatic mode should inline the leaf and outline the composition.")
+          {
+               REQUIRE( !decltype(fo::rule(leaf))::outlined );
+               REQUIRE( decltype(fo::rule(composite))::outlined );
+          }
+     }
+}
+
+
+// =====================================================================================================================
+// Storage
+// =====================================================================================================================
+namespace {
+
+bool take_digit (const char*& p)
+{
+     if (*p < '0' || '9' < *p)     return false;
+
+     ++p;
+     return true;
+}
+
+bool take_dot (const char*& p)
+{
+     if (*p != '.')     return false;
+
+     ++p;
+     return true;
+}
+
+} // namespace
+
+
+SCENARIO("A composition of stateless functions should be an empty, trivially copyable type.")
+{
+     GIVEN("A number pattern composed of lifted functions")
+     {
+          auto digits = fo::some(fo::lift<take_digit>);
+          auto number = fo::all(digits, fo::optional(fo::all(fo::lift<take_dot>, fo::many(fo::lift<take_digit>))));
+
+          using number_t = decltype(number);
+
+
+          THEN("it should be empty and trivially copyable.")
+          {
+               REQUIRE( std::is_empty_v<decltype(fo::lift<take_digit>)> );
+               REQUIRE( std::is_empty_v<decltype(digits)> );
+               REQUIRE( std::is_empty_v<number_t> );
+               REQUIRE( std::is_trivially_copyable_v<number_t> );
+               REQUIRE( std::is_empty_v<decltype(fo::rule(number))> );
+               REQUIRE( std::is_empty_v<decltype(fn::bind_back(fo::any(number, digits)))> );
+          }
+
+
+          THEN("it should be copy and move assignable.")
+          {
+               number_t other = number;
+               other = number;
+               other = std::move(number);
+
+               REQUIRE( std::is_nothrow_copy_assignable_v<number_t> );
+          }
+
+
+          THEN("it should scan as the functions it is composed of.")
+          {
+               const char* text = "12.5x";
+               const char* p    = text;
+
+               REQUIRE( number(p) );
+               REQUIRE( p - text == 4 );
+
+               p = text + 4;
+               REQUIRE( !number(p) );
+          }
+
+
+          THEN("a lifted composition should still be outlined as a rule.")
+          {
+               REQUIRE( !decltype(fo::rule(fo::lift<take_digit>))::outlined );
+               REQUIRE( decltype(fo::rule(number))::outlined );
+          }
+     }
+
+
+     GIVEN("Compositions holding state")
+     {
+          auto with_pointer = fo::some(&take_digit);
+          auto with_count   = fo::n_times(3, fo::lift<take_digit>);
+
+
+          THEN("they should take only the size of their state, and stay trivially copyable.")
+          {
+               REQUIRE( sizeof(with_pointer) == sizeof(&take_digit) );
+               REQUIRE( sizeof(with_count) == sizeof(std::size_t) );
+               REQUIRE( std::is_trivially_copyable_v<decltype(with_pointer)> );
+               REQUIRE( std::is_trivially_copyable_v<decltype(with_count)> );
+          }
+     }
+}
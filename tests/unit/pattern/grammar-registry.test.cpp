@@ -0,0 +1,157 @@
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "pattern/capture-dfa.h"
+#include "pattern/grammar-registry.h"
+
+
+using namespace Pattern;
+
+
+namespace {
+
+// Counts live instances, and checks that none is used after it is destroyed
+struct tracked
+{
+     static inline std::atomic<int> alive {0};
+
+     int                        version;
+     mutable std::atomic<bool>  destroyed {false};
+
+     explicit tracked (int version) : version {version}     { ++alive; }
+     ~tracked ()                                            { destroyed = true; --alive; }
+};
+
+
+std::unique_ptr<const capture_dfa> keyword (std::string_view word)
+{
+     pattern_graph g;
+     auto root = g.capture(g.literal(word), 0);
+     return std::make_unique<const capture_dfa>(runtime_pattern {std::move(g), root});
+}
+
+} // namespace
+
+
+// =====================================================================================================================
+// grammar_registry
+// =====================================================================================================================
+SCENARIO("A grammar registry should hand out the current grammar, and reclaim old ones once unused.")
+{
+     GIVEN("A registry of compiled patterns")
+     {
+          grammar_registry<capture_dfa> registry {keyword("let")};
+          auto reader = registry.make_reader();
+          capture_dfa::captures groups;
+
+
+          THEN("a read after publishing should see the new grammar.")
+          {
+               REQUIRE( reader.read()->match("let", groups) );
+
+               REQUIRE( registry.publish(keyword("var")) == 2 );
+
+               auto g = reader.read();
+               REQUIRE( g->match("var", groups) );
+               REQUIRE_FALSE( g->match("let", groups) );
+          }
+
+
+          THEN("a read in progress should keep the grammar it began with.")
+          {
+               auto g = reader.read();
+               registry.publish(keyword("var"));
+
+               REQUIRE( g->match("let", groups) );
+          }
+     }
+
+
+     GIVEN("A registry of tracked versions")
+     {
+          REQUIRE( tracked::alive == 0 );
+
+          {
+               grammar_registry<tracked> registry {std::make_unique<const tracked>(1)};
+               auto first  = registry.make_reader();
+               auto second = registry.make_reader();
+
+
+               WHEN("a version is replaced while no reader holds it")
+               {
+                    REQUIRE( registry.publish(std::make_unique<const tracked>(2)) == 2 );
+
+                    THEN("it should be destroyed at once.")
+                    {
+                         REQUIRE( tracked::alive == 1 );
+                    }
+               }
+
+
+               WHEN("a version is replaced while a reader holds it")
+               {
+                    {
+                         auto g = first.read();
+                         registry.publish(std::make_unique<const tracked>(2));
+
+                         THEN("it should be kept, while other readers see the new version.")
+                         {
+                              REQUIRE( tracked::alive == 2 );
+                              REQUIRE( g->version == 1 );
+                              REQUIRE( second.read()->version == 2 );
+                         }
+                    }
+
+                    THEN("it should be reclaimed once the reader is done.")
+                    {
+                         REQUIRE( registry.reclaim() == 0 );
+                         REQUIRE( tracked::alive == 1 );
+                    }
+               }
+          }
+
+          REQUIRE( tracked::alive == 0 );
+     }
+
+
+     GIVEN("Threads reading while versions are published")
+     {
+          grammar_registry<tracked> registry {std::make_unique<const tracked>(0)};
+          std::atomic<bool> done {false};
+          std::atomic<int>  errors {0};
+
+          std::vector<std::thread> workers;
+
+          for (int t = 0; t < 4; ++t)
+               workers.emplace_back([&] {
+                    auto reader = registry.make_reader();
+                    int last = 0;
+
+                    while (!done)
+                    {
+                         auto g = reader.read();
+
+                         // Versions never go backwards for one reader, and none is destroyed while held
+                         if (g->version < last || g->destroyed)     ++errors;
+                         last = g->version;
+                    }
+               });
+
+          for (int v = 1; v <= 2000; ++v)
+               registry.publish(std::make_unique<const tracked>(v));
+
+          done = true;
+          for (auto& w : workers)     w.join();
+
+
+          THEN("no reader should have seen a destroyed or older version, and every old version should be reclaimed.")
+          {
+               REQUIRE( errors == 0 );
+               REQUIRE( registry.reclaim() == 0 );
+               REQUIRE( tracked::alive == 1 );
+          }
+     }
+}
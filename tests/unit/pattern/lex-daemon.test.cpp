@@ -0,0 +1,330 @@
+#include <cctype>
+#include <cstdio>          // std::remove
+#include <cstring>         // std::memcpy
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>       // std::runtime_error
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "catch2/catch.hpp"
+#include "pattern/lex-daemon.h"
+
+
+using namespace Pattern;
+
+
+namespace {
+
+enum class tag : std::uint8_t { word, number, symbol };
+
+
+// Words, numbers, and single symbols, separated by spaces. Throws at a '!'.
+struct word_lexer
+{
+     int calls = 0;     // per copy, so per worker
+
+     void operator() (std::string_view source, token_stream<tag>& tokens)
+     {
+          ++calls;
+
+          for (std::size_t i = 0; i < source.size(); )
+          {
+               std::size_t start = i;
+               unsigned char c = source[i];
+
+               if (std::isspace(c))     { ++i; continue; }
+               if (c == '!')            throw std::runtime_error {"word_lexer: unexpected '!'"};
+
+               tag t = std::isalpha(c) ? tag::word : std::isdigit(c) ? tag::number : tag::symbol;
+
+               if (t == tag::symbol)     ++i;
+               else
+                    while (i < source.size() && std::isalnum(static_cast<unsigned char>(source[i])))     ++i;
+
+               tokens.push_back(t, static_cast<std::uint32_t>(start), static_cast<std::uint32_t>(i - start));
+          }
+     }
+};
+
+
+bool same_tokens (const token_stream<tag>& a, const token_stream<tag>& b)
+{
+     if (a.size() != b.size())     return false;
+
+     for (std::size_t i = 0; i < a.size(); ++i)
+          if (a.tag(i) != b.tag(i) || a.offset(i) != b.offset(i) || a.length(i) != b.length(i))     return false;
+
+     return true;
+}
+
+
+std::string socket_path ()
+{
+     return "/tmp/lex-daemon-test-" + std::to_string(::getpid()) + ".sock";
+}
+
+
+// A connection without a lex_client, to misbehave as one never would
+int raw_connect ()
+{
+     sockaddr_un address {};
+     address.sun_family = AF_UNIX;
+     socket_path().copy(address.sun_path, sizeof(address.sun_path) - 1);
+
+     int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+     if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)     return -1;
+
+     return fd;
+}
+
+
+void send_request (int fd, std::string_view source)
+{
+     std::uint32_t header[2] = {static_cast<std::uint32_t>(lex_request::source), std::uint32_t(source.size())};
+     REQUIRE( ::write(fd, header, sizeof(header)) == sizeof(header) );
+     REQUIRE( ::write(fd, source.data(), source.size()) == ssize_t(source.size()) );
+}
+
+} // namespace
+
+
+// =====================================================================================================================
+// lex_server, lex_client
+// =====================================================================================================================
+SCENARIO("A lexing daemon should return the tokens of buffers and files sent by its clients.")
+{
+     GIVEN("A server with two workers")
+     {
+          lex_server<tag, word_lexer> server {socket_path(), word_lexer {}, 2};
+
+
+          THEN("a buffer should be lexed as it would be in process.")
+          {
+               lex_client<tag> client {socket_path()};
+               token_stream<tag> received, expected;
+
+               std::string_view source = "print(x + 42);";
+               word_lexer {}(source, expected);
+
+               REQUIRE( client.lex_source(source, received) == lex_status::ok );
+               REQUIRE( same_tokens(received, expected) );
+               REQUIRE( received.lexeme(4, source) == "42" );
+          }
+
+
+          THEN("a file should be read and lexed by the server.")
+          {
+               std::string path = "/tmp/lex-daemon-test-input.txt";
+               std::ofstream {path} << "var answer = 42;\n";
+
+               lex_client<tag> client {socket_path()};
+               token_stream<tag> tokens;
+
+               REQUIRE( client.lex_file(path, tokens) == lex_status::ok );
+               REQUIRE( tokens.size() == 5 );
+               REQUIRE( tokens.tag(3) == tag::number );
+               REQUIRE( tokens.offset(3) == 13 );
+
+               std::remove(path.c_str());
+
+               REQUIRE( client.lex_file(path, tokens) == lex_status::unreadable_file );
+               REQUIRE( tokens.empty() );
+          }
+
+
+          THEN("a file too large for 32-bit offsets should be refused without being read.")
+          {
+               std::string path = "/tmp/lex-daemon-test-large.txt";
+               std::ofstream {path};
+               std::filesystem::resize_file(path, std::uintmax_t {1} << 32);     // sparse
+
+               lex_client<tag> client {socket_path()};
+               token_stream<tag> tokens;
+
+               REQUIRE( client.lex_file(path, tokens) == lex_status::file_too_large );
+               REQUIRE( tokens.empty() );
+
+               std::remove(path.c_str());
+          }
+
+
+          THEN("many clients should be served concurrently, each over many requests.")
+          {
+               std::vector<std::thread> clients;
+               std::atomic<int> mismatches {0};
+
+               for (int t = 0; t < 8; ++t)
+                    clients.emplace_back([&mismatches, t] {
+                         lex_client<tag> client {socket_path()};
+                         token_stream<tag> received, expected;
+
+                         for (int i = 0; i < 200; ++i)
+                         {
+                              std::string source(static_cast<std::size_t>(t * 1000 + i), ' ');
+                              for (std::size_t j = 0; j < source.size(); ++j)     source[j] = "ab1 (;"[(j * 7 + i) % 6];
+
+                              expected.clear();
+                              word_lexer {}(source, expected);
+
+                              if (client.lex_source(source, received) != lex_status::ok ||
+                                  !same_tokens(received, expected))
+                                   ++mismatches;
+                         }
+                    });
+
+               for (auto& c : clients)     c.join();
+
+               REQUIRE( mismatches == 0 );
+               REQUIRE( server.requests() == 1600 );
+          }
+     }
+
+
+     GIVEN("A server with one worker")
+     {
+          lex_server<tag, word_lexer> server {socket_path(), word_lexer {}, 1};
+
+
+          THEN("a lexer which throws should give an error to its client, and the worker should go on.")
+          {
+               lex_client<tag> client {socket_path()};
+               token_stream<tag> tokens;
+
+               REQUIRE( client.lex_source("a b ! c", tokens) == lex_status::lexer_failed );
+               REQUIRE( tokens.empty() );
+               REQUIRE( client.lex_source("a b c", tokens) == lex_status::ok );
+               REQUIRE( tokens.size() == 3 );
+          }
+
+
+          THEN("requests sent just before the client closes its end should still be answered.")
+          {
+               int fd = raw_connect();
+               REQUIRE( fd >= 0 );
+
+               send_request(fd, "x = 1");
+               send_request(fd, "y");
+               ::shutdown(fd, SHUT_WR);
+
+               std::string received;
+               char buffer[256];
+               for (ssize_t n; (n = ::read(fd, buffer, sizeof(buffer))) > 0; )     received.append(buffer, n);
+               ::close(fd);
+
+               // Two headers, then 3 and 1 tokens of 9 bytes each
+               REQUIRE( received.size() == 2 * 8 + 4 * 9 );
+               REQUIRE( server.requests() == 2 );
+          }
+
+
+          THEN("a bad request should be answered after the responses queued before it, then its connection closed.")
+          {
+               int fd = raw_connect();
+               REQUIRE( fd >= 0 );
+
+               // A response several times larger than the socket buffers, so the worker must queue it
+               std::string source(1 << 16, 'a');
+               for (std::size_t i = 1; i < source.size(); i += 2)     source[i] = ' ';
+
+               send_request(fd, source);
+
+               std::uint32_t bad[2] = {7, 0};
+               REQUIRE( ::write(fd, bad, sizeof(bad)) == sizeof(bad) );
+
+               std::string received;
+               char buffer[4096];
+               for (ssize_t n; (n = ::read(fd, buffer, sizeof(buffer))) > 0; )     received.append(buffer, n);
+               ::close(fd);
+
+               REQUIRE( received.size() == 8 + (1 << 15) * 9 + 8 );
+
+               std::uint32_t last[2];
+               std::memcpy(last, received.data() + received.size() - sizeof(last), sizeof(last));
+               REQUIRE( last[0] == static_cast<std::uint32_t>(lex_status::bad_request) );
+               REQUIRE( last[1] == 0 );
+          }
+
+
+          THEN("a client which keeps writing an oversized request should be answered and closed, not buffered.")
+          {
+               int fd = raw_connect();
+               REQUIRE( fd >= 0 );
+
+               std::uint32_t header[2] = {static_cast<std::uint32_t>(lex_request::source), detail::max_request + 1};
+               REQUIRE( ::write(fd, header, sizeof(header)) == sizeof(header) );
+
+               std::size_t written = 0;
+               std::thread writer {[fd, &written] {
+                    std::string chunk(1 << 16, 'a');
+                    for (ssize_t n; written < (std::size_t {1} << 30); written += static_cast<std::size_t>(n))
+                         if ((n = ::send(fd, chunk.data(), chunk.size(), MSG_NOSIGNAL)) <= 0)     break;
+               }};
+
+               std::uint32_t response[2] = {};
+               REQUIRE( ::read(fd, response, sizeof(response)) == sizeof(response) );
+               REQUIRE( response[0] == static_cast<std::uint32_t>(lex_status::bad_request) );
+
+               char byte;
+               REQUIRE( ::read(fd, &byte, 1) == 0 );
+
+               writer.join();
+               ::close(fd);
+
+               REQUIRE( written < (std::size_t {1} << 30) );
+          }
+
+
+          THEN("a client should refuse a request too large for the server, and stay connected.")
+          {
+               lex_client<tag> client {socket_path()};
+               token_stream<tag> tokens;
+
+               std::string source(detail::max_request + 1, 'a');
+               REQUIRE( client.lex_source(source, tokens) == lex_status::bad_request );
+               REQUIRE( tokens.empty() );
+
+               REQUIRE( client.lex_source("a b", tokens) == lex_status::ok );
+               REQUIRE( tokens.size() == 2 );
+          }
+
+
+          THEN("a client which never reads should not hold up the worker, or the server's shutdown.")
+          {
+               int fd = raw_connect();
+               REQUIRE( fd >= 0 );
+
+               // Requests the socket buffers, for responses of several times as much
+               std::string source(1 << 16, 'a');
+               for (std::size_t i = 1; i < source.size(); i += 2)     source[i] = ' ';
+
+               send_request(fd, source);
+               send_request(fd, source);
+
+               lex_client<tag> client {socket_path()};
+               token_stream<tag> tokens;
+
+               REQUIRE( client.lex_source("still served", tokens) == lex_status::ok );
+               REQUIRE( tokens.size() == 2 );
+
+               server.stop();
+               server.wait();
+               ::close(fd);
+          }
+     }
+
+
+     GIVEN("No server")
+     {
+          THEN("a client should fail to connect.")
+          {
+               REQUIRE_THROWS_AS( lex_client<tag> {"/tmp/lex-daemon-test-absent.sock"}, std::system_error );
+          }
+     }
+}
@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>          // std::remove
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "catch2/catch.hpp"
+#include "pattern/metrics.h"
+
+
+using namespace Pattern;
+
+
+// =====================================================================================================================
+// Histograms
+// =====================================================================================================================
+SCENARIO("A latency histogram should report quantiles within the precision of its buckets.")
+{
+     GIVEN("Samples spread over several orders of magnitude")
+     {
+          std::mt19937_64 gen {7};
+          std::vector<std::uint64_t> values;
+          latency_histogram h;
+
+          for (int i = 0; i < 20000; ++i)
+          {
+               std::uint64_t v = gen() >> (gen() % 44 + 20);     // within the range of the buckets
+               values.push_back(v);
+               h.record(v);
+          }
+
+          std::sort(values.begin(), values.end());
+
+          histogram_snapshot s;
+          s.merge(h);
+
+
+          THEN("each quantile should be within about 3% of the exact one.")
+          {
+               REQUIRE( s.count() == values.size() );
+               REQUIRE( s.max() == values.back() );
+
+               for (double q : {0.0, 0.1, 0.5, 0.9, 0.99, 0.999, 1.0})
+               {
+                    auto exact = values[static_cast<std::size_t>(q * (values.size() - 1))];
+                    auto found = s.quantile(q);
+
+                    REQUIRE( found >= exact );
+                    REQUIRE( found <= exact + exact / 32 + 1 );
+               }
+          }
+     }
+
+
+     GIVEN("Every bucket")
+     {
+          THEN("each should hold the values from just above the previous one up to its highest.")
+          {
+               for (std::size_t b = 1; b < histogram_buckets::count; ++b)
+               {
+                    REQUIRE( histogram_buckets::of(histogram_buckets::highest(b)) == b );
+                    REQUIRE( histogram_buckets::of(histogram_buckets::highest(b - 1) + 1) == b );
+               }
+          }
+     }
+}
+
+
+// =====================================================================================================================
+// metrics_registry
+// =====================================================================================================================
+SCENARIO("A metrics registry should merge the shards of every thread, and export them.")
+{
+     GIVEN("Threads recording into their own shards")
+     {
+          metrics_registry registry;
+
+          auto latency = registry.histogram("lex_seconds", "Time to lex a file");
+          auto bytes   = registry.counter("lex_bytes_total", "Bytes lexed");
+          auto errors  = registry.counter("lex_errors_total", "Lexical errors");
+
+          std::vector<std::thread> threads;
+
+          for (int t = 0; t < 4; ++t)
+               threads.emplace_back([&registry, latency, bytes, errors, t] {
+                    auto& shard = registry.make_shard();
+
+                    for (int i = 0; i < 1000; ++i)
+                    {
+                         shard.record(latency, std::uint64_t(1000 * (t + 1)));
+                         shard.add(bytes, 10);
+                    }
+
+                    shard.add(errors, t);
+               });
+
+          for (auto& t : threads)     t.join();
+
+
+          THEN("a snapshot should hold the totals of every thread.")
+          {
+               auto s = registry.snapshot();
+
+               REQUIRE( s.counters[0].value == 40000 );
+               REQUIRE( s.counters[1].value == 6 );
+               REQUIRE( s.histograms[0].value.count() == 4000 );
+               REQUIRE( s.histograms[0].value.quantile(0.5) / 1000 == 2 );
+               REQUIRE( s.histograms[0].value.quantile(1.0) == 4000 );
+          }
+
+
+          THEN("the Prometheus export should list counters and summaries in seconds.")
+          {
+               std::string text = registry.snapshot().prometheus();
+
+               REQUIRE( text.find("# TYPE lex_bytes_total counter\nlex_bytes_total 40000\n") != std::string::npos );
+               REQUIRE( text.find("# TYPE lex_seconds summary\n") != std::string::npos );
+               REQUIRE( text.find("lex_seconds{quantile=\"0.999\"} 4e-06\n") != std::string::npos );
+               REQUIRE( text.find("lex_seconds_count 4000\n") != std::string::npos );
+          }
+
+
+          THEN("metrics should not be defined once shards exist.")
+          {
+               REQUIRE_THROWS_AS( registry.counter("late_total", ""), std::logic_error );
+          }
+
+
+          THEN("an export to a file should replace its contents.")
+          {
+               std::string path = "/tmp/metrics-test.prom";
+
+               REQUIRE( registry.export_to_file(path) );
+
+               std::ifstream file {path};
+               std::stringstream contents;
+               contents << file.rdbuf();
+
+               REQUIRE( contents.str() == registry.snapshot().prometheus() );
+               std::remove(path.c_str());
+          }
+
+
+          THEN("an export to a local socket should be received by its listener.")
+          {
+               std::string path = "/tmp/metrics-test-" + std::to_string(::getpid()) + ".sock";
+               ::unlink(path.c_str());
+
+               sockaddr_un address {};
+               address.sun_family = AF_UNIX;
+               path.copy(address.sun_path, path.size());
+
+               int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+               REQUIRE( ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 );
+               REQUIRE( ::listen(listener, 1) == 0 );
+
+               std::string received;
+               std::thread reader {[&] {
+                    int fd = ::accept(listener, nullptr, nullptr);
+                    char buffer[4096];
+                    for (ssize_t n; (n = ::read(fd, buffer, sizeof(buffer))) > 0; )     received.append(buffer, n);
+                    ::close(fd);
+               }};
+
+               REQUIRE( registry.export_to_socket(path) );
+               reader.join();
+
+               ::close(listener);
+               ::unlink(path.c_str());
+
+               REQUIRE( received == registry.snapshot().prometheus() );
+          }
+     }
+
+
+     GIVEN("Threads which release their shards as they exit")
+     {
+          metrics_registry registry;
+
+          auto latency = registry.histogram("lex_seconds", "Time to lex a file");
+          auto tokens  = registry.counter("lex_tokens_total", "Tokens lexed");
+
+          for (int round = 0; round < 3; ++round)
+          {
+               std::vector<std::thread> threads;
+
+               for (int t = 0; t < 4; ++t)
+                    threads.emplace_back([&registry, latency, tokens] {
+                         scoped_shard shard {registry};
+                         shard->record(latency, std::uint64_t {500});
+                         shard->add(tokens, 25);
+                    });
+
+               for (auto& t : threads)     t.join();
+          }
+
+
+          THEN("their shards should be freed, and their totals kept.")
+          {
+               auto s = registry.snapshot();
+
+               REQUIRE( registry.live_shards() == 0 );
+               REQUIRE( s.counters[0].value == 300 );
+               REQUIRE( s.histograms[0].value.count() == 12 );
+               REQUIRE( s.histograms[0].value.max() == 500 );
+               REQUIRE_THROWS_AS( registry.counter("late_total", ""), std::logic_error );
+          }
+
+
+          THEN("exports to the same file from several threads should each replace it whole.")
+          {
+               std::string path = "/tmp/metrics-test-" + std::to_string(::getpid()) + "-shared.prom";
+               std::atomic<int> failures {0};
+               std::vector<std::thread> exporters;
+
+               for (int t = 0; t < 4; ++t)
+                    exporters.emplace_back([&] {
+                         for (int i = 0; i < 50; ++i)
+                              if (!registry.export_to_file(path))     ++failures;
+                    });
+
+               for (auto& t : exporters)     t.join();
+
+               std::ifstream file {path};
+               std::stringstream contents;
+               contents << file.rdbuf();
+
+               REQUIRE( failures == 0 );
+               REQUIRE( contents.str() == registry.snapshot().prometheus() );
+               std::remove(path.c_str());
+          }
+     }
+
+
+     GIVEN("A name which is not a valid metric name")
+     {
+          metrics_registry registry;
+
+          THEN("it should be rejected.")
+          {
+               REQUIRE_THROWS_AS( registry.histogram("lex-seconds", ""), std::invalid_argument );
+               REQUIRE_THROWS_AS( registry.counter("9lives", ""), std::invalid_argument );
+          }
+     }
+}
+
+
+SCENARIO("A metrics exporter should export periodically, and once more when stopped.")
+{
+     GIVEN("An exporter to a file")
+     {
+          metrics_registry registry;
+          auto latency = registry.histogram("parse_seconds", "Time to parse a file");
+          auto& shard  = registry.make_shard();
+
+          std::string path = "/tmp/metrics-exporter-test.prom";
+
+
+          THEN("the file should hold the samples recorded before it stopped.")
+          {
+               {
+                    metrics_exporter exporter {registry, path, std::chrono::milliseconds {1}};
+
+                    for (int i = 0; i < 3; ++i)
+                         scoped_timer timer {shard, latency};
+
+                    for (int wait = 0; wait < 1000 && exporter.exports() < 2; ++wait)
+                         std::this_thread::sleep_for(std::chrono::milliseconds {1});
+
+                    REQUIRE( exporter.exports() >= 2 );
+               }
+
+               std::ifstream file {path};
+               std::stringstream contents;
+               contents << file.rdbuf();
+
+               REQUIRE( contents.str().find("parse_seconds_count 3\n") != std::string::npos );
+               std::remove(path.c_str());
+          }
+     }
+}
@@ -0,0 +1,187 @@
+#include <random>
+#include <string>
+#include <string_view>
+
+#include "catch2/catch.hpp"
+#include "pattern/pattern-jit.h"
+
+
+using namespace Pattern;
+
+
+namespace {
+
+auto digit = simd::byte_class::from([] (char c) { return '0' <= c && c <= '9'; });
+
+
+// A pattern for numbers, double-quoted strings, and a few keywords sharing prefixes
+runtime_pattern make_token_pattern ()
+{
+     pattern_graph g;
+
+     auto d       = g.set(digit);
+     auto integer = g.sequence(d, g.many(d));
+     auto number  = g.sequence(integer, g.optional(g.sequence(g.literal("."), integer)));
+     auto string  = g.sequence({g.literal("\""), g.while_not(simd::byte_class::of("\"")), g.literal("\"")});
+     auto keyword = g.alternative({g.literal("function"), g.literal("fun"), g.literal("for")});
+
+     auto root    = g.alternative({number, string, keyword});
+
+     return {std::move(g), root};
+}
+
+
+std::string_view remaining (const scan_view& s)     { return {s.data(), static_cast<std::size_t>(s.size())}; }
+
+
+// A random subset of the bytes a to h, so that sets of more than four members also occur
+simd::byte_class random_class (std::mt19937& gen)
+{
+     unsigned members = gen() & 0xff;
+     return simd::byte_class::from([members] (char c) { return 'a' <= c && c <= 'h' && (members >> (c - 'a') & 1); });
+}
+
+
+pattern_graph::node_id random_node (pattern_graph& g, std::mt19937& gen, int depth)
+{
+     std::uniform_int_distribution<int> op {0, depth > 0 ? 6 : 2};
+     std::uniform_int_distribution<int> byte {'a', 'd'};
+
+     switch (op(gen))
+     {
+     case 0:
+     {
+          std::string lit(gen() % 10, ' ');
+          for (auto& c : lit)     c = static_cast<char>(byte(gen));
+          return g.literal(lit);
+     }
+     case 1:     return g.set(random_class(gen));
+     case 2:     return g.while_not(random_class(gen));
+     case 3:     return g.sequence(random_node(g, gen, depth - 1), random_node(g, gen, depth - 1));
+     case 4:     return g.alternative(random_node(g, gen, depth - 1), random_node(g, gen, depth - 1));
+     case 5:     return g.many(random_node(g, gen, depth - 1));
+     default:    return g.optional(random_node(g, gen, depth - 1));
+     }
+}
+
+} // namespace
+
+
+// =====================================================================================================================
+// runtime_pattern
+// =====================================================================================================================
+SCENARIO("A runtime pattern should scan like a pattern composed at compile time.")
+{
+     GIVEN("A pattern for numbers, strings, and keywords")
+     {
+          runtime_pattern p = make_token_pattern();
+
+
+          THEN("each alternative should be tried in order, and repetition should be greedy.")
+          {
+               scan_view s1 = "123.45x";
+               scan_view s2 = "12.x";
+               scan_view s3 = "\"a string\" x";
+               scan_view s4 = "functional";
+
+               REQUIRE( p(s1) );
+               REQUIRE( remaining(s1) == "x" );
+               REQUIRE( p(s2) );
+               REQUIRE( remaining(s2) == ".x" );
+               REQUIRE( p(s3) );
+               REQUIRE( remaining(s3) == " x" );
+               REQUIRE( p(s4) );
+               REQUIRE( remaining(s4) == "al" );
+          }
+
+
+          THEN("a failed scan should leave the cursor in place.")
+          {
+               scan_view s1 = "\"unterminated";
+               scan_view s2 = "fo";
+
+               REQUIRE_FALSE( p(s1) );
+               REQUIRE( remaining(s1) == "\"unterminated" );
+               REQUIRE_FALSE( p(s2) );
+               REQUIRE( remaining(s2) == "fo" );
+          }
+     }
+
+
+     GIVEN("A repetition of a pattern which can match nothing")
+     {
+          pattern_graph g;
+          auto root = g.many(g.optional(g.literal("a")));
+
+          runtime_pattern p {g, root};
+          scan_view s = "aab";
+
+
+          THEN("the repetition should stop rather than repeat forever.")
+          {
+               REQUIRE( p(s) );
+               REQUIRE( remaining(s) == "b" );
+          }
+     }
+}
+
+
+// =====================================================================================================================
+// jit_pattern
+// =====================================================================================================================
+SCENARIO("A compiled pattern should give the same results as the interpreter.")
+{
+     GIVEN("The pattern for numbers, strings, and keywords")
+     {
+          jit_pattern j {make_token_pattern()};
+
+#ifdef PATTERN_JIT_X86_64
+          REQUIRE( j.compiled() );
+#endif
+
+
+          THEN("every input should match to the same position.")
+          {
+               std::string long_string = "\"" + std::string(100, 'x') + "\" tail";
+               std::string_view inputs[] = {"123.45x", "12.", "\"a\"", "\"unterminated", "funx", "functional", "for", "fo",
+                                            "", long_string};
+
+               for (std::string_view in : inputs)
+               {
+                    const char* first = in.data();
+                    const char* last  = first + in.size();
+
+                    REQUIRE( j.match(first, last) == j.source().match(first, last) );
+               }
+          }
+     }
+
+
+     GIVEN("Randomly generated patterns and inputs")
+     {
+          std::mt19937 gen {7};
+          std::uniform_int_distribution<int> byte {'a', 'd'};
+
+
+          THEN("every pattern should match every input to the same position.")
+          {
+               for (int i = 0; i < 300; ++i)
+               {
+                    pattern_graph g;
+                    auto root = random_node(g, gen, 4);
+                    jit_pattern j {runtime_pattern {g, root}};
+
+                    for (int k = 0; k < 20; ++k)
+                    {
+                         std::string in(gen() % 40, ' ');
+                         for (auto& c : in)     c = static_cast<char>(byte(gen));
+
+                         const char* first = in.data();
+                         const char* last  = first + in.size();
+
+                         REQUIRE( j.match(first, last) == j.source().match(first, last) );
+                    }
+               }
+          }
+     }
+}
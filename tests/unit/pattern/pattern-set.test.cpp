@@ -0,0 +1,177 @@
+#include <random>
+#include <regex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "pattern/pattern-set.h"
+
+
+using namespace Pattern;
+
+
+namespace {
+
+using match_list = std::set<std::pair<pattern_set::pattern_id, std::size_t>>;
+
+
+match_list scan_all (pattern_set& set, std::string_view text)
+{
+     match_list matches;
+     set.scan(text, [&matches] (pattern_set::pattern_id id, std::size_t end) { matches.insert({id, end}); });
+     return matches;
+}
+
+
+// Every (id, end) such that some substring ending at end matches the regular expression of the pattern
+match_list scan_by_regex (const std::vector<std::regex>& expressions, const std::string& text)
+{
+     match_list matches;
+
+     for (pattern_set::pattern_id id = 0; id < expressions.size(); ++id)
+          for (std::size_t end = 0; end <= text.size(); ++end)
+               for (std::size_t start = 0; start <= end; ++start)
+                    if (std::regex_match(text.begin() + start, text.begin() + end, expressions[id]))
+                    {
+                         matches.insert({id, end});
+                         break;
+                    }
+
+     return matches;
+}
+
+
+runtime_pattern literal (std::string_view s)
+{
+     pattern_graph g;
+     auto root = g.literal(s);
+     return {std::move(g), root};
+}
+
+} // namespace
+
+
+// =====================================================================================================================
+// pattern_set
+// =====================================================================================================================
+SCENARIO("A pattern set should report every match of every pattern in one pass.")
+{
+     GIVEN("Patterns with the same meaning as some regular expressions")
+     {
+          auto digit = simd::byte_class::from([] (char c) { return '0' <= c && c <= '9'; });
+          auto quote = simd::byte_class::of("\"");
+
+          pattern_set set;
+          std::vector<std::regex> expressions;
+
+          {
+               pattern_graph g;
+               auto root = g.sequence(g.set(digit), g.many(g.set(digit)));
+               set.add({std::move(g), root});
+               expressions.emplace_back("[0-9][0-9]*");
+          }
+          {
+               pattern_graph g;
+               auto root = g.alternative(g.literal("ab"), g.literal("abc"));
+               set.add({std::move(g), root});
+               expressions.emplace_back("ab|abc");
+          }
+          {
+               pattern_graph g;
+               auto root = g.sequence({g.literal("\""), g.while_not(quote), g.literal("\"")});
+               set.add({std::move(g), root});
+               expressions.emplace_back("\"[^\"]*\"");
+          }
+          {
+               pattern_graph g;
+               auto root = g.sequence(g.literal("x"), g.many(g.sequence(g.literal("y"), g.optional(g.literal("z")))));
+               set.add({std::move(g), root});
+               expressions.emplace_back("x(yz?)*");
+          }
+
+
+          THEN("the matches should be those of the regular expressions.")
+          {
+               std::mt19937 gen {11};
+
+               for (int i = 0; i < 200; ++i)
+               {
+                    std::string text(gen() % 24, ' ');
+                    for (auto& c : text)     c = "abcxyz1\" "[gen() % 9];
+
+                    REQUIRE( scan_all(set, text) == scan_by_regex(expressions, text) );
+               }
+          }
+
+
+          THEN("the ids of the patterns matching anywhere should be listed in order.")
+          {
+               REQUIRE( set.matching("say \"hi\" 42") == std::vector<pattern_set::pattern_id> {0, 2} );
+               REQUIRE( set.matching("xyzy abc") == std::vector<pattern_set::pattern_id> {1, 3} );
+               REQUIRE( set.matching("nothing here").empty() );
+          }
+     }
+
+
+     GIVEN("Hundreds of literal patterns")
+     {
+          std::mt19937 gen {5};
+          std::vector<std::string> words;
+          pattern_set set;
+
+          for (int i = 0; i < 300; ++i)
+          {
+               std::string w(3 + gen() % 5, ' ');
+               for (auto& c : w)     c = static_cast<char>('a' + gen() % 6);
+
+               words.push_back(w);
+               set.add(literal(w));
+          }
+
+          std::string text(2000, ' ');
+          for (auto& c : text)     c = gen() % 4 == 0 ? ' ' : static_cast<char>('a' + gen() % 6);
+
+
+          THEN("each occurrence of each word should be reported where it ends.")
+          {
+               match_list expected;
+
+               for (pattern_set::pattern_id id = 0; id < words.size(); ++id)
+                    for (auto at = text.find(words[id]); at != std::string::npos; at = text.find(words[id], at + 1))
+                         expected.insert({id, at + words[id].size()});
+
+               REQUIRE( scan_all(set, text) == expected );
+          }
+
+
+          THEN("a small cache limit should give the same matches.")
+          {
+               pattern_set small {8};
+               for (const auto& w : words)     small.add(literal(w));
+
+               REQUIRE( scan_all(small, text) == scan_all(set, text) );
+               REQUIRE( small.cached_states() <= 8 );
+          }
+
+
+          THEN("a cache just large enough for every state should never be flushed.")
+          {
+               scan_all(set, text);
+
+               pattern_set exact {set.cached_states()};
+               for (const auto& w : words)     exact.add(literal(w));
+
+               REQUIRE( scan_all(exact, text) == scan_all(set, text) );
+               REQUIRE( exact.cached_states() == set.cached_states() );
+          }
+
+
+          THEN("a cache limit whose table entries would overflow should be rejected.")
+          {
+               REQUIRE_NOTHROW( pattern_set {pattern_set::max_state_limit} );
+               REQUIRE_THROWS_AS( pattern_set {pattern_set::max_state_limit + 1}, std::invalid_argument );
+          }
+     }
+}
@@ -0,0 +1,203 @@
+#include <cctype>
+#include <random>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "catch2/catch.hpp"
+#include "pattern/pointer-scanners.h"
+#include "pattern/scanning-algorithms.h"
+
+
+using namespace Pattern;
+using namespace std::literals;
+
+
+namespace {
+
+bool is_digit (char c)     { return '0' <= c && c <= '9'; }
+bool is_alpha (char c)     { return std::isalpha(static_cast<unsigned char>(c)); }
+
+
+// Length of the match at the start of s, or -1
+template <class F>
+long match (F f, std::string_view s)
+{
+     const char* p = f(s.data(), s.data() + s.size());
+     return p ? p - s.data() : -1;
+}
+
+} // namespace
+
+
+// =====================================================================================================================
+// Primitives and combinators
+// =====================================================================================================================
+SCENARIO("Pointer scanners should return the position after their match, or null.")
+{
+     GIVEN("A number made of primitives and combinators")
+     {
+          auto digits = ps::some(ps::one_if(fo::lift<is_digit>));
+          auto number = ps::seq(digits, ps::optional(ps::seq(ps::lit('.'), digits)));
+
+          THEN("it should match as much as it can.")
+          {
+               REQUIRE( match(number, "3.14 + x") == 4 );
+               REQUIRE( match(number, "42.") == 2 );
+               REQUIRE( match(number, "7") == 1 );
+               REQUIRE( match(number, ".5") == -1 );
+               REQUIRE( match(number, "") == -1 );
+          }
+
+          THEN("a composition should be empty if its parts are, and trivially copyable if they are.")
+          {
+               REQUIRE( std::is_empty_v<decltype(digits)> );
+               REQUIRE( std::is_trivially_copyable_v<decltype(number)> );
+          }
+     }
+
+
+     GIVEN("A choice between alternatives which share a prefix")
+     {
+          auto keyword = ps::any(ps::lit("while"sv), ps::lit("whale"sv), ps::lit("wh"sv));
+
+          THEN("each alternative should start where the choice did.")
+          {
+               REQUIRE( match(keyword, "whale song") == 5 );
+               REQUIRE( match(keyword, "whe") == 2 );
+               REQUIRE( match(keyword, "w") == -1 );
+          }
+     }
+
+
+     GIVEN("Repetitions, and a lookahead")
+     {
+          auto a = ps::lit('a');
+
+          THEN("they should match the counts they allow.")
+          {
+               REQUIRE( match(ps::many(a), "aaab") == 3 );
+               REQUIRE( match(ps::many(a), "b") == 0 );
+               REQUIRE( match(ps::some(a), "b") == -1 );
+               REQUIRE( match(ps::n_times(2, a), "aaa") == 2 );
+               REQUIRE( match(ps::n_times(2, a), "ab") == -1 );
+               REQUIRE( match(ps::repeat(1, 3, a), "aaaaa") == 3 );
+               REQUIRE( match(ps::seq(ps::many(ps::one), ps::eoi), "xyz") == 3 );
+
+               REQUIRE( match(ps::negate(a), "b") == 0 );
+               REQUIRE( match(ps::negate(a), "a") == -1 );
+          }
+
+          THEN("a repetition of a scanner which matches nothing should stop.")
+          {
+               REQUIRE( match(ps::many(ps::optional(a)), "aab") == 2 );
+               REQUIRE( match(ps::n_times(5, ps::optional(a)), "a") == 1 );
+          }
+
+          THEN("a repetition should stop once the scan budget is exhausted.")
+          {
+               std::string long_run(1000, 'a');
+               const char* first = long_run.data();
+
+               scan_budget budget {100};
+               auto result = fn::within_budget(budget, ps::to_boolean(ps::many(a)), first, first + long_run.size());
+
+               REQUIRE( result == scan_result::exhausted );
+               REQUIRE( first == long_run.data() );
+          }
+     }
+}
+
+
+// =====================================================================================================================
+// Adapters
+// =====================================================================================================================
+SCENARIO("Scanners should be adaptable between the two protocols.")
+{
+     GIVEN("Scanning algorithms and fn combinators, given the pointer protocol")
+     {
+          auto letter = ps::from_boolean(fn::bind_back(scan_if, fo::lift<is_alpha>));
+          auto word   = ps::from_boolean(fo::some(fn::bind_back(scan_if, fo::lift<is_alpha>)));
+          auto arrow  = ps::from_boolean(fn::bind_back(scan, "->"sv));
+
+          THEN("they should compose with pointer scanners.")
+          {
+               auto member = ps::seq(word, ps::any(ps::lit('.'), arrow), letter);
+
+               REQUIRE( match(member, "node->x + 1") == 7 );
+               REQUIRE( match(member, "node.y") == 6 );
+               REQUIRE( match(member, "node-y") == -1 );
+               REQUIRE( std::is_trivially_copyable_v<decltype(member)> );
+          }
+     }
+
+
+     GIVEN("A pointer scanner, given the protocol of the scanning algorithms")
+     {
+          auto number = ps::to_boolean(ps::some(ps::one_if(fo::lift<is_digit>)));
+
+          THEN("the iterator should advance only on success.")
+          {
+               std::string_view text = "123abc";
+               const char* first = text.data();
+
+               REQUIRE( number(first, text.data() + text.size()) );
+               REQUIRE( first == text.data() + 3 );
+               REQUIRE_FALSE( number(first, text.data() + text.size()) );
+               REQUIRE( first == text.data() + 3 );
+          }
+
+          THEN("it should be usable by the fn combinators, and scan a view.")
+          {
+               std::string_view text = "1 22 333 x";
+               const char* first = text.data();
+               auto blank = fn::bind_back(scan, ' ');
+
+               REQUIRE( fn::many(fo::any(number, blank), first, text.data() + text.size()) );
+               REQUIRE( *first == 'x' );
+
+               REQUIRE( number(text) );
+               REQUIRE( text == " 22 333 x" );
+          }
+
+          THEN("an empty view, whose data may be null, should be scanned as empty.")
+          {
+               std::string_view empty;
+               REQUIRE_FALSE( number(empty) );
+               REQUIRE( ps::to_boolean(ps::many(ps::one))(empty) );
+          }
+     }
+
+
+     GIVEN("Random text")
+     {
+          std::mt19937 gen {3};
+          std::string text;
+          for (int i = 0; i < 5000; ++i)     text += "ab1 .-"[gen() % 6];
+
+          auto ps_token = ps::any(ps::some(ps::one_if(fo::lift<is_alpha>)),
+                                  ps::seq(ps::some(ps::one_if(fo::lift<is_digit>)), ps::optional(ps::lit('.'))),
+                                  ps::lit("-."sv),
+                                  ps::one);
+
+          auto fo_token = fo::any(fo::some(fn::bind_back(scan_if, fo::lift<is_alpha>)),
+                                  fo::all(fo::some(fn::bind_back(scan_if, fo::lift<is_digit>)),
+                                          fo::optional(fn::bind_back(scan, '.'))),
+                                  fn::bind_back(scan, "-."sv),
+                                  fn::bind_back(scan_if, [] (char) { return true; }));
+
+          THEN("both protocols should split it into the same tokens.")
+          {
+               const char* p     = text.data();
+               const char* first = text.data();
+               const char* end   = text.data() + text.size();
+
+               while (p != end)
+               {
+                    p = ps_token(p, end);
+                    REQUIRE( fo_token(first, end) );
+                    REQUIRE( p == first );
+               }
+          }
+     }
+}
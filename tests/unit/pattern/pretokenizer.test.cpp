@@ -0,0 +1,198 @@
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "pattern/pretokenizer.h"
+
+
+using namespace Pattern;
+
+
+namespace {
+
+std::vector<std::string_view> pieces_of (std::string_view source)
+{
+     token_stream<piece_kind> pieces;
+     pretokenizer {}(source, pieces);
+
+     std::vector<std::string_view> result;
+     for (std::size_t i = 0; i < pieces.size(); ++i)     result.push_back(pieces.lexeme(i, source));
+
+     return result;
+}
+
+
+using pieces = std::vector<std::string_view>;
+
+} // namespace
+
+
+// =====================================================================================================================
+// pretokenizer
+// =====================================================================================================================
+SCENARIO("A pre-tokenizer should split text into pieces as GPT-2 does.")
+{
+     GIVEN("ASCII text")
+     {
+          THEN("words, numbers, and punctuation should take the single space before them.")
+          {
+               REQUIRE( pieces_of("Hello world, it's 2020!") ==
+                        pieces {"Hello", " world", ",", " it", "'s", " 2020", "!"} );
+          }
+
+
+          THEN("whitespace before other text should leave its last character to the piece after it.")
+          {
+               REQUIRE( pieces_of("a   b\n\nc  ") == pieces {"a", "  ", " b", "\n", "\n", "c", "  "} );
+          }
+
+
+          THEN("every contraction should be split from its word.")
+          {
+               REQUIRE( pieces_of("we're they've I'll I'm you'd don't") ==
+                        pieces {"we", "'re", " they", "'ve", " I", "'ll", " I", "'m", " you", "'d", " don", "'t"} );
+          }
+
+
+          THEN("runs of punctuation should form one piece.")
+          {
+               REQUIRE( pieces_of("x += (y);") == pieces {"x", " +=", " (", "y", ");"} );
+          }
+
+
+          THEN("each piece should be of its kind.")
+          {
+               std::string_view source = "Pi is 3.14 ";
+
+               token_stream<piece_kind> tokens;
+               pretokenizer {}(source, tokens);
+
+               REQUIRE( tokens.size() == 6 );
+               REQUIRE( tokens.tag(0) == piece_kind::word );
+               REQUIRE( tokens.tag(2) == piece_kind::number );
+               REQUIRE( tokens.tag(3) == piece_kind::punctuation );
+               REQUIRE( tokens.tag(5) == piece_kind::whitespace );
+          }
+     }
+
+
+     GIVEN("UTF-8 text")
+     {
+          THEN("letters of every script should form words.")
+          {
+               REQUIRE( pieces_of("naïve café Ωμέγα 日本語") == pieces {"naïve", " café", " Ωμέγα", " 日本語"} );
+          }
+
+
+          THEN("non-ASCII punctuation, digits, and spaces should be classified as such.")
+          {
+               REQUIRE( pieces_of("«oui» — ١٢٣ x") == pieces {"«", "oui", "»", " —", " ١٢٣", " ", "x"} );
+          }
+
+
+          THEN("invalid bytes should each be punctuation.")
+          {
+               REQUIRE( pieces_of("a\xff\xc3(b") == pieces {"a", "\xff\xc3(", "b"} );
+          }
+     }
+}
+
+
+SCENARIO("A pre-tokenizer should find the pieces of blocks by their masks as it does one character at a time.")
+{
+     GIVEN("Random texts, mostly of ASCII")
+     {
+          const char* alphabet[] = {"a", "Z", "7", " ", "  ", "\n", ",", "(", "\t", "'", "s", "é", "\xc2\xa0"};
+
+          THEN("the pieces should be those matched by match_piece.")
+          {
+               std::size_t mismatches = 0;
+
+               for (unsigned seed = 0; seed < 200; ++seed)
+               {
+                    std::mt19937 gen {seed};
+                    std::size_t letters = seed % 4 == 0 ? std::size(alphabet) : 9;     // most without special bytes
+                    bool        sparse  = seed % 4 == 1;                              // or with a few in each block
+
+                    std::string source;
+                    for (std::size_t i = 0, n = gen() % 2000; i < n; ++i)
+                         source += alphabet[sparse && gen() % 64 == 0 ? 9 + gen() % 4 : gen() % letters];
+
+                    token_stream<piece_kind> pieces;
+                    pretokenizer {}(source, pieces);
+
+                    const char* p    = source.data();
+                    const char* last = p + source.size();
+                    std::size_t i    = 0;
+
+                    for (; p != last && i < pieces.size(); ++i)
+                    {
+                         auto next = detail::match_piece(p, last);
+
+                         if (pieces.offset(i) != p - source.data() || pieces.length(i) != next.end - p ||
+                             pieces.tag(i) != next.kind)
+                              ++mismatches;
+
+                         p = next.end;
+                    }
+
+                    if (p != last || i != pieces.size())     ++mismatches;
+               }
+
+               REQUIRE( mismatches == 0 );
+          }
+     }
+}
+
+
+SCENARIO("A pre-tokenizer should split a large text in parallel chunks, as it would all at once.")
+{
+     GIVEN("A random text of several lines")
+     {
+          std::mt19937 gen {11};
+          const char* alphabet[] = {"a", "Z", "7", " ", " ", "\n", ",", "'", "s", "é", "\t", "—"};
+
+          std::string source;
+          for (int i = 0; i < 200000; ++i)     source += alphabet[gen() % std::size(alphabet)];
+
+          token_stream<piece_kind> whole;
+          pretokenizer {}(source, whole);
+
+          std::vector<piece_chunk> chunks;
+
+
+          THEN("the pieces of the chunks should be those of the whole text.")
+          {
+               for (int round = 0; round < 2; ++round)     // the second reuses the chunks
+               {
+                    pretokenizer {}.split(source, chunks, 4, 4096);
+
+                    REQUIRE( chunks.size() > 10 );
+
+                    std::size_t i = 0, mismatches = 0;
+
+                    for (auto& chunk : chunks)
+                         for (std::size_t j = 0; j < chunk.pieces.size(); ++j, ++i)
+                              if (whole.tag(i) != chunk.pieces.tag(j) ||
+                                  whole.offset(i) != chunk.base + chunk.pieces.offset(j) ||
+                                  whole.length(i) != chunk.pieces.length(j))
+                                   ++mismatches;
+
+                    REQUIRE( i == whole.size() );
+                    REQUIRE( mismatches == 0 );
+               }
+          }
+
+
+          THEN("a text without line breaks should remain one chunk.")
+          {
+               std::string line(100000, 'x');
+               pretokenizer {}.split(line, chunks, 4, 4096);
+
+               REQUIRE( chunks.size() == 1 );
+               REQUIRE( chunks[0].pieces.size() == 1 );
+          }
+     }
+}
@@ -0,0 +1,121 @@
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "pattern/push-scanner.h"
+
+
+using namespace Pattern;
+
+
+namespace {
+
+struct token_record
+{
+     push_token_kind kind;
+     std::uint64_t   position;
+     std::uint64_t   span;
+     double          value;
+
+     bool operator== (const token_record&) const = default;
+};
+
+
+std::vector<token_record> scan_in_fragments (std::string_view source, std::size_t fragment_size)
+{
+     std::vector<token_record> tokens;
+     auto sink = [&tokens] (const push_token& t) { tokens.push_back({t.kind, t.position, t.span, t.value}); };
+
+     push_scanner scanner;
+
+     for (std::size_t i = 0; i < source.size(); i += fragment_size)
+          scanner.feed(source.substr(i, fragment_size), sink);
+
+     scanner.finish(sink);
+     return tokens;
+}
+
+} // namespace
+
+
+// =====================================================================================================================
+// push_scanner
+// =====================================================================================================================
+SCENARIO("A push scanner should be a small, trivially copyable object.")
+{
+     REQUIRE( std::is_trivially_copyable_v<push_scanner> );
+     REQUIRE( sizeof(push_scanner) <= 32 );
+}
+
+
+SCENARIO("A push scanner should recognize each kind of token.")
+{
+     GIVEN("A source containing every kind of token")
+     {
+          std::string_view source = "var x_1 = 12.5; // comment\n\"a\\\"b\" 7. #";
+
+
+          WHEN("it is fed in a single fragment")
+          {
+               auto tokens = scan_in_fragments(source, source.size());
+
+
+               THEN("the tokens should be reported in order, with positions in the stream.")
+               {
+                    using enum push_token_kind;
+
+                    std::vector<token_record> expected {
+                         {identifier,  0, 3, 0},
+                         {identifier,  4, 3, 0},
+                         {symbol,      8, 1, 0},
+                         {number,     10, 4, 12.5},
+                         {symbol,     14, 1, 0},
+                         {string,     27, 6, 0},
+                         {number,     34, 1, 7},
+                         {symbol,     35, 1, 0},
+                         {symbol,     37, 1, 0}
+                    };
+
+                    REQUIRE( tokens == expected );
+               }
+          }
+     }
+}
+
+
+SCENARIO("A push scanner should produce the same tokens however its input is fragmented.")
+{
+     GIVEN("A source with tokens that will be split across fragments")
+     {
+          std::string_view source = "print 3.14159 / 2; // half of \"pi\"\n"
+                                    "var s = \"escaped \\\\ and \\\" quotes\";\n"
+                                    "x = 123456789012345678901234.5 + .5 - 9.;";
+
+          auto whole = scan_in_fragments(source, source.size());
+
+
+          THEN("feeding it in fragments of any size should give the same tokens.")
+          {
+               for (std::size_t size = 1; size < 16; ++size)
+                    REQUIRE( scan_in_fragments(source, size) == whole );
+          }
+     }
+
+
+     GIVEN("A source ending inside a string")
+     {
+          std::string_view source = "ok \"unterminated";
+
+
+          THEN("finishing the stream should report an error for the string.")
+          {
+               auto tokens = scan_in_fragments(source, 4);
+
+               REQUIRE( tokens.size() == 2 );
+               REQUIRE( tokens[1].kind == push_token_kind::error );
+               REQUIRE( tokens[1].position == 3 );
+               REQUIRE( tokens[1].span == 13 );
+          }
+     }
+}
@@ -0,0 +1,201 @@
+#include <iterator>       // std::istreambuf_iterator
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "catch2/catch.hpp"
+#include "pattern/fn-combinators.h"
+#include "pattern/scanning-algorithms.h"
+#include "pattern/scouting-iterator.h"
+
+
+using namespace Pattern;
+using namespace std::literals;
+
+
+namespace {
+
+using stream_input = speculative_input<std::istreambuf_iterator<char>, std::istreambuf_iterator<char>>;
+
+static_assert(std::forward_iterator<stream_input::iterator>);
+static_assert(std::sentinel_for<std::default_sentinel_t, stream_input::iterator>);
+
+
+bool is_alpha (char c)     { return 'a' <= c && c <= 'z'; }
+
+} // namespace
+
+
+// =====================================================================================================================
+// speculative_input
+// =====================================================================================================================
+SCENARIO("A speculative input should let single-pass input be scanned with backtracking.")
+{
+     GIVEN("A stream of keywords which share prefixes")
+     {
+          std::istringstream stream {"whale while when wh"};
+          stream_input input {std::istreambuf_iterator<char> {stream}, {}};
+
+          auto first = input.begin();
+          auto last  = input.end();
+
+          // Each alternative is tried from the same position
+          auto keyword = [&] {
+               for (auto k : {"while"sv, "whale"sv, "when"sv})
+                    if (input.speculate(first, [k] (auto& i, auto end) { return scan(i, end, k); }))
+                         return std::string {k};
+
+               return std::string {};
+          };
+
+          THEN("a failed alternative should leave the position where it was.")
+          {
+               REQUIRE( keyword() == "whale" );
+               REQUIRE( scan(first, last, ' ') );
+               REQUIRE( keyword() == "while" );
+               REQUIRE( scan(first, last, ' ') );
+               REQUIRE( keyword() == "when" );
+               REQUIRE( scan(first, last, ' ') );
+               REQUIRE( keyword().empty() );
+
+               REQUIRE( first.offset() == 17 );
+               REQUIRE( *first == 'w' );
+               REQUIRE( input.speculating() == 0 );
+          }
+     }
+
+
+     GIVEN("Nested speculations")
+     {
+          std::istringstream stream {"abcdefgh"};
+          stream_input input {std::istreambuf_iterator<char> {stream}, {}};
+
+          auto first = input.begin();
+          auto last  = input.end();
+          auto letters = fo::many(fn::bind_back(scan_if, fo::lift<is_alpha>));
+
+          THEN("rolling back the outer one should replay what the inner one committed.")
+          {
+               input.mark(first);
+               REQUIRE( fn::n_times(2, fn::bind_back(scan_if, fo::lift<is_alpha>), first, last) );
+
+               input.mark(first);
+               REQUIRE( fn::n_times(3, fn::bind_back(scan_if, fo::lift<is_alpha>), first, last) );
+               input.commit(first);
+
+               REQUIRE( *first == 'f' );
+               REQUIRE( input.buffered() == 6 );
+
+               first = input.rollback();
+
+               REQUIRE( *first == 'a' );
+               REQUIRE( letters(first, last) );
+               REQUIRE( first == last );
+          }
+     }
+
+
+     GIVEN("A long stream, scanned a word at a time")
+     {
+          std::string text;
+          for (int i = 0; i < 20000; ++i)     text += i % 3 ? "ab " : "abcde ";
+
+          std::istringstream stream {text};
+          stream_input input {std::istreambuf_iterator<char> {stream}, {}};
+
+          auto first = input.begin();
+          auto last  = input.end();
+          auto word  = fo::some(fn::bind_back(scan_if, fo::lift<is_alpha>));
+          auto blank = fn::bind_back(scan, ' ');
+
+          THEN("the buffer should grow only as large as the deepest speculation.")
+          {
+               std::size_t words = 0;
+
+               // Reads a word, then fails
+               auto lookahead = [&] (auto& i, auto end) { word(i, end); return false; };
+
+               while (first != last)
+               {
+                    REQUIRE_FALSE( input.speculate(first, lookahead) );
+                    REQUIRE( input.speculate(first, [&] (auto& i, auto end) { return word(i, end); }) );
+                    REQUIRE( blank(first, last) );
+                    ++words;
+               }
+
+               REQUIRE( words == 20000 );
+               REQUIRE( input.peak() <= 7 );
+          }
+     }
+
+
+     GIVEN("An input read past a position held by a copy")
+     {
+          std::istringstream stream {"xyz"};
+          stream_input input {std::istreambuf_iterator<char> {stream}, {}};
+
+          auto first = input.begin();
+
+          THEN("the position should stay readable until the copy moves on.")
+          {
+               auto copy = first;
+
+               REQUIRE( *first == 'x' );
+               REQUIRE( *++first == 'y' );
+               REQUIRE( *++first == 'z' );
+
+               REQUIRE( *copy == 'x' );
+               REQUIRE( input.buffered() == 3 );
+
+               copy = first;
+               REQUIRE( input.buffered() == 1 );
+          }
+     }
+
+
+     GIVEN("Alternatives which share a prefix, tried without a mark")
+     {
+          std::istringstream stream {"whale while"};
+          stream_input input {std::istreambuf_iterator<char> {stream}, {}};
+
+          auto first = input.begin();
+          auto last  = input.end();
+
+          auto keyword = fo::any(fn::bind_back(scan, "while"sv), fn::bind_back(scan, "whale"sv));
+          auto blank   = fo::optional(fn::bind_back(scan, ' '));
+          auto wharf   = fo::optional(fn::bind_back(scan, "wharf"sv));
+
+          THEN("plain fo::any and fo::optional should scan each alternative from the same position.")
+          {
+               REQUIRE( wharf(first, last) );
+               REQUIRE( first.offset() == 0 );
+
+               REQUIRE( keyword(first, last) );
+               REQUIRE( blank(first, last) );
+               REQUIRE( keyword(first, last) );
+               REQUIRE( blank(first, last) );
+               REQUIRE( first == last );
+               REQUIRE( input.buffered() <= 1 );
+          }
+     }
+
+
+     GIVEN("A scan without a mark which fails one element past its start")
+     {
+          std::istringstream stream {"acd"};
+          stream_input input {std::istreambuf_iterator<char> {stream}, {}};
+
+          auto first = input.begin();
+          auto last  = input.end();
+
+          THEN("it should be retried from the same position.")
+          {
+               REQUIRE_FALSE( scan(first, last, "ab"sv) );
+               REQUIRE( first.offset() == 0 );
+               REQUIRE( scan(first, last, "ac"sv) );
+               REQUIRE( *first == 'd' );
+               REQUIRE( input.buffered() <= 2 );
+          }
+     }
+}
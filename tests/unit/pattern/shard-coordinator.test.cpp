@@ -0,0 +1,387 @@
+#include <cctype>
+#include <chrono>
+#include <cstdio>          // std::remove
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "catch2/catch.hpp"
+#include "pattern/shard-coordinator.h"
+
+
+using namespace Pattern;
+using namespace std::chrono_literals;
+
+
+namespace {
+
+enum class tag : std::uint8_t { word, number, symbol };
+
+
+// Words, numbers, and single symbols, separated by spaces. A faulty lexer misbehaves on its first call in a process,
+// or, if poisoned, on any source which begins with "poison".
+struct word_lexer
+{
+     enum fault { none, crash, stall, poison } fault = none;
+     int calls = 0;
+
+     void operator() (std::string_view source, token_stream<tag>& tokens)
+     {
+          if (calls++ == 0 && fault == crash)                      ::_exit(3);
+          if (calls   == 1 && fault == stall)                      std::this_thread::sleep_for(2s);
+          if (fault == poison && source.starts_with("poison"))     ::_exit(3);
+
+          for (std::size_t i = 0; i < source.size(); )
+          {
+               std::size_t start = i;
+               unsigned char c = source[i];
+
+               if (std::isspace(c))     { ++i; continue; }
+
+               tag t = std::isalpha(c) ? tag::word : std::isdigit(c) ? tag::number : tag::symbol;
+
+               if (t == tag::symbol)     ++i;
+               else
+                    while (i < source.size() && std::isalnum(static_cast<unsigned char>(source[i])))     ++i;
+
+               tokens.push_back(t, static_cast<std::uint32_t>(start), static_cast<std::uint32_t>(i - start));
+          }
+     }
+};
+
+
+std::string socket_path ()
+{
+     return "/tmp/shard-coordinator-test-" + std::to_string(::getpid()) + ".sock";
+}
+
+
+// Files of varied sizes, with one missing
+struct test_corpus
+{
+     std::filesystem::path    directory = "/tmp/shard-coordinator-test-" + std::to_string(::getpid());
+     std::vector<std::string> paths;
+     std::vector<std::string> sources;
+
+     explicit test_corpus (int files)
+     {
+          std::filesystem::create_directories(directory);
+
+          for (int f = 0; f < files; ++f)
+          {
+               std::string source;
+               for (int i = 0; i < (f * 37) % 500 + 1; ++i)
+                    source += "x" + std::to_string(i * f) + " = (" + std::to_string(f) + ");\n";
+
+               paths.push_back((directory / ("file-" + std::to_string(f) + ".txt")).string());
+               sources.push_back(source);
+               std::ofstream {paths.back()} << source;
+          }
+
+          paths.push_back((directory / "missing.txt").string());
+          sources.push_back("");
+     }
+
+     ~test_corpus ()     { std::filesystem::remove_all(directory); }
+};
+
+
+void wait_for (const std::vector<pid_t>& workers)
+{
+     for (pid_t pid : workers)     ::waitpid(pid, nullptr, 0);
+}
+
+
+void require_complete (const corpus_report& report, const test_corpus& corpus)
+{
+     std::uint64_t tokens = 0;
+     std::array<std::uint64_t, 256> tag_counts {};
+
+     for (std::size_t f = 0; f + 1 < corpus.sources.size(); ++f)
+     {
+          token_stream<tag> expected;
+          word_lexer {}(corpus.sources[f], expected);
+
+          REQUIRE( report.files[f].status == file_status::ok );
+          REQUIRE( report.files[f].tokens == expected.size() );
+
+          tokens += expected.size();
+          for (std::size_t t = 0; t < expected.size(); ++t)     ++tag_counts[static_cast<int>(expected.tag(t))];
+     }
+
+     REQUIRE( report.files.back().status == file_status::unreadable );
+     REQUIRE( report.failed_files == 1 );
+     REQUIRE( report.tokens == tokens );
+     REQUIRE( report.tag_counts == tag_counts );
+}
+
+} // namespace
+
+
+// =====================================================================================================================
+// make_shards
+// =====================================================================================================================
+SCENARIO("A corpus should be split into shards of about equal size, largest files first.")
+{
+     std::vector<corpus_file> corpus = {{"a", 10}, {"b", 500}, {"c", 40}, {"d", 60}, {"e", 100}, {"f", 30}};
+
+     auto shards = make_shards(corpus, 100);
+
+     REQUIRE( shards.size() == 4 );
+     REQUIRE( shards[0].files == std::vector<std::uint32_t> {1} );
+     REQUIRE( shards[1].files == std::vector<std::uint32_t> {4} );
+     REQUIRE( shards[2].files == std::vector<std::uint32_t> {3, 2} );
+     REQUIRE( shards[3].files == std::vector<std::uint32_t> {5, 0} );
+     REQUIRE( shards[3].bytes == 40 );
+
+     REQUIRE( make_shards({}, 100).empty() );
+}
+
+
+// =====================================================================================================================
+// shard_coordinator, shard_worker
+// =====================================================================================================================
+SCENARIO("A coordinator should collect the results of every shard from its workers.")
+{
+     test_corpus files {40};
+     auto corpus = list_corpus(files.paths);
+     auto shards = make_shards(corpus, 4096);
+
+     REQUIRE( corpus.back().size == 0 );
+     REQUIRE( shards.size() > 8 );
+
+
+     GIVEN("Three workers")
+     {
+          std::vector<pid_t> workers;
+          {
+               shard_coordinator coordinator {socket_path()};
+               for (int i = 0; i < 3; ++i)     workers.push_back(spawn_shard_worker<tag>(socket_path(), word_lexer {}));
+
+               REQUIRE( coordinator.await_workers(3, 10s) );
+
+               THEN("the report should match lexing in process, and the workers should serve further corpora.")
+               {
+                    auto report = coordinator.run(corpus, shards);
+
+                    require_complete(report, files);
+                    REQUIRE( report.shards == shards.size() );
+                    REQUIRE( report.reassigned == 0 );
+                    REQUIRE( report.workers_lost == 0 );
+
+                    std::uint64_t bytes = 0;
+                    for (auto& f : corpus)     bytes += f.size;
+                    REQUIRE( report.bytes == bytes );
+
+                    auto again = coordinator.run(corpus, make_shards(corpus, 1 << 20));
+                    require_complete(again, files);
+                    REQUIRE( again.shards == 1 );
+               }
+          }
+
+          wait_for(workers);
+     }
+
+
+     GIVEN("A worker which crashes on its first shard")
+     {
+          std::vector<pid_t> workers;
+          {
+               shard_coordinator coordinator {socket_path()};
+               workers.push_back(spawn_shard_worker<tag>(socket_path(), word_lexer {word_lexer::crash}));
+               workers.push_back(spawn_shard_worker<tag>(socket_path(), word_lexer {}));
+
+               REQUIRE( coordinator.await_workers(2, 10s) );
+
+               THEN("its shard should be reassigned to the other worker.")
+               {
+                    auto report = coordinator.run(corpus, shards);
+
+                    require_complete(report, files);
+                    REQUIRE( report.workers_lost == 1 );
+                    REQUIRE( report.reassigned == 1 );
+                    REQUIRE( coordinator.workers() == 1 );
+               }
+          }
+
+          wait_for(workers);
+     }
+
+
+     GIVEN("A worker which stalls on its first shard")
+     {
+          std::vector<pid_t> workers;
+          {
+               shard_coordinator coordinator {socket_path()};
+               workers.push_back(spawn_shard_worker<tag>(socket_path(), word_lexer {word_lexer::stall}));
+               workers.push_back(spawn_shard_worker<tag>(socket_path(), word_lexer {}));
+
+               REQUIRE( coordinator.await_workers(2, 10s) );
+
+               THEN("its shard should be copied to the other worker, which finishes first.")
+               {
+                    coordinator_options options;
+                    options.straggler_floor = 50ms;
+
+                    auto report = coordinator.run(corpus, shards, options);
+
+                    require_complete(report, files);
+                    REQUIRE( report.backups == 1 );
+                    REQUIRE( report.elapsed < 2s );
+               }
+          }
+
+          wait_for(workers);
+     }
+
+
+     GIVEN("A worker which stalls past the shard timeout")
+     {
+          std::vector<pid_t> workers;
+          {
+               shard_coordinator coordinator {socket_path()};
+               workers.push_back(spawn_shard_worker<tag>(socket_path(), word_lexer {word_lexer::stall}));
+
+               REQUIRE( coordinator.await_workers(1, 10s) );
+
+               THEN("it should be dropped, and the coordinator should fail once no worker is left.")
+               {
+                    coordinator_options options;
+                    options.shard_timeout = 200ms;
+                    options.worker_wait   = 200ms;
+
+                    REQUIRE_THROWS_AS( coordinator.run(corpus, shards, options), std::runtime_error );
+                    REQUIRE( coordinator.workers() == 0 );
+               }
+          }
+
+          wait_for(workers);
+     }
+
+
+     GIVEN("A file which crashes every worker given it")
+     {
+          std::string poison_path = (files.directory / "poison.txt").string();
+          std::ofstream {poison_path} << "poison = 1;\n";
+
+          std::vector<corpus_file> poisoned = corpus;
+          poisoned.push_back({poison_path, 12});
+
+          auto poisoned_shards = shards;
+          poisoned_shards.push_back({{static_cast<std::uint32_t>(poisoned.size() - 1)}, 12});
+
+          std::vector<pid_t> workers;
+          {
+               shard_coordinator coordinator {socket_path()};
+               for (int i = 0; i < 3; ++i)
+                    workers.push_back(spawn_shard_worker<tag>(socket_path(), word_lexer {word_lexer::poison}));
+
+               REQUIRE( coordinator.await_workers(3, 10s) );
+
+               THEN("its shard should be given up after losing the workers allowed, and the rest completed.")
+               {
+                    coordinator_options options;
+                    options.max_attempts = 2;
+
+                    auto report = coordinator.run(poisoned, poisoned_shards, options);
+
+                    REQUIRE( report.files.back().status == file_status::abandoned );
+                    REQUIRE( report.files[0].status == file_status::ok );
+                    REQUIRE( report.failed_files == 2 );
+                    REQUIRE( report.abandoned == 1 );
+                    REQUIRE( report.reassigned == 1 );
+                    REQUIRE( report.workers_lost == 2 );
+                    REQUIRE( coordinator.workers() == 1 );
+               }
+          }
+
+          wait_for(workers);
+     }
+
+
+     GIVEN("An adopted listening socket which blocks")
+     {
+          std::string path = socket_path();
+          ::unlink(path.c_str());
+
+          sockaddr_un address {};
+          address.sun_family = AF_UNIX;
+          path.copy(address.sun_path, sizeof(address.sun_path) - 1);
+
+          int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+          REQUIRE( ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 );
+          REQUIRE( ::listen(listener, 8) == 0 );
+
+          std::vector<pid_t> workers;
+          {
+               shard_coordinator coordinator {listener};
+               for (int i = 0; i < 2; ++i)     workers.push_back(spawn_shard_worker<tag>(path, word_lexer {}));
+
+               THEN("accepting workers should not block the coordinator.")
+               {
+                    REQUIRE( coordinator.await_workers(2, 10s) );
+                    require_complete(coordinator.run(corpus, shards), files);
+               }
+          }
+
+          wait_for(workers);
+          ::unlink(path.c_str());
+     }
+
+
+     GIVEN("A connection which does not speak the protocol")
+     {
+          std::vector<pid_t> workers;
+          {
+               shard_coordinator coordinator {socket_path()};
+
+               int stranger = detail::connect_unix(socket_path(), "connect");
+               std::string_view garbage = "GET / HTTP/1.1\r\n\r\n";
+               REQUIRE( ::write(stranger, garbage.data(), garbage.size()) == static_cast<ssize_t>(garbage.size()) );
+
+               workers.push_back(spawn_shard_worker<tag>(socket_path(), word_lexer {}));
+               REQUIRE( coordinator.await_workers(1, 10s) );
+
+               THEN("it should be closed without disturbing the workers.")
+               {
+                    auto report = coordinator.run(corpus, shards);
+
+                    require_complete(report, files);
+                    REQUIRE( report.workers_lost == 0 );
+
+                    char byte;
+                    REQUIRE( ::read(stranger, &byte, 1) == 0 );
+               }
+
+               ::close(stranger);
+          }
+
+          wait_for(workers);
+     }
+
+
+     GIVEN("A connection which never says hello, and no workers")
+     {
+          shard_coordinator coordinator {socket_path()};
+          int silent = detail::connect_unix(socket_path(), "connect");
+
+          THEN("the coordinator should fail for want of workers.")
+          {
+               coordinator_options options;
+               options.worker_wait = 200ms;
+
+               REQUIRE_THROWS_AS( coordinator.run(corpus, shards, options), std::runtime_error );
+               REQUIRE( coordinator.workers() == 0 );
+          }
+
+          ::close(silent);
+     }
+}
@@ -0,0 +1,157 @@
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "pattern/shuffle-dfa.h"
+
+
+using namespace Pattern;
+
+
+namespace {
+
+// digits ('.' digits)?
+shuffle_dfa make_number_dfa ()
+{
+     enum : shuffle_dfa::state { start, integer, dot, fraction, reject };
+
+     return {5, start, 1 << integer | 1 << fraction, [] (shuffle_dfa::state s, unsigned char c) -> int
+     {
+          bool digit = '0' <= c && c <= '9';
+
+          switch (s)
+          {
+          case start:        return digit ? integer : reject;
+          case integer:      return digit ? integer : c == '.' ? dot : reject;
+          case dot:          return digit ? fraction : reject;
+          case fraction:     return digit ? fraction : reject;
+          default:           return reject;
+          }
+     }};
+}
+
+
+// Tracks whether a C-style block comment is open
+shuffle_dfa make_comment_dfa ()
+{
+     enum : shuffle_dfa::state { code, slash, comment, star };
+
+     return {4, code, 1 << code | 1 << slash, [] (shuffle_dfa::state s, unsigned char c) -> int
+     {
+          switch (s)
+          {
+          case code:        return c == '/' ? slash : code;
+          case slash:       return c == '*' ? comment : c == '/' ? slash : code;
+          case comment:     return c == '*' ? star : comment;
+          default:          return c == '/' ? code : c == '*' ? star : comment;
+          }
+     }};
+}
+
+} // namespace
+
+
+// =====================================================================================================================
+// shuffle_dfa
+// =====================================================================================================================
+SCENARIO("A shuffle DFA should accept the same strings as its transition function.")
+{
+     GIVEN("An automaton for numbers")
+     {
+          auto number = make_number_dfa();
+
+
+          THEN("bytes with the same transitions should share a class.")
+          {
+               REQUIRE( number.byte_classes() == 3 );
+          }
+
+
+          THEN("it should accept integers and decimals, and nothing else.")
+          {
+               REQUIRE( number.matches("0") );
+               REQUIRE( number.matches("123.456") );
+               REQUIRE( number.matches(std::string(1000, '7') + "." + std::string(1000, '1')) );
+               REQUIRE_FALSE( number.matches("") );
+               REQUIRE_FALSE( number.matches("12.") );
+               REQUIRE_FALSE( number.matches(".5") );
+               REQUIRE_FALSE( number.matches(std::string(1000, '7') + "x") );
+          }
+     }
+
+
+     GIVEN("More than 16 states, or a transition to an unknown state")
+     {
+          auto to_self  = [] (shuffle_dfa::state s, unsigned char) { return s; };
+          auto too_high = [] (shuffle_dfa::state, unsigned char) { return 3; };
+
+
+          THEN("construction should fail.")
+          {
+               REQUIRE_THROWS_AS( (shuffle_dfa {17, 0, 0, to_self}), std::invalid_argument );
+               REQUIRE_THROWS_AS( (shuffle_dfa {3, 0, 0, too_high}), std::invalid_argument );
+          }
+     }
+}
+
+
+SCENARIO("Composing transitions should reach the same state as running one byte at a time.")
+{
+     GIVEN("An automaton for block comments, and random text")
+     {
+          auto comments = make_comment_dfa();
+
+          std::mt19937 gen {3};
+          std::string text(5000, ' ');
+          for (auto& c : text)     c = "ab/* \n"[gen() % 6];
+
+
+          THEN("every prefix length and starting state should agree.")
+          {
+               for (std::size_t size : {0, 1, 7, 63, 64, 65, 100, 127, 1000, 4999, 5000})
+               {
+                    const char* first = text.data();
+                    const char* last  = first + size;
+
+                    for (shuffle_dfa::state s = 0; s < comments.states(); ++s)
+                         REQUIRE( comments.run(first, last, s) == comments.run_serial(first, last, s) );
+               }
+          }
+
+
+          THEN("the portable kernel should agree with the one selected for the host.")
+          {
+               auto portable = detail::select_compose_dfa(simd::isa::scalar);
+               auto host     = detail::select_compose_dfa(simd::detect());
+
+               const char* first = text.data();
+               const char* last  = first + text.size();
+
+               // The kernels read the transitions of each byte; build them from the public interface
+               std::vector<shuffle_dfa::transition_map> by_byte(256);
+               for (int b = 0; b < 256; ++b)
+                    for (shuffle_dfa::state s = 0; s < 16; ++s)
+                         by_byte[b][s] = s < comments.states() ? comments.next(s, static_cast<char>(b)) : s;
+
+               REQUIRE( portable(by_byte.data(), first, last) == host(by_byte.data(), first, last) );
+               REQUIRE( portable(by_byte.data(), first, last)[comments.start()] ==
+                        comments.run_serial(first, last, comments.start()) );
+          }
+
+
+          THEN("the functions of adjacent chunks should compose into the function of both.")
+          {
+               const char* first = text.data();
+               const char* mid   = first + 2345;
+               const char* last  = first + text.size();
+
+               auto whole = comments.compose(first, last);
+               auto parts = shuffle_dfa::then(comments.compose(first, mid), comments.compose(mid, last));
+
+               for (shuffle_dfa::state s = 0; s < comments.states(); ++s)
+                    REQUIRE( whole[s] == parts[s] );
+          }
+     }
+}
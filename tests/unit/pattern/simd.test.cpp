@@ -0,0 +1,147 @@
+#include <algorithm>      // std::count, std::find_if
+#include <random>
+#include <string>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "pattern/simd.h"
+
+
+using namespace Pattern;
+
+
+namespace {
+
+std::vector<simd::isa> supported_isas ()
+{
+     std::vector<simd::isa> isas {simd::isa::scalar};
+
+     for (auto level : {simd::isa::sse, simd::isa::avx2, simd::isa::avx512})
+          if (level <= simd::detect())     isas.push_back(level);
+
+     return isas;
+}
+
+
+std::string random_text (std::size_t size, unsigned seed)
+{
+     std::mt19937 gen {seed};
+     std::uniform_int_distribution<int> byte {0, 255};
+     std::uniform_int_distribution<int> ascii {' ', '~'};
+
+     std::string s(size, ' ');
+     for (auto& c : s)     c = static_cast<char>(gen() % 8 == 0 ? byte(gen) : ascii(gen));
+
+     return s;
+}
+
+} // namespace
+
+
+// =====================================================================================================================
+// Byte classes
+// =====================================================================================================================
+SCENARIO("A byte class should contain exactly the bytes it was built from.")
+{
+     auto digits = simd::byte_class::from([] (char c) { return '0' <= c && c <= '9'; });
+     auto quotes = simd::byte_class::of("\"'`");
+
+     REQUIRE( digits.contains('0') );
+     REQUIRE( digits.contains('9') );
+     REQUIRE( !digits.contains('a') );
+     REQUIRE( quotes.contains('`') );
+     REQUIRE( !quotes.complement().contains('"') );
+     REQUIRE( digits.shuffle_ok );
+}
+
+
+// =====================================================================================================================
+// Kernels
+// =====================================================================================================================
+SCENARIO("Every instruction set should give the same results as a simple loop.")
+{
+     GIVEN("Random text of various lengths, and some byte classes")
+     {
+          std::vector<simd::byte_class> classes {
+               simd::byte_class::of("\n"),
+               simd::byte_class::from([] (char c) { return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z'); }),
+               simd::byte_class::from([] (char c) { return static_cast<unsigned char>(c) >= 0x80; }),
+               simd::byte_class::from([] (char c) { return (static_cast<unsigned char>(c) * 37) % 11 == 0; })
+          };
+
+
+          THEN("each kernel should agree with its scalar definition.")
+          {
+               for (auto level : supported_isas())
+               {
+                    const auto& k = simd::kernels_for(level);
+
+                    for (std::size_t size : {0, 1, 15, 16, 17, 63, 64, 65, 200, 1000})
+                    {
+                         std::string text  = random_text(size, static_cast<unsigned>(size));
+                         const char* first = text.data();
+                         const char* last  = first + text.size();
+
+                         for (char c : {'\n', 'e', '~', '\xff'})
+                         {
+                              REQUIRE( k.find_byte(first, last, c) == std::find(first, last, c) );
+                              REQUIRE( k.count_byte(first, last, c) ==
+                                       static_cast<std::size_t>(std::count(first, last, c)) );
+                         }
+
+                         for (const auto& bc : classes)
+                         {
+                              auto in  = [&bc] (char c) { return bc.contains(c); };
+                              auto out = [&bc] (char c) { return !bc.contains(c); };
+
+                              REQUIRE( k.find_in_class(first, last, bc) == std::find_if(first, last, in) );
+                              REQUIRE( k.find_not_in_class(first, last, bc) == std::find_if(first, last, out) );
+                         }
+
+                         auto high_bit = [] (char c) { return static_cast<unsigned char>(c) >= 0x80; };
+                         REQUIRE( k.find_non_ascii(first, last) == std::find_if(first, last, high_bit) );
+
+                         // UTF-16 in both byte orders, mostly ASCII units
+                         std::string units;
+                         for (char c : text)     units += {c, static_cast<char>(c == 'q' ? 0x20 : 0)};
+                         units.resize(units.size() - (size % 3 == 0 && size != 0));     // sometimes an odd byte
+
+                         for (bool big_endian : {false, true})
+                         {
+                              for (std::size_t i = 0; big_endian && i + 1 < units.size(); i += 2)
+                                   std::swap(units[i], units[i + 1]);
+
+                              const char* u    = units.data();
+                              const char* end  = u + units.size();
+                              const char* want = u;
+
+                              while (end - want >= 2 && want[!big_endian] == 0 && !high_bit(want[big_endian]))
+                                   want += 2;
+
+                              REQUIRE( k.find_non_ascii16(u, end, big_endian) == want );
+                         }
+                    }
+
+                    std::string block = random_text(64, 99);
+                    std::vector<std::uint64_t> masks(classes.size());
+
+                    k.block_masks(block.data(), classes.data(), classes.size(), masks.data());
+
+                    for (std::size_t c = 0; c < classes.size(); ++c)
+                         for (std::size_t i = 0; i < 64; ++i)
+                              REQUIRE( ((masks[c] >> i) & 1) == classes[c].contains(block[i]) );
+               }
+          }
+     }
+}
+
+
+SCENARIO("Every instruction set should have its own kernels, whatever the optimization level.")
+{
+#if defined(__x86_64__) || defined(__i386__)
+     for (auto level : {simd::isa::scalar, simd::isa::sse, simd::isa::avx2, simd::isa::avx512})
+          REQUIRE( simd::kernels_for(level).level == level );
+#else
+     REQUIRE( simd::kernels_for(simd::isa::avx2).level == simd::isa::scalar );
+#endif
+}
@@ -0,0 +1,77 @@
+#include <cstdio>         // std::remove
+#include <string>
+#include <string_view>
+
+#include "catch2/catch.hpp"
+#include "pattern/source-manager.h"
+
+
+// =====================================================================================================================
+// source_manager
+// =====================================================================================================================
+SCENARIO("A source manager should assign each buffer a distinct range of offsets.")
+{
+     GIVEN("A source manager with a file and two buffers in memory")
+     {
+          std::string path = "source-manager.test.tmp";
+          string_to_file(path, "var a = 1;\nprint a;\n");
+
+          source_manager sources;
+          const source_file& f1 = sources.load(path);
+          const source_file& f2 = sources.add("second", "x\ny");
+          const source_file& f3 = sources.add("empty", "");
+
+          std::remove(path.c_str());
+
+
+          THEN("the ranges should follow each other without overlapping.")
+          {
+               REQUIRE( f1.base() == 0 );
+               REQUIRE( f1.last() == 20 );
+               REQUIRE( f2.base() == 21 );
+               REQUIRE( f3.base() == 25 );
+               REQUIRE( sources.size() == 3 );
+          }
+
+
+          THEN("the mapped file should hold the contents of the file.")
+          {
+               REQUIRE( f1.contents() == "var a = 1;\nprint a;\n" );
+          }
+
+
+          THEN("an offset should resolve to its buffer, line, and column.")
+          {
+               auto loc1 = sources.locate(17);
+               REQUIRE( loc1.path() == path );
+               REQUIRE( loc1.line() == 2 );
+               REQUIRE( loc1.column() == 7 );
+
+               auto loc2 = sources.locate(f2.base() + 2);
+               REQUIRE( loc2.path() == "second" );
+               REQUIRE( loc2.line() == 2 );
+               REQUIRE( loc2.column() == 1 );
+
+               auto loc3 = sources.locate(f3.base());
+               REQUIRE( loc3.path() == "empty" );
+               REQUIRE( loc3.line() == 1 );
+          }
+
+
+          THEN("a lexeme within a buffer should convert to a global offset and back.")
+          {
+               std::string_view lexeme = f1.contents().substr(17, 1);
+               source_offset offset = sources.offset_of(lexeme);
+
+               REQUIRE( offset == 17 );
+               REQUIRE( sources.text(offset, 1) == "a" );
+               REQUIRE( sources.offset_of(f2.contents().substr(2)) == f2.base() + 2 );
+          }
+
+
+          THEN("an offset outside every buffer should be rejected.")
+          {
+               REQUIRE_THROWS_AS( sources.locate(1000), std::out_of_range );
+          }
+     }
+}
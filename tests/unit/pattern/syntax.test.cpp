@@ -0,0 +1,97 @@
+#include <charconv>      // std::from_chars
+#include <string_view>
+#include <utility>       // std::pair
+#include <variant>
+
+#include "catch2/catch.hpp"
+#include "pattern/syntax.h"
+
+
+using namespace std::literals;
+
+
+namespace {
+
+enum class tag { number, word, symbol };
+
+using value = std::variant<std::monostate, std::string_view, double>;
+
+int decodes = 0;
+
+
+struct decoder
+{
+     value operator() (tag t, std::string_view lexeme) const
+     {
+          ++decodes;
+
+          if (t == tag::word)     return lexeme;
+
+          if (t == tag::number)
+          {
+               double d = 0;
+               std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), d);
+               return d;
+          }
+
+          return std::monostate {};
+     }
+};
+
+} // namespace
+
+
+// =====================================================================================================================
+// token_lazy
+// =====================================================================================================================
+SCENARIO("A lazy token should decode its value from its lexeme only when the value is read.")
+{
+     std::string_view source = "let x = 3.25;";
+     decodes = 0;
+
+     GIVEN("Tokens without a memo")
+     {
+          token_lazy<tag, decoder> number {tag::number, source.substr(8, 4)};
+          token_lazy<tag, decoder> word   {tag::word, source.substr(4, 1)};
+          token_lazy<tag, decoder> semi   {tag::symbol, source.substr(12, 1)};
+
+          THEN("making them should decode nothing, and each read should decode again.")
+          {
+               REQUIRE( decodes == 0 );
+               REQUIRE( sizeof(number) == sizeof(std::pair<tag, std::string_view>) );
+
+               REQUIRE( std::get<double>(number.value()) == 3.25 );
+               REQUIRE( std::get<double>(number.value()) == 3.25 );
+               REQUIRE( std::get<std::string_view>(word.value()) == "x" );
+               REQUIRE( std::holds_alternative<std::monostate>(semi.value()) );
+               REQUIRE( decodes == 4 );
+               REQUIRE_FALSE( number.decoded() );
+          }
+
+          THEN("their positions should come from their lexemes.")
+          {
+               REQUIRE( number.position(source.data()) == 8 );
+               REQUIRE( number.span() == 4 );
+               REQUIRE( number.source_location(source.data()).column == 8 );
+          }
+     }
+
+
+     GIVEN("A token with a memo")
+     {
+          token_lazy<tag, decoder, true> number {tag::number, source.substr(8, 4)};
+
+          THEN("its value should be decoded once.")
+          {
+               REQUIRE_FALSE( number.decoded() );
+               REQUIRE( std::get<double>(number.value()) == 3.25 );
+               REQUIRE( std::get<double>(number.value()) == 3.25 );
+               REQUIRE( number.decoded() );
+               REQUIRE( decodes == 1 );
+
+               auto copy = number;
+               REQUIRE( std::get<double>(copy.value()) == 3.25 );
+               REQUIRE( decodes == 1 );
+          }
+     }
+}
@@ -0,0 +1,263 @@
+#include <array>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "catch2/catch.hpp"
+#include "pattern/scanning-algorithms.h"
+#include "pattern/token-ring.h"
+
+
+using namespace Pattern;
+
+
+namespace {
+
+enum class tag : std::uint8_t { word, number, symbol };
+
+
+// A source of n words, each of i letters, and its tokens
+void make_record (std::size_t n, std::size_t i, std::string& source, token_stream<tag>& tokens)
+{
+     source.clear();
+     tokens.clear();
+
+     for (std::size_t k = 0; k < n; ++k)
+     {
+          tokens.push_back(k % 2 ? tag::word : tag::number, static_cast<std::uint32_t>(source.size()),
+                           static_cast<std::uint32_t>(i));
+          source.append(i, static_cast<char>('a' + k % 26));
+          source += ' ';
+     }
+}
+
+
+// Whether every token of an entry spans the letters of its word
+bool check_entry (const ring_entry<tag>& entry, std::size_t n, std::size_t i)
+{
+     token_view<tag> v = entry.tokens;
+
+     if (v.size() != n)     return false;
+
+     for (std::size_t k = 0; v.has_more(); ++k, ++v)
+     {
+          std::string_view lexeme = entry.source.substr(v.offset(), v.length());
+
+          if (v.peek() != (k % 2 ? tag::word : tag::number) || lexeme != std::string(i, 'a' + k % 26))
+               return false;
+     }
+
+     return true;
+}
+
+} // namespace
+
+
+// =====================================================================================================================
+// token_ring, token_ring_reader
+// =====================================================================================================================
+SCENARIO("A token ring should hand token streams to a reader, which views them in place.")
+{
+     GIVEN("A ring of one page, and a reader with its own mapping")
+     {
+          token_ring<tag> ring {1};
+          token_ring_reader<tag> reader {ring.descriptor()};
+
+          std::string source;
+          token_stream<tag> tokens;
+
+
+          THEN("an empty ring should have nothing to read.")
+          {
+               REQUIRE( !reader.try_read() );
+          }
+
+
+          THEN("a record should be read as written, and scanned by the same algorithms as in process.")
+          {
+               make_record(5, 3, source, tokens);
+               REQUIRE( ring.try_write(tokens, source) );
+
+               auto entry = reader.try_read();
+               REQUIRE( entry );
+               REQUIRE( check_entry(*entry, 5, 3) );
+
+               auto v = entry->tokens;
+               REQUIRE( scan(v, std::array {tag::number, tag::word}) );
+               REQUIRE( v.index() == 2 );
+
+               REQUIRE( !reader.try_read() );
+               REQUIRE( !ring.drained() );
+
+               reader.release();
+               REQUIRE( ring.drained() );
+          }
+
+
+          THEN("a full ring should refuse records until the reader releases them.")
+          {
+               make_record(100, 7, source, tokens);
+
+               int written = 0;
+               while (ring.try_write(tokens, source))     ++written;
+
+               REQUIRE( written > 0 );
+
+               REQUIRE( reader.try_read() );
+               reader.release();
+               REQUIRE( ring.try_write(tokens, source) );
+          }
+
+
+          THEN("a drained ring should take a record too large for either side of its head.")
+          {
+               make_record(117, 7, source, tokens);     // about half of one page
+               REQUIRE( ring.try_write(tokens, source) );
+               REQUIRE( reader.try_read() );
+               reader.release();
+               REQUIRE( ring.drained() );
+
+               make_record(146, 7, source, tokens);     // larger than the space before and after the head
+               REQUIRE( detail::record_size(146, source.size()) > ring.capacity() / 2 );
+
+               REQUIRE( !ring.try_write(tokens, source) );
+               REQUIRE( !reader.try_read() );
+               REQUIRE( ring.try_write(tokens, source) );
+
+               auto entry = reader.try_read();
+               REQUIRE( entry );
+               REQUIRE( check_entry(*entry, 146, 7) );
+
+               reader.release();
+               REQUIRE( ring.drained() );
+          }
+
+
+          THEN("a record larger than the ring should be rejected.")
+          {
+               make_record(1000, 10, source, tokens);
+               REQUIRE_THROWS_AS( ring.try_write(tokens, source), std::length_error );
+          }
+     }
+
+
+     GIVEN("A writer and a reader on their own threads")
+     {
+          token_ring<tag> ring {1 << 14};
+          token_ring_reader<tag> reader {ring.descriptor()};
+
+          constexpr std::size_t records = 5000;
+
+
+          THEN("records of every size should arrive in order, across many laps of the ring.")
+          {
+               std::thread writer {[&ring] {
+                    std::string source;
+                    token_stream<tag> tokens;
+
+                    for (std::size_t r = 0; r < records; ++r)
+                    {
+                         make_record(r % 97, r % 13 + 1, source, tokens);
+                         while (!ring.try_write(tokens, source))     std::this_thread::yield();
+                    }
+               }};
+
+               std::size_t mismatches = 0;
+
+               for (std::size_t r = 0; r < records; )
+               {
+                    auto entry = reader.try_read();
+                    if (!entry)     { std::this_thread::yield(); continue; }
+
+                    if (!check_entry(*entry, r % 97, r % 13 + 1))     ++mismatches;
+                    if (++r % 3 == 0)     reader.release();
+               }
+
+               writer.join();
+               reader.release();
+
+               REQUIRE( mismatches == 0 );
+               REQUIRE( ring.drained() );
+          }
+     }
+
+
+     GIVEN("A descriptor which is not of a token ring")
+     {
+          THEN("it should be rejected.")
+          {
+               int fd = ::memfd_create("not_a_ring", MFD_CLOEXEC);
+               REQUIRE( ::ftruncate(fd, 1 << 16) == 0 );
+
+               REQUIRE_THROWS_AS( token_ring_reader<tag> {fd}, std::invalid_argument );
+               ::close(fd);
+          }
+     }
+}
+
+
+SCENARIO("A token ring should be shared with another process by passing its descriptor.")
+{
+     GIVEN("A child process which writes into a ring and sends its descriptor")
+     {
+          int sockets[2];
+          REQUIRE( ::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0 );
+
+          pid_t child = ::fork();
+          REQUIRE( child >= 0 );
+
+          if (child == 0)
+          {
+               ::close(sockets[0]);
+
+               token_ring<tag> ring {1 << 12};
+               send_descriptor(sockets[1], ring.descriptor());
+
+               std::string source;
+               token_stream<tag> tokens;
+
+               for (std::size_t r = 0; r < 100; ++r)
+               {
+                    make_record(r, 4, source, tokens);
+                    while (!ring.try_write(tokens, source))     std::this_thread::yield();
+               }
+
+               while (!ring.drained())     std::this_thread::yield();
+               ::_exit(0);
+          }
+
+          ::close(sockets[1]);
+
+
+          THEN("the parent should read every record in place.")
+          {
+               int fd = receive_descriptor(sockets[0]);
+               token_ring_reader<tag> reader {fd};
+               ::close(fd);
+
+               std::size_t mismatches = 0;
+
+               for (std::size_t r = 0; r < 100; )
+               {
+                    auto entry = reader.try_read();
+                    if (!entry)     { std::this_thread::yield(); continue; }
+
+                    if (!check_entry(*entry, r, 4))     ++mismatches;
+                    reader.release();
+                    ++r;
+               }
+
+               int status;
+               ::waitpid(child, &status, 0);
+               ::close(sockets[0]);
+
+               REQUIRE( mismatches == 0 );
+               REQUIRE( WIFEXITED(status) );
+               REQUIRE( WEXITSTATUS(status) == 0 );
+          }
+     }
+}
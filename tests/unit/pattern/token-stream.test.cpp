@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <random>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "pattern/fn-combinators.h"
+#include "pattern/scanning-algorithms.h"
+#include "pattern/token-stream.h"
+
+
+using namespace Pattern;
+
+
+namespace {
+
+enum class tag : std::uint8_t { identifier, number, left_paren, right_paren, comma, semicolon, equal, dot };
+
+
+// Splits identifiers, numbers, and punctuation, skipping spaces
+token_stream<tag> lex (std::string_view source)
+{
+     token_stream<tag> tokens;
+
+     for (std::size_t i = 0; i < source.size(); )
+     {
+          std::size_t start = i;
+          char c = source[i];
+
+          if (c == ' ')     { ++i; continue; }
+
+          tag t;
+
+          if (std::isalpha(c))
+          {
+               while (i < source.size() && std::isalnum(source[i]))     ++i;
+               t = tag::identifier;
+          }
+          else if (std::isdigit(c))
+          {
+               while (i < source.size() && std::isdigit(source[i]))     ++i;
+               t = tag::number;
+          }
+          else
+          {
+               ++i;
+               t = c == '(' ? tag::left_paren  :
+                   c == ')' ? tag::right_paren :
+                   c == ',' ? tag::comma       :
+                   c == ';' ? tag::semicolon   :
+                   c == '=' ? tag::equal       : tag::dot;
+          }
+
+          tokens.push_back(t, static_cast<std::uint32_t>(start), static_cast<std::uint32_t>(i - start));
+     }
+
+     return tokens;
+}
+
+} // namespace
+
+
+// =====================================================================================================================
+// token_stream, token_view
+// =====================================================================================================================
+SCENARIO("A token view should be scanned by the scanning algorithms and combinators.")
+{
+     GIVEN("The tokens of some source text")
+     {
+          std::string_view source = "f(x, 42); y = g()";
+          auto tokens = lex(source);
+          auto v = tokens.view();
+
+          REQUIRE( tokens.size() == 12 );
+
+
+          THEN("scan should match a tag, or a sequence of tags, advancing past the match.")
+          {
+               REQUIRE( scan(v, tag::identifier) );
+               REQUIRE( v.index() == 1 );
+
+               REQUIRE_FALSE( scan(v, std::array {tag::left_paren, tag::number}) );
+               REQUIRE( v.index() == 1 );
+
+               REQUIRE( scan(v, std::array {tag::left_paren, tag::identifier}) );
+               REQUIRE( v.index() == 3 );
+               REQUIRE( tokens.lexeme(v.index(), source) == "," );
+          }
+
+
+          THEN("the token scanners should compose with the combinators of fo.")
+          {
+               auto argument  = tk::is(tag::identifier, tag::number);
+               auto arguments = fo::optional(fo::all(argument, fo::many(fo::all(tk::is(tag::comma), argument))));
+               auto call      = fo::all(tk::sequence(tag::identifier, tag::left_paren),
+                                        arguments,
+                                        tk::is(tag::right_paren));
+
+               v.save();
+               REQUIRE( call(v) );
+               REQUIRE( v.skipped(source) == "f(x, 42)" );
+
+               REQUIRE( tk::is(tag::semicolon)(v) );
+               REQUIRE_FALSE( call(v) );
+               REQUIRE( tk::except(tag::semicolon)(v) );
+               REQUIRE( tk::is(tag::equal)(v) );
+
+               v.save();
+               REQUIRE( call(v) );
+               REQUIRE( v.skipped(source) == "g()" );
+               REQUIRE( v.empty() );
+          }
+
+
+          THEN("a tag sequence should be found at its first occurrence.")
+          {
+               const tag* first = tokens.tags();
+               const tag* last  = first + tokens.size();
+
+               REQUIRE( find_tags(first, last, {tag::identifier, tag::left_paren}) == first );
+               REQUIRE( find_tags(first + 1, last, {tag::identifier, tag::left_paren}) == first + 9 );
+               REQUIRE( find_tags(first, last, {tag::identifier, tag::dot}) == last );
+               REQUIRE( count_tag(first, last, tag::identifier) == 4 );
+          }
+     }
+
+
+     GIVEN("A long random stream of tokens")
+     {
+          std::mt19937 gen {3};
+          token_stream<tag> tokens;
+
+          for (std::uint32_t i = 0; i < 5000; ++i)
+               tokens.push_back(static_cast<tag>(gen() % 8), i, 1);
+
+          const tag* first = tokens.tags();
+          const tag* last  = first + tokens.size();
+
+
+          THEN("searches should agree with a token-by-token search.")
+          {
+               for (auto t : {tag::identifier, tag::dot})
+               {
+                    REQUIRE( find_tag(first + 17, last, t) == std::find(first + 17, last, t) );
+                    REQUIRE( count_tag(first, last, t) == std::size_t(std::count(first, last, t)) );
+               }
+
+               std::array sequence {tag::identifier, tag::left_paren, tag::right_paren};
+
+               REQUIRE( find_tags(first, last, {tag::identifier, tag::left_paren, tag::right_paren})
+                        == std::search(first, last, sequence.begin(), sequence.end()) );
+          }
+     }
+}
+
+
+// =====================================================================================================================
+// tag_dispatch
+// =====================================================================================================================
+SCENARIO("A tag dispatch should try only the patterns which may begin with the current tag.")
+{
+     GIVEN("Cases for calls, assignments, and numbers")
+     {
+          std::string_view source = "a = 1; f(b); 2; c.d = e(); g";
+          auto tokens = lex(source);
+
+          auto call       = fo::all(tk::sequence(tag::identifier, tag::left_paren),
+                                    fo::many(tk::except(tag::right_paren)),
+                                    tk::is(tag::right_paren));
+          auto assignment = fo::all(tk::is(tag::identifier),
+                                    fo::many(tk::sequence(tag::dot, tag::identifier)),
+                                    tk::is(tag::equal));
+
+          int attempts = 0;
+          auto number = [&attempts] (token_view<tag>& v) { ++attempts; return tk::is(tag::number)(v); };
+
+          tag_dispatch dispatch {on(tag::identifier, call), on(tag::identifier, assignment), on(tag::number, number)};
+
+
+          THEN("matching should choose the first case that matches, in order.")
+          {
+               auto v = tokens.view();
+
+               REQUIRE( dispatch.match(v) == 1 );
+               REQUIRE( v.index() == 2 );
+               REQUIRE( dispatch.match(v) == 2 );
+               REQUIRE( dispatch.match(v) == tag_dispatch<tag>::no_match );
+               REQUIRE( v.index() == 3 );
+          }
+
+
+          THEN("finding every match should report each case with its range of tokens.")
+          {
+               std::vector<std::tuple<int, std::string_view>> found;
+
+               dispatch.find_all(tokens.view(), [&] (int c, std::size_t first, std::size_t last) {
+                    std::size_t begin = tokens.offset(first);
+                    std::size_t end   = tokens.offset(last - 1) + tokens.length(last - 1);
+                    found.push_back({c, source.substr(begin, end - begin)});
+               });
+
+               REQUIRE( found == std::vector<std::tuple<int, std::string_view>> {
+                    {1, "a ="}, {2, "1"}, {0, "f(b)"}, {2, "2"}, {1, "c.d ="}, {0, "e()"}
+               });
+
+               // The number case is never tried at an identifier
+               REQUIRE( attempts == 2 );
+          }
+     }
+
+
+     GIVEN("A case which may match no tokens")
+     {
+          auto tokens = lex("x y 1");
+
+          tag_dispatch dispatch {on(tag::identifier, fo::many(tk::is(tag::number)))};
+
+
+          THEN("finding every match should report each empty match once, and move on.")
+          {
+               std::vector<std::tuple<int, std::size_t, std::size_t>> found;
+
+               dispatch.find_all(tokens.view(), [&] (int c, std::size_t first, std::size_t last) {
+                    found.push_back({c, first, last});
+               });
+
+               REQUIRE( found == std::vector<std::tuple<int, std::size_t, std::size_t>> {{0, 0, 0}, {0, 1, 1}} );
+          }
+     }
+}
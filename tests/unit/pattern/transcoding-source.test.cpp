@@ -0,0 +1,246 @@
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "pattern/push-scanner.h"
+#include "pattern/transcoding-source.h"
+
+
+using namespace Pattern;
+using namespace std::literals;
+
+
+namespace {
+
+// A text in one encoding, with the expected UTF-8 and the original offset of each character
+struct encoded_text
+{
+     std::string                original;
+     std::string                utf8;
+     std::vector<std::uint64_t> utf8_starts;
+     std::vector<std::uint64_t> original_starts;
+};
+
+
+encoded_text encode (std::u32string_view text, source_encoding encoding, bool bom)
+{
+     encoded_text t;
+
+     auto unit = [&] (char32_t u) {
+          char low = static_cast<char>(u & 0xff), high = static_cast<char>(u >> 8);
+
+          if (encoding == source_encoding::utf16le)     t.original += {low, high};
+          else                                          t.original += {high, low};
+     };
+
+     if (bom && encoding == source_encoding::utf16le)     t.original = "\xFF\xFE";
+     if (bom && encoding == source_encoding::utf16be)     t.original = "\xFE\xFF";
+
+     for (char32_t c : text)
+     {
+          t.utf8_starts.push_back(t.utf8.size());
+          t.original_starts.push_back(t.original.size());
+
+          char buffer[4];
+          t.utf8.append(buffer, detail::encode_utf8(c, buffer));
+
+          if (encoding == source_encoding::latin1)     t.original += static_cast<char>(c);
+          else if (c < 0x10000)                        unit(c);
+          else
+          {
+               unit(0xD800 + ((c - 0x10000) >> 10));
+               unit(0xDC00 + ((c - 0x10000) & 0x3FF));
+          }
+     }
+
+     return t;
+}
+
+
+std::string read_all (transcoding_source& source, std::size_t block_size)
+{
+     std::string all;
+
+     for (auto block = source.next_block(); !block.empty(); block = source.next_block())
+     {
+          REQUIRE( block.size() <= block_size );
+          all += block;
+     }
+
+     return all;
+}
+
+
+// Line, and column in characters, of each character of a UTF-8 text
+std::vector<std::pair<int, int>> reference_locations (std::string_view utf8)
+{
+     std::vector<std::pair<int, int>> locations;
+     int line = 1, column = 1;
+
+     for (unsigned char c : utf8)
+     {
+          if ((c & 0xC0) == 0x80)     continue;
+
+          locations.push_back({line, column});
+
+          if (c == '\n')     { ++line; column = 1; }
+          else               ++column;
+     }
+
+     return locations;
+}
+
+} // namespace
+
+
+// =====================================================================================================================
+// detect_encoding
+// =====================================================================================================================
+SCENARIO("The encoding of a source should be taken from its byte order mark, or else from a hint.")
+{
+     REQUIRE( detect_encoding("\xFF\xFEx\0"sv).encoding == source_encoding::utf16le );
+     REQUIRE( detect_encoding("\xFE\xFF\0x"sv).encoding == source_encoding::utf16be );
+     REQUIRE( detect_encoding("\xEF\xBB\xBFx").bom_size == 3 );
+     REQUIRE( detect_encoding("x", source_encoding::latin1).encoding == source_encoding::latin1 );
+     REQUIRE( detect_encoding("x", source_encoding::latin1).bom_size == 0 );
+}
+
+
+// =====================================================================================================================
+// transcoding_source
+// =====================================================================================================================
+SCENARIO("A transcoding source should produce UTF-8 in blocks, and map its positions back to the original.")
+{
+     GIVEN("Latin-1 text")
+     {
+          transcoding_source source {"caf\xE9 \xFC" "ber\n\xA9 2020", source_encoding::latin1};
+
+          THEN("each byte above 0x7F should become two bytes of UTF-8.")
+          {
+               REQUIRE( read_all(source, transcoding_source::default_block_size) == "café über\n© 2020" );
+               REQUIRE( source.blocks() == 1 );
+
+               REQUIRE( source.original_offset(11) == 9 );          // the newline
+               REQUIRE( source.original_offset(12) == 10 );         // ©
+               REQUIRE( source.original_offset(13) == 10 );         // its second byte
+               REQUIRE( source.location(8).line == 1 );
+               REQUIRE( source.location(8).column == 7 );           // b
+               REQUIRE( source.location(15).line == 2 );
+               REQUIRE( source.location(15).column == 3 );          // 2
+          }
+     }
+
+
+     GIVEN("Text of mixed scripts, with characters beyond the basic plane, in each encoding")
+     {
+          std::u32string text;
+          for (int i = 0; i < 300; ++i)
+               text += i % 7 == 0 ? U"var π = 3.14; // ≈ 😀\n"
+                     : i % 3 == 0 ? U"naïve façade\r\n"
+                     :              U"plain ascii text\n";
+
+          std::u32string latin;
+          for (int i = 0; i < 300; ++i)     latin += U"déjà vu, ¿qué?\n";
+
+          for (auto [encoding, bom, block_size] : {std::tuple {source_encoding::utf16le, true,  std::size_t {64}},
+                                                   std::tuple {source_encoding::utf16be, true,  std::size_t {1000}},
+                                                   std::tuple {source_encoding::utf16le, false, std::size_t {16}},
+                                                   std::tuple {source_encoding::latin1,  false, std::size_t {100}}})
+          {
+               auto t = encode(encoding == source_encoding::latin1 ? latin : text, encoding, bom);
+               transcoding_source source {t.original, bom ? source_encoding::utf8 : encoding, block_size};
+
+               REQUIRE( source.encoding() == encoding );
+
+               THEN("the blocks should make up the text in UTF-8, with a checkpoint each.")
+               {
+                    REQUIRE( read_all(source, block_size) == t.utf8 );
+                    REQUIRE( source.done() );
+                    REQUIRE( source.produced() == t.utf8.size() );
+                    REQUIRE( source.blocks() <= t.utf8.size() / (block_size - 3) + 1 );
+               }
+
+               THEN("every character should map to its position, line, and column in the original.")
+               {
+                    read_all(source, block_size);
+                    auto expected = reference_locations(t.utf8);
+
+                    for (std::size_t i = 0; i < t.utf8_starts.size(); ++i)
+                    {
+                         auto location = source.location(t.utf8_starts[i]);
+
+                         REQUIRE( source.original_offset(t.utf8_starts[i]) == t.original_starts[i] );
+                         REQUIRE( location.line == expected[i].first );
+                         REQUIRE( location.column == expected[i].second );
+                    }
+
+                    REQUIRE( source.original_offset(t.utf8.size()) == t.original.size() );
+               }
+          }
+     }
+
+
+     GIVEN("UTF-16 with unpaired surrogates and a trailing odd byte")
+     {
+          std::string original = "a\0\x00\xD8" "b\0\x00\xDC" "c"s;
+          transcoding_source source {original, source_encoding::utf16le};
+
+          THEN("each should be replaced by U+FFFD.")
+          {
+               REQUIRE( read_all(source, transcoding_source::default_block_size) == "a�b��" );
+          }
+     }
+
+
+     GIVEN("UTF-8 with a byte order mark")
+     {
+          std::string original = "\xEF\xBB\xBFlet x = \"ü\";\nprint x;";
+          transcoding_source source {original, source_encoding::latin1, 16};
+
+          THEN("the text after the mark should pass through unchanged.")
+          {
+               REQUIRE( source.encoding() == source_encoding::utf8 );
+
+               auto first = source.next_block();
+               REQUIRE( first.data() == original.data() + 3 );
+               REQUIRE( first.size() == 16 );
+               REQUIRE( read_all(source, 16) == "int x;" );
+
+               REQUIRE( source.original_offset(17) == 20 );
+               REQUIRE( source.location(17).line == 2 );
+               REQUIRE( source.location(11).column == 11 );       // the closing quote, after a character of two bytes
+          }
+     }
+
+
+     GIVEN("A push scanner fed from a UTF-16 source")
+     {
+          auto t = encode(U"// ünïcode\nvar size = 42; // größe\n  return \"ök\";",
+                          source_encoding::utf16be, true);
+          transcoding_source source {t.original, source_encoding::utf8, 16};
+          push_scanner scanner;
+
+          std::vector<push_token> tokens;
+          auto sink = [&tokens] (const push_token& token) { tokens.push_back(token); };
+
+          for (auto block = source.next_block(); !block.empty(); block = source.next_block())
+               scanner.feed(block, sink);
+
+          scanner.finish(sink);
+
+          THEN("token positions should resolve to lines and columns in the original.")
+          {
+               REQUIRE( tokens.size() == 8 );
+
+               REQUIRE( tokens[3].kind == push_token_kind::number );
+               REQUIRE( source.location(tokens[3].position).line == 2 );
+               REQUIRE( source.location(tokens[3].position).column == 12 );
+
+               REQUIRE( tokens[5].kind == push_token_kind::identifier );
+               REQUIRE( source.location(tokens[5].position).line == 3 );
+               REQUIRE( source.location(tokens[5].position).column == 3 );
+               REQUIRE( source.original_offset(tokens[5].position) == 2 + 2 * 37 );
+          }
+     }
+}